@@ -0,0 +1,303 @@
+/**
+ @file      voxel3d_acquisition.h
+ @brief     Concurrent acquisition from several 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_ACQUISITION_H__
+#define __VOXEL3D_ACQUISITION_H__
+
+#include "voxel3d.h"
+#include "voxel3d_backend.h"
+#include "voxel3d_capture.h"
+#include "voxel3d_device.h"
+#include "voxel3d_orientation.h"
+#include "voxel3d_proximity.h"
+
+/*
+ * Every device is queried from its own thread, optionally pinned to a CPU, so the frame
+ * transfers of different devices overlap instead of queuing behind one polling loop.
+ * Each thread fills framesets from a pool of its own and pushes them on one lock-free
+ * queue shared by all devices; the application pops them from a single thread and hands
+ * them back with voxel3d_acquisition_release(). When the application holds every
+ * frameset of a device, new frames of that device are dropped and counted.
+ *
+ * With stall_ms set, each thread also watches the age of the newest frame of its device
+ * (a repeated frame count is not a new frame). Once no new frame came for stall_ms, the
+ * thread releases the device's sensors and initializes them again with
+ * voxel3d_device_reinit(), every retry_ms until they are back, which also restores the
+ * settings made through voxel3d_acquisition_get_device(). The other devices keep
+ * streaming meanwhile. Each step is reported through event_cb.
+ *
+ * IMU samples are read by a second thread per device into a ring of
+ * ACQUISITION_IMU_RING_SIZE, every ms whether or not a ToF frame came, as a live device
+ * only hands out its newest sample: the ring keeps the full IMU rate while the ToF query
+ * blocks, stalls or recovers. An application that needs every sample
+ * drains it with voxel3d_acquisition_read_imu_batch() at its own pace instead of polling
+ * the device; framesets get the samples of the ring since the previous frameset.
+ *
+ * When both ToF and IMU are acquired, the IMU clock and the ToF frame count of each device
+ * are estimated against the host clock from the arrival of the samples and frames (see
+ * voxel3d_clock_create()). The ToF exposure of a frameset is placed frame_latency_us +
+ * exposure_us before the arrival of its frame and converted to the IMU clock, which gives
+ * the IMU samples covering it (voxel3d_acquisition_imu_slice()) and the accel / gyro
+ * interpolated at mid-exposure.
+ *
+ * With an orientation filter selected, every IMU sample also updates the orientation of
+ * its device in the acquisition thread (see voxel3d_orientation_create()), and each
+ * frameset carries the orientation and gravity direction at mid-exposure, or at its
+ * newest sample when the exposure isn't on the IMU clock.
+ *
+ * With max_gyro_rate set, a frame whose exposure saw the gyro above it is smeared by the
+ * rotation and tagged ACQUISITION_FRAME_MOTION_BLUR, or dropped in the acquisition thread
+ * with ACQUISITION_FLAG_DROP_BLURRED before anything downstream spends time on it.
+ *
+ * With proximity zones set for a device, the acquisition thread also finds the closest
+ * point of each zone in every depth frame it delivers (see voxel3d_proximity_create()),
+ * so a safety layer reads the obstacle distances off the frameset without waiting for any
+ * other processing.
+ */
+#define ACQUISITION_DEFAULT_FRAMESETS   (4)
+#define ACQUISITION_MAX_IMU_SAMPLES     (64)
+#define ACQUISITION_CPU_ANY             (-1)
+#define ACQUISITION_DEFAULT_RETRY_MS    (500)
+#define ACQUISITION_IMU_RING_SIZE       (4096)  /* samples, 20 s at 200 Hz */
+#define ACQUISITION_DEFAULT_EXPOSURE_US (4000)
+
+/* AcquisitionFrameset.flags */
+#define ACQUISITION_FRAME_IMU_SYNCED    (0x1)   /**< exposure_imu_ts is valid */
+#define ACQUISITION_FRAME_IMU_INTERPOLATED  (0x2)   /**< imu_mid_exposure is valid */
+#define ACQUISITION_FRAME_ORIENTATION   (0x4)   /**< orientation is valid */
+#define ACQUISITION_FRAME_MOTION_BLUR   (0x8)   /**< peak_gyro above max_gyro_rate */
+#define ACQUISITION_FRAME_PROXIMITY     (0x10)  /**< proximity is valid */
+
+/* AcquisitionEvent.type */
+#define ACQUISITION_EVENT_STALL         (1)     /**< no new frame for stall_ms */
+#define ACQUISITION_EVENT_REINIT        (2)     /**< one re-init attempt finished */
+#define ACQUISITION_EVENT_RECOVERED     (3)     /**< first new frame after the stall */
+
+/**
+ * @brief  Flag of AcquisitionConfig.flags to pin the thread of device ix to cpu[ix]
+ */
+#define ACQUISITION_FLAG_PIN_THREADS    (0x1)
+
+/**
+ * @brief  Flag of AcquisitionConfig.flags to drop the frames over max_gyro_rate instead of
+ *         tagging them
+ */
+#define ACQUISITION_FLAG_DROP_BLURRED   (0x2)
+
+/**
+ * @brief  Bit of a CaptureStream in AcquisitionConfig.streams / AcquisitionFrameset.streams
+ */
+#define ACQUISITION_STREAM(stream)      (1u << (stream))
+
+/**
+ * @brief  Recovery step of one device, see AcquisitionConfig.event_cb
+ */
+struct AcquisitionEvent {
+    int type;                           /**< ACQUISITION_EVENT_* */
+    unsigned int device;                /**< index of the device in the acquisition */
+    const char *dev_sn;
+    unsigned long long host_ts_us;      /**< voxel3d_host_time_us() of the step */
+    unsigned int attempts;              /**< re-init attempts of this recovery so far */
+    int result;                         /**< voxel3d_device_reinit() result of REINIT */
+    unsigned long long downtime_us;     /**< since the last frame before the stall */
+};
+
+/**
+ * @brief  Recovery callback of an acquisition
+ * @note   Called from the acquisition thread of the device, one call at a time. Don't stop
+ *         the acquisition from it.
+ * @param  user: AcquisitionConfig.user
+ * @param  event: recovery step
+ */
+typedef void (*acquisition_event_cb)(void *user, const AcquisitionEvent *event);
+
+/**
+ * @brief  Structure used in voxel3d_acquisition_start() to select devices and streams
+ */
+struct AcquisitionConfig {
+    const DeviceBackend *backend;       /**< NULL for voxel3d_device_backend() */
+    unsigned int num_devices;           /**< 0 for every device found by the backend's scan */
+    char dev_sn[MAX_SUPPORTED_CAMERA_MODULE][MAX_PRODUCT_SN_LEN];  /**< when num_devices > 0 */
+    int cpu[MAX_SUPPORTED_CAMERA_MODULE];   /**< with ACQUISITION_FLAG_PIN_THREADS, CPU of
+                                                 each device thread or ACQUISITION_CPU_ANY */
+    unsigned int streams;               /**< ACQUISITION_STREAM() bits, 0 for ToF + IMU */
+    unsigned int framesets;             /**< framesets per device, 0 for the default */
+    unsigned int flags;                 /**< ACQUISITION_FLAG_* bits */
+    unsigned int stall_ms;              /**< frame age that starts a recovery, 0 for none */
+    unsigned int retry_ms;              /**< wait between re-init attempts, 0 for the default */
+    acquisition_event_cb event_cb;      /**< NULL for none */
+    void *user;
+    unsigned int exposure_us;           /**< ToF exposure window, 0 for the default */
+    unsigned int frame_latency_us;      /**< from the end of the exposure to the ToF query
+                                             returning: readout and transfer */
+    OrientationConfig orientation;      /**< filter ORIENTATION_NONE for no orientation */
+    float max_gyro_rate;                /**< |imu_gyro| during the exposure that blurs a frame,
+                                             0 for no motion gating */
+    ProximityConfig proximity[MAX_SUPPORTED_CAMERA_MODULE];    /**< zones of each device's ToF
+                                                                    camera, num_zones 0 for
+                                                                    none */
+};
+
+/**
+ * @brief  Frames of one device gathered in one pass of its acquisition thread
+ * @note   A frameset is driven by ToF when it is acquired: it holds one new depth frame,
+ *         the RGB / thermal frames that arrived meanwhile and the IMU samples read since
+ *         the previous frameset, the newest ACQUISITION_MAX_IMU_SAMPLES of them after a
+ *         stall. Buffers of streams not acquired are NULL.
+ */
+struct AcquisitionFrameset {
+    unsigned int device;                /**< index of the device in the acquisition */
+    const char *dev_sn;
+    unsigned long long sequence;        /**< framesets delivered by the device before */
+    unsigned int streams;               /**< ACQUISITION_STREAM() bits of the new frames */
+    unsigned int frame_count[CAPTURE_STREAM_COUNT];     /**< queryframe() results */
+    unsigned long long host_ts_us[CAPTURE_STREAM_COUNT];    /**< voxel3d_host_time_us() after
+                                                                 each query returned */
+    unsigned short *depthmap;           /**< TOF_DEPTH_PIXELS */
+    unsigned short *irmap;              /**< TOF_IR_PIXELS */
+    unsigned char *rgb_map;             /**< RGB_PIXELS * 3, rectified frames are smaller */
+    float *thermal_map;                 /**< TOF_DEPTH_PIXELS, unrectified frames are smaller */
+    unsigned int imu_count;
+    IMU_DATA imu[ACQUISITION_MAX_IMU_SAMPLES];
+    unsigned int flags;                 /**< ACQUISITION_FRAME_* bits */
+    unsigned int exposure_imu_ts[2];    /**< start / end of the ToF exposure on the IMU clock */
+    IMU_DATA imu_mid_exposure;          /**< accel / gyro interpolated at mid-exposure, imu_ts
+                                             is the mid-exposure time */
+    Orientation orientation;            /**< at mid-exposure when imu_mid_exposure is valid,
+                                             else at the newest sample */
+    float peak_gyro;                    /**< largest |imu_gyro| during the exposure, or of imu[]
+                                             when the exposure isn't on the IMU clock */
+    float motion_weight;                /**< 1 at rest down to 0 at max_gyro_rate, to weight
+                                             the frame in temporal filters */
+    ProximityHit proximity[PROXIMITY_MAX_ZONES];    /**< closest point of each zone of the
+                                                         device, in the order of the zones */
+};
+
+/**
+ * @brief  Counters of one device, see voxel3d_acquisition_get_stats()
+ */
+struct AcquisitionStats {
+    unsigned long long framesets;       /**< pushed on the queue */
+    unsigned long long dropped;         /**< acquired while no frameset was free */
+    int cpu;                            /**< CPU the thread is pinned to, or ACQUISITION_CPU_ANY */
+    unsigned long long recoveries;      /**< stalls streaming recovered from */
+    unsigned long long last_downtime_us;    /**< from the last frame before the latest stall
+                                                 to the first frame after it */
+    unsigned long long imu_samples;     /**< put in the IMU ring */
+    unsigned long long imu_overruns;    /**< overwritten in the IMU ring before they were read */
+    unsigned long long blurred;         /**< frames over max_gyro_rate, tagged or dropped */
+};
+
+typedef struct acquisition acquisition_t;
+
+
+/**
+ * @brief       Open the devices, initialize their streams and start one acquisition
+ *              thread per device
+ * @param[in]   config: devices and streams to acquire
+ * @return      acquisition handle, NULL if a device or a stream failed to start
+ */
+extern "C" acquisition_t *voxel3d_acquisition_start(const AcquisitionConfig *config);
+
+
+/**
+ * @brief       Number of devices acquired
+ * @param[in]   acq: handle from voxel3d_acquisition_start()
+ * @return      number of devices, AcquisitionFrameset.device is below it
+ */
+extern "C" unsigned int voxel3d_acquisition_device_count(acquisition_t *acq);
+
+
+/**
+ * @brief       Get the handle of a device, e.g. to change its settings while streaming
+ * @note        Settings made through it are applied again after a recovery. Don't query
+ *              frames through it.
+ * @param[in]   acq: handle from voxel3d_acquisition_start()
+ * @param[in]   device: device index, below voxel3d_acquisition_device_count()
+ * @return      device handle owned by the acquisition, NULL on invalid parameter
+ */
+extern "C" voxel3d_device_t *voxel3d_acquisition_get_device(acquisition_t *acq,
+                                                           unsigned int device);
+
+
+/**
+ * @brief       Take the next frameset of any device
+ * @warning     Not thread-safe, call it from one consumer thread
+ * @param[in]   acq: handle from voxel3d_acquisition_start()
+ * @param[in]   timeout_ms: longest wait for a frameset, 0 to return at once
+ * @return      frameset to hand back with voxel3d_acquisition_release(), NULL on timeout
+ */
+extern "C" AcquisitionFrameset *voxel3d_acquisition_pop(acquisition_t *acq,
+                                                        unsigned int timeout_ms);
+
+
+/**
+ * @brief       Hand a frameset back to its device
+ * @note        Safe to call from any thread, e.g. the worker that processed the frameset
+ * @param[in]   acq: handle from voxel3d_acquisition_start()
+ * @param[in]   frameset: frameset from voxel3d_acquisition_pop()
+ */
+extern "C" void voxel3d_acquisition_release(acquisition_t *acq, AcquisitionFrameset *frameset);
+
+
+/**
+ * @brief       Drain the IMU samples of a device received since the previous call
+ * @note        Safe to call from any thread, one reader per device. A reader falling more
+ *              than ACQUISITION_IMU_RING_SIZE samples behind loses the oldest ones.
+ * @param[in]   acq: handle from voxel3d_acquisition_start() with the IMU stream
+ * @param[in]   dev_sn: S/N of the device
+ * @param[out]  imu_data: user-allocated buffer of max samples, oldest first
+ * @param[in]   max: size of imu_data
+ * @param[out]  count: number of samples copied, max means more may be left
+ * @return      true: count samples copied
+ * @return      < 0: invalid parameter or no such device
+ */
+extern "C" int voxel3d_acquisition_read_imu_batch(acquisition_t *acq, const char *dev_sn,
+                                                  IMU_DATA *imu_data, unsigned int max,
+                                                  unsigned int *count);
+
+
+/**
+ * @brief       Get the IMU samples covering the ToF exposure of a frameset
+ * @note        From the last sample at or before the exposure start through the first one
+ *              at or after its end, so an exposure shorter than the IMU period is covered
+ *              too. Samples newer than the frameset's pass or already overwritten in the
+ *              ring are missing.
+ * @param[in]   acq: handle from voxel3d_acquisition_start()
+ * @param[in]   frameset: frameset with ACQUISITION_FRAME_IMU_SYNCED
+ * @param[out]  imu_data: user-allocated buffer of max samples, oldest first
+ * @param[in]   max: size of imu_data
+ * @param[out]  count: number of samples copied
+ * @return      true: count samples copied
+ * @return      < 0: invalid parameter or the exposure isn't on the IMU clock
+ */
+extern "C" int voxel3d_acquisition_imu_slice(acquisition_t *acq,
+                                             const AcquisitionFrameset *frameset,
+                                             IMU_DATA *imu_data, unsigned int max,
+                                             unsigned int *count);
+
+
+/**
+ * @brief       Read the counters of a device
+ * @param[in]   acq: handle from voxel3d_acquisition_start()
+ * @param[in]   device: device index, below voxel3d_acquisition_device_count()
+ * @param[out]  stats: pointer of user-allocated structure
+ * @return      true: stats filled
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_acquisition_get_stats(acquisition_t *acq, unsigned int device,
+                                             AcquisitionStats *stats);
+
+
+/**
+ * @brief       Stop the acquisition threads and close the devices
+ * @note        Framesets not released yet become invalid
+ * @param[in]   acq: handle from voxel3d_acquisition_start()
+ */
+extern "C" void voxel3d_acquisition_stop(acquisition_t *acq);
+
+#endif /* __VOXEL3D_ACQUISITION_H__ */
@@ -0,0 +1,74 @@
+/**
+ @file      voxel3d_backend.h
+ @brief     Device access table shared by libvoxel3d companion modules
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_BACKEND_H__
+#define __VOXEL3D_BACKEND_H__
+
+#include "voxel3d.h"
+
+/**
+ * @brief  Function table of the voxel3d_* device APIs
+ * @note   Every entry has the same signature and return convention as the libvoxel3d API
+ *         of the same name. voxel3d_device_backend() fills it with the live device APIs,
+ *         voxel3d_replay_backend() with the recorded-file implementation, so application
+ *         code written against the table runs unchanged on either.
+ */
+struct DeviceBackend {
+    const char *name;
+
+    int (*scan)(CamDevInfo *cam_dev_info);
+
+    int (*tof_init)(char *dev_sn);
+    unsigned int (*tof_queryframe)(char *dev_sn, unsigned short *depthmap, unsigned short *irmap);
+    int (*tof_generatePointCloud)(char *dev_sn, unsigned short *depthmap, float *xyz);
+    void (*tof_release)(char *dev_sn);
+
+    int (*lepton3_init)(char *dev_sn);
+    unsigned int (*lepton3_queryframe)(char *dev_sn, float *thermal_map);
+    void (*lepton3_release)(char *dev_sn);
+
+    int (*rgb_init)(char *dev_sn);
+    unsigned int (*rgb_queryframe)(char *dev_sn, unsigned char *rgb_map);
+    void (*rgb_release)(char *dev_sn);
+
+    void (*release)(char *dev_sn);
+
+    int (*read_imu_data)(char *dev_sn, IMU_DATA *imu_data);
+    int (*tof_read_camera_info)(char *dev_sn, CameraInfo *cam_info);
+    int (*lepton3_read_camera_info)(char *dev_sn, CameraInfo *cam_info);
+    int (*rgb_read_camera_info)(char *dev_sn, CameraInfo *cam_info);
+    int (*set_rectifyType)(char *dev_sn, int inputType);
+    int (*read_fw_version)(char *dev_sn, char *fw_ver, unsigned int max_len);
+
+    int (*tof_get_conf_threshold)(char *dev_sn);
+    int (*tof_set_conf_threshold)(char *dev_sn, unsigned int conf_threshold);
+    int (*tof_set_auto_exposure_mode)(char *dev_sn, unsigned int enable);
+    float (*tof_get_depth_hfov)(char *dev_sn);
+    float (*tof_get_depth_vfov)(char *dev_sn);
+    int (*read_fw_build_date)(char *dev_sn, char *fw_build_date, unsigned int max_len);
+    int (*dev_fw_upgrade)(char *dev_sn, char *file_path,
+                          unsigned char (*fw_upgrade_cb)(int state, unsigned int percent_complete));
+    int (*dev_fw_upgrade_state_poll)(char *dev_sn, int &state, unsigned int &percent_complete);
+};
+
+
+/**
+ * @brief       Get the backend table bound to the libvoxel3d device APIs
+ * @return      pointer to a static table, never NULL
+ */
+extern "C" const DeviceBackend *voxel3d_device_backend(void);
+
+
+/**
+ * @brief       Read the host monotonic clock
+ * @details     All host-side timestamps of the companion modules (recording, replay)
+ *              are taken from this clock
+ * @return      microseconds since an arbitrary fixed point
+ */
+extern "C" unsigned long long voxel3d_host_time_us(void);
+
+#endif /* __VOXEL3D_BACKEND_H__ */
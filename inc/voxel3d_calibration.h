@@ -0,0 +1,113 @@
+/**
+ @file      voxel3d_calibration.h
+ @brief     Host-side calibration cache of 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_CALIBRATION_H__
+#define __VOXEL3D_CALIBRATION_H__
+
+#include "voxel3d.h"
+#include "voxel3d_device.h"
+
+/*
+ * A calibration holds the camera info of every sensor, the depth FoV and the ToF ray table
+ * (undistorted normalized (x, y) of each depth pixel, so a point is (x * z, y * z, z)).
+ *
+ * With a cache directory, it is stored in <dir>/<S/N>_<F/W version>.v3dcal after the first
+ * load from the device. Later loads of the same device and F/W only read the F/W version,
+ * then take everything from the file, including the ray table, and fill the handle's
+ * caches with it, so neither the camera info reads nor the table build are repeated.
+ * A F/W upgrade changes the key and with it the file.
+ *
+ * RGB / thermal camera info depends on the rectify type, so the type set on the handle is
+ * part of the key too: a handle rectifying to ToF uses <S/N>_<F/W version>_r<type>.v3dcal.
+ * Load the calibration again after voxel3d_device_set_rectifyType().
+ */
+#define CALIBRATION_FILE_VERSION        (2)
+#define CALIBRATION_FILE_EXT            ".v3dcal"
+
+/* Bits of CalibrationData.valid */
+#define CALIBRATION_TOF                 (0x01)
+#define CALIBRATION_RGB                 (0x02)
+#define CALIBRATION_THERMAL             (0x04)
+#define CALIBRATION_FOV                 (0x08)
+
+/* Flag of voxel3d_calibration_load() to read from the device and rewrite the file */
+#define CALIBRATION_FLAG_REFRESH        (0x1)
+
+/**
+ * @brief  Calibration of one device, see voxel3d_calibration_get_data()
+ */
+struct CalibrationData {
+    char product_sn[MAX_PRODUCT_SN_LEN];
+    char fw_version[MAX_FW_VER_LEN];
+    int rectify_type;                   /**< RectifyType of the RGB / thermal camera info */
+    unsigned int valid;                 /**< CALIBRATION_* bits of the fields read */
+    CameraInfo tof_cam_info;
+    CameraInfo rgb_cam_info;
+    CameraInfo flir_cam_info;
+    float hfov;
+    float vfov;
+};
+
+typedef struct calibration calibration_t;
+
+
+/**
+ * @brief       Load the calibration of a device, from the cache file when it matches
+ * @note        Sensors not initialized can't be read; their bits stay clear in valid
+ * @param[in]   dev: handle from voxel3d_device_open() / voxel3d_open_all()
+ * @param[in]   cache_dir: directory of the cache files, NULL to read from the device
+ *                         without caching
+ * @param[in]   flags: 0 or CALIBRATION_FLAG_REFRESH
+ * @return      calibration handle, NULL if neither the file nor the device had ToF info
+ */
+extern "C" calibration_t *voxel3d_calibration_load(voxel3d_device_t *dev, const char *cache_dir,
+                                                   unsigned int flags);
+
+
+/**
+ * @brief       Check where a calibration came from
+ * @param[in]   cal: handle from voxel3d_calibration_load()
+ * @return      true: cache file, 0: device
+ */
+extern "C" int voxel3d_calibration_from_cache(calibration_t *cal);
+
+
+/**
+ * @brief       Read the calibration data
+ * @param[in]   cal: handle from voxel3d_calibration_load()
+ * @param[out]  data: pointer of user-allocated structure
+ * @return      true: data filled
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_calibration_get_data(calibration_t *cal, CalibrationData *data);
+
+
+/**
+ * @brief       Get the ToF ray table
+ * @param[in]   cal: handle from voxel3d_calibration_load()
+ * @return      TOF_DEPTH_PIXELS (x, y) pairs, valid until voxel3d_calibration_release()
+ */
+extern "C" const float *voxel3d_calibration_rays(calibration_t *cal);
+
+
+/**
+ * @brief       Release a calibration
+ * @param[in]   cal: handle from voxel3d_calibration_load()
+ */
+extern "C" void voxel3d_calibration_release(calibration_t *cal);
+
+
+/**
+ * @brief       Build a ToF ray table by inverting the lens distortion of each depth pixel
+ * @param[in]   cam_info: ToF camera info
+ * @param[out]  rays: user-allocated buffer of TOF_DEPTH_PIXELS * 2 floats
+ * @return      true: table built
+ * @return      < 0: invalid camera info
+ */
+extern "C" int voxel3d_calibration_build_rays(const CameraInfo *cam_info, float *rays);
+
+#endif /* __VOXEL3D_CALIBRATION_H__ */
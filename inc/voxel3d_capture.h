@@ -0,0 +1,326 @@
+/**
+ @file      voxel3d_capture.h
+ @brief     Recording file APIs for 5Voxel 5VHiRab device streams
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_CAPTURE_H__
+#define __VOXEL3D_CAPTURE_H__
+
+#include "voxel3d.h"
+
+#define CAPTURE_FILE_VERSION          (2)
+
+/*
+ * Frames are buffered per stream and appended to the file as one chunk when the chunk
+ * reaches CAPTURE_CHUNK_MAX_BYTES or spans CAPTURE_CHUNK_MAX_US, so a crash loses at
+ * most the last CAPTURE_CHUNK_MAX_US of each stream.
+ */
+#define CAPTURE_CHUNK_MAX_BYTES       (4 * 1024 * 1024)
+#define CAPTURE_CHUNK_MAX_US          (500000)
+
+/*
+ * Readers opened by voxel3d_capture_open_mapped() ask the OS to read this much of the
+ * file ahead of the frame being accessed once a stream is read sequentially
+ */
+#define CAPTURE_PREFETCH_BYTES        (16 * 1024 * 1024)
+
+/**
+ * @brief  Flag of voxel3d_capture_create_ex(): bypass the OS page cache (O_DIRECT /
+ *         FILE_FLAG_NO_BUFFERING), chunks are written as whole aligned blocks
+ */
+#define CAPTURE_FLAG_DIRECT_IO        (0x1)
+
+/**
+ * @brief  Streams stored in a recording file
+ */
+enum CaptureStream
+{
+    CAPTURE_STREAM_TOF = 0,           /**< depth + IR, TOF_DEPTH_IR_FRAME_SIZE per frame */
+    CAPTURE_STREAM_RGB = 1,           /**< 3 bytes per pixel, size depends on rectify type */
+    CAPTURE_STREAM_THERMAL = 2,       /**< float per pixel, size depends on rectify type */
+    CAPTURE_STREAM_IMU = 3,           /**< one IMU_DATA per sample */
+    CAPTURE_STREAM_COUNT = 4,
+};
+
+/**
+ * @brief  Payload encoding of a chunk
+ */
+enum CaptureCodec
+{
+    CAPTURE_CODEC_RAW = 0,
+    CAPTURE_CODEC_RVL = 1,            /**< voxel3d_depth_encode() per 16-bit plane, ToF only */
+};
+
+/**
+ * @brief  Device description stored once in the header of a recording file
+ */
+struct CaptureDeviceInfo {
+    char product_sn[MAX_PRODUCT_SN_LEN];
+    char fw_version[MAX_FW_VER_LEN];
+    int rectify_type;
+    CameraInfo tof_cam_info;
+    CameraInfo rgb_cam_info;
+    CameraInfo flir_cam_info;
+};
+
+/**
+ * @brief  Per-frame description of a recorded frame
+ * @note   host_ts_us is voxel3d_host_time_us() at the time the frame was returned by
+ *         its voxel3d_*_queryframe() / voxel3d_read_imu_data() call
+ */
+struct CaptureFrameInfo {
+    unsigned int stream;
+    unsigned int frame_count;
+    unsigned long long host_ts_us;
+    unsigned int width;
+    unsigned int height;
+    unsigned int size;
+};
+
+/**
+ * @brief  Recorded frame payload as stored in a memory-mapped recording file
+ * @note   data points into the mapping and stays valid until voxel3d_capture_release()
+ */
+struct CaptureMappedFrame {
+    CaptureFrameInfo info;
+    unsigned int codec;               /**< CaptureCodec of data */
+    unsigned int stored_size;         /**< bytes at data, equals info.size for CAPTURE_CODEC_RAW */
+    const void *data;
+};
+
+typedef struct capture_writer capture_writer_t;
+typedef struct capture_reader capture_reader_t;
+
+
+/**
+ * @brief       Create a recording file
+ * @note        ToF frames are stored with CAPTURE_CODEC_RVL, other streams raw, see
+ *              voxel3d_capture_set_codec()
+ * @param[in]   file_path: path of the file to create, an existing file is truncated
+ * @param[in]   dev_info: device description stored in the file header
+ * @return      writer handle, NULL on failure
+ */
+extern "C" capture_writer_t *voxel3d_capture_create(const char *file_path,
+                                                    const CaptureDeviceInfo *dev_info);
+
+
+/**
+ * @brief       Create a recording file with options
+ * @details     With CAPTURE_FLAG_DIRECT_IO a long recording doesn't fill the page cache
+ *              and evict the working set of the application; where the file system has no
+ *              direct I/O the file is written through the page cache in the same blocks
+ * @param[in]   file_path: path of the file to create, an existing file is truncated
+ * @param[in]   dev_info: device description stored in the file header
+ * @param[in]   flags: 0 or CAPTURE_FLAG_DIRECT_IO
+ * @return      writer handle, NULL on failure
+ */
+extern "C" capture_writer_t *voxel3d_capture_create_ex(const char *file_path,
+                                                       const CaptureDeviceInfo *dev_info,
+                                                       unsigned int flags);
+
+
+/**
+ * @brief       Select the payload encoding of a stream
+ * @details     Takes effect from the next chunk, the pending chunk of the stream is written
+ *              out first
+ * @param[in]   writer: handle from voxel3d_capture_create()
+ * @param[in]   stream: CaptureStream
+ * @param[in]   codec: CaptureCodec. CAPTURE_CODEC_RVL is only valid for CAPTURE_STREAM_TOF
+ * @return      true: codec selected
+ * @return      < 0: invalid parameter or write failure
+ */
+extern "C" int voxel3d_capture_set_codec(capture_writer_t *writer, unsigned int stream,
+                                         unsigned int codec);
+
+
+/**
+ * @brief       Append a frame to a recording file
+ * @details     The frame is buffered in the chunk of its stream, see CAPTURE_CHUNK_MAX_BYTES
+ * @param[in]   writer: handle from voxel3d_capture_create()
+ * @param[in]   info: frame description, info->size bytes are read from data
+ * @param[in]   data: frame payload
+ * @return      true: frame buffered or written
+ * @return      < 0: invalid parameter or write failure
+ */
+extern "C" int voxel3d_capture_write_frame(capture_writer_t *writer,
+                                           const CaptureFrameInfo *info,
+                                           const void *data);
+
+
+/**
+ * @brief       Write out the pending chunk of every stream and sync the file to the disk
+ * @details     Chunks written as they fill up only reach the OS cache; what is flushed
+ *              here also survives a power loss. The sync may take tens of ms
+ * @param[in]   writer: handle from voxel3d_capture_create()
+ * @return      true: all buffered frames written
+ * @return      < 0: invalid parameter or write failure
+ */
+extern "C" int voxel3d_capture_flush(capture_writer_t *writer);
+
+
+/**
+ * @brief       Flush pending chunks, append the seek index and close a recording file
+ * @param[in]   writer: handle from voxel3d_capture_create()
+ */
+extern "C" void voxel3d_capture_close(capture_writer_t *writer);
+
+
+/**
+ * @brief       Open a recording file for reading
+ * @details     The seek index at the end of the file is loaded. A file without index (the
+ *              recording process died before voxel3d_capture_close()) is recovered by
+ *              walking its chunks; a torn last chunk is dropped.
+ * @param[in]   file_path: path of the recording file
+ * @return      reader handle, NULL if the file can't be opened or isn't a recording
+ */
+extern "C" capture_reader_t *voxel3d_capture_open(const char *file_path);
+
+
+/**
+ * @brief       Open a recording file for memory-mapped random access
+ * @details     Same as voxel3d_capture_open(), the whole file is additionally mapped
+ *              read-only so stored payloads can be accessed in place by
+ *              voxel3d_capture_map_frame(), compressed ones still need decoding.
+ *              voxel3d_capture_read_frame() copies from the mapping instead of seeking the
+ *              file, and prefetches ahead as well when called on consecutive frames.
+ * @param[in]   file_path: path of the recording file
+ * @return      reader handle, NULL if the file can't be opened, mapped or isn't a recording
+ */
+extern "C" capture_reader_t *voxel3d_capture_open_mapped(const char *file_path);
+
+
+/**
+ * @brief       Read the device description from the recording header
+ * @param[in]   reader: handle from voxel3d_capture_open()
+ * @param[out]  dev_info: pointer of user-allocated structure
+ * @return      true: dev_info filled
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_capture_get_device_info(capture_reader_t *reader,
+                                               CaptureDeviceInfo *dev_info);
+
+
+/**
+ * @brief       Number of frames recorded for a stream
+ * @param[in]   reader: handle from voxel3d_capture_open()
+ * @param[in]   stream: CaptureStream
+ * @return      >= 0: number of frames
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_capture_frame_count(capture_reader_t *reader, unsigned int stream);
+
+
+/**
+ * @brief       Get the description of a recorded frame without reading its payload
+ * @param[in]   reader: handle from voxel3d_capture_open()
+ * @param[in]   stream: CaptureStream
+ * @param[in]   index: 0 ~ voxel3d_capture_frame_count() - 1
+ * @param[out]  info: pointer of user-allocated structure
+ * @return      true: info filled
+ * @return      < 0: invalid parameter or index out of range
+ */
+extern "C" int voxel3d_capture_frame_info(capture_reader_t *reader, unsigned int stream,
+                                          unsigned int index, CaptureFrameInfo *info);
+
+
+/**
+ * @brief       Find a recorded frame by host timestamp
+ * @param[in]   reader: handle from voxel3d_capture_open()
+ * @param[in]   stream: CaptureStream
+ * @param[in]   host_ts_us: timestamp in voxel3d_host_time_us() domain of the recording
+ * @return      >= 0: index of the last frame recorded at or before host_ts_us
+ * @return      < 0: invalid parameter or no frame recorded at or before host_ts_us
+ */
+extern "C" int voxel3d_capture_seek_time(capture_reader_t *reader, unsigned int stream,
+                                         unsigned long long host_ts_us);
+
+
+/**
+ * @brief       Find a recorded frame by frame count
+ * @param[in]   reader: handle from voxel3d_capture_open()
+ * @param[in]   stream: CaptureStream
+ * @param[in]   frame_count: frame count returned by voxel3d_*_queryframe() while recording
+ * @return      >= 0: index of the frame
+ * @return      < 0: invalid parameter or frame count not recorded
+ */
+extern "C" int voxel3d_capture_seek_frame_count(capture_reader_t *reader, unsigned int stream,
+                                                unsigned int frame_count);
+
+
+/**
+ * @brief       Read a recorded frame
+ * @param[in]   reader: handle from voxel3d_capture_open()
+ * @param[in]   stream: CaptureStream
+ * @param[in]   index: 0 ~ voxel3d_capture_frame_count() - 1
+ * @param[out]  info: pointer of user-allocated structure, can be NULL
+ * @param[out]  data: pointer of user-allocated buffer for the payload
+ * @param[in]   max_size: size of data buffer, shall be at least info->size
+ * @return      > 0: payload bytes copied to data
+ * @return      < 0: invalid parameter, index out of range, buffer too small or read failure
+ */
+extern "C" int voxel3d_capture_read_frame(capture_reader_t *reader, unsigned int stream,
+                                          unsigned int index, CaptureFrameInfo *info,
+                                          void *data, unsigned int max_size);
+
+
+/**
+ * @brief       Access the stored payload of a recorded frame in place, without copy
+ * @details     Only raw streams are pixels in place. A CAPTURE_CODEC_RVL stream (ToF by
+ *              default) is mapped as its compressed payload: no decode happens here, and
+ *              getting its pixels takes a decoding copy by voxel3d_capture_decode_frame()
+ *              into a caller's buffer, the same cost as voxel3d_capture_read_frame().
+ *              Consecutive indexes (either direction) are detected as playback and the
+ *              next CAPTURE_PREFETCH_BYTES of the file are prefetched in the background, a
+ *              random access only brings in the frame itself. Safe to call from several
+ *              threads on the same reader.
+ * @param[in]   reader: handle from voxel3d_capture_open_mapped()
+ * @param[in]   stream: CaptureStream
+ * @param[in]   index: 0 ~ voxel3d_capture_frame_count() - 1, see voxel3d_capture_seek_time()
+ *                     and voxel3d_capture_seek_frame_count() to find a frame
+ * @param[out]  frame: pointer of user-allocated structure
+ * @return      true: frame filled, frame->data is the payload as stored, see
+ *                    voxel3d_capture_decode_frame() for CAPTURE_CODEC_RVL
+ * @return      < 0: invalid parameter, reader not mapped or index out of range
+ */
+extern "C" int voxel3d_capture_map_frame(capture_reader_t *reader, unsigned int stream,
+                                         unsigned int index, CaptureMappedFrame *frame);
+
+
+/**
+ * @brief       Access the stored payload of the recorded frame at a host timestamp in
+ *              place, without copy
+ * @details     voxel3d_capture_seek_time() followed by voxel3d_capture_map_frame(), compressed
+ *              payloads are returned as stored the same way
+ * @param[in]   reader: handle from voxel3d_capture_open_mapped()
+ * @param[in]   stream: CaptureStream
+ * @param[in]   host_ts_us: timestamp in voxel3d_host_time_us() domain of the recording
+ * @param[out]  frame: pointer of user-allocated structure
+ * @return      >= 0: index of the last frame recorded at or before host_ts_us, frame filled
+ * @return      < 0: invalid parameter, reader not mapped or no frame at or before host_ts_us
+ */
+extern "C" int voxel3d_capture_map_frame_time(capture_reader_t *reader, unsigned int stream,
+                                              unsigned long long host_ts_us,
+                                              CaptureMappedFrame *frame);
+
+
+/**
+ * @brief       Decode a frame from voxel3d_capture_map_frame() into a user buffer
+ * @param[in]   frame: frame from voxel3d_capture_map_frame()
+ * @param[out]  data: pointer of user-allocated buffer for the payload
+ * @param[in]   max_size: size of data buffer, shall be at least frame->info.size
+ * @return      > 0: payload bytes written to data
+ * @return      < 0: invalid parameter, buffer too small or corrupted payload
+ */
+extern "C" int voxel3d_capture_decode_frame(const CaptureMappedFrame *frame, void *data,
+                                            unsigned int max_size);
+
+
+/**
+ * @brief       Close a recording file opened for reading
+ * @param[in]   reader: handle from voxel3d_capture_open() or voxel3d_capture_open_mapped()
+ */
+extern "C" void voxel3d_capture_release(capture_reader_t *reader);
+
+#endif /* __VOXEL3D_CAPTURE_H__ */
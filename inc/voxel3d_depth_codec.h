@@ -0,0 +1,50 @@
+/**
+ @file      voxel3d_depth_codec.h
+ @brief     Lossless depth frame codec for 5Voxel 5VHiRab ToF frames
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_DEPTH_CODEC_H__
+#define __VOXEL3D_DEPTH_CODEC_H__
+
+#include "voxel3d.h"
+
+/**
+ * @brief  Worst-case encoded size in bytes of a frame of the given number of pixels,
+ *         use it to size the output buffer of voxel3d_depth_encode()
+ */
+#define DEPTH_CODEC_MAX_ENCODED_SIZE(pixels)    ((pixels) * 3 + 64)
+
+
+/**
+ * @brief       Losslessly encode a 16-bit depth (or IR) plane
+ * @details     RVL scheme: runs of zero pixels and of valid pixels are coded as counts,
+ *              valid pixels as the zig-zag delta to the previous valid pixel, all in
+ *              3-bit-per-nibble variable length codes. Invalid (zero) depth costs almost
+ *              nothing and smooth surfaces take one or two nibbles per pixel.
+ * @param[in]   depthmap: plane to encode, e.g. from voxel3d_tof_queryframe()
+ * @param[in]   pixels: number of pixels, e.g. TOF_DEPTH_PIXELS
+ * @param[out]  out: pointer of user-allocated buffer for the encoded stream
+ * @param[in]   max_size: size of out in bytes, shall be at least
+ *                        DEPTH_CODEC_MAX_ENCODED_SIZE(pixels)
+ * @return      > 0: encoded size in bytes, a multiple of 4
+ * @return      < 0: invalid parameter or max_size too small
+ */
+extern "C" int voxel3d_depth_encode(const unsigned short *depthmap, int pixels,
+                                    unsigned char *out, int max_size);
+
+
+/**
+ * @brief       Decode a plane encoded by voxel3d_depth_encode()
+ * @param[in]   in: encoded stream
+ * @param[in]   size: size of the encoded stream in bytes
+ * @param[out]  depthmap: pointer of user-allocated buffer for the decoded plane
+ * @param[in]   pixels: number of pixels the plane was encoded with
+ * @return      > 0: bytes of in consumed
+ * @return      < 0: invalid parameter or corrupted stream
+ */
+extern "C" int voxel3d_depth_decode(const unsigned char *in, int size,
+                                    unsigned short *depthmap, int pixels);
+
+#endif /* __VOXEL3D_DEPTH_CODEC_H__ */
@@ -0,0 +1,207 @@
+/**
+ @file      voxel3d_device.h
+ @brief     Handle-based access to 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_DEVICE_H__
+#define __VOXEL3D_DEVICE_H__
+
+#include "voxel3d.h"
+#include "voxel3d_backend.h"
+
+/*
+ * A handle pins one device: its S/N is resolved once at open (NULL / empty means the 1st
+ * scanned device, as in the voxel3d_* APIs), so every call afterwards addresses exactly
+ * that device. Values that don't change while streaming (camera info, FoV, F/W version
+ * and build date) are read from the device once and then served from the handle.
+ *
+ * Every voxel3d_device_* call has the same parameters, return values and warnings as the
+ * voxel3d_* API of the same name, with the handle in place of dev_sn.
+ */
+typedef struct voxel3d_device voxel3d_device_t;
+
+/*
+ * voxel3d_open_all() brings the sensors of a device up concurrently, one thread per sensor,
+ * and reads what the handle caches (camera info, FoV, F/W version and build date) right
+ * after each sensor is up, so the first frames are not held up by them. Instead of waiting
+ * a fixed time for the F/W information to become readable after ToF init, it is retried
+ * every DEVICE_FW_INFO_RETRY_MS for up to DEVICE_FW_INFO_TIMEOUT_MS.
+ */
+#define DEVICE_OPEN_TOF                 (0x01)
+#define DEVICE_OPEN_RGB                 (0x02)
+#define DEVICE_OPEN_THERMAL             (0x04)
+#define DEVICE_OPEN_CALIBRATION         (0x10)  /**< camera info and FoV of the sensors opened */
+#define DEVICE_OPEN_FW_INFO             (0x20)  /**< F/W version and build date, needs ToF */
+#define DEVICE_OPEN_SEQUENTIAL          (0x100) /**< one sensor after the other */
+#define DEVICE_OPEN_SENSORS             (DEVICE_OPEN_TOF | DEVICE_OPEN_RGB | DEVICE_OPEN_THERMAL)
+#define DEVICE_OPEN_ALL                 (DEVICE_OPEN_SENSORS | DEVICE_OPEN_CALIBRATION | \
+                                         DEVICE_OPEN_FW_INFO)
+
+#define DEVICE_FW_INFO_RETRY_MS         (10)
+#define DEVICE_FW_INFO_TIMEOUT_MS       (1000)
+
+/**
+ * @brief  Results and timings of voxel3d_open_all(), in microseconds
+ */
+struct DeviceOpenReport {
+    int tof_result;                     /**< voxel3d_tof_init() result, 0 if not requested */
+    int rgb_result;                     /**< voxel3d_rgb_init() result, 0 if not requested */
+    int thermal_result;                 /**< voxel3d_lepton3_init() result, 0 if not requested */
+    unsigned int scan_us;               /**< resolving the S/N, see voxel3d_device_open() */
+    unsigned int tof_init_us;
+    unsigned int rgb_init_us;
+    unsigned int thermal_init_us;
+    unsigned int calibration_us;        /**< longest camera info / FoV read of a sensor */
+    unsigned int fw_info_us;            /**< F/W information, including retries */
+    unsigned int total_us;
+};
+
+
+/**
+ * @brief       Open a handle on a device
+ * @note        No sensor is initialized, call voxel3d_device_tof_init() etc. as with S/N
+ * @param[in]   dev_sn: device S/N. Input S/N with NULL pointer or empty string opens the
+ *                      1st device found by the backend's scan
+ * @param[in]   backend: device access table, NULL for voxel3d_device_backend()
+ * @return      device handle, NULL if no device was found
+ */
+extern "C" voxel3d_device_t *voxel3d_device_open(char *dev_sn, const DeviceBackend *backend);
+
+
+/**
+ * @brief       Open a handle on a device and bring its sensors up concurrently
+ * @param[in]   dev_sn: device S/N, see voxel3d_device_open()
+ * @param[in]   flags: DEVICE_OPEN_* bits, DEVICE_OPEN_ALL for every sensor and all the
+ *                     information the handle caches
+ * @param[in]   backend: device access table, NULL for voxel3d_device_backend()
+ * @param[out]  report: pointer of user-allocated structure, NULL if not needed
+ * @return      device handle, NULL if no device was found or none of the requested sensors
+ *              came up. Sensors that failed are reported and left uninitialized.
+ */
+extern "C" voxel3d_device_t *voxel3d_open_all(char *dev_sn, unsigned int flags,
+                                              const DeviceBackend *backend,
+                                              DeviceOpenReport *report);
+
+
+/**
+ * @brief       Release the sensors initialized through the handle and close it
+ * @param[in]   dev: handle from voxel3d_device_open()
+ */
+extern "C" void voxel3d_device_close(voxel3d_device_t *dev);
+
+
+/**
+ * @brief       S/N the handle is bound to
+ * @param[in]   dev: handle from voxel3d_device_open()
+ * @return      S/N string, valid until voxel3d_device_close()
+ */
+extern "C" const char *voxel3d_device_sn(voxel3d_device_t *dev);
+
+
+/**
+ * @brief       Device access table the handle was opened with
+ * @param[in]   dev: handle from voxel3d_device_open()
+ * @return      backend table, never NULL for a valid handle
+ */
+extern "C" const DeviceBackend *voxel3d_device_get_backend(voxel3d_device_t *dev);
+
+
+extern "C" int voxel3d_device_tof_init(voxel3d_device_t *dev);
+extern "C" unsigned int voxel3d_device_tof_queryframe(voxel3d_device_t *dev,
+                                                      unsigned short *depthmap,
+                                                      unsigned short *irmap);
+extern "C" int voxel3d_device_tof_generatePointCloud(voxel3d_device_t *dev,
+                                                     unsigned short *depthmap,
+                                                     float *xyz);
+extern "C" void voxel3d_device_tof_release(voxel3d_device_t *dev);
+
+extern "C" int voxel3d_device_lepton3_init(voxel3d_device_t *dev);
+extern "C" unsigned int voxel3d_device_lepton3_queryframe(voxel3d_device_t *dev,
+                                                          float *thermal_map);
+extern "C" void voxel3d_device_lepton3_release(voxel3d_device_t *dev);
+
+extern "C" int voxel3d_device_rgb_init(voxel3d_device_t *dev);
+extern "C" unsigned int voxel3d_device_rgb_queryframe(voxel3d_device_t *dev,
+                                                      unsigned char *rgb_map);
+extern "C" void voxel3d_device_rgb_release(voxel3d_device_t *dev);
+
+extern "C" int voxel3d_device_read_imu_data(voxel3d_device_t *dev, IMU_DATA *imu_data);
+
+/**
+ * @note        Camera info is cached per rectify type, voxel3d_device_set_rectifyType()
+ *              re-reads RGB / thermal camera info on next call
+ */
+extern "C" int voxel3d_device_tof_read_camera_info(voxel3d_device_t *dev, CameraInfo *cam_info);
+extern "C" int voxel3d_device_lepton3_read_camera_info(voxel3d_device_t *dev,
+                                                       CameraInfo *cam_info);
+extern "C" int voxel3d_device_rgb_read_camera_info(voxel3d_device_t *dev, CameraInfo *cam_info);
+
+/**
+ * @brief       Fill the handle's camera info cache with a value read earlier, e.g. from the
+ *              calibration cache, so it isn't read from the device
+ * @param[in]   dev: handle from voxel3d_device_open()
+ * @param[in]   sensor: DEVICE_OPEN_TOF, DEVICE_OPEN_RGB or DEVICE_OPEN_THERMAL
+ * @param[in]   cam_info: camera info of the sensor
+ * @return      true: cached
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_device_preload_camera_info(voxel3d_device_t *dev, unsigned int sensor,
+                                                  const CameraInfo *cam_info);
+
+/**
+ * @brief       Fill the handle's depth FoV cache, see voxel3d_device_preload_camera_info()
+ * @param[in]   dev: handle from voxel3d_device_open()
+ * @param[in]   hfov: horizontal FoV as voxel3d_tof_get_depth_hfov() returns it
+ * @param[in]   vfov: vertical FoV as voxel3d_tof_get_depth_vfov() returns it
+ * @return      true: cached
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_device_preload_fov(voxel3d_device_t *dev, float hfov, float vfov);
+
+extern "C" int voxel3d_device_tof_get_conf_threshold(voxel3d_device_t *dev);
+extern "C" int voxel3d_device_tof_set_conf_threshold(voxel3d_device_t *dev,
+                                                     unsigned int conf_threshold);
+extern "C" int voxel3d_device_tof_set_auto_exposure_mode(voxel3d_device_t *dev,
+                                                         unsigned int enable);
+extern "C" float voxel3d_device_tof_get_depth_hfov(voxel3d_device_t *dev);
+extern "C" float voxel3d_device_tof_get_depth_vfov(voxel3d_device_t *dev);
+
+extern "C" int voxel3d_device_set_rectifyType(voxel3d_device_t *dev, int inputType);
+
+/**
+ * @brief       Get the rectify type last set successfully through the handle
+ * @param[in]   dev: handle from voxel3d_device_open()
+ * @return      RectifyType, NONE until voxel3d_device_set_rectifyType() succeeds
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_device_get_rectifyType(voxel3d_device_t *dev);
+
+
+/**
+ * @brief       Release the sensors of the handle and bring them up again, then apply the
+ *              confidence threshold, auto exposure mode and rectify type set through the
+ *              handle once more, e.g. after the device dropped off the bus and came back
+ * @warning     Don't query frames through the handle from another thread meanwhile
+ * @param[in]   dev: handle from voxel3d_device_open()
+ * @return      true: every sensor is up with its settings restored
+ * @return      < 0: a sensor or setting failed, the sensors that came up stay up. Call it
+ *              again to retry.
+ */
+extern "C" int voxel3d_device_reinit(voxel3d_device_t *dev);
+
+extern "C" int voxel3d_device_read_fw_version(voxel3d_device_t *dev, char *fw_ver,
+                                              unsigned int max_len);
+extern "C" int voxel3d_device_read_fw_build_date(voxel3d_device_t *dev, char *fw_build_date,
+                                                 unsigned int max_len);
+
+/**
+ * @note        F/W version and build date are read from the device again after an upgrade
+ */
+extern "C" int voxel3d_device_fw_upgrade(voxel3d_device_t *dev, char *file_path,
+    unsigned char (*fw_upgrade_cb)(int state, unsigned int percent_complete));
+extern "C" int voxel3d_device_fw_upgrade_state_poll(voxel3d_device_t *dev, int &state,
+                                                    unsigned int &percent_complete);
+
+#endif /* __VOXEL3D_DEVICE_H__ */
@@ -0,0 +1,129 @@
+/**
+ @file      voxel3d_fw_upgrade.h
+ @brief     Concurrent firmware upgrade of several 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_FW_UPGRADE_H__
+#define __VOXEL3D_FW_UPGRADE_H__
+
+#include "voxel3d.h"
+#include "voxel3d_backend.h"
+
+/*
+ * A batch flashes one firmware image to a list of devices, each from its own worker
+ * thread, so the blocking voxel3d_dev_fw_upgrade() of one device no longer waits for the
+ * others. Up to max_parallel devices are flashed at a time; the rest wait for a free
+ * worker. Progress of every device is reported through one callback and can be polled
+ * for the whole batch at any time. It comes from the upgrade callback when that runs on the
+ * worker's thread, and from voxel3d_dev_fw_upgrade_state_poll() of the device every
+ * 100 ms whichever thread the callback runs on.
+ */
+
+/* F/W upgrade states, as reported by voxel3d_dev_fw_upgrade_state_poll() */
+#define FW_UPGRADE_STATE_ERROR          (-1)
+#define FW_UPGRADE_STATE_INITIAL        (0)
+#define FW_UPGRADE_STATE_DOWNLOADING    (1)
+#define FW_UPGRADE_STATE_COMPLETE       (2)
+
+/* Status of a device in a batch */
+#define FW_BATCH_FAILED                 (-1)
+#define FW_BATCH_PENDING                (0)     /**< waiting for a worker */
+#define FW_BATCH_RUNNING                (1)
+#define FW_BATCH_DONE                   (2)     /**< image sent, takes effect after power cycle */
+
+/**
+ * @brief  Progress callback of a batch
+ * @note   Called from the worker threads, one call at a time
+ * @param  user: FwUpgradeBatchConfig.user
+ * @param  device: index of the device in the batch
+ * @param  dev_sn: S/N of the device
+ * @param  state: FW_UPGRADE_STATE_*
+ * @param  percent_complete: 0 ~ 100
+ */
+typedef void (*fw_upgrade_progress_cb)(void *user, unsigned int device, const char *dev_sn,
+                                       int state, unsigned int percent_complete);
+
+/**
+ * @brief  Structure used in voxel3d_fw_upgrade_batch_start() to select devices and image
+ */
+struct FwUpgradeBatchConfig {
+    const DeviceBackend *backend;       /**< NULL for voxel3d_device_backend() */
+    unsigned int num_devices;           /**< 0 for every device found by the backend's scan */
+    char dev_sn[MAX_SUPPORTED_CAMERA_MODULE][MAX_PRODUCT_SN_LEN];  /**< when num_devices > 0 */
+    const char *file_path;              /**< firmware image, copied at start */
+    unsigned int max_parallel;          /**< devices flashed at a time, 0 for all */
+    fw_upgrade_progress_cb progress_cb; /**< NULL for none */
+    void *user;
+};
+
+/**
+ * @brief  Progress of one device of a batch
+ */
+struct FwUpgradeProgress {
+    char dev_sn[MAX_PRODUCT_SN_LEN];
+    char fw_version[64];                /**< F/W version before the upgrade, empty if unread */
+    int status;                         /**< FW_BATCH_* */
+    int state;                          /**< last FW_UPGRADE_STATE_* reported */
+    unsigned int percent_complete;
+    int result;                         /**< voxel3d_dev_fw_upgrade() result once finished */
+};
+
+/**
+ * @brief  Progress of a batch, see voxel3d_fw_upgrade_batch_poll()
+ */
+struct FwUpgradeBatchState {
+    unsigned int num_devices;
+    unsigned int pending;
+    unsigned int running;
+    unsigned int done;
+    unsigned int failed;
+    unsigned int percent_complete;      /**< mean over all devices, failed ones count as 100 */
+    FwUpgradeProgress device[MAX_SUPPORTED_CAMERA_MODULE];
+};
+
+typedef struct fw_upgrade_batch fw_upgrade_batch_t;
+
+
+/**
+ * @brief       Start flashing a firmware image to a list of devices
+ * @warning     Same as voxel3d_dev_fw_upgrade(), the upgrade also allows a downgrade.
+ *              Don't stream from the devices of a batch until it has finished.
+ * @param[in]   config: devices, image and callback
+ * @return      batch handle, NULL on invalid parameter or when no device was found
+ */
+extern "C" fw_upgrade_batch_t *voxel3d_fw_upgrade_batch_start(const FwUpgradeBatchConfig *config);
+
+
+/**
+ * @brief       Poll the progress of every device of a batch
+ * @param[in]   batch: handle from voxel3d_fw_upgrade_batch_start()
+ * @param[out]  state: pointer of user-allocated structure, NULL to only check completion
+ * @return      true: devices still pending or running
+ * @return      < 0: batch finished or invalid parameter, state tells which devices failed
+ */
+extern "C" int voxel3d_fw_upgrade_batch_poll(fw_upgrade_batch_t *batch,
+                                             FwUpgradeBatchState *state);
+
+
+/**
+ * @brief       Wait for a batch to finish
+ * @param[in]   batch: handle from voxel3d_fw_upgrade_batch_start()
+ * @param[in]   timeout_ms: longest wait, 0 to wait until finished
+ * @return      true: the batch finished, see voxel3d_fw_upgrade_batch_poll() for results
+ * @return      0: batch not finished within timeout_ms
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_fw_upgrade_batch_wait(fw_upgrade_batch_t *batch, unsigned int timeout_ms);
+
+
+/**
+ * @brief       Release a batch
+ * @note        Devices not started yet are skipped and reported failed; upgrades in progress
+ *              can't be interrupted, so it waits for them to finish
+ * @param[in]   batch: handle from voxel3d_fw_upgrade_batch_start()
+ */
+extern "C" void voxel3d_fw_upgrade_batch_release(fw_upgrade_batch_t *batch);
+
+#endif /* __VOXEL3D_FW_UPGRADE_H__ */
@@ -0,0 +1,132 @@
+/**
+ @file      voxel3d_icp.h
+ @brief     Point-to-plane ICP camera tracking on organized clouds of 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_ICP_H__
+#define __VOXEL3D_ICP_H__
+
+#include "voxel3d.h"
+#include "voxel3d_parallel.h"
+
+/*
+ * The camera pose of a frame is found by aligning its organized cloud to a model cloud
+ * with normals, e.g. the previous frame or a raycast of voxel3d_tsdf_raycast():
+ *
+ * 1. Both clouds are halved levels - 1 times, 2x2 pixels averaged unless their depths
+ *    differ by more than ICP_MERGE_DEPTH_RATIO, and the alignment runs coarse to fine.
+ * 2. A pixel of the frame moved by the current pose is projected into the model camera,
+ *    lens distortion included, and pairs with the model pixel it falls on when they are
+ *    within max_distance: no neighbour search.
+ * 3. The distances of the pairs along the model normals give a 6x6 linear system for a
+ *    small motion, summed up 4 pixels at a time in bands of rows on the pool, and the
+ *    pose takes the solved motion until it gets below ICP_CONVERGED_MOTION.
+ *
+ * Poses are 3x4 row-major [R | t] matrices taking camera points to the world, like those
+ * of voxel3d_tsdf_integrate(). Clouds of a frame are in its camera frame, as from
+ * voxel3d_pointcloud_generate() without rotation.
+ *
+ * Tracking takes more than a few ms: with the default levels, a frame of odometry takes
+ * about 15 ms on one 2.1 GHz core. The pyramid and the normals of a frame are built once,
+ * aligned as the source and then swapped in as the next model, about 6 ms; iterating takes
+ * the other 9 ms, as a level converges within 1 to 3 iterations at 30 fps. The work
+ * spreads over a pool by bands of rows.
+ */
+#define ICP_MAX_LEVELS                  (4)
+#define ICP_DEFAULT_LEVELS              (3)         /* 640x480, 320x240 and 160x120 */
+#define ICP_DEFAULT_ITERATIONS          (10)        /* per level */
+#define ICP_DEFAULT_MAX_DISTANCE        (0.1f)      /* meters */
+#define ICP_MERGE_DEPTH_RATIO           (0.05f)
+#define ICP_CONVERGED_MOTION            (1e-4f)     /* radians + meters, 0.1 mm is well
+                                                       within the depth noise */
+#define ICP_MIN_PAIRS_RATIO             (32)        /* of the pixels of a level, at least
+                                                       1 / ICP_MIN_PAIRS_RATIO pair up */
+
+/**
+ * @brief  Structure used in voxel3d_icp_create() to tune the alignment, 0 for defaults
+ */
+struct IcpConfig {
+    unsigned int levels;                /**< 1 ~ ICP_MAX_LEVELS */
+    unsigned int iterations;            /**< most iterations of a level */
+    float max_distance;                 /**< meters between the points of a pair */
+};
+
+typedef struct icp icp_t;
+
+
+/**
+ * @brief       Create a tracker
+ * @param[in]   cam_info: ToF camera info, e.g. from voxel3d_tof_read_camera_info()
+ * @param[in]   config: levels, iterations and pairing distance, NULL for defaults
+ * @return      tracker handle, NULL on invalid parameter
+ */
+extern "C" icp_t *voxel3d_icp_create(const CameraInfo *cam_info, const IcpConfig *config);
+
+
+/**
+ * @brief       Set the cloud the next frames align to
+ * @param[in]   icp: handle from voxel3d_icp_create()
+ * @param[in]   xyz: TOF_DEPTH_PIXELS points in the world, organized by the pixels of the
+ *                   camera at pose, e.g. from voxel3d_tsdf_raycast()
+ * @param[in]   normals: TOF_DEPTH_PIXELS unit normals in the world, 0 where invalid, or NULL
+ *                       to estimate them with voxel3d_pointcloud_normals()
+ * @param[in]   pose: 3x4 row-major camera to world matrix of the model, NULL for the identity
+ * @param[in]   pool: handle from voxel3d_parallel_create(), NULL for the calling thread
+ * @return      true: model set
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_icp_set_model(icp_t *icp, const float *xyz, const float *normals,
+                                     const float *pose, parallel_t *pool);
+
+
+/**
+ * @brief       Find the pose of a frame against the model
+ * @param[in]   icp: handle from voxel3d_icp_create()
+ * @param[in]   xyz: TOF_DEPTH_PIXELS points of the frame in its camera frame
+ * @param[in]   pool: handle from voxel3d_parallel_create(), NULL for the calling thread
+ * @param[in,out] pose: 3x4 row-major camera to world matrix, the guess in, the estimate out,
+ *                      left as it was when the alignment fails
+ * @return      > 0: number of pairs at the finest level
+ * @return      0: failed, no model or too few pairs, or a degenerate scene
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_icp_align(icp_t *icp, const float *xyz, parallel_t *pool, float *pose);
+
+
+/**
+ * @brief       Odometry: align a frame to the previous one, then keep it as the model
+ * @details     The first frame after create or reset starts at the identity pose. A frame
+ *              failing to align starts a new model at the last pose.
+ * @param[in]   icp: handle from voxel3d_icp_create()
+ * @param[in]   xyz: TOF_DEPTH_PIXELS points of the frame in its camera frame
+ * @param[in]   gyro_rotation: 3x3 row-major rotation of the camera since the previous frame,
+ *                             previous = gyro_rotation * current, seeding the alignment,
+ *                             e.g. transpose(R0) * R1 with voxel3d_orientation_matrix() of
+ *                             the orientations of both framesets; NULL for none
+ * @param[in]   pool: handle from voxel3d_parallel_create(), NULL for the calling thread
+ * @param[out]  pose: 3x4 row-major camera to world matrix of the frame, the world being the
+ *                    camera frame of the first one
+ * @return      > 0: number of pairs at the finest level
+ * @return      0: first frame or failed alignment
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_icp_track(icp_t *icp, const float *xyz, const float *gyro_rotation,
+                                 parallel_t *pool, float *pose);
+
+
+/**
+ * @brief       Forget the model and the odometry pose
+ * @param[in]   icp: handle from voxel3d_icp_create()
+ */
+extern "C" void voxel3d_icp_reset(icp_t *icp);
+
+
+/**
+ * @brief       Release a tracker
+ * @param[in]   icp: handle from voxel3d_icp_create()
+ */
+extern "C" void voxel3d_icp_destroy(icp_t *icp);
+
+#endif /* __VOXEL3D_ICP_H__ */
@@ -0,0 +1,134 @@
+/**
+ @file      voxel3d_occupancy.h
+ @brief     2.5D occupancy grid and heightmap from the depth frames of 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_OCCUPANCY_H__
+#define __VOXEL3D_OCCUPANCY_H__
+
+#include "voxel3d.h"
+#include "voxel3d_parallel.h"
+
+/*
+ * A square grid of size x size cells on the ground keeps, per cell, the evidence of an
+ * obstacle and the height of its top, fused over frames. The grid follows the robot by
+ * whole cells, see voxel3d_occupancy_recenter().
+ *
+ * 1. Every stride-th pixel of every stride-th row is taken from the depth plane with the
+ *    ray table built at creation, 4 pixels at a time; no point cloud is built. A point
+ *    between min_height and max_height above the ground is an obstacle of its cell, a lower
+ *    one is ground, a higher one (ceiling, overhang) is left out.
+ * 2. Points are binned by their azimuth around the camera in OCCUPANCY_BINS sectors, each
+ *    keeping its nearest point, its farthest ground and its nearest obstacle. A cell that
+ *    lies in a sector between the nearest point and both the farthest ground and the
+ *    nearest obstacle is seen free: its ray cast through the sector ends beyond it.
+ * 3. Cells take OCCUPANCY_HIT_EVIDENCE when min_points obstacles fall in them, lose
+ *    OCCUPANCY_FREE_EVIDENCE when seen free, and every cell's evidence fades by decay per
+ *    frame, so cells not seen for a while go back to unknown.
+ *
+ * The grid frame is the levelled camera frame of voxel3d_orientation_level(), x right,
+ * y down along gravity and z forward, moved so that the ground is the plane y = 0: a point
+ * is -y meters above the ground. Cell (col, row) covers x from origin[0] + col * cell and
+ * z from origin[1] + row * cell.
+ */
+#define OCCUPANCY_DEFAULT_CELL          (0.05f)     /* meters */
+#define OCCUPANCY_DEFAULT_SIZE          (200)       /* cells, 10 m square by default */
+#define OCCUPANCY_DEFAULT_MIN_HEIGHT    (0.1f)      /* meters, lower points are ground */
+#define OCCUPANCY_DEFAULT_MAX_HEIGHT    (1.5f)      /* meters, higher points clear the robot */
+#define OCCUPANCY_DEFAULT_MAX_RANGE     (4.f)       /* meters of depth */
+#define OCCUPANCY_DEFAULT_DECAY         (0.98f)     /* evidence kept per frame */
+#define OCCUPANCY_DEFAULT_MIN_POINTS    (2)         /* per frame */
+#define OCCUPANCY_DEFAULT_STRIDE        (2)         /* pixels */
+#define OCCUPANCY_MAX_SIZE              (4096)
+#define OCCUPANCY_BINS                  (720)       /* azimuth sectors of free space */
+#define OCCUPANCY_HIT_EVIDENCE          (0.85f)     /* log-odds */
+#define OCCUPANCY_FREE_EVIDENCE         (0.4f)      /* log-odds */
+#define OCCUPANCY_MAX_EVIDENCE          (3.5f)      /* log-odds, either way */
+#define OCCUPANCY_KNOWN_EVIDENCE        (0.2f)      /* log-odds, weaker is unknown */
+
+#define OCCUPANCY_UNKNOWN               (255)       /* voxel3d_occupancy_get(), else 0 ~ 100 */
+
+/**
+ * @brief  Structure used in voxel3d_occupancy_create() to set up the grid, 0 for defaults
+ */
+struct OccupancyConfig {
+    float cell;                         /**< cell size in meters */
+    unsigned int size;                  /**< cells per side, up to OCCUPANCY_MAX_SIZE */
+    float min_height;                   /**< meters above the ground an obstacle starts */
+    float max_height;                   /**< meters above the ground an obstacle ends */
+    float max_range;                    /**< farther depth is left out */
+    float decay;                        /**< evidence kept per frame, 1 keeps it forever */
+    unsigned int min_points;            /**< obstacles of a frame marking their cell */
+    unsigned int stride;                /**< pixels between the pixels taken, both ways */
+};
+
+typedef struct occupancy_grid occupancy_grid_t;
+
+
+/**
+ * @brief       Create an unknown grid centered on the origin
+ * @param[in]   cam_info: ToF camera info, e.g. from voxel3d_tof_read_camera_info()
+ * @param[in]   config: cells, height band, range and fusion, NULL for defaults
+ * @return      grid handle, NULL on invalid parameter
+ */
+extern "C" occupancy_grid_t *voxel3d_occupancy_create(const CameraInfo *cam_info,
+                                                      const OccupancyConfig *config);
+
+
+/**
+ * @brief       Move the grid by whole cells to center it on the robot
+ * @details     Cells moving out are forgotten, cells moving in are unknown
+ * @param[in]   grid: handle from voxel3d_occupancy_create()
+ * @param[in]   x: meters along x of the grid frame
+ * @param[in]   z: meters along z of the grid frame
+ * @return      true: grid moved or already there
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_occupancy_recenter(occupancy_grid_t *grid, float x, float z);
+
+
+/**
+ * @brief       Fuse a depth frame into the grid
+ * @param[in]   grid: handle from voxel3d_occupancy_create()
+ * @param[in]   depthmap: depth frame, e.g. from voxel3d_tof_queryframe()
+ * @param[in]   pose: 3x4 row-major camera to grid frame matrix, e.g. the rotation of
+ *                    voxel3d_orientation_level() and (0, -mount height, 0)
+ * @param[in]   pool: handle from voxel3d_parallel_create(), NULL for the calling thread
+ * @return      >= 0: number of cells seen, occupied or free
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_occupancy_integrate(occupancy_grid_t *grid, const unsigned short *depthmap,
+                                           const float *pose, parallel_t *pool);
+
+
+/**
+ * @brief       Copy the grid
+ * @param[in]   grid: handle from voxel3d_occupancy_create()
+ * @param[out]  occupancy: pointer of user-allocated buffer of size * size bytes, row by row,
+ *                         0 (free) ~ 100 (occupied) percent or OCCUPANCY_UNKNOWN, or NULL
+ * @param[out]  heights: pointer of user-allocated buffer of size * size floats, meters of the
+ *                       top of a cell above the ground as last seen, 0 where unknown, or NULL
+ * @param[out]  origin: x and z of the corner of cell (0, 0) in meters, or NULL
+ * @return      > 0: cells per side
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_occupancy_get(occupancy_grid_t *grid, unsigned char *occupancy,
+                                     float *heights, float origin[2]);
+
+
+/**
+ * @brief       Forget every cell, the grid stays where it is
+ * @param[in]   grid: handle from voxel3d_occupancy_create()
+ */
+extern "C" void voxel3d_occupancy_reset(occupancy_grid_t *grid);
+
+
+/**
+ * @brief       Release a grid
+ * @param[in]   grid: handle from voxel3d_occupancy_create()
+ */
+extern "C" void voxel3d_occupancy_destroy(occupancy_grid_t *grid);
+
+#endif /* __VOXEL3D_OCCUPANCY_H__ */
@@ -0,0 +1,132 @@
+/**
+ @file      voxel3d_orientation.h
+ @brief     IMU orientation filters of 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_ORIENTATION_H__
+#define __VOXEL3D_ORIENTATION_H__
+
+#include "voxel3d.h"
+
+/*
+ * An orientation filter integrates the gyro and pulls the result towards the direction
+ * of gravity measured by the accelerometer, with either the gradient descent step of
+ * Madgwick or the PI feedback of Mahony. Both use the same error: the cross product of
+ * the measured and the estimated direction of gravity.
+ *
+ * Axes follow the ToF camera: x right, y down, z forward. The world frame is the camera
+ * frame levelled, so gravity points along +y there and a level camera has the identity
+ * orientation. Heading has no reference (no magnetometer) and drifts with the gyro bias.
+ *
+ * The first sample, and any sample after a gap of ORIENTATION_MAX_GAP_US or a timestamp
+ * going backwards, seeds the orientation from the accelerometer alone.
+ */
+#define ORIENTATION_NONE                (0)
+#define ORIENTATION_MADGWICK            (1)
+#define ORIENTATION_MAHONY              (2)
+
+#define ORIENTATION_DEFAULT_BETA        (0.1f)
+#define ORIENTATION_DEFAULT_KP          (1.0f)
+#define ORIENTATION_MAX_GAP_US          (500000)
+#define ORIENTATION_GYRO_DEG_S          (0.017453292f)      /* gyro_scale of degrees per s */
+
+/**
+ * @brief  Structure used in voxel3d_orientation_create() to select the filter
+ */
+struct OrientationConfig {
+    int filter;                         /**< ORIENTATION_MADGWICK or ORIENTATION_MAHONY */
+    float beta;                         /**< Madgwick gain, 0 for the default */
+    float kp;                           /**< Mahony proportional gain, 0 for the default */
+    float ki;                           /**< Mahony integral gain, corrects the gyro bias */
+    float gyro_scale;                   /**< rad/s per IMU_DATA.imu_gyro unit, 0 for 1 */
+};
+
+/**
+ * @brief  Orientation of the camera at one IMU sample
+ */
+struct Orientation {
+    float q[4];                         /**< w, x, y, z, rotates camera vectors into the
+                                             world frame */
+    float gravity[3];                   /**< unit direction of gravity in the camera frame */
+    unsigned int imu_ts;                /**< sample the orientation was updated with */
+};
+
+typedef struct orientation_filter orientation_filter_t;
+
+
+/**
+ * @brief       Create an orientation filter
+ * @param[in]   config: filter and gains
+ * @return      filter handle, NULL on invalid parameter
+ */
+extern "C" orientation_filter_t *voxel3d_orientation_create(const OrientationConfig *config);
+
+
+/**
+ * @brief       Update the orientation with the next IMU sample
+ * @param[in]   filter: handle from voxel3d_orientation_create()
+ * @param[in]   imu_data: sample newer than the previous one
+ * @return      true: orientation updated
+ * @return      0: orientation seeded from the accelerometer, see above
+ * @return      < 0: invalid parameter or no acceleration in the sample
+ */
+extern "C" int voxel3d_orientation_update(orientation_filter_t *filter, const IMU_DATA *imu_data);
+
+
+/**
+ * @brief       Read the current orientation
+ * @param[in]   filter: handle from voxel3d_orientation_create()
+ * @param[out]  orientation: pointer of user-allocated structure
+ * @return      true: orientation filled
+ * @return      < 0: invalid parameter or no sample yet
+ */
+extern "C" int voxel3d_orientation_get(orientation_filter_t *filter, Orientation *orientation);
+
+
+/**
+ * @brief       Forget the orientation, the next sample seeds it again
+ * @param[in]   filter: handle from voxel3d_orientation_create()
+ */
+extern "C" void voxel3d_orientation_reset(orientation_filter_t *filter);
+
+
+/**
+ * @brief       Release an orientation filter
+ * @param[in]   filter: handle from voxel3d_orientation_create()
+ */
+extern "C" void voxel3d_orientation_destroy(orientation_filter_t *filter);
+
+
+/**
+ * @brief       Interpolate between two orientations
+ * @param[in]   a: orientation at t = 0
+ * @param[in]   b: orientation at t = 1
+ * @param[in]   t: 0 ~ 1
+ * @param[out]  orientation: interpolated orientation, imu_ts is left untouched
+ */
+extern "C" void voxel3d_orientation_interpolate(const Orientation *a, const Orientation *b,
+                                                float t, Orientation *orientation);
+
+
+/**
+ * @brief       Build the 3x3 row-major matrix of a quaternion
+ * @param[in]   q: w, x, y, z, unit length
+ * @param[out]  r: r[row * 3 + col], world = r * camera
+ */
+extern "C" void voxel3d_orientation_matrix(const float q[4], float r[9]);
+
+
+/**
+ * @brief       Build the rotation that levels the camera without turning it
+ * @details     The shortest rotation taking gravity onto +y, so the levelled frame keeps
+ *              the heading of the camera instead of the drifting heading of q
+ * @param[in]   gravity: direction of gravity in the camera frame, e.g. Orientation.gravity
+ * @param[out]  r: r[row * 3 + col], levelled = r * camera
+ * @return      true: r filled
+ * @return      < 0: invalid parameter or zero gravity
+ */
+extern "C" int voxel3d_orientation_level(const float gravity[3], float r[9]);
+
+#endif /* __VOXEL3D_ORIENTATION_H__ */
@@ -0,0 +1,65 @@
+/**
+ @file      voxel3d_parallel.h
+ @brief     Worker pool of the libvoxel3d point cloud kernels
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_PARALLEL_H__
+#define __VOXEL3D_PARALLEL_H__
+
+#include "voxel3d.h"
+
+/*
+ * A pool keeps its worker threads parked between runs, so splitting a frame into tasks
+ * (e.g. bands of rows) costs a wakeup rather than a thread start per frame. The thread
+ * calling voxel3d_parallel_run() takes tasks too: a pool of N threads has N - 1 workers.
+ *
+ * Kernels taking a pool run on the calling thread alone when it is NULL.
+ */
+
+/**
+ * @brief  Task of voxel3d_parallel_run()
+ * @param  user: user pointer given to voxel3d_parallel_run()
+ * @param  task: 0 ~ tasks - 1, each index runs exactly once
+ */
+typedef void (*parallel_task_fn)(void *user, unsigned int task);
+
+typedef struct parallel parallel_t;
+
+
+/**
+ * @brief       Create a worker pool
+ * @param[in]   threads: threads running the tasks, caller included, 0 for one per CPU
+ * @return      pool handle, NULL on failure
+ */
+extern "C" parallel_t *voxel3d_parallel_create(unsigned int threads);
+
+
+/**
+ * @brief       Number of threads running the tasks of a pool
+ * @param[in]   pool: handle from voxel3d_parallel_create(), or NULL
+ * @return      threads, caller included, 1 for NULL
+ */
+extern "C" unsigned int voxel3d_parallel_threads(parallel_t *pool);
+
+
+/**
+ * @brief       Run tasks on the pool and wait for all of them
+ * @warning     Not thread-safe, run one batch of tasks at a time on a pool
+ * @param[in]   pool: handle from voxel3d_parallel_create(), NULL to run on the caller
+ * @param[in]   tasks: number of tasks
+ * @param[in]   fn: task function, called from any thread of the pool
+ * @param[in]   user: passed to fn
+ */
+extern "C" void voxel3d_parallel_run(parallel_t *pool, unsigned int tasks, parallel_task_fn fn,
+                                     void *user);
+
+
+/**
+ * @brief       Stop the worker threads and release the pool
+ * @param[in]   pool: handle from voxel3d_parallel_create()
+ */
+extern "C" void voxel3d_parallel_destroy(parallel_t *pool);
+
+#endif /* __VOXEL3D_PARALLEL_H__ */
@@ -0,0 +1,101 @@
+/**
+ @file      voxel3d_planes.h
+ @brief     Plane extraction from organized point clouds of 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_PLANES_H__
+#define __VOXEL3D_PLANES_H__
+
+#include "voxel3d.h"
+#include "voxel3d_parallel.h"
+
+/*
+ * Agglomerative clustering of blocks, after Feng et al., "Fast Plane Extraction in
+ * Organized Point Clouds Using Agglomerative Hierarchical Clustering" (PEAC):
+ *
+ * 1. The cloud is cut into block x block pixel blocks and a plane is fitted to each. A
+ *    block with too many invalid points, a depth edge inside or a fit worse than the
+ *    noise allowed at its range doesn't take part. Bands of blocks run on the pool.
+ * 2. The flattest remaining block or cluster is merged with the neighbours giving the
+ *    flattest unions, as long as the union still fits within the noise allowed. A cluster
+ *    that can't grow any more becomes a plane when it has min_blocks blocks.
+ * 3. With a label map, the pixels of the blocks left out next to a plane join it when
+ *    they are within PLANES_REFINE_SIGMA times the noise allowed of it, which recovers the
+ *    plane borders lost to whole blocks.
+ *
+ * The noise allowed at a range r is noise_ratio * r + noise_floor (RMS distance to the
+ * plane, meters). Plane sums are kept per cluster, so a merge costs one 3x3 eigenvalue.
+ *
+ * Extraction isn't always within 5 ms on one core: on one 2.1 GHz core, a 640x480 frame of
+ * two planes takes 4 to 6 ms, about 2.5 ms fitting the blocks and 2 ms merging them, and
+ * 1 ms more with a label map. Fitting and labelling spread over a pool by bands of blocks
+ * but the merge stays sequential, its 2 ms being left whatever the pool.
+ */
+#define PLANES_DEFAULT_BLOCK            (10)        /* pixels, divides 640 and 480 */
+#define PLANES_DEFAULT_MIN_BLOCKS       (25)
+#define PLANES_DEFAULT_NOISE_RATIO      (0.005f)
+#define PLANES_DEFAULT_NOISE_FLOOR      (0.002f)    /* meters */
+#define PLANES_DEFAULT_DEPTH_CHANGE     (0.05f)
+#define PLANES_REFINE_SIGMA             (3.f)
+
+/**
+ * @brief  Structure used in voxel3d_planes_create() to tune the extraction, 0 for defaults
+ */
+struct PlaneConfig {
+    unsigned int block;                 /**< block size in pixels, shall divide 640 and 480 */
+    unsigned int min_blocks;            /**< smallest plane in blocks */
+    float noise_ratio;                  /**< noise allowed per meter of range */
+    float noise_floor;                  /**< noise allowed at any range, meters */
+    float max_depth_change;             /**< relative range difference of neighbouring pixels
+                                             that makes a depth edge */
+};
+
+/**
+ * @brief  Plane found by voxel3d_planes_extract(), normal . p + d = 0
+ */
+struct Plane {
+    float normal[3];                    /**< unit, towards the camera */
+    float d;                            /**< distance of the camera from the plane */
+    float center[3];                    /**< centroid of the fitted points */
+    float rms;                          /**< RMS distance of the fitted points, meters */
+    unsigned int points;                /**< points of the fitted blocks */
+    unsigned int blocks;
+};
+
+typedef struct plane_extractor plane_extractor_t;
+
+
+/**
+ * @brief       Create a plane extractor and its buffers
+ * @param[in]   config: block size and thresholds, NULL for defaults
+ * @return      extractor handle, NULL on invalid parameter
+ */
+extern "C" plane_extractor_t *voxel3d_planes_create(const PlaneConfig *config);
+
+
+/**
+ * @brief       Extract the planes of an organized point cloud
+ * @param[in]   ext: handle from voxel3d_planes_create()
+ * @param[in]   xyz: TOF_DEPTH_PIXELS points, e.g. from voxel3d_pointcloud_generate()
+ * @param[in]   pool: handle from voxel3d_parallel_create(), NULL for the calling thread
+ * @param[out]  planes: user-allocated array of max_planes planes, largest first
+ * @param[in]   max_planes: size of planes, smaller planes are left out
+ * @param[out]  labels: TOF_DEPTH_PIXELS plane indexes + 1, 0 for none, or NULL to skip
+ *                      the labelling and its refinement
+ * @return      >= 0: number of planes filled
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_planes_extract(plane_extractor_t *ext, const float *xyz,
+                                      parallel_t *pool, Plane *planes, unsigned int max_planes,
+                                      unsigned short *labels);
+
+
+/**
+ * @brief       Release a plane extractor
+ * @param[in]   ext: handle from voxel3d_planes_create()
+ */
+extern "C" void voxel3d_planes_destroy(plane_extractor_t *ext);
+
+#endif /* __VOXEL3D_PLANES_H__ */
@@ -0,0 +1,87 @@
+/**
+ @file      voxel3d_pointcloud.h
+ @brief     Host-side point clouds of 5Voxel 5VHiRab ToF frames
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_POINTCLOUD_H__
+#define __VOXEL3D_POINTCLOUD_H__
+
+#include "voxel3d.h"
+#include "voxel3d_parallel.h"
+
+/*
+ * Point clouds are organized: point ix comes from depth pixel ix, in meters, and invalid
+ * (zero) depth gives (0, 0, 0) in every frame. They are generated from a ToF ray table
+ * (see voxel3d_calibration_rays()), so no lens model is evaluated per frame.
+ *
+ * A rotation given to the generation is applied in the same pass: the rotated ray of a
+ * pixel is scaled by its depth, which costs a few multiplies per point instead of a
+ * second pass over the cloud. With voxel3d_orientation_level() on the gravity of a
+ * frameset (see AcquisitionFrameset.orientation) the cloud comes out levelled.
+ */
+#define POINTCLOUD_DEPTH_UNIT_M         (0.001f)    /* meters per depth unit */
+
+/*
+ * Normals use the grid instead of a neighbour search: the normal of a pixel is the cross
+ * product of the vectors between its neighbours step pixels to the left / right and
+ * above / below, facing the camera. A larger step smooths over more noise. Pixels with an
+ * invalid neighbour, a neighbour whose range differs from theirs by more than
+ * max_depth_change (a depth edge) or closer than step to the border get a zero normal.
+ * Bands of rows run on the pool given.
+ */
+#define POINTCLOUD_NORMAL_FLOAT         (0)     /* 3 floats per pixel */
+#define POINTCLOUD_NORMAL_PACKED        (1)     /* 10-bit x, y, z in one unsigned int, x in
+                                                   the low bits, 0 when invalid */
+#define POINTCLOUD_DEFAULT_NORMAL_STEP  (2)
+#define POINTCLOUD_DEFAULT_DEPTH_CHANGE (0.05f)
+
+/**
+ * @brief  Structure used in voxel3d_pointcloud_normals() to tune the estimation
+ */
+struct NormalConfig {
+    unsigned int step;                  /**< pixels to the neighbours, 0 for the default */
+    float max_depth_change;             /**< relative range difference to a neighbour,
+                                             0 for the default */
+    int format;                         /**< POINTCLOUD_NORMAL_FLOAT or _PACKED */
+};
+
+
+/**
+ * @brief       Generate the organized point cloud of a depth frame
+ * @param[in]   rays: TOF_DEPTH_PIXELS (x, y) pairs of the device, see
+ *                    voxel3d_calibration_rays()
+ * @param[in]   depthmap: depth frame, e.g. from voxel3d_tof_queryframe()
+ * @param[in]   rotation: 3x3 row-major matrix applied to every point, NULL for the
+ *                        camera frame
+ * @param[out]  xyz: pointer of user-allocated buffer of TOF_DEPTH_PIXELS * 3 floats
+ * @return      > 0: points filled in xyz, TOF_DEPTH_PIXELS
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_pointcloud_generate(const float *rays, const unsigned short *depthmap,
+                                           const float *rotation, float *xyz);
+
+
+/**
+ * @brief       Estimate the normal of every pixel of an organized point cloud
+ * @param[in]   xyz: TOF_DEPTH_PIXELS points, e.g. from voxel3d_pointcloud_generate()
+ * @param[in]   config: step, depth change and format, NULL for defaults and float normals
+ * @param[in]   pool: handle from voxel3d_parallel_create(), NULL for the calling thread
+ * @param[out]  normals: pointer of user-allocated buffer of TOF_DEPTH_PIXELS * 3 floats, or
+ *                       TOF_DEPTH_PIXELS unsigned ints with POINTCLOUD_NORMAL_PACKED
+ * @return      >= 0: number of valid normals
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_pointcloud_normals(const float *xyz, const NormalConfig *config,
+                                          parallel_t *pool, void *normals);
+
+
+/**
+ * @brief       Unpack a POINTCLOUD_NORMAL_PACKED normal
+ * @param[in]   packed: packed normal
+ * @param[out]  normal: x, y, z, about unit length, 0 for an invalid normal
+ */
+extern "C" void voxel3d_pointcloud_unpack_normal(unsigned int packed, float normal[3]);
+
+#endif /* __VOXEL3D_POINTCLOUD_H__ */
@@ -0,0 +1,100 @@
+/**
+ @file      voxel3d_proximity.h
+ @brief     Closest obstacle within zones from the depth frames of 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_PROXIMITY_H__
+#define __VOXEL3D_PROXIMITY_H__
+
+#include "voxel3d.h"
+
+/*
+ * A zone is a convex volume around the robot: a box, or a sector of a vertical cylinder
+ * around the y axis, up to half of it, between two heights. At creation the ray of every
+ * depth pixel is clipped against every zone, which leaves the depth interval the pixel is
+ * inside the zone for, in depth units, and per row the span of pixels whose rays cross it.
+ * A query then costs one pass of integer compares over those spans of the depth plane, 8
+ * pixels at a time, and the distance of a pixel inside a zone is its depth times the
+ * length of its ray.
+ *
+ * The spans are visited by bands of PROXIMITY_BAND_ROWS rows, the band whose intervals
+ * allow the nearest point first, and a zone stops at the first band that can't come
+ * closer than the point it has: an occupied zone is usually settled in a band or two.
+ *
+ * Zones are given in a frame of the robot, posed from the camera, with the axes of the ToF
+ * camera: x right, y down and z forward. Distances are meters from the camera.
+ */
+#define PROXIMITY_MAX_ZONES             (8)
+#define PROXIMITY_BAND_ROWS             (16)
+
+/* ProximityZone.type */
+#define PROXIMITY_BOX                   (0)
+#define PROXIMITY_SECTOR                (1)
+
+/**
+ * @brief  Zone of a ProximityConfig
+ */
+struct ProximityZone {
+    int type;                           /**< PROXIMITY_BOX or PROXIMITY_SECTOR */
+    float min[3];                       /**< box: x, y, z of its lowest corner, sector: y of its
+                                             top in min[1] */
+    float max[3];                       /**< box: x, y, z of its highest corner, sector: y of
+                                             its bottom in max[1] */
+    float radius;                       /**< sector: meters from the y axis */
+    float angles[2];                    /**< sector: azimuth atan2(x, z) from angles[0] to
+                                             angles[1] in radians, up to pi apart */
+};
+
+/**
+ * @brief  Structure used in voxel3d_proximity_create() to set up the zones
+ */
+struct ProximityConfig {
+    float pose[12];                     /**< 3x4 row-major camera to zone frame matrix, all 0
+                                             for the identity */
+    unsigned int num_zones;             /**< up to PROXIMITY_MAX_ZONES */
+    ProximityZone zones[PROXIMITY_MAX_ZONES];
+};
+
+/**
+ * @brief  Closest point of a zone, see voxel3d_proximity_query()
+ */
+struct ProximityHit {
+    float distance;                     /**< meters from the camera, 0 when the zone is clear */
+    int pixel;                          /**< y * TOF_DEPTH_WIDTH + x, -1 when the zone is clear */
+};
+
+typedef struct proximity proximity_t;
+
+
+/**
+ * @brief       Clip the rays of a ToF camera against zones
+ * @param[in]   cam_info: ToF camera info, e.g. from voxel3d_tof_read_camera_info()
+ * @param[in]   config: pose and zones
+ * @return      query handle, NULL on invalid parameter
+ */
+extern "C" proximity_t *voxel3d_proximity_create(const CameraInfo *cam_info,
+                                                 const ProximityConfig *config);
+
+
+/**
+ * @brief       Find the closest point of each zone in a depth frame
+ * @param[in]   prox: handle from voxel3d_proximity_create()
+ * @param[in]   depthmap: depth frame, e.g. from voxel3d_tof_queryframe()
+ * @param[out]  hits: pointer of user-allocated buffer of ProximityConfig.num_zones hits, in
+ *                    the order of the zones
+ * @return      >= 0: number of zones with a point
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_proximity_query(proximity_t *prox, const unsigned short *depthmap,
+                                       ProximityHit *hits);
+
+
+/**
+ * @brief       Release a query
+ * @param[in]   prox: handle from voxel3d_proximity_create()
+ */
+extern "C" void voxel3d_proximity_destroy(proximity_t *prox);
+
+#endif /* __VOXEL3D_PROXIMITY_H__ */
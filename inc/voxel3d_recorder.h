@@ -0,0 +1,109 @@
+/**
+ @file      voxel3d_recorder.h
+ @brief     Asynchronous recording of 5Voxel 5VHiRab device streams
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_RECORDER_H__
+#define __VOXEL3D_RECORDER_H__
+
+#include "voxel3d.h"
+#include "voxel3d_capture.h"
+
+/*
+ * Frames are copied into a ring buffer allocated and touched once at creation and written
+ * to the recording file by a dedicated thread. When the disk falls behind by more than the
+ * ring holds, new frames are dropped and counted; the acquisition thread never waits for
+ * the disk.
+ */
+#define RECORDER_DEFAULT_BUFFER_SIZE  (64 * 1024 * 1024)
+
+/**
+ * @brief  Counters of a recorder, see voxel3d_recorder_get_stats()
+ */
+struct RecorderStats {
+    unsigned long long frames_written[CAPTURE_STREAM_COUNT];
+    unsigned long long frames_dropped[CAPTURE_STREAM_COUNT];
+    unsigned long long bytes_written;     /**< payload bytes handed to the file writer */
+    unsigned long long bytes_dropped;
+    unsigned int buffer_size;
+    unsigned int queued_bytes;            /**< ring usage now */
+    unsigned int max_queued_bytes;        /**< ring usage high-water mark */
+    int write_failed;                     /**< the file writer failed, later frames are dropped */
+};
+
+typedef struct capture_recorder recorder_t;
+
+
+/**
+ * @brief       Create a recording file written by a background thread
+ * @param[in]   file_path: path of the file to create, an existing file is truncated
+ * @param[in]   dev_info: device description stored in the file header
+ * @param[in]   buffer_size: bytes of frames held for the writer thread, 0 for
+ *                           RECORDER_DEFAULT_BUFFER_SIZE. Size it for the longest disk
+ *                           stall to ride out, e.g. 1 s of all recorded streams
+ * @param[in]   flags: 0 or CAPTURE_FLAG_DIRECT_IO, see voxel3d_capture_create_ex()
+ * @return      recorder handle, NULL on failure
+ */
+extern "C" recorder_t *voxel3d_recorder_create(const char *file_path,
+                                               const CaptureDeviceInfo *dev_info,
+                                               unsigned int buffer_size, unsigned int flags);
+
+
+/**
+ * @brief       Select the payload encoding of a stream, see voxel3d_capture_set_codec()
+ * @note        Waits for the frame being written, call it before recording starts
+ * @param[in]   recorder: handle from voxel3d_recorder_create()
+ * @param[in]   stream: CaptureStream
+ * @param[in]   codec: CaptureCodec
+ * @return      true: codec selected
+ * @return      < 0: invalid parameter or write failure
+ */
+extern "C" int voxel3d_recorder_set_codec(recorder_t *recorder, unsigned int stream,
+                                          unsigned int codec);
+
+
+/**
+ * @brief       Queue a frame for recording
+ * @details     Copies the frame into the ring buffer and returns without waiting for the
+ *              disk. Safe to call from several threads, e.g. one per stream.
+ * @param[in]   recorder: handle from voxel3d_recorder_create()
+ * @param[in]   info: frame description, info->size bytes are read from data
+ * @param[in]   data: frame payload
+ * @return      true: frame queued
+ * @return      -1: invalid parameter
+ * @return      -2: frame dropped, ring buffer full or the file writer failed
+ */
+extern "C" int voxel3d_recorder_write_frame(recorder_t *recorder, const CaptureFrameInfo *info,
+                                            const void *data);
+
+
+/**
+ * @brief       Wait until all queued frames are written to the recording file
+ * @details     The file is synced to the disk as by voxel3d_capture_flush(), direct I/O
+ *              included, so the frames flushed survive a power loss
+ * @param[in]   recorder: handle from voxel3d_recorder_create()
+ * @return      true: queued frames written
+ * @return      < 0: invalid parameter or write failure
+ */
+extern "C" int voxel3d_recorder_flush(recorder_t *recorder);
+
+
+/**
+ * @brief       Read the counters of a recorder
+ * @param[in]   recorder: handle from voxel3d_recorder_create()
+ * @param[out]  stats: pointer of user-allocated structure
+ * @return      true: stats filled
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_recorder_get_stats(recorder_t *recorder, RecorderStats *stats);
+
+
+/**
+ * @brief       Write out all queued frames and close the recording file
+ * @param[in]   recorder: handle from voxel3d_recorder_create()
+ */
+extern "C" void voxel3d_recorder_close(recorder_t *recorder);
+
+#endif /* __VOXEL3D_RECORDER_H__ */
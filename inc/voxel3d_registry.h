@@ -0,0 +1,122 @@
+/**
+ @file      voxel3d_registry.h
+ @brief     Cached device list kept up to date by hotplug notifications
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_REGISTRY_H__
+#define __VOXEL3D_REGISTRY_H__
+
+#include "voxel3d.h"
+#include "voxel3d_backend.h"
+
+/*
+ * A registry scans once when it is opened and serves the device list from memory after
+ * that. A monitor thread rescans only when the OS reports a USB device arriving or leaving
+ * (kernel uevents on Linux, CM_Register_Notification() on Windows), once the burst of
+ * notifications of one plug has settled for REGISTRY_SETTLE_MS. The rescan is compared
+ * with the cached list and each difference is reported as an arrival or removal.
+ *
+ * Where hotplug notifications are not available (no permission for the uevent socket, or
+ * a backend without real devices such as replay / simulated), the monitor rescans every
+ * poll_interval_ms instead.
+ */
+#define REGISTRY_SETTLE_MS              (200)
+#define REGISTRY_DEFAULT_POLL_MS        (1000)
+
+#define REGISTRY_EVENT_ARRIVAL          (1)
+#define REGISTRY_EVENT_REMOVAL          (2)
+
+/* Flag of RegistryConfig.flags to rescan every poll_interval_ms even with hotplug */
+#define REGISTRY_FLAG_POLL              (0x1)
+
+/**
+ * @brief  Arrival / removal callback of a registry
+ * @note   Called from the monitor thread, or from voxel3d_registry_open() for the devices
+ *         found by the first scan. Don't call voxel3d_registry_close() from it.
+ * @param  user: RegistryConfig.user
+ * @param  event: REGISTRY_EVENT_ARRIVAL or REGISTRY_EVENT_REMOVAL
+ * @param  dev_sn: S/N of the device
+ */
+typedef void (*registry_event_cb)(void *user, int event, const char *dev_sn);
+
+/**
+ * @brief  Structure used in voxel3d_registry_open() to configure the registry
+ */
+struct RegistryConfig {
+    const DeviceBackend *backend;       /**< NULL for voxel3d_device_backend() */
+    registry_event_cb event_cb;         /**< NULL for none */
+    void *user;
+    unsigned int poll_interval_ms;      /**< rescan period without hotplug, 0 for the default */
+    unsigned int flags;                 /**< 0 or REGISTRY_FLAG_POLL */
+};
+
+typedef struct registry registry_t;
+
+
+/**
+ * @brief       Scan the devices once and start watching for hotplug
+ * @param[in]   config: backend and callback, NULL for voxel3d_device_backend() without one
+ * @return      registry handle, NULL on failure
+ */
+extern "C" registry_t *voxel3d_registry_open(const RegistryConfig *config);
+
+
+/**
+ * @brief       Read the cached device list
+ * @note        Same content as voxel3d_scan() fills in, without enumerating the devices
+ * @param[in]   reg: handle from voxel3d_registry_open()
+ * @param[out]  cam_dev_info: pointer of user-allocated structure
+ * @return      >= 0: number of devices
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_registry_get_devices(registry_t *reg, CamDevInfo *cam_dev_info);
+
+
+/**
+ * @brief       Check if a device is in the cached list
+ * @param[in]   reg: handle from voxel3d_registry_open()
+ * @param[in]   dev_sn: device S/N
+ * @return      true: present
+ * @return      0: not present
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_registry_has_device(registry_t *reg, const char *dev_sn);
+
+
+/**
+ * @brief       Wait for a change of the device list
+ * @param[in]   reg: handle from voxel3d_registry_open()
+ * @param[in]   generation: value returned by the previous call, 0 at first
+ * @param[in]   timeout_ms: longest wait, 0 to return at once
+ * @return      > 0: current generation, it differs from generation when the list changed
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_registry_wait(registry_t *reg, int generation, unsigned int timeout_ms);
+
+
+/**
+ * @brief       Rescan now, e.g. after a device was power cycled
+ * @param[in]   reg: handle from voxel3d_registry_open()
+ * @return      >= 0: number of devices
+ * @return      < 0: invalid parameter or scan failure
+ */
+extern "C" int voxel3d_registry_rescan(registry_t *reg);
+
+
+/**
+ * @brief       Check if the registry is driven by hotplug notifications
+ * @param[in]   reg: handle from voxel3d_registry_open()
+ * @return      true: hotplug, 0: polling
+ */
+extern "C" int voxel3d_registry_hotplug(registry_t *reg);
+
+
+/**
+ * @brief       Stop the monitor thread and release the registry
+ * @param[in]   reg: handle from voxel3d_registry_open()
+ */
+extern "C" void voxel3d_registry_close(registry_t *reg);
+
+#endif /* __VOXEL3D_REGISTRY_H__ */
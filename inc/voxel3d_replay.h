@@ -0,0 +1,123 @@
+/**
+ @file      voxel3d_replay.h
+ @brief     Replay of recorded 5Voxel 5VHiRab streams through the voxel3d_* device APIs
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_REPLAY_H__
+#define __VOXEL3D_REPLAY_H__
+
+#include "voxel3d.h"
+#include "voxel3d_backend.h"
+
+/**
+ * @brief  Structure used in voxel3d_replay_open() to select the playback clock
+ */
+enum ReplayMode
+{
+    REPLAY_RECORDED_TIMING = 0,       /**< frames are released at their recorded timing */
+    REPLAY_AS_FAST_AS_POSSIBLE = 1,   /**< every ToF query returns the next frame */
+    REPLAY_FIXED_RATE = 2,            /**< recorded timing rescaled to a fixed ToF frame rate */
+};
+
+/**
+ * @brief  Flag OR-ed into the mode of voxel3d_replay_open() to restart from the first
+ *         frame once the ToF stream is exhausted
+ */
+#define REPLAY_LOOP                   (0x100)
+
+
+/**
+ * @brief       Open a recording as a replay device
+ * @details     The replay device is addressed by dev_sn in the voxel3d_replay_* calls, the
+ *              same way as a live device. Streams follow one playback clock:
+ *              - REPLAY_RECORDED_TIMING: wall clock since open
+ *              - REPLAY_FIXED_RATE: wall clock scaled so the ToF stream runs at fixed_fps
+ *              - REPLAY_AS_FAST_AS_POSSIBLE: timestamp of the last ToF frame returned, so
+ *                RGB / thermal / IMU stay aligned with depth however fast it is pulled.
+ *                Recordings without ToF return the next frame of each stream on every call
+ *              Like a live device, RGB / thermal / ToF queries skip to the newest due frame.
+ *              IMU samples are never skipped; voxel3d_replay_read_imu_data() returns them
+ *              one by one in recorded order once due.
+ * @param[in]   dev_sn: S/N to address the replay device with. NULL pointer or empty string
+ *                      uses the S/N stored in the recording. Either way it must not
+ *                      address a replay device already open
+ * @param[in]   file_path: recording created with voxel3d_capture_create()
+ * @param[in]   mode: ReplayMode, optionally OR-ed with REPLAY_LOOP
+ * @param[in]   fixed_fps: ToF frame rate for REPLAY_FIXED_RATE, ignored otherwise
+ * @return      true: replay device opened
+ * @return      < 0: invalid parameter, S/N empty or already open, file error, or all
+ *                   MAX_SUPPORTED_CAMERA_MODULE replay devices in use
+ */
+extern "C" int voxel3d_replay_open(char *dev_sn, const char *file_path, int mode, float fixed_fps);
+
+
+/**
+ * @brief       Close a replay device
+ * @param[in]   dev_sn: S/N given to voxel3d_replay_open(). NULL pointer or empty string
+ *                      closes the 1st opened replay device
+ */
+extern "C" void voxel3d_replay_close(char *dev_sn);
+
+
+/**
+ * @brief       Replay counterpart of voxel3d_tof_queryframe()
+ * @return      > 0: recorded frame count
+ * @return      = 0: no new frame due, or end of recording
+ */
+extern "C" unsigned int voxel3d_replay_tof_queryframe(char *dev_sn,
+                                                      unsigned short *depthmap,
+                                                      unsigned short *irmap);
+
+
+/**
+ * @brief       Replay counterpart of voxel3d_tof_generatePointCloud()
+ * @details     Uses the ToF camera info stored in the recording
+ */
+extern "C" int voxel3d_replay_tof_generatePointCloud(char *dev_sn,
+                                                     unsigned short *depthmap,
+                                                     float *xyz);
+
+
+/**
+ * @brief       Replay counterpart of voxel3d_lepton3_queryframe()
+ * @note        Buffer size follows the rectify type set on the replay device, recorded
+ *              frames of another size are skipped
+ */
+extern "C" unsigned int voxel3d_replay_lepton3_queryframe(char *dev_sn, float *thermal_map);
+
+
+/**
+ * @brief       Replay counterpart of voxel3d_rgb_queryframe()
+ * @note        Buffer size follows the rectify type set on the replay device, recorded
+ *              frames of another size are skipped
+ */
+extern "C" unsigned int voxel3d_replay_rgb_queryframe(char *dev_sn, unsigned char *rgb_map);
+
+
+/**
+ * @brief       Replay counterpart of voxel3d_read_imu_data()
+ */
+extern "C" int voxel3d_replay_read_imu_data(char *dev_sn, IMU_DATA *imu_data);
+
+
+/**
+ * @brief       Replay counterpart of voxel3d_tof_read_camera_info()
+ */
+extern "C" int voxel3d_replay_tof_read_camera_info(char *dev_sn, CameraInfo *cam_info);
+
+
+/**
+ * @brief       Get the backend table bound to the replay APIs
+ * @note        scan lists the opened replay devices. The *_init entries succeed only on
+ *              an opened replay device, *_release entries are no-ops (use
+ *              voxel3d_replay_close()). set_rectifyType succeeds only for NONE and the
+ *              rectify type the recording was made with. HFoV / VFoV are derived from the
+ *              recorded ToF camera info; sensor settings, F/W build date and F/W upgrade are
+ *              not available and fail.
+ * @return      pointer to a static table, never NULL
+ */
+extern "C" const DeviceBackend *voxel3d_replay_backend(void);
+
+#endif /* __VOXEL3D_REPLAY_H__ */
@@ -0,0 +1,104 @@
+/**
+ @file      voxel3d_simulated.h
+ @brief     Simulated 5Voxel 5VHiRab devices behind the voxel3d_* device APIs
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_SIMULATED_H__
+#define __VOXEL3D_SIMULATED_H__
+
+#include "voxel3d.h"
+#include "voxel3d_backend.h"
+
+/*
+ * Simulated devices are named SIM00, SIM01, ... and render a fixed scene (floor, back wall
+ * and a box moving across the view) with the intrinsics of SIMULATED_FOCAL_LENGTH. Each
+ * device runs on its own clock: frames and IMU samples are produced at their nominal rate
+ * in device time, which drifts against the host clock by up to clock_drift_ppm and starts
+ * from a per-device offset.
+ *
+ * A ToF query blocks until the device's next frame is produced, then for transfer_us to
+ * model the USB transfer, like a live device polled from its own thread. A query that
+ * comes later than one frame period skips to the newest frame. RGB / thermal queries and
+ * IMU reads never block and return 0 when nothing new is produced. IMU reads drain a FIFO
+ * of 1 s of samples, or with imu_newest_only return the newest sample again and again
+ * like the vendor library, losing whatever a reader misses. Sensor init blocks for
+ * init_ms, as the firmware of a live device takes a while to start a sensor.
+ *
+ * A F/W upgrade checks that the image file can be read, then reports its progress through
+ * the callback and the state poll over fw_upgrade_ms. The F/W version doesn't change, as
+ * a real device only runs the new image after a power cycle.
+ *
+ * Faults injected with voxel3d_simulated_inject_fault() reproduce how a live device fails
+ * while streaming: SIMULATED_FAULT_DISCONNECT drops it off the bus for a while (scan
+ * doesn't list it, every init fails and it comes back with default settings), and
+ * SIMULATED_FAULT_STALL stops its ToF frames until the ToF sensor is initialized again.
+ *
+ * A device is at rest unless gyro_rate is set: then it tilts down and back up about its
+ * x axis once every SIMULATED_TILT_PERIOD_MS, the gyro following a sine up to gyro_rate
+ * and the accelerometer the direction of gravity, starting level. Only the IMU sees the
+ * motion, the rendered frames don't.
+ */
+#define SIMULATED_DEFAULT_FPS           (30.f)
+#define SIMULATED_DEFAULT_IMU_RATE      (200)
+#define SIMULATED_THERMAL_FPS           (9.f)
+#define SIMULATED_FOCAL_LENGTH          (500.f)
+#define SIMULATED_DEFAULT_FW_UPGRADE_MS (3000)
+#define SIMULATED_TILT_PERIOD_MS        (2000)
+
+#define SIMULATED_FAULT_DISCONNECT      (1)
+#define SIMULATED_FAULT_STALL           (2)
+
+/**
+ * @brief  Structure used in voxel3d_simulated_open() to describe the simulated devices
+ */
+struct SimulatedConfig {
+    unsigned int num_devices;       /**< 1 ~ MAX_SUPPORTED_CAMERA_MODULE */
+    float tof_fps;                  /**< ToF and RGB frame rate, 0 for SIMULATED_DEFAULT_FPS */
+    unsigned int imu_rate;          /**< IMU samples per second, 0 for SIMULATED_DEFAULT_IMU_RATE */
+    unsigned int transfer_us;       /**< time a ToF query spends transferring the frame */
+    float clock_drift_ppm;          /**< largest device clock drift against the host clock */
+    unsigned int fw_upgrade_ms;     /**< duration of a F/W upgrade, 0 for the default */
+    unsigned int init_ms;           /**< time a sensor init takes */
+    float gyro_rate;                /**< peak tilt rate in rad/s, 0 for devices at rest */
+    bool imu_newest_only;           /**< IMU reads return the newest sample, no FIFO */
+};
+
+
+/**
+ * @brief       Create the simulated devices, replacing any created before
+ * @param[in]   config: device description, NULL for 1 device with default rates
+ * @return      > 0: number of simulated devices
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_simulated_open(const SimulatedConfig *config);
+
+
+/**
+ * @brief       Remove all simulated devices
+ */
+extern "C" void voxel3d_simulated_close(void);
+
+
+/**
+ * @brief       Inject a fault into a simulated device
+ * @param[in]   dev_sn: S/N of the device
+ * @param[in]   fault: SIMULATED_FAULT_DISCONNECT or SIMULATED_FAULT_STALL
+ * @param[in]   duration_ms: time the device stays off the bus with SIMULATED_FAULT_DISCONNECT
+ * @return      true: fault injected
+ * @return      < 0: invalid parameter or no such device
+ */
+extern "C" int voxel3d_simulated_inject_fault(const char *dev_sn, int fault,
+                                              unsigned int duration_ms);
+
+
+/**
+ * @brief       Get the backend table bound to the simulated devices
+ * @note        scan lists the simulated devices. Sensor settings are kept per device but
+ *              have no effect on the rendered frames.
+ * @return      pointer to a static table, never NULL
+ */
+extern "C" const DeviceBackend *voxel3d_simulated_backend(void);
+
+#endif /* __VOXEL3D_SIMULATED_H__ */
@@ -0,0 +1,207 @@
+/**
+ @file      voxel3d_sync.h
+ @brief     Device clock estimation and cross-device frameset matching
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_SYNC_H__
+#define __VOXEL3D_SYNC_H__
+
+#include "voxel3d.h"
+#include "voxel3d_acquisition.h"
+
+/*
+ * Clock estimator: maps a device clock onto the host clock (voxel3d_host_time_us()) by a
+ * least-squares line through the last `window` pairs of device timestamp and host arrival
+ * time. The line is then lowered onto the earliest arrival in the window, so transfer and
+ * scheduling delays, which only ever add to the arrival time, don't bias the mapping.
+ * Timestamps going backwards (device reset) restart the estimation.
+ */
+#define CLOCK_DEFAULT_WINDOW            (256)
+#define CLOCK_MIN_SAMPLES               (8)
+
+/**
+ * @brief  Current line of a clock estimator, see voxel3d_clock_get_estimate()
+ * @note   host_us = host_base_us + rate * (device_us - device_base_us) + offset_us
+ */
+struct ClockEstimate {
+    unsigned long long device_base_us;
+    unsigned long long host_base_us;
+    double rate;                        /**< host microseconds per device microsecond */
+    double offset_us;
+    double jitter_us;                   /**< RMS of arrivals above the line */
+    unsigned int samples;
+};
+
+typedef struct clock_estimator clock_estimator_t;
+
+
+/**
+ * @brief       Create a clock estimator
+ * @param[in]   window: number of latest samples fitted, 0 for CLOCK_DEFAULT_WINDOW
+ * @return      estimator handle, NULL on failure
+ */
+extern "C" clock_estimator_t *voxel3d_clock_create(unsigned int window);
+
+
+/**
+ * @brief       Add a device timestamp and the host time it arrived at
+ * @param[in]   clk: handle from voxel3d_clock_create()
+ * @param[in]   device_us: device timestamp in microseconds, unwrapped
+ * @param[in]   host_us: voxel3d_host_time_us() when the data carrying it arrived
+ * @return      true: sample added
+ * @return      0: device_us went backwards, the estimation restarted from this sample
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_clock_add(clock_estimator_t *clk, unsigned long long device_us,
+                                 unsigned long long host_us);
+
+
+/**
+ * @brief       Convert a device timestamp to the host clock
+ * @param[in]   clk: handle from voxel3d_clock_create()
+ * @param[in]   device_us: device timestamp in microseconds, unwrapped
+ * @param[out]  host_us: host time of device_us
+ * @return      true: converted
+ * @return      < 0: invalid parameter or fewer than CLOCK_MIN_SAMPLES samples yet
+ */
+extern "C" int voxel3d_clock_to_host(clock_estimator_t *clk, unsigned long long device_us,
+                                     unsigned long long *host_us);
+
+
+/**
+ * @brief       Convert a host time to the device clock
+ * @param[in]   clk: handle from voxel3d_clock_create()
+ * @param[in]   host_us: voxel3d_host_time_us() based time
+ * @param[out]  device_us: device timestamp of host_us, unwrapped
+ * @return      true: converted
+ * @return      < 0: invalid parameter or fewer than CLOCK_MIN_SAMPLES samples yet
+ */
+extern "C" int voxel3d_clock_to_device(clock_estimator_t *clk, unsigned long long host_us,
+                                       unsigned long long *device_us);
+
+
+/**
+ * @brief       Read the current line of an estimator
+ * @param[in]   clk: handle from voxel3d_clock_create()
+ * @param[out]  estimate: pointer of user-allocated structure
+ * @return      true: estimate filled
+ * @return      < 0: invalid parameter or fewer than CLOCK_MIN_SAMPLES samples yet
+ */
+extern "C" int voxel3d_clock_get_estimate(clock_estimator_t *clk, ClockEstimate *estimate);
+
+
+/**
+ * @brief       Release a clock estimator
+ * @param[in]   clk: handle from voxel3d_clock_create()
+ */
+extern "C" void voxel3d_clock_destroy(clock_estimator_t *clk);
+
+
+/*
+ * Frameset matching: framesets popped from an acquisition get a capture time on the host
+ * clock from their device's clock estimator (ToF frame count at the nominal frame rate is
+ * the device clock). Framesets of different devices whose capture times lie within the
+ * tolerance are handed out together; older ones that can no longer be matched are given
+ * back to the acquisition and counted.
+ */
+#define SYNC_DEFAULT_MAX_WAIT_US        (100000)
+
+/**
+ * @brief  Structure used in voxel3d_sync_create() to set the matching rules
+ */
+struct SyncConfig {
+    float fps;                          /**< nominal ToF frame rate of the devices */
+    unsigned int tolerance_us;          /**< largest capture time difference within a match,
+                                             0 for half a frame period */
+    unsigned int min_devices;           /**< devices a partial match needs, 0 for all */
+    unsigned int max_wait_us;           /**< wait for missing devices before a partial match,
+                                             0 for SYNC_DEFAULT_MAX_WAIT_US */
+    unsigned int clock_window;          /**< see voxel3d_clock_create() */
+};
+
+/**
+ * @brief  Framesets of several devices captured at the same time
+ */
+struct SyncFrameset {
+    unsigned int num_devices;           /**< entries in frameset[], the acquisition's devices */
+    unsigned int matched;               /**< non-NULL entries */
+    unsigned long long host_ts_us;      /**< mean capture time of the matched framesets */
+    unsigned int spread_us;             /**< latest minus earliest capture time */
+    AcquisitionFrameset *frameset[MAX_SUPPORTED_CAMERA_MODULE];    /**< NULL: no match */
+    unsigned long long capture_ts_us[MAX_SUPPORTED_CAMERA_MODULE]; /**< on the host clock */
+};
+
+/**
+ * @brief  Counters of a sync, see voxel3d_sync_get_stats()
+ */
+struct SyncStats {
+    unsigned long long matches;
+    unsigned long long partial_matches;
+    unsigned long long unmatched;       /**< framesets given back without a match */
+};
+
+typedef struct frameset_sync sync_t;
+
+
+/**
+ * @brief       Create a frameset matcher on top of a running acquisition
+ * @param[in]   acq: handle from voxel3d_acquisition_start(), 3 or more framesets per
+ *                   device leave room for buffering while matching
+ * @param[in]   config: matching rules
+ * @return      sync handle, NULL on failure
+ */
+extern "C" sync_t *voxel3d_sync_create(acquisition_t *acq, const SyncConfig *config);
+
+
+/**
+ * @brief       Take the next matched framesets
+ * @warning     Pops from the acquisition, so it replaces voxel3d_acquisition_pop() and
+ *              shares its single-consumer restriction
+ * @param[in]   sync: handle from voxel3d_sync_create()
+ * @param[out]  group: pointer of user-allocated structure
+ * @param[in]   timeout_ms: longest wait for a match, 0 to return at once
+ * @return      true: group filled, hand it back with voxel3d_sync_release()
+ * @return      0: no match within timeout_ms
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_sync_next(sync_t *sync, SyncFrameset *group, unsigned int timeout_ms);
+
+
+/**
+ * @brief       Hand the framesets of a group back to the acquisition
+ * @param[in]   sync: handle from voxel3d_sync_create()
+ * @param[in]   group: group filled by voxel3d_sync_next()
+ */
+extern "C" void voxel3d_sync_release(sync_t *sync, SyncFrameset *group);
+
+
+/**
+ * @brief       Read the counters of a sync
+ * @param[in]   sync: handle from voxel3d_sync_create()
+ * @param[out]  stats: pointer of user-allocated structure
+ * @return      true: stats filled
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_sync_get_stats(sync_t *sync, SyncStats *stats);
+
+
+/**
+ * @brief       Read the clock estimate of one device
+ * @param[in]   sync: handle from voxel3d_sync_create()
+ * @param[in]   device: device index of the acquisition
+ * @param[out]  estimate: pointer of user-allocated structure
+ * @return      see voxel3d_clock_get_estimate()
+ */
+extern "C" int voxel3d_sync_get_clock(sync_t *sync, unsigned int device, ClockEstimate *estimate);
+
+
+/**
+ * @brief       Give buffered framesets back to the acquisition and release the sync
+ * @note        Call it before voxel3d_acquisition_stop()
+ * @param[in]   sync: handle from voxel3d_sync_create()
+ */
+extern "C" void voxel3d_sync_destroy(sync_t *sync);
+
+#endif /* __VOXEL3D_SYNC_H__ */
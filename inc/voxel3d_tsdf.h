@@ -0,0 +1,164 @@
+/**
+ @file      voxel3d_tsdf.h
+ @brief     TSDF volumetric fusion of the depth frames of 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_TSDF_H__
+#define __VOXEL3D_TSDF_H__
+
+#include "voxel3d.h"
+#include "voxel3d_parallel.h"
+
+/*
+ * A volume keeps a truncated signed distance (positive in front of the surface, towards the
+ * camera) and a weight per voxel, in blocks of TSDF_BLOCK_SIZE^3 voxels allocated where
+ * surfaces are seen and found through a hash of their coordinates, so the memory follows
+ * the scanned surface rather than the scanned space.
+ *
+ * 1. Integration allocates the blocks within truncation of the depth of every
+ *    TSDF_ALLOC_STRIDE-th pixel, then projects the voxels of those blocks into the depth
+ *    frame with the ToF camera info, lens distortion included, blocks in parallel.
+ * 2. Raycasting marches the ray of every pixel of a pose through the volume to the first
+ *    zero crossing, giving the model cloud and normals, e.g. to track the next frame.
+ *    Unallocated blocks and blocks of free space only are crossed in one step each, as
+ *    are blocks observed in front of the surface only but for their last sample. The
+ *    crossing found takes one trilinear sample, a Newton step whose gradient is the normal
+ *    too. A ray grazing a surface gives up after a bounded number of samples, which
+ *    voxel3d_tsdf_raycast_gave_up() tells apart from a miss.
+ * 3. The mesh is kept per block: an update runs marching cubes on the blocks integrated
+ *    since the last update only, and their neighbours sharing cells with them.
+ *
+ * Poses are 3x4 row-major [R | t] matrices taking camera points to the world, a point of a
+ * depth pixel being (x * z, y * z, z) in the camera as for voxel3d_pointcloud_generate().
+ *
+ * Raycasting and meshing aren't real time on one core: on one 2.1 GHz core, a 640x480
+ * raycast takes about 100 ms of a still scene and 180 ms when a moving surface has left a
+ * thick band of positive voxels to march through, and meshing the blocks of a frame about
+ * 45 ms. Both spread over a pool by rows / blocks, so a 30 fps loop needs several cores or
+ * a raycast every few frames.
+ */
+#define TSDF_BLOCK_SIZE                 (8)         /* voxels per block side */
+#define TSDF_ALLOC_STRIDE               (4)         /* pixels */
+#define TSDF_DEFAULT_VOXEL              (0.01f)     /* meters */
+#define TSDF_DEFAULT_TRUNCATION_VOXELS  (4)
+#define TSDF_DEFAULT_MIN_DEPTH          (0.1f)      /* meters */
+#define TSDF_DEFAULT_MAX_DEPTH          (4.f)       /* meters */
+#define TSDF_DEFAULT_MAX_WEIGHT         (64)
+#define TSDF_DEFAULT_MAX_BLOCKS         (65536)     /* 2 KB per block */
+
+/**
+ * @brief  Structure used in voxel3d_tsdf_create() to set up the volume, 0 for defaults
+ */
+struct TsdfConfig {
+    float voxel;                        /**< voxel size in meters */
+    float truncation;                   /**< meters, default TSDF_DEFAULT_TRUNCATION_VOXELS
+                                             voxels */
+    float min_depth;                    /**< nearer depth isn't integrated nor raycast */
+    float max_depth;                    /**< farther depth isn't integrated nor raycast */
+    unsigned int max_weight;            /**< frames averaged before the oldest fade, < 65536 */
+    unsigned int max_blocks;            /**< memory bound, blocks beyond aren't allocated */
+};
+
+typedef struct tsdf_volume tsdf_volume_t;
+
+
+/**
+ * @brief       Create an empty volume
+ * @param[in]   cam_info: ToF camera info, e.g. from voxel3d_tof_read_camera_info()
+ * @param[in]   config: voxel size, truncation and limits, NULL for defaults
+ * @return      volume handle, NULL on invalid parameter
+ */
+extern "C" tsdf_volume_t *voxel3d_tsdf_create(const CameraInfo *cam_info,
+                                              const TsdfConfig *config);
+
+
+/**
+ * @brief       Fuse a depth frame into the volume
+ * @param[in]   vol: handle from voxel3d_tsdf_create()
+ * @param[in]   depthmap: depth frame, e.g. from voxel3d_tof_queryframe()
+ * @param[in]   pose: 3x4 row-major camera to world matrix, NULL for the identity
+ * @param[in]   pool: handle from voxel3d_parallel_create(), NULL for the calling thread
+ * @return      >= 0: number of blocks integrated
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_tsdf_integrate(tsdf_volume_t *vol, const unsigned short *depthmap,
+                                      const float *pose, parallel_t *pool);
+
+
+/**
+ * @brief       Render the surface seen from a pose
+ * @param[in]   vol: handle from voxel3d_tsdf_create()
+ * @param[in]   pose: 3x4 row-major camera to world matrix, NULL for the identity
+ * @param[in]   pool: handle from voxel3d_parallel_create(), NULL for the calling thread
+ * @param[out]  xyz: pointer of user-allocated buffer of TOF_DEPTH_PIXELS * 3 floats, world
+ *                   points, (0, 0, 0) where the ray misses the surface or gives up
+ * @param[out]  normals: pointer of user-allocated buffer of TOF_DEPTH_PIXELS * 3 floats,
+ *                       unit world normals towards the camera, or NULL
+ * @return      >= 0: number of pixels hitting the surface
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_tsdf_raycast(tsdf_volume_t *vol, const float *pose, parallel_t *pool,
+                                    float *xyz, float *normals);
+
+
+/**
+ * @brief       Tell the rays of the last voxel3d_tsdf_raycast() that gave up along a surface
+ *              they graze from the ones that missed, both (0, 0, 0) in its cloud
+ * @param[in]   vol: handle from voxel3d_tsdf_create()
+ * @param[out]  gave_up: pointer of user-allocated buffer of TOF_DEPTH_PIXELS bytes, 1 where
+ *                       the ray gave up and 0 elsewhere, or NULL
+ * @return      >= 0: number of rays that gave up
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_tsdf_raycast_gave_up(tsdf_volume_t *vol, unsigned char *gave_up);
+
+
+/**
+ * @brief       Run marching cubes on the blocks changed since the last update
+ * @param[in]   vol: handle from voxel3d_tsdf_create()
+ * @param[in]   pool: handle from voxel3d_parallel_create(), NULL for the calling thread
+ * @return      >= 0: number of blocks meshed again
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_tsdf_update_mesh(tsdf_volume_t *vol, parallel_t *pool);
+
+
+/**
+ * @brief       Copy the mesh as of the last voxel3d_tsdf_update_mesh()
+ * @param[in]   vol: handle from voxel3d_tsdf_create()
+ * @param[out]  triangles: pointer of user-allocated buffer of max_triangles * 9 floats, 3
+ *                         world vertices per triangle, counter-clockwise seen from the
+ *                         front, or NULL to query the count
+ * @param[in]   max_triangles: size of triangles, the triangles beyond are left out
+ * @return      >= 0: number of triangles of the mesh
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_tsdf_get_mesh(tsdf_volume_t *vol, float *triangles,
+                                     unsigned int max_triangles);
+
+
+/**
+ * @brief       Number of blocks allocated
+ * @param[in]   vol: handle from voxel3d_tsdf_create()
+ * @return      >= 0: blocks, up to TsdfConfig.max_blocks
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_tsdf_num_blocks(tsdf_volume_t *vol);
+
+
+/**
+ * @brief       Empty the volume, e.g. to start a new scan
+ * @param[in]   vol: handle from voxel3d_tsdf_create()
+ */
+extern "C" void voxel3d_tsdf_reset(tsdf_volume_t *vol);
+
+
+/**
+ * @brief       Release a volume
+ * @param[in]   vol: handle from voxel3d_tsdf_create()
+ */
+extern "C" void voxel3d_tsdf_destroy(tsdf_volume_t *vol);
+
+#endif /* __VOXEL3D_TSDF_H__ */
@@ -0,0 +1,75 @@
+/**
+ @file      voxel3d_voxelgrid.h
+ @brief     Voxel-grid downsampling of point clouds of 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+*/
+
+#ifndef __VOXEL3D_VOXELGRID_H__
+#define __VOXEL3D_VOXELGRID_H__
+
+#include "voxel3d.h"
+#include "voxel3d_parallel.h"
+
+/*
+ * Every occupied leaf x leaf x leaf voxel gives one point. Voxels are found by hashing
+ * their packed coordinates into open-addressing maps instead of sorting the points, so a
+ * frame costs one pass over the cloud plus one over the voxels:
+ *
+ * 1. The cloud is cut into one contiguous chunk per thread of the pool, each chunk fills
+ *    its own partial maps, one per partition of the hash space.
+ * 2. The partial maps of a partition are merged in chunk order, partitions in parallel.
+ * 3. The points of the voxels are written out, partitions in parallel.
+ *
+ * The voxels come out partition by partition, in the order their first point comes in a
+ * chunk. Points at (0, 0, 0), the invalid points of organized clouds, are skipped, as are
+ * points more than VOXELGRID_MAX_INDEX voxels away from the origin.
+ */
+#define VOXELGRID_CENTROID              (0)     /* mean of the points of a voxel */
+#define VOXELGRID_FIRST                 (1)     /* first point of a voxel in the cloud */
+#define VOXELGRID_MEDIAN                (2)     /* median of each coordinate, costs a scatter
+                                                   of the points by voxel and a selection */
+#define VOXELGRID_DEFAULT_LEAF          (0.02f) /* meters */
+#define VOXELGRID_MAX_INDEX             (1 << 20)
+
+/**
+ * @brief  Structure used in voxel3d_voxelgrid_create() to set up the filter
+ */
+struct VoxelGridConfig {
+    float leaf;                         /**< voxel size in meters, 0 for the default */
+    int mode;                           /**< VOXELGRID_CENTROID, _FIRST or _MEDIAN */
+};
+
+typedef struct voxel_grid voxel_grid_t;
+
+
+/**
+ * @brief       Create a voxel-grid filter, its maps grow to the largest cloud filtered
+ * @param[in]   config: leaf size and mode, NULL for defaults and centroids
+ * @return      filter handle, NULL on invalid parameter
+ */
+extern "C" voxel_grid_t *voxel3d_voxelgrid_create(const VoxelGridConfig *config);
+
+
+/**
+ * @brief       Downsample a point cloud
+ * @param[in]   grid: handle from voxel3d_voxelgrid_create()
+ * @param[in]   xyz: num_points points, e.g. from voxel3d_pointcloud_generate()
+ * @param[in]   num_points: points in xyz
+ * @param[in]   pool: handle from voxel3d_parallel_create(), NULL for the calling thread
+ * @param[out]  out: pointer of user-allocated buffer of num_points * 3 floats, one point
+ *                   per occupied voxel
+ * @return      >= 0: number of points filled in out
+ * @return      < 0: invalid parameter
+ */
+extern "C" int voxel3d_voxelgrid_filter(voxel_grid_t *grid, const float *xyz,
+                                        unsigned int num_points, parallel_t *pool, float *out);
+
+
+/**
+ * @brief       Release a voxel-grid filter
+ * @param[in]   grid: handle from voxel3d_voxelgrid_create()
+ */
+extern "C" void voxel3d_voxelgrid_destroy(voxel_grid_t *grid);
+
+#endif /* __VOXEL3D_VOXELGRID_H__ */
@@ -0,0 +1,913 @@
+/**
+ @file      voxel3d_acquisition.cpp
+ @brief     Thread-per-device acquisition and the shared frameset queue
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef PLAT_WINDOWS
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif /* PLAT_WINDOWS */
+
+#include "voxel3d_acquisition.h"
+#include "voxel3d_sync.h"
+
+#define CACHE_LINE_SIZE         (64)
+#define IDLE_SLEEP_US           (1000)
+#define RETRY_SLEEP_MS          (10)
+
+/*
+ * Bounded multi-producer / single-consumer queue of frameset pointers, after D. Vyukov's
+ * bounded queue. The slot of position p is free for the producer that claimed p once its
+ * sequence is p, and holds a frameset for the consumer once its sequence is p + 1.
+ * Every queue is sized for all framesets that can be in it at once, so a push never
+ * finds the queue full.
+ */
+struct QueueSlot {
+    std::atomic<uint64_t> sequence;
+    AcquisitionFrameset *frameset;
+};
+
+struct FramesetQueue {
+    std::unique_ptr<QueueSlot[]> slots;
+    uint64_t mask;
+    char pad0[CACHE_LINE_SIZE];
+    std::atomic<uint64_t> tail;                 /* next position claimed by a producer */
+    char pad1[CACHE_LINE_SIZE];
+    uint64_t head;                              /* next position popped, consumer only */
+    char pad2[CACHE_LINE_SIZE];
+};
+
+struct AcquisitionDevice {
+    acquisition_t *acq;
+    unsigned int index;
+    voxel3d_device_t *handle;
+    int cpu;                                    /* requested CPU */
+
+    std::vector<AcquisitionFrameset> framesets; /* pool, the last one is the drop target */
+    std::vector<unsigned short> tof_storage;
+    std::vector<unsigned char> rgb_storage;
+    std::vector<float> thermal_storage;
+    FramesetQueue free;                         /* released by the application */
+
+    unsigned long long sequence;                /* acquisition thread only */
+    unsigned int last_tof_count;
+    unsigned long long last_frame_us;           /* newest frame, or the latest re-init */
+    unsigned long long down_since_us;           /* last frame before a stall, 0 when none */
+    unsigned int attempts;
+
+    /* IMU thread only */
+    unsigned int last_imu_ts;
+    bool imu_seen;
+    unsigned long long imu_device_us;           /* last imu_ts, unwrapped */
+    orientation_filter_t *orientation;
+    IMU_DATA imu_batch[ACQUISITION_MAX_IMU_SAMPLES];
+    unsigned long long imu_batch_device_us[ACQUISITION_MAX_IMU_SAMPLES];   /* unwrapped */
+    unsigned long long imu_batch_host_us[ACQUISITION_MAX_IMU_SAMPLES];     /* of each read */
+    Orientation orientation_batch[ACQUISITION_MAX_IMU_SAMPLES];
+    std::atomic<bool> imu_restart;              /* set by a recovery, the counter restarts */
+
+    std::vector<IMU_DATA> imu_ring;             /* ACQUISITION_IMU_RING_SIZE */
+    unsigned long long imu_written;             /* under imu_lock */
+    unsigned long long imu_read;
+    unsigned long long imu_overruns;
+    std::mutex imu_lock;
+    clock_estimator_t *imu_clock;               /* IMU clock against the host clock, imu_lock */
+    clock_estimator_t *tof_clock;               /* ToF frame count against the host clock */
+    std::vector<Orientation> orientation_ring;  /* orientation after each imu_ring sample */
+    unsigned long long orientation_from;        /* first imu_ring sample with an orientation */
+    unsigned long long frameset_imu_from;       /* first imu_ring sample not in a frameset yet,
+                                                   acquisition thread only */
+    proximity_t *proximity;                     /* acquisition thread only */
+
+    std::atomic<unsigned long long> pushed;
+    std::atomic<unsigned long long> dropped;
+    std::atomic<unsigned long long> recoveries;
+    std::atomic<unsigned long long> last_downtime_us;
+    std::atomic<unsigned long long> blurred;
+    std::atomic<int> pinned_cpu;
+    std::thread thread;
+    std::thread imu_thread;
+};
+
+struct acquisition {
+    unsigned int streams;
+    unsigned int flags;
+    unsigned int stall_ms;
+    unsigned int retry_ms;
+    acquisition_event_cb event_cb;
+    void *user;
+    unsigned int exposure_us;
+    unsigned int frame_latency_us;
+    float max_gyro_rate;
+    std::mutex event_lock;                      /* one event_cb call at a time */
+    std::vector<std::unique_ptr<AcquisitionDevice>> devices;
+    FramesetQueue ready;
+    std::atomic<bool> stopping;
+
+    /* the consumer sleeps here when the queue is empty, producers only lock to wake it */
+    std::atomic<bool> waiting;
+    std::mutex wait_lock;
+    std::condition_variable wakeup;
+};
+
+/*
+ * Queue
+ */
+static void queue_init(FramesetQueue *queue, unsigned int capacity)
+{
+    uint64_t size = 1;
+
+    while (size < capacity)
+        size <<= 1;
+
+    queue->slots.reset(new QueueSlot[size]);
+    for (uint64_t ix = 0; ix < size; ix++)
+        queue->slots[ix].sequence.store(ix, std::memory_order_relaxed);
+    queue->mask = size - 1;
+    queue->tail.store(0, std::memory_order_relaxed);
+    queue->head = 0;
+}
+
+static void queue_push(FramesetQueue *queue, AcquisitionFrameset *frameset)
+{
+    uint64_t position = queue->tail.fetch_add(1, std::memory_order_relaxed);
+    QueueSlot *slot = &queue->slots[position & queue->mask];
+
+    /* only waits while the consumer is finishing the pop of the previous lap */
+    while (slot->sequence.load(std::memory_order_acquire) != position)
+        std::this_thread::yield();
+
+    slot->frameset = frameset;
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+static AcquisitionFrameset *queue_pop(FramesetQueue *queue)
+{
+    QueueSlot *slot = &queue->slots[queue->head & queue->mask];
+
+    if (slot->sequence.load(std::memory_order_acquire) != queue->head + 1)
+        return NULL;
+
+    AcquisitionFrameset *frameset = slot->frameset;
+    slot->sequence.store(queue->head + queue->mask + 1, std::memory_order_release);
+    queue->head++;
+    return frameset;
+}
+
+/*
+ * Acquisition threads
+ */
+static bool pin_current_thread(int cpu)
+{
+#ifdef PLAT_WINDOWS
+    if (cpu < 0 || cpu >= (int)(sizeof(DWORD_PTR) * 8))
+        return false;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#else /* PLAT_LINUX */
+    cpu_set_t set;
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif /* PLAT_WINDOWS */
+}
+
+static void wake_consumer(acquisition_t *acq)
+{
+    /* orders the push before reading waiting, pairs with the fence in pop */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!acq->waiting.load(std::memory_order_relaxed))
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(acq->wait_lock);
+    }
+    acq->wakeup.notify_one();
+}
+
+static void mark_stream(AcquisitionFrameset *frameset, unsigned int stream, unsigned int count)
+{
+    frameset->streams |= ACQUISITION_STREAM(stream);
+    frameset->frame_count[stream] = count;
+    frameset->host_ts_us[stream] = voxel3d_host_time_us();
+}
+
+/* Publish the batch of the IMU thread, the orientation is valid from its sample unseeded */
+static void imu_ring_put(AcquisitionDevice *dev, unsigned int count, unsigned int unseeded)
+{
+    std::lock_guard<std::mutex> guard(dev->imu_lock);
+    for (unsigned int ix = 0; ix < count; ix++) {
+        dev->imu_ring[(dev->imu_written + ix) % ACQUISITION_IMU_RING_SIZE] = dev->imu_batch[ix];
+        if (dev->imu_clock)
+            voxel3d_clock_add(dev->imu_clock, dev->imu_batch_device_us[ix],
+                              dev->imu_batch_host_us[ix]);
+    }
+    if (dev->orientation) {
+        for (unsigned int ix = 0; ix < count; ix++)
+            dev->orientation_ring[(dev->imu_written + ix) % ACQUISITION_IMU_RING_SIZE] =
+                dev->orientation_batch[ix];
+        if (unseeded)
+            dev->orientation_from = dev->imu_written + unseeded;
+    }
+    dev->imu_written += count;
+}
+
+/* Signed distance of two IMU timestamps, right across the 32-bit wrap */
+static int imu_ts_diff(unsigned int a, unsigned int b)
+{
+    return (int)(a - b);
+}
+
+static void interpolate_imu(const IMU_DATA *before, const IMU_DATA *after, unsigned int ts,
+                            IMU_DATA *imu)
+{
+    float t = (float)imu_ts_diff(ts, before->imu_ts) / imu_ts_diff(after->imu_ts, before->imu_ts);
+
+    imu->imu_ts = ts;
+    for (int axis = 0; axis < 3; axis++) {
+        imu->imu_accel[axis] = before->imu_accel[axis] +
+                               t * (after->imu_accel[axis] - before->imu_accel[axis]);
+        imu->imu_gyro[axis] = before->imu_gyro[axis] +
+                              t * (after->imu_gyro[axis] - before->imu_gyro[axis]);
+    }
+}
+
+/* Ring position of the last sample at or before ts, the oldest one if none, under imu_lock */
+static unsigned long long imu_ring_find(AcquisitionDevice *dev, unsigned int ts)
+{
+    unsigned long long oldest = dev->imu_written > ACQUISITION_IMU_RING_SIZE ?
+                                dev->imu_written - ACQUISITION_IMU_RING_SIZE : 0;
+    unsigned long long pos = dev->imu_written;
+
+    while (pos > oldest) {
+        pos--;
+        if (imu_ts_diff(dev->imu_ring[pos % ACQUISITION_IMU_RING_SIZE].imu_ts, ts) <= 0)
+            break;
+    }
+    return pos;
+}
+
+static float gyro_rate(const IMU_DATA *imu)
+{
+    return sqrtf(imu->imu_gyro[0] * imu->imu_gyro[0] + imu->imu_gyro[1] * imu->imu_gyro[1] +
+                 imu->imu_gyro[2] * imu->imu_gyro[2]);
+}
+
+/* Tag the frameset blurred when the gyro went over max_gyro_rate during its exposure */
+static void gate_motion(AcquisitionDevice *dev, AcquisitionFrameset *frameset)
+{
+    acquisition_t *acq = dev->acq;
+    float peak = 0.f;
+
+    if (frameset->flags & ACQUISITION_FRAME_IMU_SYNCED) {
+        /* the samples bracketing the exposure, as voxel3d_acquisition_imu_slice() */
+        std::lock_guard<std::mutex> guard(dev->imu_lock);
+        for (unsigned long long pos = imu_ring_find(dev, frameset->exposure_imu_ts[0]);
+             pos < dev->imu_written; pos++) {
+            const IMU_DATA *imu = &dev->imu_ring[pos % ACQUISITION_IMU_RING_SIZE];
+            float rate = gyro_rate(imu);
+
+            peak = rate > peak ? rate : peak;
+            if (imu_ts_diff(imu->imu_ts, frameset->exposure_imu_ts[1]) >= 0)
+                break;
+        }
+    }
+    else {
+        for (unsigned int ix = 0; ix < frameset->imu_count; ix++) {
+            float rate = gyro_rate(&frameset->imu[ix]);
+
+            peak = rate > peak ? rate : peak;
+        }
+    }
+
+    frameset->peak_gyro = peak;
+    frameset->motion_weight = peak < acq->max_gyro_rate ? 1.f - peak / acq->max_gyro_rate : 0.f;
+    if (peak > acq->max_gyro_rate) {
+        frameset->flags |= ACQUISITION_FRAME_MOTION_BLUR;
+        dev->blurred.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/* Place the ToF exposure of the frameset on the IMU clock and interpolate at its middle */
+static void locate_exposure(AcquisitionDevice *dev, AcquisitionFrameset *frameset)
+{
+    acquisition_t *acq = dev->acq;
+    unsigned long long arrival_us, mid_us;
+
+    /* the arrival of the frame count on the fitted line drops the scheduling delay of
+       this query, which the host time it returned at still has */
+    if (voxel3d_clock_to_host(dev->tof_clock, frameset->frame_count[CAPTURE_STREAM_TOF],
+                              &arrival_us) <= 0)
+        return;
+
+    std::lock_guard<std::mutex> guard(dev->imu_lock);
+    if (voxel3d_clock_to_device(dev->imu_clock, arrival_us - acq->frame_latency_us -
+                                acq->exposure_us / 2, &mid_us) <= 0)
+        return;
+
+    unsigned int mid = (unsigned int)mid_us;
+    frameset->exposure_imu_ts[0] = mid - acq->exposure_us / 2;
+    frameset->exposure_imu_ts[1] = mid + (acq->exposure_us - acq->exposure_us / 2);
+    frameset->flags |= ACQUISITION_FRAME_IMU_SYNCED;
+
+    /* the newest pair of samples around mid-exposure, from the newest one backwards */
+    unsigned long long oldest = dev->imu_written > ACQUISITION_IMU_RING_SIZE ?
+                                dev->imu_written - ACQUISITION_IMU_RING_SIZE : 0;
+    for (unsigned long long pos = dev->imu_written; pos > oldest + 1; pos--) {
+        const IMU_DATA *after = &dev->imu_ring[(pos - 1) % ACQUISITION_IMU_RING_SIZE];
+        const IMU_DATA *before = &dev->imu_ring[(pos - 2) % ACQUISITION_IMU_RING_SIZE];
+
+        if (imu_ts_diff(after->imu_ts, mid) <= 0)
+            break;
+        if (imu_ts_diff(before->imu_ts, mid) <= 0) {
+            interpolate_imu(before, after, mid, &frameset->imu_mid_exposure);
+            frameset->flags |= ACQUISITION_FRAME_IMU_INTERPOLATED;
+            if (dev->orientation && pos - 2 >= dev->orientation_from) {
+                voxel3d_orientation_interpolate(
+                    &dev->orientation_ring[(pos - 2) % ACQUISITION_IMU_RING_SIZE],
+                    &dev->orientation_ring[(pos - 1) % ACQUISITION_IMU_RING_SIZE],
+                    (float)imu_ts_diff(mid, before->imu_ts) /
+                    imu_ts_diff(after->imu_ts, before->imu_ts), &frameset->orientation);
+                frameset->orientation.imu_ts = mid;
+                frameset->flags |= ACQUISITION_FRAME_ORIENTATION;
+            }
+            break;
+        }
+    }
+}
+
+/*
+ * Read the new IMU samples of the device into the ring. A live device hands out only its
+ * newest sample per read, so this runs on a thread of its own: the acquisition thread
+ * spends most of a frame period blocked in the ToF query, and during a stall or a
+ * recovery it isn't reading at all.
+ */
+static unsigned int read_imu(AcquisitionDevice *dev)
+{
+    unsigned int count = 0, unseeded = 0;
+
+    if (dev->imu_restart.exchange(false, std::memory_order_acquire))
+        dev->imu_seen = false;
+
+    while (count < ACQUISITION_MAX_IMU_SAMPLES) {
+        IMU_DATA *imu = &dev->imu_batch[count];
+
+        /* a sample seen before means the device has nothing newer */
+        if (voxel3d_device_read_imu_data(dev->handle, imu) <= 0 ||
+            (dev->imu_seen && imu->imu_ts == dev->last_imu_ts))
+            break;
+
+        /* imu_ts is 32 bits of microseconds, it wraps every 71 minutes */
+        if (dev->imu_seen && imu_ts_diff(imu->imu_ts, dev->last_imu_ts) > 0)
+            dev->imu_device_us += imu->imu_ts - dev->last_imu_ts;
+        else
+            dev->imu_device_us = imu->imu_ts;
+        dev->imu_batch_device_us[count] = dev->imu_device_us;
+        dev->imu_batch_host_us[count] = voxel3d_host_time_us();
+        dev->last_imu_ts = imu->imu_ts;
+        dev->imu_seen = true;
+        if (dev->orientation) {
+            /* the filter reseeds itself after the restart of a recovery */
+            voxel3d_orientation_update(dev->orientation, imu);
+            if (voxel3d_orientation_get(dev->orientation, &dev->orientation_batch[count]) <= 0)
+                unseeded = count + 1;
+        }
+        count++;
+    }
+    if (count)
+        imu_ring_put(dev, count, unseeded);
+    return count;
+}
+
+static void imu_thread(AcquisitionDevice *dev)
+{
+    acquisition_t *acq = dev->acq;
+
+    if (dev->cpu != ACQUISITION_CPU_ANY)
+        pin_current_thread(dev->cpu);
+
+    while (!acq->stopping.load(std::memory_order_acquire)) {
+        /* a full batch means more samples are waiting */
+        if (read_imu(dev) < ACQUISITION_MAX_IMU_SAMPLES)
+            std::this_thread::sleep_for(std::chrono::microseconds(IDLE_SLEEP_US));
+    }
+}
+
+/* Hand the newest ring samples since the previous frameset to this one */
+static void take_imu(AcquisitionDevice *dev, AcquisitionFrameset *frameset)
+{
+    std::lock_guard<std::mutex> guard(dev->imu_lock);
+    unsigned long long from = dev->frameset_imu_from;
+
+    /* older ones than fit are left to voxel3d_acquisition_read_imu_batch() */
+    if (dev->imu_written - from > ACQUISITION_MAX_IMU_SAMPLES)
+        from = dev->imu_written - ACQUISITION_MAX_IMU_SAMPLES;
+    for (unsigned long long pos = from; pos < dev->imu_written; pos++)
+        frameset->imu[frameset->imu_count++] = dev->imu_ring[pos % ACQUISITION_IMU_RING_SIZE];
+    dev->frameset_imu_from = dev->imu_written;
+
+    if (dev->orientation && dev->imu_written > dev->orientation_from) {
+        frameset->orientation =
+            dev->orientation_ring[(dev->imu_written - 1) % ACQUISITION_IMU_RING_SIZE];
+        frameset->flags |= ACQUISITION_FRAME_ORIENTATION;
+    }
+}
+
+/* One pass over the device's streams, false when nothing new arrived */
+static bool acquire_frameset(AcquisitionDevice *dev, AcquisitionFrameset *frameset)
+{
+    unsigned int streams = dev->acq->streams;
+    unsigned int count;
+
+    frameset->streams = 0;
+    frameset->imu_count = 0;
+    frameset->flags = 0;
+    frameset->peak_gyro = 0.f;
+    frameset->motion_weight = 1.f;
+    memset(frameset->frame_count, 0, sizeof(frameset->frame_count));
+    memset(frameset->host_ts_us, 0, sizeof(frameset->host_ts_us));
+
+    if (streams & ACQUISITION_STREAM(CAPTURE_STREAM_TOF)) {
+        count = voxel3d_device_tof_queryframe(dev->handle, frameset->depthmap, frameset->irmap);
+        if (!count || count == dev->last_tof_count)
+            return false;
+        dev->last_tof_count = count;
+        mark_stream(frameset, CAPTURE_STREAM_TOF, count);
+        if (dev->tof_clock)
+            voxel3d_clock_add(dev->tof_clock, count, frameset->host_ts_us[CAPTURE_STREAM_TOF]);
+    }
+
+    if ((streams & ACQUISITION_STREAM(CAPTURE_STREAM_RGB)) &&
+        (count = voxel3d_device_rgb_queryframe(dev->handle, frameset->rgb_map)))
+        mark_stream(frameset, CAPTURE_STREAM_RGB, count);
+
+    if ((streams & ACQUISITION_STREAM(CAPTURE_STREAM_THERMAL)) &&
+        (count = voxel3d_device_lepton3_queryframe(dev->handle, frameset->thermal_map)))
+        mark_stream(frameset, CAPTURE_STREAM_THERMAL, count);
+
+    if (streams & ACQUISITION_STREAM(CAPTURE_STREAM_IMU)) {
+        take_imu(dev, frameset);
+        if (frameset->imu_count)
+            mark_stream(frameset, CAPTURE_STREAM_IMU, frameset->imu_count);
+        if (dev->tof_clock && (frameset->streams & ACQUISITION_STREAM(CAPTURE_STREAM_TOF)))
+            locate_exposure(dev, frameset);
+        if (dev->acq->max_gyro_rate > 0.f)
+            gate_motion(dev, frameset);
+    }
+
+    return frameset->streams != 0;
+}
+
+static void report(AcquisitionDevice *dev, int type, int result, unsigned long long now)
+{
+    acquisition_t *acq = dev->acq;
+    AcquisitionEvent event;
+
+    if (!acq->event_cb)
+        return;
+
+    event.type = type;
+    event.device = dev->index;
+    event.dev_sn = voxel3d_device_sn(dev->handle);
+    event.host_ts_us = now;
+    event.attempts = dev->attempts;
+    event.result = result;
+    event.downtime_us = now - dev->down_since_us;
+
+    std::lock_guard<std::mutex> guard(acq->event_lock);
+    acq->event_cb(acq->user, &event);
+}
+
+/* Re-init the stalled device until its sensors are back, false if stopped meanwhile */
+static bool recover(AcquisitionDevice *dev)
+{
+    acquisition_t *acq = dev->acq;
+
+    /* a re-init that brings the sensors back without frames is one more stall of the same
+       outage, its downtime still counts from the last frame */
+    if (!dev->down_since_us) {
+        dev->down_since_us = dev->last_frame_us;
+        dev->attempts = 0;
+        report(dev, ACQUISITION_EVENT_STALL, 0, voxel3d_host_time_us());
+    }
+
+    for (;;) {
+        int ret = voxel3d_device_reinit(dev->handle);
+
+        dev->attempts++;
+        report(dev, ACQUISITION_EVENT_REINIT, ret, voxel3d_host_time_us());
+        if (ret > 0)
+            break;
+
+        /* short sleeps, so stopping the acquisition doesn't wait for retry_ms */
+        auto retry = std::chrono::steady_clock::now() + std::chrono::milliseconds(acq->retry_ms);
+        while (std::chrono::steady_clock::now() < retry) {
+            if (acq->stopping.load(std::memory_order_acquire))
+                return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(RETRY_SLEEP_MS));
+        }
+    }
+
+    /* the device restarts its frame and IMU counters */
+    dev->last_tof_count = 0;
+    dev->imu_restart.store(true, std::memory_order_release);
+    dev->last_frame_us = voxel3d_host_time_us();
+    return true;
+}
+
+static void acquisition_thread(AcquisitionDevice *dev)
+{
+    acquisition_t *acq = dev->acq;
+    AcquisitionFrameset *drop_target = &dev->framesets.back();
+    AcquisitionFrameset *frameset = NULL;
+
+    if (dev->cpu != ACQUISITION_CPU_ANY && pin_current_thread(dev->cpu))
+        dev->pinned_cpu.store(dev->cpu, std::memory_order_relaxed);
+
+    dev->last_frame_us = voxel3d_host_time_us();
+    while (!acq->stopping.load(std::memory_order_acquire)) {
+        if (!frameset)
+            frameset = queue_pop(&dev->free);
+
+        /* with every frameset held by the application the device is still drained */
+        if (!acquire_frameset(dev, frameset ? frameset : drop_target)) {
+            if (acq->stall_ms &&
+                voxel3d_host_time_us() - dev->last_frame_us > acq->stall_ms * 1000ULL) {
+                if (!recover(dev))
+                    break;
+                continue;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(IDLE_SLEEP_US));
+            continue;
+        }
+
+        dev->last_frame_us = voxel3d_host_time_us();
+        if (dev->down_since_us) {
+            unsigned long long downtime = dev->last_frame_us - dev->down_since_us;
+
+            report(dev, ACQUISITION_EVENT_RECOVERED, true, dev->last_frame_us);
+            dev->last_downtime_us.store(downtime, std::memory_order_relaxed);
+            dev->recoveries.fetch_add(1, std::memory_order_relaxed);
+            dev->down_since_us = 0;
+        }
+        if (!frameset) {
+            dev->dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        /* the frameset is filled again by the next pass */
+        if ((frameset->flags & ACQUISITION_FRAME_MOTION_BLUR) &&
+            (acq->flags & ACQUISITION_FLAG_DROP_BLURRED))
+            continue;
+        if (dev->proximity && (frameset->streams & ACQUISITION_STREAM(CAPTURE_STREAM_TOF)) &&
+            voxel3d_proximity_query(dev->proximity, frameset->depthmap, frameset->proximity) >= 0)
+            frameset->flags |= ACQUISITION_FRAME_PROXIMITY;
+
+        frameset->sequence = dev->sequence++;
+        dev->pushed.fetch_add(1, std::memory_order_relaxed);
+        queue_push(&acq->ready, frameset);
+        frameset = NULL;
+        wake_consumer(acq);
+    }
+}
+
+/*
+ * Set up / tear down
+ */
+static bool open_device(acquisition_t *acq, AcquisitionDevice *dev, char *dev_sn,
+                        const DeviceBackend *backend, unsigned int num_framesets,
+                        const OrientationConfig *orientation, const ProximityConfig *proximity)
+{
+    unsigned int streams = acq->streams;
+
+    dev->handle = voxel3d_device_open(dev_sn, backend);
+    if (!dev->handle)
+        return false;
+
+    if (((streams & ACQUISITION_STREAM(CAPTURE_STREAM_TOF)) &&
+         voxel3d_device_tof_init(dev->handle) <= 0) ||
+        ((streams & ACQUISITION_STREAM(CAPTURE_STREAM_RGB)) &&
+         voxel3d_device_rgb_init(dev->handle) <= 0) ||
+        ((streams & ACQUISITION_STREAM(CAPTURE_STREAM_THERMAL)) &&
+         voxel3d_device_lepton3_init(dev->handle) <= 0))
+        return false;
+
+    if ((streams & ACQUISITION_STREAM(CAPTURE_STREAM_TOF)) && proximity->num_zones) {
+        CameraInfo cam_info;
+
+        if (voxel3d_device_tof_read_camera_info(dev->handle, &cam_info) <= 0)
+            return false;
+        dev->proximity = voxel3d_proximity_create(&cam_info, proximity);
+        if (!dev->proximity)
+            return false;
+    }
+
+    /* buffers are touched now, a page fault in the acquisition path is a stall too */
+    unsigned int count = num_framesets + 1;
+    if (streams & ACQUISITION_STREAM(CAPTURE_STREAM_IMU)) {
+        IMU_DATA zero;
+
+        memset(&zero, 0, sizeof(zero));
+        dev->imu_ring.assign(ACQUISITION_IMU_RING_SIZE, zero);
+        if (orientation->filter != ORIENTATION_NONE) {
+            Orientation identity;
+
+            dev->orientation = voxel3d_orientation_create(orientation);
+            if (!dev->orientation)
+                return false;
+            memset(&identity, 0, sizeof(identity));
+            identity.q[0] = 1.f;
+            dev->orientation_ring.assign(ACQUISITION_IMU_RING_SIZE, identity);
+        }
+        if (streams & ACQUISITION_STREAM(CAPTURE_STREAM_TOF)) {
+            dev->imu_clock = voxel3d_clock_create(0);
+            dev->tof_clock = voxel3d_clock_create(0);
+        }
+    }
+    if (streams & ACQUISITION_STREAM(CAPTURE_STREAM_TOF))
+        dev->tof_storage.assign((size_t)count * TOF_DEPTH_PIXELS * 2, 0);
+    if (streams & ACQUISITION_STREAM(CAPTURE_STREAM_RGB))
+        dev->rgb_storage.assign((size_t)count * RGB_PIXELS * 3, 0);
+    if (streams & ACQUISITION_STREAM(CAPTURE_STREAM_THERMAL))
+        dev->thermal_storage.assign((size_t)count * TOF_DEPTH_PIXELS, 0.f);
+
+    dev->framesets.resize(count);
+    for (unsigned int ix = 0; ix < count; ix++) {
+        AcquisitionFrameset *frameset = &dev->framesets[ix];
+
+        memset(frameset, 0, sizeof(*frameset));
+        frameset->device = dev->index;
+        frameset->dev_sn = voxel3d_device_sn(dev->handle);
+        if (!dev->tof_storage.empty()) {
+            frameset->depthmap = &dev->tof_storage[(size_t)ix * TOF_DEPTH_PIXELS * 2];
+            frameset->irmap = frameset->depthmap + TOF_DEPTH_PIXELS;
+        }
+        if (!dev->rgb_storage.empty())
+            frameset->rgb_map = &dev->rgb_storage[(size_t)ix * RGB_PIXELS * 3];
+        if (!dev->thermal_storage.empty())
+            frameset->thermal_map = &dev->thermal_storage[(size_t)ix * TOF_DEPTH_PIXELS];
+    }
+
+    queue_init(&dev->free, num_framesets);
+    for (unsigned int ix = 0; ix < num_framesets; ix++)
+        queue_push(&dev->free, &dev->framesets[ix]);
+    return true;
+}
+
+static void destroy(acquisition_t *acq)
+{
+    acq->stopping.store(true, std::memory_order_release);
+    for (auto &dev : acq->devices) {
+        if (dev->thread.joinable())
+            dev->thread.join();
+        if (dev->imu_thread.joinable())
+            dev->imu_thread.join();
+    }
+    for (auto &dev : acq->devices) {
+        voxel3d_device_close(dev->handle);
+        voxel3d_clock_destroy(dev->imu_clock);
+        voxel3d_clock_destroy(dev->tof_clock);
+        voxel3d_orientation_destroy(dev->orientation);
+        voxel3d_proximity_destroy(dev->proximity);
+    }
+    delete acq;
+}
+
+/*
+ * Public APIs
+ */
+extern "C" acquisition_t *voxel3d_acquisition_start(const AcquisitionConfig *config)
+{
+    CamDevInfo scan_info;
+    const DeviceBackend *backend;
+    unsigned int num_devices, num_framesets;
+
+    if (!config || config->num_devices > MAX_SUPPORTED_CAMERA_MODULE)
+        return NULL;
+
+    backend = config->backend ? config->backend : voxel3d_device_backend();
+    num_devices = config->num_devices;
+    if (!num_devices) {
+        if (backend->scan(&scan_info) <= 0)
+            return NULL;
+        num_devices = (unsigned int)scan_info.num_of_devices;
+    }
+    num_framesets = config->framesets ? config->framesets : ACQUISITION_DEFAULT_FRAMESETS;
+
+    acquisition_t *acq = new acquisition_t;
+    acq->streams = config->streams ? config->streams :
+                   ACQUISITION_STREAM(CAPTURE_STREAM_TOF) | ACQUISITION_STREAM(CAPTURE_STREAM_IMU);
+    acq->flags = config->flags;
+    acq->stall_ms = config->stall_ms;
+    acq->retry_ms = config->retry_ms ? config->retry_ms : ACQUISITION_DEFAULT_RETRY_MS;
+    acq->event_cb = config->event_cb;
+    acq->user = config->user;
+    acq->exposure_us = config->exposure_us ? config->exposure_us : ACQUISITION_DEFAULT_EXPOSURE_US;
+    acq->frame_latency_us = config->frame_latency_us;
+    acq->max_gyro_rate = config->max_gyro_rate;
+    acq->stopping.store(false, std::memory_order_relaxed);
+    acq->waiting.store(false, std::memory_order_relaxed);
+    queue_init(&acq->ready, num_devices * num_framesets);
+
+    for (unsigned int ix = 0; ix < num_devices; ix++) {
+        char *dev_sn = config->num_devices ? (char *)config->dev_sn[ix] : scan_info.product_sn[ix];
+        AcquisitionDevice *dev = new AcquisitionDevice;
+
+        acq->devices.emplace_back(dev);
+        dev->acq = acq;
+        dev->index = ix;
+        dev->handle = NULL;
+        dev->cpu = (config->flags & ACQUISITION_FLAG_PIN_THREADS) ? config->cpu[ix] :
+                                                                    ACQUISITION_CPU_ANY;
+        dev->sequence = 0;
+        dev->last_imu_ts = 0;
+        dev->imu_seen = false;
+        dev->last_tof_count = 0;
+        dev->last_frame_us = 0;
+        dev->down_since_us = 0;
+        dev->attempts = 0;
+        dev->imu_written = 0;
+        dev->imu_read = 0;
+        dev->imu_overruns = 0;
+        dev->imu_clock = NULL;
+        dev->tof_clock = NULL;
+        dev->imu_device_us = 0;
+        dev->imu_restart.store(false, std::memory_order_relaxed);
+        dev->orientation = NULL;
+        dev->orientation_from = 0;
+        dev->frameset_imu_from = 0;
+        dev->proximity = NULL;
+        dev->pushed.store(0, std::memory_order_relaxed);
+        dev->dropped.store(0, std::memory_order_relaxed);
+        dev->recoveries.store(0, std::memory_order_relaxed);
+        dev->last_downtime_us.store(0, std::memory_order_relaxed);
+        dev->blurred.store(0, std::memory_order_relaxed);
+        dev->pinned_cpu.store(ACQUISITION_CPU_ANY, std::memory_order_relaxed);
+
+        if (!open_device(acq, dev, dev_sn, backend, num_framesets, &config->orientation,
+                         &config->proximity[ix])) {
+            destroy(acq);
+            return NULL;
+        }
+    }
+
+    /* every device is ready before any thread starts, so they start together */
+    for (auto &dev : acq->devices) {
+        if (!dev->imu_ring.empty())
+            dev->imu_thread = std::thread(imu_thread, dev.get());
+        dev->thread = std::thread(acquisition_thread, dev.get());
+    }
+    return acq;
+}
+
+extern "C" unsigned int voxel3d_acquisition_device_count(acquisition_t *acq)
+{
+    return acq ? (unsigned int)acq->devices.size() : 0;
+}
+
+extern "C" voxel3d_device_t *voxel3d_acquisition_get_device(acquisition_t *acq,
+                                                           unsigned int device)
+{
+    if (!acq || device >= acq->devices.size())
+        return NULL;
+
+    return acq->devices[device]->handle;
+}
+
+extern "C" AcquisitionFrameset *voxel3d_acquisition_pop(acquisition_t *acq,
+                                                        unsigned int timeout_ms)
+{
+    AcquisitionFrameset *frameset;
+
+    if (!acq)
+        return NULL;
+
+    frameset = queue_pop(&acq->ready);
+    if (frameset || !timeout_ms)
+        return frameset;
+
+    std::unique_lock<std::mutex> lock(acq->wait_lock);
+    acq->waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    acq->wakeup.wait_for(lock, std::chrono::milliseconds(timeout_ms), [acq, &frameset] {
+        return (frameset = queue_pop(&acq->ready)) != NULL;
+    });
+    acq->waiting.store(false, std::memory_order_relaxed);
+    return frameset;
+}
+
+extern "C" void voxel3d_acquisition_release(acquisition_t *acq, AcquisitionFrameset *frameset)
+{
+    if (!acq || !frameset || frameset->device >= acq->devices.size())
+        return;
+
+    queue_push(&acq->devices[frameset->device]->free, frameset);
+}
+
+extern "C" int voxel3d_acquisition_read_imu_batch(acquisition_t *acq, const char *dev_sn,
+                                                  IMU_DATA *imu_data, unsigned int max,
+                                                  unsigned int *count)
+{
+    AcquisitionDevice *dev = NULL;
+
+    if (!acq || !dev_sn || !imu_data || !count)
+        return -1;
+
+    for (auto &candidate : acq->devices) {
+        if (!strncmp(voxel3d_device_sn(candidate->handle), dev_sn, MAX_PRODUCT_SN_LEN)) {
+            dev = candidate.get();
+            break;
+        }
+    }
+    if (!dev || dev->imu_ring.empty())
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->imu_lock);
+    if (dev->imu_written - dev->imu_read > ACQUISITION_IMU_RING_SIZE) {
+        dev->imu_overruns += dev->imu_written - dev->imu_read - ACQUISITION_IMU_RING_SIZE;
+        dev->imu_read = dev->imu_written - ACQUISITION_IMU_RING_SIZE;
+    }
+
+    /* at most two copies, up to the end of the ring and from its start */
+    unsigned int pending = (unsigned int)(dev->imu_written - dev->imu_read);
+    unsigned int total = pending < max ? pending : max;
+    unsigned int start = (unsigned int)(dev->imu_read % ACQUISITION_IMU_RING_SIZE);
+    unsigned int first = ACQUISITION_IMU_RING_SIZE - start < total ?
+                         ACQUISITION_IMU_RING_SIZE - start : total;
+
+    memcpy(imu_data, &dev->imu_ring[start], first * sizeof(IMU_DATA));
+    memcpy(imu_data + first, &dev->imu_ring[0], (total - first) * sizeof(IMU_DATA));
+    dev->imu_read += total;
+    *count = total;
+    return true;
+}
+
+extern "C" int voxel3d_acquisition_imu_slice(acquisition_t *acq,
+                                             const AcquisitionFrameset *frameset,
+                                             IMU_DATA *imu_data, unsigned int max,
+                                             unsigned int *count)
+{
+    if (!acq || !frameset || !imu_data || !count || frameset->device >= acq->devices.size() ||
+        !(frameset->flags & ACQUISITION_FRAME_IMU_SYNCED))
+        return -1;
+
+    AcquisitionDevice *dev = acq->devices[frameset->device].get();
+    unsigned int start = frameset->exposure_imu_ts[0];
+    unsigned int end = frameset->exposure_imu_ts[1];
+
+    std::lock_guard<std::mutex> guard(dev->imu_lock);
+    unsigned long long first = imu_ring_find(dev, start);
+
+    *count = 0;
+    for (unsigned long long pos = first; pos < dev->imu_written && *count < max; pos++) {
+        const IMU_DATA *imu = &dev->imu_ring[pos % ACQUISITION_IMU_RING_SIZE];
+
+        imu_data[(*count)++] = *imu;
+        if (imu_ts_diff(imu->imu_ts, end) >= 0)
+            break;
+    }
+    return true;
+}
+
+extern "C" int voxel3d_acquisition_get_stats(acquisition_t *acq, unsigned int device,
+                                             AcquisitionStats *stats)
+{
+    if (!acq || !stats || device >= acq->devices.size())
+        return -1;
+
+    AcquisitionDevice *dev = acq->devices[device].get();
+    stats->framesets = dev->pushed.load(std::memory_order_relaxed);
+    stats->dropped = dev->dropped.load(std::memory_order_relaxed);
+    stats->cpu = dev->pinned_cpu.load(std::memory_order_relaxed);
+    stats->recoveries = dev->recoveries.load(std::memory_order_relaxed);
+    stats->last_downtime_us = dev->last_downtime_us.load(std::memory_order_relaxed);
+    stats->blurred = dev->blurred.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> guard(dev->imu_lock);
+    stats->imu_samples = dev->imu_written;
+    stats->imu_overruns = dev->imu_overruns;
+    return true;
+}
+
+extern "C" void voxel3d_acquisition_stop(acquisition_t *acq)
+{
+    if (!acq)
+        return;
+
+    destroy(acq);
+}
@@ -23,6 +23,14 @@
 #include "opencv2/calib3d/calib3d.hpp"
 
 #include "voxel3d.h"
+#include "voxel3d_backend.h"
+#include "voxel3d_calibration.h"
+#include "voxel3d_capture.h"
+#include "voxel3d_device.h"
+#include "voxel3d_fw_upgrade.h"
+#include "voxel3d_recorder.h"
+#include "voxel3d_registry.h"
+#include "voxel3d_replay.h"
 
 #define TOOLS_VER_MAJOR         (1)
 #define TOOLS_VER_MINOR         (5)
@@ -32,11 +40,7 @@
 
 #define M_PI                    (3.141592653589793f)
 
-#ifdef PLAT_WINDOWS
-#define SleepSeconds(x)        Sleep(x * 1000)
-#else /* PLAT_LINUX */
-#define SleepSeconds(x)        sleep(x)
-#endif /* PLAT_WINDOWS */
+#define FW_PROGRESS_INTERVAL_MS (500)
 
 #define BYTE_SWAP_16(x)  \
            (((unsigned short)(x & 0x00ff) << 8) + ((unsigned short)(x & 0xff00) >> 8))
@@ -48,8 +52,19 @@ static unsigned short   tof_depth[TOF_DEPTH_PIXELS];
 static unsigned short   tof_ir[TOF_IR_PIXELS];
 static unsigned short   tof_flir[FLIR_PIXELS];
 static float            pointCloudXYZ[TOF_DEPTH_PIXELS * 3];
+static unsigned short   tof_record[TOF_DEPTH_PIXELS * 2];
 static int              iWaitKey = 0;
 
+static const DeviceBackend *backend = voxel3d_device_backend();
+static voxel3d_device_t *device = NULL;
+static recorder_t       *recorder = NULL;
+static char             *record_file = NULL;
+static unsigned int     record_flags = 0;
+static char             *replay_file = NULL;
+static float            replay_fps = -1.f;
+static char             *calib_cache_dir = NULL;
+static calibration_t    *calibration = NULL;
+
 static bool m_doRGBDRectify = false;
 static bool m_doTDRectify = false;
 
@@ -102,6 +117,64 @@ static unsigned char fw_upgrade_cb(int state, unsigned int percent_complete)
     return (1);
 }
 
+static void record_frame(unsigned int stream, unsigned int frame_count,
+                         unsigned int width, unsigned int height,
+                         unsigned int size, const void *data)
+{
+    CaptureFrameInfo info;
+
+    if (!recorder)
+        return;
+
+    info.stream = stream;
+    info.frame_count = frame_count;
+    info.host_ts_us = voxel3d_host_time_us();
+    info.width = width;
+    info.height = height;
+    info.size = size;
+    voxel3d_recorder_write_frame(recorder, &info, data);
+}
+
+static void start_recording(voxel3d_device_t *dev)
+{
+    CaptureDeviceInfo cap_info;
+
+    memset(&cap_info, 0x0, sizeof(cap_info));
+    strncpy(cap_info.product_sn, voxel3d_device_sn(dev), MAX_PRODUCT_SN_LEN - 1);
+    voxel3d_device_read_fw_version(dev, cap_info.fw_version, sizeof(cap_info.fw_version));
+    voxel3d_device_tof_read_camera_info(dev, &cap_info.tof_cam_info);
+    voxel3d_device_rgb_read_camera_info(dev, &cap_info.rgb_cam_info);
+    voxel3d_device_lepton3_read_camera_info(dev, &cap_info.flir_cam_info);
+    cap_info.rectify_type = m_doRGBDRectify ? RectifyType::RGB2TOF :
+                            m_doTDRectify ? RectifyType::FLIR2TOF : RectifyType::NONE;
+
+    recorder = voxel3d_recorder_create(record_file, &cap_info, 0, record_flags);
+    if (recorder) {
+        printf("Recording to %s\n", record_file);
+    }
+    else {
+        printf("Failed to create recording %s\n", record_file);
+    }
+}
+
+static void stop_recording(void)
+{
+    RecorderStats stats;
+    unsigned long long dropped = 0;
+
+    voxel3d_recorder_flush(recorder);
+    voxel3d_recorder_get_stats(recorder, &stats);
+    voxel3d_recorder_close(recorder);
+    recorder = NULL;
+
+    for (int ix = 0; ix < CAPTURE_STREAM_COUNT; ix++)
+        dropped += stats.frames_dropped[ix];
+    printf("Recorded ToF %llu, RGB %llu, thermal %llu, IMU %llu frames, dropped %llu%s\n",
+           stats.frames_written[CAPTURE_STREAM_TOF], stats.frames_written[CAPTURE_STREAM_RGB],
+           stats.frames_written[CAPTURE_STREAM_THERMAL], stats.frames_written[CAPTURE_STREAM_IMU],
+           dropped, stats.write_failed ? " (write failed)" : "");
+}
+
 void ToFCallBackFunc(int event, int x, int y, int flags, void* userdata)
 {
     if (event == EVENT_LBUTTONDOWN)
@@ -169,7 +242,7 @@ void RGBCallBackFunc(int event, int x, int y, int flags, void* userdata)
 }
 
 
-static void mainloop(char* dev_sn)
+static void mainloop(voxel3d_device_t *dev)
 {
     int pcl_pixels = 0;
     int tof_center_pixel_loc = TOF_DEPTH_WIDTH * (TOF_DEPTH_HEIGHT / 2) +
@@ -180,6 +253,9 @@ static void mainloop(char* dev_sn)
 
     Mat colorMap, conf8u, depth8U, flir8U;
     IMU_DATA imu_data = { 0, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+    IMU_DATA imu_sample;
+    bool imu_seen = false;
+    int imu_count;
 
     cv::Mat operateMat = cv::Mat::zeros(200, 400, CV_8U);
     cv::putText(operateMat, "Press F to get RGB-D", cv::Point(10, 60), cv::FONT_HERSHEY_PLAIN, 1.5, cv::Scalar(255, 255, 255));
@@ -187,44 +263,57 @@ static void mainloop(char* dev_sn)
     cv::imshow("operate", operateMat);
 
     while (iWaitKey != 27) {
-        if (iWaitKey == 'f')
-        {           
-            m_doRGBDRectify = !m_doRGBDRectify;
-            m_doTDRectify = false;
-            voxel3d_set_rectifyType(dev_sn, RectifyType::RGB2TOF);
+        /* a recording keeps the frame sizes of the rectify type in its header */
+        if ((iWaitKey == 'f' || iWaitKey == 't') && recorder)
+        {
+            std::cout << "rectify can't change while recording" << std::endl;
+        }
+        else if (iWaitKey == 'f')
+        {
+            bool rectify = !m_doRGBDRectify;
 
-            if (m_doRGBDRectify)
+            /* the flags size the query buffers, they follow the device only */
+            if (voxel3d_device_set_rectifyType(dev, rectify ? RectifyType::RGB2TOF :
+                                                              RectifyType::NONE) > 0)
             {
-                std::cout << "open RGB-D" << std::endl;
+                m_doRGBDRectify = rectify;
+                m_doTDRectify = false;
+                std::cout << (rectify ? "open RGB-D" : "close RGB-D") << std::endl;
             }
             else {
-                std::cout << "close RGB-D" << std::endl;
+                std::cout << "failed to " << (rectify ? "open" : "close") << " RGB-D"
+                          << std::endl;
             }
         }
         else if (iWaitKey == 't')
         {
-            m_doRGBDRectify = false;
-            m_doTDRectify = !m_doTDRectify;
-            voxel3d_set_rectifyType(dev_sn, RectifyType::FLIR2TOF);
-            if (m_doTDRectify)
+            bool rectify = !m_doTDRectify;
+
+            if (voxel3d_device_set_rectifyType(dev, rectify ? RectifyType::FLIR2TOF :
+                                                              RectifyType::NONE) > 0)
             {
-                std::cout << "open Thermal-D" << std::endl;
+                m_doRGBDRectify = false;
+                m_doTDRectify = rectify;
+                std::cout << (rectify ? "open Thermal-D" : "close Thermal-D") << std::endl;
             }
             else {
-                std::cout << "close Thermal-D" << std::endl;
+                std::cout << "failed to " << (rectify ? "open" : "close") << " Thermal-D"
+                          << std::endl;
             }
         }
 
-        if (!m_doRGBDRectify && !m_doTDRectify)
-        {
-            voxel3d_set_rectifyType(dev_sn, RectifyType::NONE);
-        }
-
         if (found_tof_device) {
-            unsigned int ret = voxel3d_tof_queryframe(dev_sn, depth.ptr<unsigned short>(0), conf.ptr<unsigned short>(0));
+            unsigned int ret = voxel3d_device_tof_queryframe(dev, depth.ptr<unsigned short>(0), conf.ptr<unsigned short>(0));
             if (ret) {
-                pcl_pixels = voxel3d_tof_generatePointCloud(
-                    dev_sn,
+                if (recorder) {
+                    memcpy(tof_record, depth.ptr<unsigned short>(0), TOF_DEPTH_ONLY_FRAME_SIZE);
+                    memcpy(tof_record + TOF_DEPTH_PIXELS, conf.ptr<unsigned short>(0), TOF_IR_ONLY_FRAME_SIZE);
+                    record_frame(CAPTURE_STREAM_TOF, ret, TOF_DEPTH_WIDTH, TOF_DEPTH_HEIGHT,
+                                 TOF_DEPTH_IR_FRAME_SIZE, tof_record);
+                }
+
+                pcl_pixels = voxel3d_device_tof_generatePointCloud(
+                    dev,
                     depth.ptr<unsigned short>(0),
                     pointCloudXYZ);
 
@@ -246,11 +335,18 @@ static void mainloop(char* dev_sn)
                 {
                     if (m_doRGBDRectify)
                     {
-                        ret = voxel3d_rgb_queryframe(dev_sn, rectify_rgb.ptr<uchar>(0));
-                        
+                        ret = voxel3d_device_rgb_queryframe(dev, rectify_rgb.ptr<uchar>(0));
+                        if (ret) {
+                            record_frame(CAPTURE_STREAM_RGB, ret, TOF_DEPTH_WIDTH, TOF_DEPTH_HEIGHT,
+                                         TOF_DEPTH_PIXELS * 3, rectify_rgb.ptr<uchar>(0));
+                        }
                     }
                     else {
-                        ret = voxel3d_rgb_queryframe(dev_sn, rgb.ptr<uchar>(0));
+                        ret = voxel3d_device_rgb_queryframe(dev, rgb.ptr<uchar>(0));
+                        if (ret) {
+                            record_frame(CAPTURE_STREAM_RGB, ret, RGB_WIDTH, RGB_HEIGHT,
+                                         RGB_PIXELS * 3, rgb.ptr<uchar>(0));
+                        }
                         cv::resize(rgb, rectify_rgb, rectify_rgb.size());
                     }
                     putText(rectify_rgb, format("%d, %d, %d", rectify_rgb.at<cv::Vec3b>(mouse_y, mouse_x)(0), rectify_rgb.at<cv::Vec3b>(mouse_y, mouse_x)(1), rectify_rgb.at<cv::Vec3b>(mouse_y, mouse_x)(2)), Point(mouse_x, mouse_y), 1, 1, Scalar(255, 255, 255));
@@ -261,12 +357,20 @@ static void mainloop(char* dev_sn)
                 if (found_flir_device) {
                     if (m_doTDRectify)
                     {
-                        ret = voxel3d_lepton3_queryframe(dev_sn, rectify_flir.ptr<float>(0));                        
+                        ret = voxel3d_device_lepton3_queryframe(dev, rectify_flir.ptr<float>(0));
+                        if (ret) {
+                            record_frame(CAPTURE_STREAM_THERMAL, ret, TOF_DEPTH_WIDTH, TOF_DEPTH_HEIGHT,
+                                         TOF_DEPTH_PIXELS * sizeof(float), rectify_flir.ptr<float>(0));
+                        }
                     }
                     else
                     {
-                        ret = voxel3d_lepton3_queryframe(dev_sn, flir.ptr<float>(0));                       
-                        cv::resize(flir, rectify_flir, rectify_flir.size());               
+                        ret = voxel3d_device_lepton3_queryframe(dev, flir.ptr<float>(0));
+                        if (ret) {
+                            record_frame(CAPTURE_STREAM_THERMAL, ret, FLIR_WIDTH, FLIR_HEIGHT,
+                                         FLIR_FRAME_SIZE, flir.ptr<float>(0));
+                        }
+                        cv::resize(flir, rectify_flir, rectify_flir.size());
                     }
                     rectify_flir.convertTo(flir8U, CV_8UC1, 255.0 / 40.0);
                     putText(flir8U, format("%f", rectify_flir.at<float>(mouse_y, mouse_x)), Point(mouse_x, mouse_y), 1, 1, Scalar(0, 0, 0));
@@ -278,7 +382,16 @@ static void mainloop(char* dev_sn)
         //set the callback function for any mouse event
         setMouseCallback("Depth", ToFCallBackFunc, NULL);
 
-        if (voxel3d_read_imu_data(dev_sn, &imu_data)) {
+        /* every sample queued since the last loop is recorded, the newest one printed */
+        imu_count = 0;
+        while (voxel3d_device_read_imu_data(dev, &imu_sample) > 0 &&
+               !(imu_seen && imu_sample.imu_ts == imu_data.imu_ts)) {
+            imu_data = imu_sample;
+            imu_seen = true;
+            record_frame(CAPTURE_STREAM_IMU, imu_data.imu_ts, 1, 1, sizeof(imu_data), &imu_data);
+            imu_count++;
+        }
+        if (imu_count) {
             printf("IMU TS = %ld, ACC (%.4f, %.4f, %.4f), GYRO (%.4f, %.4f, %.4f)\n",
                 imu_data.imu_ts, imu_data.imu_accel[0], imu_data.imu_accel[1], imu_data.imu_accel[2],
                 imu_data.imu_gyro[0], imu_data.imu_gyro[1], imu_data.imu_gyro[2]);
@@ -289,6 +402,66 @@ static void mainloop(char* dev_sn)
     return;
 }
 
+static void fw_upgrade_all(const char *file_path)
+{
+    FwUpgradeBatchConfig config;
+    FwUpgradeBatchState state;
+
+    memset(&config, 0, sizeof(config));
+    config.backend = backend;
+    config.file_path = file_path;
+
+    fw_upgrade_batch_t *batch = voxel3d_fw_upgrade_batch_start(&config);
+    if (!batch) {
+        printf("Can't find any 5Voxel device\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("F/W file     : %s\n", file_path);
+    while (!voxel3d_fw_upgrade_batch_wait(batch, FW_PROGRESS_INTERVAL_MS)) {
+        voxel3d_fw_upgrade_batch_poll(batch, &state);
+        printf("\rFW upgrade - %u device(s): %u running, %u done, %u failed (%u%%)   ",
+               state.num_devices, state.running, state.done, state.failed,
+               state.percent_complete);
+        fflush(stdout);
+    }
+    voxel3d_fw_upgrade_batch_poll(batch, &state);
+    voxel3d_fw_upgrade_batch_release(batch);
+
+    printf("\n--------------------------------------------------------\n");
+    for (unsigned int ix = 0; ix < state.num_devices; ix++) {
+        printf("%-24s F/W %-16s %s\n", state.device[ix].dev_sn, state.device[ix].fw_version,
+               state.device[ix].status == FW_BATCH_DONE ? "upgraded" : "FAILED");
+    }
+    printf("--------------------------------------------------------\n");
+    if (state.failed) {
+        printf("5HiRab FW upgrade failed on %u device(s)\n", state.failed);
+        exit(EXIT_FAILURE);
+    }
+    printf("Firmware upgrade completed. Need manual poewr cycle to take effect\n");
+}
+
+static void registry_cb(void *user, int event, const char *dev_sn)
+{
+    printf("%s: SN = %s\n", event == REGISTRY_EVENT_ARRIVAL ? "Arrived" : "Removed", dev_sn);
+    fflush(stdout);
+}
+
+static void watch_devices(void)
+{
+    RegistryConfig config;
+
+    memset(&config, 0, sizeof(config));
+    config.backend = backend;
+    config.event_cb = registry_cb;
+
+    registry_t *reg = voxel3d_registry_open(&config);
+    printf("Watching devices (%s), Ctrl-C to quit\n",
+           voxel3d_registry_hotplug(reg) ? "hotplug" : "polling");
+    for (int generation = 0;;)
+        generation = voxel3d_registry_wait(reg, generation, 1000);
+}
+
 static void usage(FILE *fp, int argc, char **argv)
 {
     fprintf(fp,
@@ -298,32 +471,46 @@ static void usage(FILE *fp, int argc, char **argv)
          "-h | --help             Print this message\n"
          "-A | --set_auto_expo    set auto exposure mode\n"
          "-b | --build_date       show firmware build date\n"
+         "-C | --calib_cache      calibration cache directory\n"
+         "-D | --direct_io        record without OS file cache\n"
+         "-F | --replay_fps       replay ToF frame rate (0: as fast as possible)\n"
          "-i | --show_info        show device info\n"
+         "-r | --record           record streams to file\n"
+         "-R | --replay           replay streams from recorded file\n"
          "-S | --scan_dev         scan devices and list device S/N\n"
          "-s | --dev_sn           specify device S/N to access\n"
          "-t | --get_conf         get confidence threshold\n"
          "-T | --set_conf         set confidence threshold\n"
          "-u | --fw_upgrade       device firmware upgrade\n"
+         "-U | --fw_upgrade_all   firmware upgrade of all devices in parallel\n"
          "-v | --version          show lib & firmware version\n"
+         "-W | --watch_dev        list devices as they arrive and leave\n"
          "\n",
          argv[0], TOOLS_VER_MAJOR, TOOLS_VER_MINOR);
 }
 
-static const char short_options[] = "hA:bpiSs:tT:u:v";
+static const char short_options[] = "hA:bC:DF:pir:R:Ss:tT:u:U:vW";
 
 static const struct option
 long_options[] = {
     { "help",              no_argument,       NULL, 'h' },
     { "set_auto_expo",     required_argument, NULL, 'A' },
     { "build_date",        no_argument,       NULL, 'b' },
+    { "calib_cache",       required_argument, NULL, 'C' },
+    { "direct_io",         no_argument,       NULL, 'D' },
+    { "replay_fps",        required_argument, NULL, 'F' },
     { "prod_sn",           no_argument,       NULL, 'p' },
     { "show_info",         no_argument,       NULL, 'i' },
+    { "record",            required_argument, NULL, 'r' },
+    { "replay",            required_argument, NULL, 'R' },
     { "scan_dev",          no_argument,       NULL, 'S' },
     { "dev_sn",            required_argument, NULL, 's' },
     { "get_conf",          no_argument,       NULL, 't' },
     { "set_conf",          required_argument, NULL, 'T' },
     { "fw_upgrade",        required_argument, NULL, 'u' },
+    { "fw_upgrade_all",    required_argument, NULL, 'U' },
     { "version",           no_argument,       NULL, 'v' },
+    { "watch_dev",         no_argument,       NULL, 'W' },
     { 0, 0, 0, 0 }
 };
 
@@ -399,6 +586,29 @@ int main(int argc, char **argv)
             strncpy(dev_sn, optarg, MAX_PRODUCT_SN_LEN);
             break;
 
+        case 'F':
+            errno = 0;
+            replay_fps = strtof(optarg, NULL);
+            if (errno)
+                errno_exit(optarg);
+            break;
+
+        case 'C':
+            calib_cache_dir = optarg;
+            break;
+
+        case 'D':
+            record_flags |= CAPTURE_FLAG_DIRECT_IO;
+            break;
+
+        case 'r':
+            record_file = optarg;
+            break;
+
+        case 'R':
+            replay_file = optarg;
+            break;
+
         case 'S':
             voxel3d_scan(&devInfo);
             if (devInfo.num_of_devices > 0) {
@@ -470,11 +680,15 @@ int main(int argc, char **argv)
             }
             break;
 
+        case 'U':
+            fw_upgrade_all(optarg);
+            exit(EXIT_SUCCESS);
+
         case 'v':
-            found_tof_device = voxel3d_tof_init(dev_sn);
-            if (found_tof_device > 0) {
+            /* polls for the F/W version to become readable instead of sleeping */
+            device = voxel3d_open_all(dev_sn, DEVICE_OPEN_TOF | DEVICE_OPEN_FW_INFO, backend, NULL);
+            if (device) {
                 int ret;
-                SleepSeconds(1);
                 memset(data, 0x0, sizeof(data));
                 ret = voxel3d_read_lib_version(data, sizeof(data));
                 if (ret < 0) {
@@ -485,15 +699,19 @@ int main(int argc, char **argv)
                 }
 
                 memset(data, 0x0, sizeof(data));
-                ret = voxel3d_read_fw_version(dev_sn, data, sizeof(data));
-                if (ret < 0) {
+                ret = voxel3d_device_read_fw_version(device, data, sizeof(data));
+                if (ret <= 0) {
                     printf("Failed to read 5VHiRab F/W version\n");
                 }
                 else {
                     printf("5VHiRab F/W version   : %s\n", data);
                 }
+                voxel3d_device_close(device);
             }
-            voxel3d_tof_release(dev_sn);
+            exit(EXIT_SUCCESS);
+
+        case 'W':
+            watch_devices();
             exit(EXIT_SUCCESS);
 
         default:
@@ -505,35 +723,81 @@ int main(int argc, char **argv)
     /*
      * Start device
      */
-    found_tof_device = voxel3d_tof_init(dev_sn);
-    found_flir_device = voxel3d_lepton3_init(dev_sn);
-    found_rgb_device = voxel3d_rgb_init(dev_sn);
+    if (replay_file) {
+        int mode = REPLAY_RECORDED_TIMING;
+        if (replay_fps == 0.f) {
+            mode = REPLAY_AS_FAST_AS_POSSIBLE;
+        }
+        else if (replay_fps > 0.f) {
+            mode = REPLAY_FIXED_RATE;
+        }
+
+        if (voxel3d_replay_open(dev_sn, replay_file, mode | REPLAY_LOOP, replay_fps) < 0) {
+            printf("Failed to open recording %s\n", replay_file);
+            exit(EXIT_FAILURE);
+        }
+        backend = voxel3d_replay_backend();
+    }
+
+    /* with a calibration cache, camera info comes from it instead of the device */
+    DeviceOpenReport open_report;
+    unsigned int open_flags = DEVICE_OPEN_ALL;
+    if (calib_cache_dir) {
+        open_flags &= ~DEVICE_OPEN_CALIBRATION;
+    }
+    device = voxel3d_open_all(dev_sn, open_flags, backend, &open_report);
+    if (!device) {
+        printf("No device found\n");
+        if (replay_file) {
+            voxel3d_replay_close(dev_sn);
+        }
+        exit(EXIT_FAILURE);
+    }
+
+    found_tof_device = open_report.tof_result;
+    found_flir_device = open_report.thermal_result;
+    found_rgb_device = open_report.rgb_result;
+    printf("Device up in %u ms (ToF %u ms, RGB %u ms, thermal %u ms, calibration %u ms, "
+           "F/W info %u ms)\n", open_report.total_us / 1000, open_report.tof_init_us / 1000,
+           open_report.rgb_init_us / 1000, open_report.thermal_init_us / 1000,
+           open_report.calibration_us / 1000, open_report.fw_info_us / 1000);
+
+    if (calib_cache_dir) {
+        calibration = voxel3d_calibration_load(device, calib_cache_dir, 0);
+        if (calibration) {
+            printf("Calibration read from %s\n",
+                   voxel3d_calibration_from_cache(calibration) ? "cache" : "device");
+        }
+    }
 
     m_doRGBDRectify = false;
     m_doTDRectify = false;
 
-    voxel3d_set_rectifyType(dev_sn, RectifyType::NONE);
+    voxel3d_device_set_rectifyType(device, RectifyType::NONE);
+
+    if (record_file && !replay_file) {
+        start_recording(device);
+    }
     /*
      * main loop function
      */
     if (found_tof_device > 0 || found_flir_device > 0 || found_rgb_device > 0) {
-        mainloop(dev_sn);
+        mainloop(device);
     }
 
     /*
      * Stop device
      */
-    if (found_tof_device > 0) {
-        voxel3d_tof_release(dev_sn);
+    if (recorder) {
+        stop_recording();
     }
 
-    if (found_flir_device > 0) {
-        voxel3d_lepton3_release(dev_sn);
-    }
+    /* releases the sensors initialized above */
+    voxel3d_calibration_release(calibration);
+    voxel3d_device_close(device);
 
-    if (found_rgb_device > 0)
-    {
-        voxel3d_rgb_release(dev_sn);
+    if (replay_file) {
+        voxel3d_replay_close(dev_sn);
     }
 
     return 0;
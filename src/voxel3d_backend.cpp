@@ -0,0 +1,58 @@
+/**
+ @file      voxel3d_backend.cpp
+ @brief     Device access table bound to libvoxel3d
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <chrono>
+
+#include "voxel3d_backend.h"
+
+static const DeviceBackend device_backend = {
+    "device",
+
+    voxel3d_scan,
+
+    voxel3d_tof_init,
+    voxel3d_tof_queryframe,
+    voxel3d_tof_generatePointCloud,
+    voxel3d_tof_release,
+
+    voxel3d_lepton3_init,
+    voxel3d_lepton3_queryframe,
+    voxel3d_lepton3_release,
+
+    voxel3d_rgb_init,
+    voxel3d_rgb_queryframe,
+    voxel3d_rgb_release,
+
+    voxel3d_release,
+
+    voxel3d_read_imu_data,
+    voxel3d_tof_read_camera_info,
+    voxel3d_lepton3_read_camera_info,
+    voxel3d_rgb_read_camera_info,
+    voxel3d_set_rectifyType,
+    voxel3d_read_fw_version,
+
+    voxel3d_tof_get_conf_threshold,
+    voxel3d_tof_set_conf_threshold,
+    voxel3d_tof_set_auto_exposure_mode,
+    voxel3d_tof_get_depth_hfov,
+    voxel3d_tof_get_depth_vfov,
+    voxel3d_read_fw_build_date,
+    voxel3d_dev_fw_upgrade,
+    voxel3d_dev_fw_upgrade_state_poll,
+};
+
+extern "C" const DeviceBackend *voxel3d_device_backend(void)
+{
+    return &device_backend;
+}
+
+extern "C" unsigned long long voxel3d_host_time_us(void)
+{
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,1265 @@
+/**
+ @file      voxel3d_bench.cpp
+ @brief     Benchmarks of the libvoxel3d companion modules on recorded data
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>             /* getopt_long() */
+#include <errno.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif /* HAVE_LZ4 */
+
+#include "voxel3d.h"
+#include "voxel3d_acquisition.h"
+#include "voxel3d_calibration.h"
+#include "voxel3d_capture.h"
+#include "voxel3d_depth_codec.h"
+#include "voxel3d_device.h"
+#include "voxel3d_icp.h"
+#include "voxel3d_occupancy.h"
+#include "voxel3d_proximity.h"
+#include "voxel3d_orientation.h"
+#include "voxel3d_planes.h"
+#include "voxel3d_pointcloud.h"
+#include "voxel3d_recorder.h"
+#include "voxel3d_simulated.h"
+#include "voxel3d_sync.h"
+#include "voxel3d_tsdf.h"
+#include "voxel3d_voxelgrid.h"
+
+#define BENCH_VER_MAJOR         (1)
+#define BENCH_VER_MINOR         (0)
+
+#define TOF_FPS                 (30)
+#define IMU_RATE                (200)
+#define SIM_TRANSFER_US         (5000)
+#define SIM_DRIFT_PPM           (100.f)
+#define SIM_INIT_MS             (50)
+#define RECOVERY_STALL_MS       (200)
+#define RECOVERY_RETRY_MS       (100)
+#define RECOVERY_OFFLINE_MS     (1000)
+#define RECOVERY_CONF_THRESHOLD (42)
+#define MOTION_GYRO_RATE        (1.5f)          /* rad/s, peak of the simulated tilt */
+#define MOTION_MAX_GYRO_RATE    (0.75f)
+#define DEG_PER_RAD             (57.29577951f)
+#define POINTCLOUD_TILT_RAD     (0.3f)
+#define POINTCLOUD_CAMERA_HEIGHT (1.f)          /* meters above the floor */
+#define POINTCLOUD_MAX_PLANES   (16)
+#define POINTCLOUD_VOXEL_LEAF   (0.04f)
+
+static int max_frames = 300;
+static int num_devices = 1;
+static unsigned int record_flags = 0;
+
+static void errno_exit(const char *s)
+{
+    fprintf(stderr, "%s error %d, %s\n", s, errno, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Codec benchmark
+ */
+typedef int (*encode_fn)(const unsigned short *depthmap, unsigned char *out, int max_size);
+typedef int (*decode_fn)(const unsigned char *in, int size, unsigned short *depthmap);
+
+static int rvl_encode(const unsigned short *depthmap, unsigned char *out, int max_size)
+{
+    return voxel3d_depth_encode(depthmap, TOF_DEPTH_PIXELS, out, max_size);
+}
+
+static int rvl_decode(const unsigned char *in, int size, unsigned short *depthmap)
+{
+    return voxel3d_depth_decode(in, size, depthmap, TOF_DEPTH_PIXELS);
+}
+
+#ifdef HAVE_ZLIB
+static int zlib_encode(const unsigned short *depthmap, unsigned char *out, int max_size)
+{
+    uLongf size = max_size;
+    if (compress2(out, &size, (const Bytef *)depthmap, TOF_DEPTH_ONLY_FRAME_SIZE, Z_BEST_SPEED) != Z_OK)
+        return -1;
+    return (int)size;
+}
+
+static int zlib_decode(const unsigned char *in, int size, unsigned short *depthmap)
+{
+    uLongf out_size = TOF_DEPTH_ONLY_FRAME_SIZE;
+    if (uncompress((Bytef *)depthmap, &out_size, in, size) != Z_OK)
+        return -1;
+    return size;
+}
+#endif /* HAVE_ZLIB */
+
+#ifdef HAVE_LZ4
+static int lz4_encode(const unsigned short *depthmap, unsigned char *out, int max_size)
+{
+    return LZ4_compress_default((const char *)depthmap, (char *)out, TOF_DEPTH_ONLY_FRAME_SIZE, max_size);
+}
+
+static int lz4_decode(const unsigned char *in, int size, unsigned short *depthmap)
+{
+    if (LZ4_decompress_safe((const char *)in, (char *)depthmap, size, TOF_DEPTH_ONLY_FRAME_SIZE) < 0)
+        return -1;
+    return size;
+}
+#endif /* HAVE_LZ4 */
+
+static void run_codec(const char *name, encode_fn encode, decode_fn decode,
+                      const std::vector<unsigned short> &frames, int num_frames)
+{
+    std::vector<unsigned char> encoded(DEPTH_CODEC_MAX_ENCODED_SIZE(TOF_DEPTH_PIXELS) * 2);
+    std::vector<unsigned short> decoded(TOF_DEPTH_PIXELS);
+    std::vector<int> sizes(num_frames);
+    std::vector<size_t> offsets(num_frames);
+    std::vector<unsigned char> stream;
+    double stored = 0, enc_s = 0, dec_s;
+    int mismatch = 0;
+
+    /* only the encoder is timed, not the growth of the stream */
+    for (int ix = 0; ix < num_frames; ix++) {
+        auto start = std::chrono::steady_clock::now();
+        sizes[ix] = encode(&frames[(size_t)ix * TOF_DEPTH_PIXELS], encoded.data(), (int)encoded.size());
+        enc_s += seconds_since(start);
+        if (sizes[ix] < 0) {
+            printf("%-8s encode failed\n", name);
+            return;
+        }
+        offsets[ix] = stream.size();
+        stream.insert(stream.end(), encoded.data(), encoded.data() + sizes[ix]);
+        stored += sizes[ix];
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++) {
+        if (decode(&stream[offsets[ix]], sizes[ix], decoded.data()) < 0 ||
+            memcmp(decoded.data(), &frames[(size_t)ix * TOF_DEPTH_PIXELS], TOF_DEPTH_ONLY_FRAME_SIZE))
+            mismatch++;
+    }
+    dec_s = seconds_since(start);
+
+    double raw = (double)num_frames * TOF_DEPTH_ONLY_FRAME_SIZE;
+    printf("%-8s %8.2f %12.1f %12.1f %16.2f %s\n", name, raw / stored,
+           raw / enc_s / 1e6, raw / dec_s / 1e6,
+           stored / num_frames * TOF_FPS / 1e6,
+           mismatch ? "MISMATCH" : "");
+}
+
+/* Depth planes of up to max_frames ToF frames of a recording, exits when there are none */
+static int load_depth_frames(const char *file_path, std::vector<unsigned short> &frames,
+                             CaptureDeviceInfo *dev_info)
+{
+    capture_reader_t *reader = voxel3d_capture_open(file_path);
+    std::vector<unsigned short> tof(TOF_DEPTH_PIXELS * 2);
+    int num_frames = 0;
+
+    if (!reader) {
+        printf("Failed to open recording %s\n", file_path);
+        exit(EXIT_FAILURE);
+    }
+
+    int available = voxel3d_capture_frame_count(reader, CAPTURE_STREAM_TOF);
+    for (int ix = 0; ix < available && num_frames < max_frames; ix++) {
+        if (voxel3d_capture_read_frame(reader, CAPTURE_STREAM_TOF, ix, NULL, tof.data(),
+                                       TOF_DEPTH_IR_FRAME_SIZE) < 0)
+            continue;
+        frames.insert(frames.end(), tof.begin(), tof.begin() + TOF_DEPTH_PIXELS);
+        num_frames++;
+    }
+    if (dev_info)
+        voxel3d_capture_get_device_info(reader, dev_info);
+    voxel3d_capture_release(reader);
+
+    if (!num_frames) {
+        printf("No ToF frame in %s\n", file_path);
+        exit(EXIT_FAILURE);
+    }
+    return num_frames;
+}
+
+static void bench_codec(const char *file_path)
+{
+    std::vector<unsigned short> frames;
+
+    /* depth planes only, the stream the codec is meant for */
+    int num_frames = load_depth_frames(file_path, frames, NULL);
+
+    printf("Depth codec, %d frames of %dx%d from %s\n", num_frames, TOF_DEPTH_WIDTH,
+           TOF_DEPTH_HEIGHT, file_path);
+    printf("raw stream at %d fps: %.2f MB/s\n\n", TOF_FPS, TOF_DEPTH_ONLY_FRAME_SIZE * TOF_FPS / 1e6);
+    printf("%-8s %8s %12s %12s %16s\n", "codec", "ratio", "enc MB/s", "dec MB/s", "stored MB/s@fps");
+
+    run_codec("rvl", rvl_encode, rvl_decode, frames, num_frames);
+    /* optional, e.g. msbuild /p:ZlibDir=... /p:Lz4Dir=... for voxel3d_bench.vcxproj */
+#ifdef HAVE_ZLIB
+    run_codec("zlib-1", zlib_encode, zlib_decode, frames, num_frames);
+#else
+    printf("%-8s not built, needs HAVE_ZLIB\n", "zlib-1");
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_LZ4
+    run_codec("lz4", lz4_encode, lz4_decode, frames, num_frames);
+#else
+    printf("%-8s not built, needs HAVE_LZ4\n", "lz4");
+#endif /* HAVE_LZ4 */
+}
+
+/*
+ * Scrub benchmark: random seeks by timestamp, as offline analytics jump around a recording
+ */
+static void bench_scrub(const char *file_path)
+{
+    capture_reader_t *reader = voxel3d_capture_open(file_path);
+    capture_reader_t *mapped = voxel3d_capture_open_mapped(file_path);
+    std::vector<unsigned char> frame(TOF_DEPTH_IR_FRAME_SIZE);
+    std::vector<unsigned long long> seeks;
+    CaptureFrameInfo first, last;
+    double read_s, map_s, decode_s;
+
+    if (!reader || !mapped) {
+        printf("Failed to open recording %s\n", file_path);
+        exit(EXIT_FAILURE);
+    }
+
+    int available = voxel3d_capture_frame_count(reader, CAPTURE_STREAM_TOF);
+    if (available <= 0) {
+        printf("No ToF frame in %s\n", file_path);
+        exit(EXIT_FAILURE);
+    }
+    voxel3d_capture_frame_info(reader, CAPTURE_STREAM_TOF, 0, &first);
+    voxel3d_capture_frame_info(reader, CAPTURE_STREAM_TOF, available - 1, &last);
+
+    srand(1);
+    for (int ix = 0; ix < max_frames; ix++) {
+        unsigned long long span = last.host_ts_us - first.host_ts_us + 1;
+        seeks.push_back(first.host_ts_us + ((unsigned long long)rand() * RAND_MAX + rand()) % span);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long ts : seeks) {
+        int index = voxel3d_capture_seek_time(reader, CAPTURE_STREAM_TOF, ts);
+        voxel3d_capture_read_frame(reader, CAPTURE_STREAM_TOF, index, NULL, frame.data(),
+                                   (unsigned int)frame.size());
+    }
+    read_s = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned long long ts : seeks) {
+        CaptureMappedFrame mapped_frame;
+        voxel3d_capture_map_frame_time(mapped, CAPTURE_STREAM_TOF, ts, &mapped_frame);
+    }
+    map_s = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned long long ts : seeks) {
+        CaptureMappedFrame mapped_frame;
+        if (voxel3d_capture_map_frame_time(mapped, CAPTURE_STREAM_TOF, ts, &mapped_frame) >= 0)
+            voxel3d_capture_decode_frame(&mapped_frame, frame.data(), (unsigned int)frame.size());
+    }
+    decode_s = seconds_since(start);
+
+    voxel3d_capture_release(mapped);
+    voxel3d_capture_release(reader);
+
+    printf("Scrub, %d random ToF seeks over %.1f s of %s\n\n", max_frames,
+           (last.host_ts_us - first.host_ts_us) / 1e6, file_path);
+    printf("%-20s %12s\n", "access", "us/frame");
+    printf("%-20s %12.1f\n", "read_frame", read_s * 1e6 / max_frames);
+    printf("%-20s %12.1f\n", "map_frame", map_s * 1e6 / max_frames);
+    printf("%-20s %12.1f\n", "map_frame + decode", decode_s * 1e6 / max_frames);
+}
+
+/*
+ * Recording benchmark: every device records ToF, RGB and thermal at TOF_FPS and IMU at
+ * IMU_RATE in real time from its own thread, like an acquisition loop per camera
+ */
+static void record_device(recorder_t *recorder, int num_frames)
+{
+    std::vector<unsigned short> tof(TOF_DEPTH_PIXELS * 2);
+    std::vector<unsigned char> rgb(RGB_WIDTH * RGB_HEIGHT * 3);
+    std::vector<float> thermal(FLIR_WIDTH * FLIR_HEIGHT);
+    IMU_DATA imu;
+    CaptureFrameInfo info;
+    auto start = std::chrono::steady_clock::now();
+
+    memset(&imu, 0, sizeof(imu));
+    for (int frame = 0; frame < num_frames; frame++) {
+        unsigned long long ts = (unsigned long long)frame * 1000000 / TOF_FPS;
+
+        /* depth-like content so the ToF codec does real work */
+        for (int ix = 0; ix < TOF_DEPTH_PIXELS; ix++)
+            tof[ix] = (ix % TOF_DEPTH_WIDTH < 40) ? 0 : (unsigned short)(1000 + (ix / TOF_DEPTH_WIDTH) + frame);
+
+        info.frame_count = frame;
+        info.host_ts_us = ts;
+        info.stream = CAPTURE_STREAM_TOF;
+        info.width = TOF_DEPTH_WIDTH;
+        info.height = TOF_DEPTH_HEIGHT;
+        info.size = TOF_DEPTH_IR_FRAME_SIZE;
+        voxel3d_recorder_write_frame(recorder, &info, tof.data());
+
+        info.stream = CAPTURE_STREAM_RGB;
+        info.width = RGB_WIDTH;
+        info.height = RGB_HEIGHT;
+        info.size = (unsigned int)rgb.size();
+        voxel3d_recorder_write_frame(recorder, &info, rgb.data());
+
+        info.stream = CAPTURE_STREAM_THERMAL;
+        info.width = FLIR_WIDTH;
+        info.height = FLIR_HEIGHT;
+        info.size = (unsigned int)(thermal.size() * sizeof(float));
+        voxel3d_recorder_write_frame(recorder, &info, thermal.data());
+
+        info.stream = CAPTURE_STREAM_IMU;
+        info.width = 1;
+        info.height = 1;
+        info.size = sizeof(imu);
+        for (int ix = 0; ix < IMU_RATE / TOF_FPS; ix++)
+            voxel3d_recorder_write_frame(recorder, &info, &imu);
+
+        std::this_thread::sleep_until(start + std::chrono::microseconds(ts + 1000000 / TOF_FPS));
+    }
+}
+
+static void bench_record(const char *file_prefix)
+{
+    const DeviceBackend *backend = voxel3d_simulated_backend();
+    std::vector<recorder_t *> recorders;
+    std::vector<std::thread> threads;
+    CaptureDeviceInfo dev_info;
+    CamDevInfo scan_info;
+    char file_path[1024];
+
+    /* camera info of a simulated device, so the recordings play back through -p */
+    memset(&dev_info, 0, sizeof(dev_info));
+    voxel3d_simulated_open(NULL);
+    if (backend->scan(&scan_info) <= 0 ||
+        backend->tof_read_camera_info(scan_info.product_sn[0], &dev_info.tof_cam_info) <= 0 ||
+        backend->rgb_read_camera_info(scan_info.product_sn[0], &dev_info.rgb_cam_info) <= 0 ||
+        backend->lepton3_read_camera_info(scan_info.product_sn[0], &dev_info.flir_cam_info) <= 0) {
+        printf("Failed to read the simulated camera info\n");
+        exit(EXIT_FAILURE);
+    }
+    backend->read_fw_version(scan_info.product_sn[0], dev_info.fw_version,
+                             sizeof(dev_info.fw_version));
+    voxel3d_simulated_close();
+
+    for (int ix = 0; ix < num_devices; ix++) {
+        snprintf(file_path, sizeof(file_path), "%s%d.v3d", file_prefix, ix);
+        snprintf(dev_info.product_sn, sizeof(dev_info.product_sn), "BENCH%d", ix);
+        recorder_t *recorder = voxel3d_recorder_create(file_path, &dev_info, 0, record_flags);
+        if (!recorder) {
+            printf("Failed to create recording %s\n", file_path);
+            exit(EXIT_FAILURE);
+        }
+        recorders.push_back(recorder);
+    }
+
+    printf("Recording, %d device(s) x %d frames of ToF + RGB + thermal @ %d fps, IMU @ %d Hz%s\n\n",
+           num_devices, max_frames, TOF_FPS, IMU_RATE,
+           (record_flags & CAPTURE_FLAG_DIRECT_IO) ? ", direct I/O" : "");
+
+    auto start = std::chrono::steady_clock::now();
+    for (recorder_t *recorder : recorders)
+        threads.emplace_back(record_device, recorder, max_frames);
+    for (std::thread &thread : threads)
+        thread.join();
+    for (recorder_t *recorder : recorders)
+        voxel3d_recorder_flush(recorder);
+    double record_s = seconds_since(start);
+
+    printf("%-8s %10s %10s %10s %10s %12s %10s\n", "device", "tof", "rgb", "thermal", "imu",
+           "max queue MB", "MB/s");
+    for (int ix = 0; ix < num_devices; ix++) {
+        RecorderStats stats;
+        unsigned long long dropped = 0;
+
+        voxel3d_recorder_get_stats(recorders[ix], &stats);
+        voxel3d_recorder_close(recorders[ix]);
+        for (int stream = 0; stream < CAPTURE_STREAM_COUNT; stream++)
+            dropped += stats.frames_dropped[stream];
+
+        printf("%-8d %10llu %10llu %10llu %10llu %12.1f %10.1f %s\n", ix,
+               stats.frames_written[CAPTURE_STREAM_TOF], stats.frames_written[CAPTURE_STREAM_RGB],
+               stats.frames_written[CAPTURE_STREAM_THERMAL], stats.frames_written[CAPTURE_STREAM_IMU],
+               stats.max_queued_bytes / 1e6, stats.bytes_written / record_s / 1e6,
+               dropped ? "DROPPED" : "");
+        if (dropped)
+            printf("%-8s %10llu %10llu %10llu %10llu frames dropped\n", "",
+                   stats.frames_dropped[CAPTURE_STREAM_TOF], stats.frames_dropped[CAPTURE_STREAM_RGB],
+                   stats.frames_dropped[CAPTURE_STREAM_THERMAL], stats.frames_dropped[CAPTURE_STREAM_IMU]);
+    }
+}
+
+/*
+ * Acquisition benchmark: simulated devices at TOF_FPS whose ToF transfer takes
+ * SIM_TRANSFER_US, acquired by one loop polling every device in turn and by one thread
+ * per device
+ */
+static double acquire_sequential(int devices, double seconds)
+{
+    std::vector<voxel3d_device_t *> handles;
+    std::vector<unsigned short> tof(TOF_DEPTH_PIXELS * 2);
+    unsigned long long frames = 0;
+    IMU_DATA imu;
+
+    for (int ix = 0; ix < devices; ix++) {
+        char dev_sn[MAX_PRODUCT_SN_LEN];
+        snprintf(dev_sn, sizeof(dev_sn), "SIM%02d", ix);
+        handles.push_back(voxel3d_device_open(dev_sn, voxel3d_simulated_backend()));
+        voxel3d_device_tof_init(handles.back());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    while (seconds_since(start) < seconds) {
+        for (voxel3d_device_t *handle : handles) {
+            if (voxel3d_device_tof_queryframe(handle, tof.data(), tof.data() + TOF_DEPTH_PIXELS))
+                frames++;
+            while (voxel3d_device_read_imu_data(handle, &imu) > 0)
+                ;
+        }
+    }
+    double elapsed = seconds_since(start);
+
+    for (voxel3d_device_t *handle : handles)
+        voxel3d_device_close(handle);
+    return frames / elapsed;
+}
+
+static acquisition_t *start_acquisition(int devices)
+{
+    AcquisitionConfig config;
+    int cpus = (int)std::thread::hardware_concurrency();
+
+    memset(&config, 0, sizeof(config));
+    config.backend = voxel3d_simulated_backend();
+    config.flags = ACQUISITION_FLAG_PIN_THREADS;
+    for (int ix = 0; ix < MAX_SUPPORTED_CAMERA_MODULE; ix++)
+        config.cpu[ix] = cpus > 0 ? ix % cpus : ACQUISITION_CPU_ANY;
+
+    acquisition_t *acq = voxel3d_acquisition_start(&config);
+    if (!acq) {
+        printf("Failed to start acquisition of %d device(s)\n", devices);
+        exit(EXIT_FAILURE);
+    }
+    return acq;
+}
+
+static double acquire_threaded(int devices, double seconds, unsigned long long *dropped)
+{
+    unsigned long long frames = 0;
+    acquisition_t *acq = start_acquisition(devices);
+
+    auto start = std::chrono::steady_clock::now();
+    while (seconds_since(start) < seconds) {
+        AcquisitionFrameset *frameset = voxel3d_acquisition_pop(acq, 100);
+        if (frameset) {
+            frames++;
+            voxel3d_acquisition_release(acq, frameset);
+        }
+    }
+    double elapsed = seconds_since(start);
+
+    *dropped = 0;
+    for (int ix = 0; ix < devices; ix++) {
+        AcquisitionStats stats;
+        voxel3d_acquisition_get_stats(acq, ix, &stats);
+        *dropped += stats.dropped;
+    }
+    voxel3d_acquisition_stop(acq);
+    return frames / elapsed;
+}
+
+static void bench_acquisition(void)
+{
+    SimulatedConfig sim;
+    double seconds = (double)max_frames / TOF_FPS;
+    double single = 0;
+
+    printf("Acquisition, 1 ~ %d simulated device(s) @ %d fps, %d us ToF transfer, %.1f s each\n\n",
+           num_devices, TOF_FPS, SIM_TRANSFER_US, seconds);
+    printf("%-8s %12s %14s %14s %10s %10s\n", "devices", "device fps", "polling fps",
+           "threaded fps", "scaling", "dropped");
+
+    memset(&sim, 0, sizeof(sim));
+    sim.tof_fps = TOF_FPS;
+    sim.imu_rate = IMU_RATE;
+    sim.transfer_us = SIM_TRANSFER_US;
+    for (int devices = 1; devices <= num_devices; devices++) {
+        unsigned long long dropped;
+
+        sim.num_devices = devices;
+        voxel3d_simulated_open(&sim);
+        double polling = acquire_sequential(devices, seconds);
+        double threaded = acquire_threaded(devices, seconds, &dropped);
+        if (devices == 1)
+            single = threaded;
+
+        /* scaling 1.00 is linear: every added device adds the throughput of the first */
+        printf("%-8d %12d %14.1f %14.1f %10.2f %10llu\n", devices, devices * TOF_FPS, polling,
+               threaded, single > 0 ? threaded / (single * devices) : 0, dropped);
+    }
+
+    /* cross-device matching on clocks drifting up to SIM_DRIFT_PPM apart */
+    SyncConfig sync_config;
+    SyncStats sync_stats;
+    unsigned long long spread = 0, max_spread = 0;
+
+    sim.num_devices = num_devices;
+    sim.clock_drift_ppm = SIM_DRIFT_PPM;
+    voxel3d_simulated_open(&sim);
+    acquisition_t *acq = start_acquisition(num_devices);
+    memset(&sync_config, 0, sizeof(sync_config));
+    sync_config.fps = TOF_FPS;
+    sync_t *sync = voxel3d_sync_create(acq, &sync_config);
+
+    auto start = std::chrono::steady_clock::now();
+    while (seconds_since(start) < seconds) {
+        SyncFrameset group;
+        if (voxel3d_sync_next(sync, &group, 100) <= 0)
+            continue;
+        spread += group.spread_us;
+        max_spread = group.spread_us > max_spread ? group.spread_us : max_spread;
+        voxel3d_sync_release(sync, &group);
+    }
+    double elapsed = seconds_since(start);
+
+    voxel3d_sync_get_stats(sync, &sync_stats);
+    voxel3d_sync_destroy(sync);
+    voxel3d_acquisition_stop(acq);
+    voxel3d_simulated_close();
+
+    unsigned long long groups = sync_stats.matches + sync_stats.partial_matches;
+    printf("\nMatched %d device(s), +/-%.0f ppm clocks: %.1f groups/s, %llu partial, "
+           "%llu unmatched, spread %.0f us mean / %llu us max\n", num_devices, SIM_DRIFT_PPM,
+           groups / elapsed, sync_stats.partial_matches, sync_stats.unmatched,
+           groups ? (double)spread / groups : 0.0, max_spread);
+}
+
+/*
+ * Motion gating: one simulated device tilting up to MOTION_GYRO_RATE, its frames over
+ * MOTION_MAX_GYRO_RATE tagged or dropped, with the orientation filter following the tilt
+ */
+static void run_motion(const char *name, unsigned int flags, double seconds)
+{
+    AcquisitionConfig config;
+    AcquisitionStats stats;
+    unsigned long long framesets = 0, tagged = 0;
+    double weight = 0, max_tilt = 0;
+    float peak_gyro = 0.f;
+
+    memset(&config, 0, sizeof(config));
+    config.backend = voxel3d_simulated_backend();
+    config.flags = flags;
+    config.orientation.filter = ORIENTATION_MAHONY;
+    config.max_gyro_rate = MOTION_MAX_GYRO_RATE;
+    acquisition_t *acq = voxel3d_acquisition_start(&config);
+    if (!acq) {
+        printf("Failed to start acquisition of 1 device\n");
+        exit(EXIT_FAILURE);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    while (seconds_since(start) < seconds) {
+        AcquisitionFrameset *frameset = voxel3d_acquisition_pop(acq, 100);
+        if (!frameset)
+            continue;
+        framesets++;
+        tagged += (frameset->flags & ACQUISITION_FRAME_MOTION_BLUR) ? 1 : 0;
+        peak_gyro = frameset->peak_gyro > peak_gyro ? frameset->peak_gyro : peak_gyro;
+        weight += frameset->motion_weight;
+        if (frameset->flags & ACQUISITION_FRAME_ORIENTATION) {
+            /* angle between the camera's y axis and gravity */
+            double tilt = acos(std::min(1.f, std::max(-1.f, frameset->orientation.gravity[1])));
+            max_tilt = tilt > max_tilt ? tilt : max_tilt;
+        }
+        voxel3d_acquisition_release(acq, frameset);
+    }
+
+    voxel3d_acquisition_get_stats(acq, 0, &stats);
+    voxel3d_acquisition_stop(acq);
+    printf("%-8s %10llu %10llu %10llu %12.2f %12.2f %10.1f\n", name, stats.blurred, framesets,
+           tagged, peak_gyro, framesets ? weight / framesets : 0.0, max_tilt * DEG_PER_RAD);
+}
+
+static void bench_motion(void)
+{
+    SimulatedConfig sim;
+    double seconds = (double)max_frames / TOF_FPS;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.num_devices = 1;
+    sim.tof_fps = TOF_FPS;
+    sim.imu_rate = IMU_RATE;
+    sim.transfer_us = SIM_TRANSFER_US;
+    sim.gyro_rate = MOTION_GYRO_RATE;
+    voxel3d_simulated_open(&sim);
+
+    printf("\nMotion gating, 1 simulated device tilting at up to %.2f rad/s every %d ms, "
+           "max_gyro_rate %.2f rad/s, %.1f s each\n\n", MOTION_GYRO_RATE,
+           SIMULATED_TILT_PERIOD_MS, MOTION_MAX_GYRO_RATE, seconds);
+    printf("%-8s %10s %10s %10s %12s %12s %10s\n", "mode", "blurred", "delivered", "tagged",
+           "peak gyro", "mean weight", "tilt deg");
+    run_motion("tag", 0, seconds);
+    run_motion("drop", ACQUISITION_FLAG_DROP_BLURRED, seconds);
+    voxel3d_simulated_close();
+}
+
+/*
+ * Recovery benchmark: faults injected into the first of the simulated devices while every
+ * device streams, timed from the injection through the stall detection and the re-init
+ * attempts to the first frame after it
+ */
+struct RecoveryLog {
+    std::mutex lock;
+    unsigned long long stall_us;
+    unsigned long long recovered_us;
+    unsigned int attempts;
+    unsigned long long downtime_us;
+};
+
+static void recovery_event(void *user, const AcquisitionEvent *event)
+{
+    RecoveryLog *log = (RecoveryLog *)user;
+
+    std::lock_guard<std::mutex> guard(log->lock);
+    switch (event->type) {
+    case ACQUISITION_EVENT_STALL:
+        log->stall_us = event->host_ts_us;
+        break;
+    case ACQUISITION_EVENT_REINIT:
+        log->attempts = event->attempts;
+        break;
+    case ACQUISITION_EVENT_RECOVERED:
+        log->recovered_us = event->host_ts_us;
+        log->downtime_us = event->downtime_us;
+        break;
+    }
+}
+
+static void run_fault(acquisition_t *acq, RecoveryLog *log, const char *name, int fault)
+{
+    voxel3d_device_t *handle = voxel3d_acquisition_get_device(acq, 0);
+    unsigned long long others = 0, injected_us, recovered_us = 0;
+    double timeout = RECOVERY_OFFLINE_MS / 1000.0 + 5.0;
+    AcquisitionFrameset *frameset;
+
+    /* framesets queued before the fault would count as streamed during it */
+    while ((frameset = voxel3d_acquisition_pop(acq, 0)))
+        voxel3d_acquisition_release(acq, frameset);
+
+    {
+        std::lock_guard<std::mutex> guard(log->lock);
+        log->stall_us = 0;
+        log->recovered_us = 0;
+        log->attempts = 0;
+        log->downtime_us = 0;
+    }
+
+    injected_us = voxel3d_host_time_us();
+    voxel3d_simulated_inject_fault(voxel3d_device_sn(handle), fault, RECOVERY_OFFLINE_MS);
+
+    /* the other devices keep streaming meanwhile */
+    auto start = std::chrono::steady_clock::now();
+    while (!recovered_us && seconds_since(start) < timeout) {
+        frameset = voxel3d_acquisition_pop(acq, 10);
+        if (frameset) {
+            others += frameset->device ? 1 : 0;
+            voxel3d_acquisition_release(acq, frameset);
+        }
+        std::lock_guard<std::mutex> guard(log->lock);
+        recovered_us = log->recovered_us;
+    }
+    double outage = seconds_since(start);
+
+    std::lock_guard<std::mutex> guard(log->lock);
+    if (!recovered_us) {
+        printf("%-12s not recovered after %.1f s\n", name, timeout);
+        return;
+    }
+    printf("%-12s %12.1f %10u %14.1f %10s %14.1f\n", name,
+           (log->stall_us - injected_us) / 1000.0, log->attempts, log->downtime_us / 1000.0,
+           voxel3d_device_tof_get_conf_threshold(handle) == RECOVERY_CONF_THRESHOLD ? "yes" : "no",
+           num_devices > 1 ? others / outage / (num_devices - 1) : 0.0);
+}
+
+static void bench_recovery(void)
+{
+    SimulatedConfig sim;
+    AcquisitionConfig config;
+    RecoveryLog log;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.num_devices = num_devices;
+    sim.tof_fps = TOF_FPS;
+    sim.imu_rate = IMU_RATE;
+    sim.transfer_us = SIM_TRANSFER_US;
+    sim.init_ms = SIM_INIT_MS;
+    voxel3d_simulated_open(&sim);
+
+    memset(&config, 0, sizeof(config));
+    config.backend = voxel3d_simulated_backend();
+    config.stall_ms = RECOVERY_STALL_MS;
+    config.retry_ms = RECOVERY_RETRY_MS;
+    config.event_cb = recovery_event;
+    config.user = &log;
+    acquisition_t *acq = voxel3d_acquisition_start(&config);
+    if (!acq) {
+        printf("Failed to start acquisition of %d device(s)\n", num_devices);
+        exit(EXIT_FAILURE);
+    }
+    voxel3d_device_tof_set_conf_threshold(voxel3d_acquisition_get_device(acq, 0),
+                                          RECOVERY_CONF_THRESHOLD);
+
+    printf("Recovery, %d simulated device(s) @ %d fps, %d ms sensor init, stall after %d ms, "
+           "retry every %d ms\n\n", num_devices, TOF_FPS, SIM_INIT_MS, RECOVERY_STALL_MS,
+           RECOVERY_RETRY_MS);
+    printf("%-12s %12s %10s %14s %10s %14s\n", "fault", "detect ms", "attempts", "downtime ms",
+           "restored", "others fps");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(RECOVERY_STALL_MS));
+    run_fault(acq, &log, "stall", SIMULATED_FAULT_STALL);
+    run_fault(acq, &log, "disconnect", SIMULATED_FAULT_DISCONNECT);
+
+    voxel3d_acquisition_stop(acq);
+    voxel3d_simulated_close();
+    printf("\nThe disconnect keeps the device off the bus for %d ms.\n", RECOVERY_OFFLINE_MS);
+}
+
+/* ToF framesets and IMU ring samples per second of the first device over seconds */
+static void measure_rates(acquisition_t *acq, double seconds, double *fps, double *imu_rate)
+{
+    AcquisitionStats before, after;
+    AcquisitionFrameset *frameset;
+
+    voxel3d_acquisition_get_stats(acq, 0, &before);
+    auto start = std::chrono::steady_clock::now();
+    while (seconds_since(start) < seconds) {
+        if ((frameset = voxel3d_acquisition_pop(acq, 10)))
+            voxel3d_acquisition_release(acq, frameset);
+    }
+    double elapsed = seconds_since(start);
+    voxel3d_acquisition_get_stats(acq, 0, &after);
+
+    *fps = (after.framesets - before.framesets) / elapsed;
+    *imu_rate = (after.imu_samples - before.imu_samples) / elapsed;
+}
+
+/*
+ * IMU ring of a device while its ToF streams and while it stays stalled, reading the
+ * device's 1 s FIFO or, like a live device, only its newest sample
+ */
+static void run_imu_stall(const char *name, bool newest_only, double seconds)
+{
+    SimulatedConfig sim;
+    AcquisitionConfig config;
+    double fps, imu_rate, stalled_fps, stalled_imu_rate;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.num_devices = 1;
+    sim.tof_fps = TOF_FPS;
+    sim.imu_rate = IMU_RATE;
+    sim.transfer_us = SIM_TRANSFER_US;
+    sim.imu_newest_only = newest_only;
+    voxel3d_simulated_open(&sim);
+
+    memset(&config, 0, sizeof(config));
+    config.backend = voxel3d_simulated_backend();
+    acquisition_t *acq = voxel3d_acquisition_start(&config);
+    if (!acq) {
+        printf("Failed to start acquisition of 1 device\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* no stall_ms, the stall lasts until the acquisition stops */
+    measure_rates(acq, seconds, &fps, &imu_rate);
+    voxel3d_simulated_inject_fault(voxel3d_device_sn(voxel3d_acquisition_get_device(acq, 0)),
+                                   SIMULATED_FAULT_STALL, 0);
+    measure_rates(acq, seconds, &stalled_fps, &stalled_imu_rate);
+
+    voxel3d_acquisition_stop(acq);
+    voxel3d_simulated_close();
+    printf("%-12s %12.1f %12.1f %12.1f %12.1f\n", name, fps, imu_rate, stalled_fps,
+           stalled_imu_rate);
+}
+
+static void bench_imu_stall(void)
+{
+    double seconds = (double)max_frames / TOF_FPS;
+
+    printf("\nIMU ring, 1 simulated device @ %d fps, IMU @ %d Hz, streaming then ToF stalled, "
+           "%.1f s each\n\n", TOF_FPS, IMU_RATE, seconds);
+    printf("%-12s %12s %12s %12s %12s\n", "imu read", "fps", "imu/s", "stalled fps",
+           "stalled imu/s");
+    run_imu_stall("fifo", false, seconds);
+    run_imu_stall("newest only", true, seconds);
+}
+
+/*
+ * Point cloud benchmark: the ToF frames of a recording through the point cloud kernels,
+ * with the ray table of its ToF camera info and a camera pitched by POINTCLOUD_TILT_RAD
+ */
+static void print_kernel(const char *name, double seconds, int num_frames, const char *note)
+{
+    printf("%-24s %12.3f %s\n", name, seconds * 1e3 / num_frames, note);
+}
+
+/* Voxel grid by sorting the packed voxel keys of the points, the reference of the hashing */
+static int sort_voxels(const float *xyz, std::vector<unsigned long long> &keys, float *out)
+{
+    size_t count = 0;
+
+    keys.resize(TOF_DEPTH_PIXELS);
+    for (int ix = 0; ix < TOF_DEPTH_PIXELS; ix++) {
+        const float *p = &xyz[(size_t)ix * 3];
+        unsigned long long key = 0;
+
+        if (p[0] == 0.f && p[1] == 0.f && p[2] == 0.f)
+            continue;
+        /* 15 bits per axis, the point index rides in the 19 low bits */
+        for (int axis = 0; axis < 3; axis++) {
+            long long cell = (long long)floorf(p[axis] * (1.f / POINTCLOUD_VOXEL_LEAF));
+            key = key << 15 | (unsigned long long)((cell + 0x4000) & 0x7FFF);
+        }
+        keys[count++] = key << 19 | (unsigned long long)ix;
+    }
+    std::sort(keys.begin(), keys.begin() + count);
+
+    int voxels = 0;
+    for (size_t ix = 0; ix < count;) {
+        size_t next = ix;
+        float sum[3] = { 0.f, 0.f, 0.f };
+
+        for (; next < count && keys[next] >> 19 == keys[ix] >> 19; next++) {
+            for (int axis = 0; axis < 3; axis++)
+                sum[axis] += xyz[(keys[next] & 0x7FFFF) * 3 + axis];
+        }
+        for (int axis = 0; axis < 3; axis++)
+            out[voxels * 3 + axis] = sum[axis] / (float)(next - ix);
+        voxels++;
+        ix = next;
+    }
+    return voxels;
+}
+
+static void bench_pointcloud(const char *file_path)
+{
+    std::vector<unsigned short> frames;
+    std::vector<float> rays(TOF_DEPTH_PIXELS * 2), xyz(TOF_DEPTH_PIXELS * 3);
+    std::vector<float> levelled(TOF_DEPTH_PIXELS * 3), normals(TOF_DEPTH_PIXELS * 3);
+    std::vector<unsigned int> packed(TOF_DEPTH_PIXELS);
+    std::vector<unsigned short> labels(TOF_DEPTH_PIXELS);
+    std::vector<float> voxels(TOF_DEPTH_PIXELS * 3);
+    std::vector<unsigned long long> keys;
+    parallel_t *pool = voxel3d_parallel_create(0);
+    plane_extractor_t *extractor = voxel3d_planes_create(NULL);
+    Plane planes[POINTCLOUD_MAX_PLANES];
+    NormalConfig normal_config;
+    CaptureDeviceInfo dev_info;
+    float gravity[3] = { 0.f, cosf(POINTCLOUD_TILT_RAD), sinf(POINTCLOUD_TILT_RAD) };
+    float r[9];
+    double seconds;
+    int mismatch = 0, num_planes = 0, num_voxels = 0;
+    char note[32];
+
+    memset(&dev_info, 0, sizeof(dev_info));
+    int num_frames = load_depth_frames(file_path, frames, &dev_info);
+    if (voxel3d_calibration_build_rays(&dev_info.tof_cam_info, rays.data()) < 0) {
+        printf("No ToF camera info in %s\n", file_path);
+        exit(EXIT_FAILURE);
+    }
+    voxel3d_orientation_level(gravity, r);
+
+    printf("Point cloud, %d frames of %dx%d from %s, %u threads\n\n", num_frames,
+           TOF_DEPTH_WIDTH, TOF_DEPTH_HEIGHT, file_path, voxel3d_parallel_threads(pool));
+    printf("%-24s %12s\n", "kernel", "ms/frame");
+
+    auto start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++)
+        voxel3d_pointcloud_generate(rays.data(), &frames[(size_t)ix * TOF_DEPTH_PIXELS], NULL,
+                                    xyz.data());
+    print_kernel("camera frame", seconds_since(start), num_frames, "");
+
+    /* the second pass the fused rotation saves */
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++) {
+        voxel3d_pointcloud_generate(rays.data(), &frames[(size_t)ix * TOF_DEPTH_PIXELS], NULL,
+                                    xyz.data());
+        for (int px = 0; px < TOF_DEPTH_PIXELS; px++) {
+            float *p = &xyz[(size_t)px * 3];
+            float x = p[0], y = p[1], z = p[2];
+
+            p[0] = r[0] * x + r[1] * y + r[2] * z;
+            p[1] = r[3] * x + r[4] * y + r[5] * z;
+            p[2] = r[6] * x + r[7] * y + r[8] * z;
+        }
+    }
+    print_kernel("levelled, two passes", seconds_since(start), num_frames, "");
+
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++)
+        voxel3d_pointcloud_generate(rays.data(), &frames[(size_t)ix * TOF_DEPTH_PIXELS], r,
+                                    levelled.data());
+    seconds = seconds_since(start);
+    for (int px = 0; px < TOF_DEPTH_PIXELS * 3; px++) {
+        if (fabsf(levelled[px] - xyz[px]) > 1e-4f)
+            mismatch++;
+    }
+    print_kernel("levelled, fused", seconds, num_frames, mismatch ? "MISMATCH" : "");
+
+    /* the per-frame steps below run on the levelled cloud of each frame */
+    std::vector<float> clouds((size_t)num_frames * TOF_DEPTH_PIXELS * 3);
+    for (int ix = 0; ix < num_frames; ix++)
+        voxel3d_pointcloud_generate(rays.data(), &frames[(size_t)ix * TOF_DEPTH_PIXELS], r,
+                                    &clouds[(size_t)ix * TOF_DEPTH_PIXELS * 3]);
+
+    memset(&normal_config, 0, sizeof(normal_config));
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++)
+        voxel3d_pointcloud_normals(&clouds[(size_t)ix * TOF_DEPTH_PIXELS * 3], &normal_config,
+                                   pool, normals.data());
+    print_kernel("normals, float", seconds_since(start), num_frames, "");
+
+    normal_config.format = POINTCLOUD_NORMAL_PACKED;
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++)
+        voxel3d_pointcloud_normals(&clouds[(size_t)ix * TOF_DEPTH_PIXELS * 3], &normal_config,
+                                   pool, packed.data());
+    print_kernel("normals, packed", seconds_since(start), num_frames, "");
+
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++)
+        num_planes = voxel3d_planes_extract(extractor, &clouds[(size_t)ix * TOF_DEPTH_PIXELS * 3],
+                                            pool, planes, POINTCLOUD_MAX_PLANES, NULL);
+    snprintf(note, sizeof(note), "%d planes", num_planes);
+    print_kernel("planes", seconds_since(start), num_frames, note);
+
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++)
+        voxel3d_planes_extract(extractor, &clouds[(size_t)ix * TOF_DEPTH_PIXELS * 3], pool,
+                               planes, POINTCLOUD_MAX_PLANES, labels.data());
+    print_kernel("planes, labelled", seconds_since(start), num_frames, "");
+
+    static const struct {
+        const char *name;
+        int mode;
+    } voxel_modes[] = {
+        { "voxel grid, centroid", VOXELGRID_CENTROID },
+        { "voxel grid, first", VOXELGRID_FIRST },
+        { "voxel grid, median", VOXELGRID_MEDIAN },
+    };
+    for (const auto &voxel_mode : voxel_modes) {
+        VoxelGridConfig grid_config = { POINTCLOUD_VOXEL_LEAF, voxel_mode.mode };
+        voxel_grid_t *grid = voxel3d_voxelgrid_create(&grid_config);
+
+        start = std::chrono::steady_clock::now();
+        for (int ix = 0; ix < num_frames; ix++)
+            num_voxels = voxel3d_voxelgrid_filter(grid, &clouds[(size_t)ix * TOF_DEPTH_PIXELS * 3],
+                                                  TOF_DEPTH_PIXELS, pool, voxels.data());
+        snprintf(note, sizeof(note), "%d voxels", num_voxels);
+        print_kernel(voxel_mode.name, seconds_since(start), num_frames, note);
+        voxel3d_voxelgrid_destroy(grid);
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++)
+        num_voxels = sort_voxels(&clouds[(size_t)ix * TOF_DEPTH_PIXELS * 3], keys, voxels.data());
+    snprintf(note, sizeof(note), "%d voxels", num_voxels);
+    print_kernel("voxel grid, sorted keys", seconds_since(start), num_frames, note);
+
+    /* every frame fused at the levelling pose, the camera doesn't move in a recording */
+    tsdf_volume_t *volume = voxel3d_tsdf_create(&dev_info.tof_cam_info, NULL);
+    float pose[12];
+    int count = 0;
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 3; col++)
+            pose[row * 4 + col] = r[row * 3 + col];
+        pose[row * 4 + 3] = 0.f;
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++)
+        count = voxel3d_tsdf_integrate(volume, &frames[(size_t)ix * TOF_DEPTH_PIXELS], pose, pool);
+    snprintf(note, sizeof(note), "%d blocks", count);
+    print_kernel("tsdf integrate", seconds_since(start), num_frames, note);
+
+    /* the first frame fused num_frames times, the thin band of positive voxels of a still
+       scene, where the wall of the recording leaves a thick one as it recedes */
+    tsdf_volume_t *still = voxel3d_tsdf_create(&dev_info.tof_cam_info, NULL);
+    for (int ix = 0; ix < num_frames; ix++)
+        voxel3d_tsdf_integrate(still, frames.data(), pose, pool);
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++)
+        count = voxel3d_tsdf_raycast(still, pose, pool, xyz.data(), normals.data());
+    snprintf(note, sizeof(note), "%d hits, %d gave up", count,
+             voxel3d_tsdf_raycast_gave_up(still, NULL));
+    print_kernel("tsdf raycast, still", seconds_since(start), num_frames, note);
+    voxel3d_tsdf_destroy(still);
+
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++)
+        count = voxel3d_tsdf_raycast(volume, pose, pool, xyz.data(), normals.data());
+    snprintf(note, sizeof(note), "%d hits, %d gave up", count,
+             voxel3d_tsdf_raycast_gave_up(volume, NULL));
+    print_kernel("tsdf raycast", seconds_since(start), num_frames, note);
+
+    start = std::chrono::steady_clock::now();
+    voxel3d_tsdf_update_mesh(volume, pool);
+    seconds = seconds_since(start);
+    snprintf(note, sizeof(note), "%d triangles", voxel3d_tsdf_get_mesh(volume, NULL, 0));
+    print_kernel("tsdf mesh, all blocks", seconds, 1, note);
+
+    /* a frame changes the blocks it sees only, the update meshes those again */
+    voxel3d_tsdf_integrate(volume, frames.data(), pose, pool);
+    start = std::chrono::steady_clock::now();
+    count = voxel3d_tsdf_update_mesh(volume, pool);
+    snprintf(note, sizeof(note), "%d blocks", count);
+    print_kernel("tsdf mesh, one frame", seconds_since(start), 1, note);
+
+    /* tracking runs on camera frame clouds, the wall of the recording recedes frame by frame */
+    for (int ix = 0; ix < num_frames; ix++)
+        voxel3d_pointcloud_generate(rays.data(), &frames[(size_t)ix * TOF_DEPTH_PIXELS], NULL,
+                                    &clouds[(size_t)ix * TOF_DEPTH_PIXELS * 3]);
+    icp_t *icp = voxel3d_icp_create(&dev_info.tof_cam_info, NULL);
+    float track[12];
+
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++)
+        count = voxel3d_icp_track(icp, &clouds[(size_t)ix * TOF_DEPTH_PIXELS * 3], NULL, pool,
+                                  track);
+    snprintf(note, sizeof(note), "%.1f mm moved", 1000.f * sqrtf(track[3] * track[3] +
+             track[7] * track[7] + track[11] * track[11]));
+    print_kernel("icp track", seconds_since(start), num_frames, note);
+
+    /* frame to model, the raycast at the levelling pose above */
+    float offset = 0.f;
+    voxel3d_icp_set_model(icp, xyz.data(), normals.data(), pose, pool);
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++) {
+        memcpy(track, pose, sizeof(track));
+        count = voxel3d_icp_align(icp, &clouds[(size_t)ix * TOF_DEPTH_PIXELS * 3], pool, track);
+        offset += sqrtf(track[3] * track[3] + track[7] * track[7] + track[11] * track[11]);
+    }
+    seconds = seconds_since(start);
+    snprintf(note, sizeof(note), "%.1f mm mean offset", 1000.f * offset / num_frames);
+    print_kernel("icp align to tsdf", seconds, num_frames, note);
+    voxel3d_icp_destroy(icp);
+    voxel3d_tsdf_destroy(volume);
+
+    /* straight from the depth planes at the levelling pose, the floor at the camera height */
+    pose[7] = -POINTCLOUD_CAMERA_HEIGHT;
+    for (unsigned int stride = OCCUPANCY_DEFAULT_STRIDE; stride; stride--) {
+        OccupancyConfig occupancy_config;
+        memset(&occupancy_config, 0, sizeof(occupancy_config));
+        occupancy_config.stride = stride;
+        occupancy_grid_t *grid = voxel3d_occupancy_create(&dev_info.tof_cam_info,
+                                                          &occupancy_config);
+        char name[32];
+
+        start = std::chrono::steady_clock::now();
+        for (int ix = 0; ix < num_frames; ix++)
+            count = voxel3d_occupancy_integrate(grid, &frames[(size_t)ix * TOF_DEPTH_PIXELS],
+                                                pose, pool);
+        snprintf(name, sizeof(name), "occupancy, stride %u", stride);
+        snprintf(note, sizeof(note), "%d cells seen", count);
+        print_kernel(name, seconds_since(start), num_frames, note);
+        voxel3d_occupancy_destroy(grid);
+    }
+
+    /* a stop box ahead and slow-down sectors around it, above the floor */
+    ProximityConfig proximity_config;
+    ProximityHit hits[PROXIMITY_MAX_ZONES];
+    float nearest = 0.f;
+
+    memset(&proximity_config, 0, sizeof(proximity_config));
+    memcpy(proximity_config.pose, pose, sizeof(proximity_config.pose));
+    for (int ix = 0; ix < 3; ix++) {
+        ProximityZone *zone = &proximity_config.zones[proximity_config.num_zones++];
+
+        zone->type = ix ? PROXIMITY_SECTOR : PROXIMITY_BOX;
+        zone->min[0] = -0.4f;
+        zone->min[1] = -POINTCLOUD_CAMERA_HEIGHT - 0.8f;
+        zone->max[0] = 0.4f;
+        zone->max[1] = -0.05f;
+        zone->max[2] = 1.5f;
+        zone->radius = 1.5f + 1.5f * ix;
+        zone->angles[0] = -0.75f * ix;
+        zone->angles[1] = 0.75f * ix;
+    }
+    proximity_t *proximity = voxel3d_proximity_create(&dev_info.tof_cam_info, &proximity_config);
+
+    start = std::chrono::steady_clock::now();
+    for (int ix = 0; ix < num_frames; ix++)
+        count = voxel3d_proximity_query(proximity, &frames[(size_t)ix * TOF_DEPTH_PIXELS], hits);
+    seconds = seconds_since(start);
+    for (unsigned int ix = 0; ix < proximity_config.num_zones; ix++) {
+        if (hits[ix].pixel >= 0 && (nearest == 0.f || hits[ix].distance < nearest))
+            nearest = hits[ix].distance;
+    }
+    snprintf(note, sizeof(note), "%d of %u zones hit, %.2f m", count,
+             proximity_config.num_zones, nearest);
+    print_kernel("proximity query", seconds, num_frames, note);
+    voxel3d_proximity_destroy(proximity);
+
+    voxel3d_planes_destroy(extractor);
+    voxel3d_parallel_destroy(pool);
+}
+
+static void usage(FILE *fp, int argc, char **argv)
+{
+    fprintf(fp,
+         "Usage: %s [options]\n\n"
+         "Version %d.%d\n"
+         "Options:\n"
+         "-h | --help             Print this message\n"
+         "-a | --acquisition      multi-device acquisition benchmark on simulated devices\n"
+         "-c | --codec            depth codec benchmark on recorded file\n"
+         "-d | --devices          number of devices to record / acquire (default 1)\n"
+         "-D | --direct_io        record without OS file cache\n"
+         "-f | --recovery         stall / disconnect recovery benchmark on simulated devices\n"
+         "-m | --scrub            random access benchmark on recorded file\n"
+         "-n | --frames           max number of frames / seeks to use (default 300)\n"
+         "-p | --pointcloud       point cloud benchmark on recorded file\n"
+         "-w | --record           recording benchmark, writes <prefix><device>.v3d\n"
+         "\n",
+         argv[0], BENCH_VER_MAJOR, BENCH_VER_MINOR);
+}
+
+static const char short_options[] = "hac:d:Dfm:n:p:w:";
+
+static const struct option
+long_options[] = {
+    { "help",              no_argument,       NULL, 'h' },
+    { "acquisition",       no_argument,       NULL, 'a' },
+    { "codec",             required_argument, NULL, 'c' },
+    { "devices",           required_argument, NULL, 'd' },
+    { "direct_io",         no_argument,       NULL, 'D' },
+    { "recovery",          no_argument,       NULL, 'f' },
+    { "scrub",             required_argument, NULL, 'm' },
+    { "frames",            required_argument, NULL, 'n' },
+    { "pointcloud",        required_argument, NULL, 'p' },
+    { "record",            required_argument, NULL, 'w' },
+    { 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+    char *codec_file = NULL;
+    char *scrub_file = NULL;
+    char *record_prefix = NULL;
+    char *pointcloud_file = NULL;
+    bool acquisition = false;
+    bool recovery = false;
+
+    for (;;) {
+        int idx;
+        int c;
+
+        c = getopt_long(argc, argv,
+                        short_options, long_options, &idx);
+
+        if (-1 == c)
+            break;
+
+        switch (c) {
+        case 0:
+            break;
+
+        case 'h':
+            usage(stdout, argc, argv);
+            exit(EXIT_SUCCESS);
+
+        case 'a':
+            acquisition = true;
+            break;
+
+        case 'c':
+            codec_file = optarg;
+            break;
+
+        case 'd':
+            errno = 0;
+            num_devices = strtol(optarg, NULL, 0);
+            if (errno || num_devices <= 0 || num_devices > MAX_SUPPORTED_CAMERA_MODULE)
+                errno_exit(optarg);
+            break;
+
+        case 'D':
+            record_flags |= CAPTURE_FLAG_DIRECT_IO;
+            break;
+
+        case 'f':
+            recovery = true;
+            break;
+
+        case 'm':
+            scrub_file = optarg;
+            break;
+
+        case 'n':
+            errno = 0;
+            max_frames = strtol(optarg, NULL, 0);
+            if (errno || max_frames <= 0)
+                errno_exit(optarg);
+            break;
+
+        case 'p':
+            pointcloud_file = optarg;
+            break;
+
+        case 'w':
+            record_prefix = optarg;
+            break;
+
+        default:
+            usage(stderr, argc, argv);
+            exit(EXIT_SUCCESS);
+        }
+    }
+
+    if (codec_file) {
+        bench_codec(codec_file);
+    }
+    if (scrub_file) {
+        bench_scrub(scrub_file);
+    }
+    if (record_prefix) {
+        bench_record(record_prefix);
+    }
+    if (acquisition) {
+        bench_acquisition();
+        bench_motion();
+    }
+    if (recovery) {
+        bench_recovery();
+        bench_imu_stall();
+    }
+    if (pointcloud_file) {
+        bench_pointcloud(pointcloud_file);
+    }
+    if (!codec_file && !scrub_file && !record_prefix && !acquisition && !recovery &&
+        !pointcloud_file) {
+        usage(stdout, argc, argv);
+    }
+
+    return 0;
+}
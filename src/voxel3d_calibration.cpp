@@ -0,0 +1,306 @@
+/**
+ @file      voxel3d_calibration.cpp
+ @brief     Host-side calibration cache of 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#ifdef PLAT_WINDOWS
+#include <windows.h>
+#endif /* PLAT_WINDOWS */
+
+#include "voxel3d_calibration.h"
+
+#define CALIBRATION_FILE_MAGIC  "V3DCAL\r\n"
+#define UNDISTORT_ITERATIONS    (8)
+
+/*
+ * On-disk layout (little endian)
+ *   CalibrationHeader
+ *   float rays[TOF_DEPTH_PIXELS * 2]       when CALIBRATION_TOF is valid
+ */
+#pragma pack(push, 1)
+struct CalibrationHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    char product_sn[MAX_PRODUCT_SN_LEN];
+    char fw_version[MAX_FW_VER_LEN];
+    uint32_t rectify_type;
+    uint32_t valid;
+    CameraInfo tof_cam_info;
+    CameraInfo rgb_cam_info;
+    CameraInfo flir_cam_info;
+    float hfov;
+    float vfov;
+    uint32_t ray_count;
+    uint32_t rays_crc;
+    uint32_t header_crc;            /* all fields above */
+};
+#pragma pack(pop)
+
+struct calibration {
+    CalibrationData data;
+    std::vector<float> rays;
+    bool from_cache;
+};
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t size)
+{
+    static const struct Table {
+        uint32_t v[256];
+        Table()
+        {
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                v[n] = c;
+            }
+        }
+    } table;
+
+    const unsigned char *p = (const unsigned char *)data;
+    crc = ~crc;
+    while (size--)
+        crc = table.v[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+/*
+ * <dir>/<S/N>_<F/W version>[_r<rectify type>].v3dcal, with characters unsafe in a file name
+ * replaced; the suffix is left out for RectifyType::NONE
+ */
+static std::string cache_path(const char *cache_dir, const CalibrationData *data)
+{
+    std::string name = std::string(data->product_sn) + "_" + data->fw_version;
+    std::string path = cache_dir;
+
+    if (data->rectify_type != RectifyType::NONE)
+        name += "_r" + std::to_string(data->rectify_type);
+
+    for (auto &c : name) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              c == '.' || c == '-'))
+            c = '_';
+    }
+    if (!path.empty() && path.back() != '/' && path.back() != '\\')
+        path += '/';
+    return path + name + CALIBRATION_FILE_EXT;
+}
+
+static bool read_cache(const std::string &path, calibration_t *cal)
+{
+    CalibrationHeader header;
+    bool ok = false;
+
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return false;
+
+    if (fread(&header, sizeof(header), 1, fp) == 1 &&
+        !memcmp(header.magic, CALIBRATION_FILE_MAGIC, sizeof(header.magic)) &&
+        header.version == CALIBRATION_FILE_VERSION && header.header_size == sizeof(header) &&
+        header.header_crc == crc32_update(0, &header, offsetof(CalibrationHeader, header_crc)) &&
+        !strncmp(header.product_sn, cal->data.product_sn, MAX_PRODUCT_SN_LEN) &&
+        !strncmp(header.fw_version, cal->data.fw_version, MAX_FW_VER_LEN) &&
+        header.rectify_type == (uint32_t)cal->data.rectify_type &&
+        (header.valid & CALIBRATION_TOF) && header.ray_count == TOF_DEPTH_PIXELS) {
+        cal->rays.resize(TOF_DEPTH_PIXELS * 2);
+        ok = fread(cal->rays.data(), sizeof(float), cal->rays.size(), fp) == cal->rays.size() &&
+             crc32_update(0, cal->rays.data(), cal->rays.size() * sizeof(float)) ==
+             header.rays_crc;
+    }
+    fclose(fp);
+
+    if (!ok) {
+        cal->rays.clear();
+        return false;
+    }
+    cal->data.valid = header.valid;
+    cal->data.tof_cam_info = header.tof_cam_info;
+    cal->data.rgb_cam_info = header.rgb_cam_info;
+    cal->data.flir_cam_info = header.flir_cam_info;
+    cal->data.hfov = header.hfov;
+    cal->data.vfov = header.vfov;
+    return true;
+}
+
+/* Written next to the target and renamed over it, so readers never see a partial file */
+static bool write_cache(const std::string &path, const calibration_t *cal)
+{
+    CalibrationHeader header;
+    std::string tmp_path = path + ".tmp";
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CALIBRATION_FILE_MAGIC, sizeof(header.magic));
+    header.version = CALIBRATION_FILE_VERSION;
+    header.header_size = sizeof(header);
+    memcpy(header.product_sn, cal->data.product_sn, MAX_PRODUCT_SN_LEN);
+    memcpy(header.fw_version, cal->data.fw_version, MAX_FW_VER_LEN);
+    header.rectify_type = cal->data.rectify_type;
+    header.valid = cal->data.valid;
+    header.tof_cam_info = cal->data.tof_cam_info;
+    header.rgb_cam_info = cal->data.rgb_cam_info;
+    header.flir_cam_info = cal->data.flir_cam_info;
+    header.hfov = cal->data.hfov;
+    header.vfov = cal->data.vfov;
+    header.ray_count = TOF_DEPTH_PIXELS;
+    header.rays_crc = crc32_update(0, cal->rays.data(), cal->rays.size() * sizeof(float));
+    header.header_crc = crc32_update(0, &header, offsetof(CalibrationHeader, header_crc));
+
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if (!fp)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(cal->rays.data(), sizeof(float), cal->rays.size(), fp) == cal->rays.size();
+    ok = fclose(fp) == 0 && ok;
+
+#ifdef PLAT_WINDOWS
+    ok = ok && MoveFileExA(tmp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else /* PLAT_LINUX */
+    ok = ok && rename(tmp_path.c_str(), path.c_str()) == 0;
+#endif /* PLAT_WINDOWS */
+    if (!ok)
+        remove(tmp_path.c_str());
+    return ok;
+}
+
+/* Read what the file didn't have from the device; returns the bits added */
+static unsigned int read_device(voxel3d_device_t *dev, CalibrationData *data)
+{
+    unsigned int added = 0;
+
+    if (!(data->valid & CALIBRATION_TOF) &&
+        voxel3d_device_tof_read_camera_info(dev, &data->tof_cam_info) > 0)
+        added |= CALIBRATION_TOF;
+    if (!(data->valid & CALIBRATION_RGB) &&
+        voxel3d_device_rgb_read_camera_info(dev, &data->rgb_cam_info) > 0)
+        added |= CALIBRATION_RGB;
+    if (!(data->valid & CALIBRATION_THERMAL) &&
+        voxel3d_device_lepton3_read_camera_info(dev, &data->flir_cam_info) > 0)
+        added |= CALIBRATION_THERMAL;
+    if (!(data->valid & CALIBRATION_FOV)) {
+        data->hfov = voxel3d_device_tof_get_depth_hfov(dev);
+        data->vfov = voxel3d_device_tof_get_depth_vfov(dev);
+        if (data->hfov > 0 && data->vfov > 0)
+            added |= CALIBRATION_FOV;
+    }
+    data->valid |= added;
+    return added;
+}
+
+/*
+ * Public APIs
+ */
+extern "C" int voxel3d_calibration_build_rays(const CameraInfo *cam_info, float *rays)
+{
+    if (!cam_info || !rays || cam_info->focalLengthFx <= 0.f || cam_info->focalLengthFy <= 0.f)
+        return -1;
+
+    /* the same fixed-point iteration as cv::undistortPoints() */
+    const CameraInfo &ci = *cam_info;
+    for (int v = 0; v < TOF_DEPTH_HEIGHT; v++) {
+        for (int u = 0; u < TOF_DEPTH_WIDTH; u++) {
+            float x0 = (u - ci.principalPointCx) / ci.focalLengthFx;
+            float y0 = (v - ci.principalPointCy) / ci.focalLengthFy;
+            float x = x0, y = y0;
+
+            for (int it = 0; it < UNDISTORT_ITERATIONS; it++) {
+                float r2 = x * x + y * y;
+                float icdist = (1 + ((ci.K6 * r2 + ci.K5) * r2 + ci.K4) * r2) /
+                               (1 + ((ci.K3 * r2 + ci.K2) * r2 + ci.K1) * r2);
+                float dx = 2 * ci.P1 * x * y + ci.P2 * (r2 + 2 * x * x);
+                float dy = ci.P1 * (r2 + 2 * y * y) + 2 * ci.P2 * x * y;
+                x = (x0 - dx) * icdist;
+                y = (y0 - dy) * icdist;
+            }
+
+            rays[(v * TOF_DEPTH_WIDTH + u) * 2] = x;
+            rays[(v * TOF_DEPTH_WIDTH + u) * 2 + 1] = y;
+        }
+    }
+    return true;
+}
+
+extern "C" calibration_t *voxel3d_calibration_load(voxel3d_device_t *dev, const char *cache_dir,
+                                                   unsigned int flags)
+{
+    std::string path;
+    unsigned int added;
+
+    if (!dev)
+        return NULL;
+
+    calibration_t *cal = new calibration_t;
+    memset(&cal->data, 0, sizeof(cal->data));
+    cal->from_cache = false;
+    strncpy(cal->data.product_sn, voxel3d_device_sn(dev), MAX_PRODUCT_SN_LEN - 1);
+    cal->data.rectify_type = voxel3d_device_get_rectifyType(dev);
+    if (voxel3d_device_read_fw_version(dev, cal->data.fw_version, MAX_FW_VER_LEN) <= 0) {
+        /* no key without the F/W version, don't cache */
+        cache_dir = NULL;
+    }
+
+    if (cache_dir && cache_dir[0]) {
+        path = cache_path(cache_dir, &cal->data);
+        if (!(flags & CALIBRATION_FLAG_REFRESH) && read_cache(path, cal)) {
+            cal->from_cache = true;
+            voxel3d_device_preload_camera_info(dev, DEVICE_OPEN_TOF, &cal->data.tof_cam_info);
+            if (cal->data.valid & CALIBRATION_RGB)
+                voxel3d_device_preload_camera_info(dev, DEVICE_OPEN_RGB, &cal->data.rgb_cam_info);
+            if (cal->data.valid & CALIBRATION_THERMAL)
+                voxel3d_device_preload_camera_info(dev, DEVICE_OPEN_THERMAL,
+                                                   &cal->data.flir_cam_info);
+            if (cal->data.valid & CALIBRATION_FOV)
+                voxel3d_device_preload_fov(dev, cal->data.hfov, cal->data.vfov);
+        }
+    }
+
+    /* a sensor not up when the file was written is read now and the file completed */
+    added = read_device(dev, &cal->data);
+    if (!(cal->data.valid & CALIBRATION_TOF)) {
+        delete cal;
+        return NULL;
+    }
+    if (cal->rays.empty()) {
+        cal->rays.resize(TOF_DEPTH_PIXELS * 2);
+        if (voxel3d_calibration_build_rays(&cal->data.tof_cam_info, cal->rays.data()) < 0) {
+            delete cal;
+            return NULL;
+        }
+    }
+    if (!path.empty() && (added || !cal->from_cache))
+        write_cache(path, cal);
+    return cal;
+}
+
+extern "C" int voxel3d_calibration_from_cache(calibration_t *cal)
+{
+    return cal && cal->from_cache ? true : 0;
+}
+
+extern "C" int voxel3d_calibration_get_data(calibration_t *cal, CalibrationData *data)
+{
+    if (!cal || !data)
+        return -1;
+
+    *data = cal->data;
+    return true;
+}
+
+extern "C" const float *voxel3d_calibration_rays(calibration_t *cal)
+{
+    return cal ? cal->rays.data() : NULL;
+}
+
+extern "C" void voxel3d_calibration_release(calibration_t *cal)
+{
+    delete cal;
+}
@@ -0,0 +1,1043 @@
+/**
+ @file      voxel3d_capture.cpp
+ @brief     Recording file writer / reader
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#ifdef PLAT_WINDOWS
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif /* PLAT_WINDOWS */
+
+#include "voxel3d_capture.h"
+#include "voxel3d_depth_codec.h"
+
+#ifdef PLAT_WINDOWS
+#define capture_fseek           _fseeki64
+#define capture_ftell           _ftelli64
+#else /* PLAT_LINUX */
+#define capture_fseek           fseeko
+#define capture_ftell           ftello
+#endif /* PLAT_WINDOWS */
+
+#define PREFETCH_PAGE_SIZE      (4096)
+
+/* Direct I/O writes whole blocks of this alignment from a staging buffer of this size */
+#define DIRECT_IO_ALIGN         (4096)
+#define DIRECT_IO_BUFFER_SIZE   (1024 * 1024)
+
+#define CAPTURE_FILE_MAGIC      "V3DCAP\r\n"
+#define CAPTURE_INDEX_MAGIC     "V3DIDX\r\n"
+#define CAPTURE_CHUNK_MAGIC     (0x4b4e4843)        /* "CHNK" */
+
+/*
+ * On-disk layout (little endian)
+ *   FileHeader
+ *   { ChunkHeader, ChunkFrame[num_frames], payloads } ...   one stream per chunk
+ *   IndexEntry[entry_count]                                  written by close
+ *   IndexFooter
+ *
+ * Chunks are only ever appended, each with its own CRC, so a file cut anywhere is
+ * still readable up to the last complete chunk.
+ *
+ * CAPTURE_CODEC_RVL payload, per TOF_DEPTH_PIXELS plane (depth, then IR):
+ *   uint32_t encoded_size, voxel3d_depth_encode() stream
+ */
+#pragma pack(push, 1)
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    CaptureDeviceInfo dev_info;
+};
+
+struct ChunkHeader {
+    uint32_t magic;
+    uint32_t stream;
+    uint32_t codec;
+    uint32_t num_frames;
+    uint64_t chunk_size;            /* header + frame table + payloads */
+    uint32_t payload_crc;           /* frame table + payloads */
+    uint32_t header_crc;            /* all fields above */
+};
+
+struct ChunkFrame {
+    uint64_t host_ts_us;
+    uint32_t frame_count;
+    uint32_t offset;                /* from start of chunk payloads */
+    uint32_t size;                  /* decoded size */
+    uint32_t stored_size;           /* size in file */
+    uint32_t width;
+    uint32_t height;
+};
+
+struct IndexEntry {
+    uint64_t offset;                /* file offset of stored payload */
+    uint64_t host_ts_us;
+    uint32_t stream;
+    uint32_t frame_count;
+    uint32_t size;
+    uint32_t stored_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t codec;
+    uint32_t reserved;
+};
+
+struct IndexFooter {
+    char magic[8];
+    uint64_t index_offset;
+    uint64_t entry_count;
+    uint32_t index_crc;
+    uint32_t reserved;
+};
+#pragma pack(pop)
+
+#define RVL_PLANE_SIZE          TOF_DEPTH_ONLY_FRAME_SIZE
+
+struct StreamChunk {
+    uint32_t codec;
+    std::vector<ChunkFrame> frames;
+    std::vector<unsigned char> payload;
+};
+
+struct capture_writer {
+    FILE *fp;                               /* NULL with CAPTURE_FLAG_DIRECT_IO */
+#ifdef PLAT_WINDOWS
+    HANDLE direct_file;
+#else /* PLAT_LINUX */
+    int direct_fd;
+#endif /* PLAT_WINDOWS */
+    unsigned char *direct_buffer;           /* DIRECT_IO_ALIGN aligned, file tail not yet final */
+    size_t direct_used;
+
+    int64_t file_size;
+    bool failed;
+    StreamChunk chunks[CAPTURE_STREAM_COUNT];
+    std::vector<IndexEntry> index;
+    std::vector<unsigned char> encoded;     /* one RVL plane */
+};
+
+struct FrameEntry {
+    int64_t offset;
+    uint32_t stored_size;
+    uint32_t codec;
+    CaptureFrameInfo info;
+};
+
+/* Sequential access detection of a mapped stream */
+struct StreamPrefetch {
+    int last_index;
+    int64_t begin;                  /* file range already prefetched */
+    int64_t end;
+};
+
+struct capture_reader {
+    FILE *fp;
+    int64_t file_size;
+    CaptureDeviceInfo dev_info;
+    std::vector<FrameEntry> frames[CAPTURE_STREAM_COUNT];
+    std::vector<unsigned char> stored;      /* encoded payload being decoded */
+
+    const unsigned char *map;               /* whole file, NULL unless opened mapped */
+#ifdef PLAT_WINDOWS
+    HANDLE map_file;
+    HANDLE map_handle;
+#endif /* PLAT_WINDOWS */
+    std::mutex prefetch_lock;
+    StreamPrefetch prefetch[CAPTURE_STREAM_COUNT];
+};
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t size)
+{
+    static const struct Table {
+        uint32_t v[256];
+        Table()
+        {
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                v[n] = c;
+            }
+        }
+    } table;
+
+    const unsigned char *p = (const unsigned char *)data;
+    crc = ~crc;
+    while (size--)
+        crc = table.v[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void *alloc_aligned(size_t size, size_t alignment)
+{
+#ifdef PLAT_WINDOWS
+    return _aligned_malloc(size, alignment);
+#else /* PLAT_LINUX */
+    void *p;
+    return posix_memalign(&p, alignment, size) ? NULL : p;
+#endif /* PLAT_WINDOWS */
+}
+
+static void free_aligned(void *p)
+{
+#ifdef PLAT_WINDOWS
+    _aligned_free(p);
+#else /* PLAT_LINUX */
+    free(p);
+#endif /* PLAT_WINDOWS */
+}
+
+static bool open_direct(capture_writer_t *writer, const char *file_path)
+{
+#ifdef PLAT_WINDOWS
+    writer->direct_file = CreateFileA(file_path, GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                                      CREATE_ALWAYS, FILE_FLAG_NO_BUFFERING, NULL);
+    if (writer->direct_file == INVALID_HANDLE_VALUE)
+        return false;
+#else /* PLAT_LINUX */
+    writer->direct_fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    /* file systems without O_DIRECT (tmpfs) still get the aligned whole-block writes */
+    if (writer->direct_fd < 0 && errno == EINVAL)
+        writer->direct_fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->direct_fd < 0)
+        return false;
+#endif /* PLAT_WINDOWS */
+
+    writer->direct_buffer = (unsigned char *)alloc_aligned(DIRECT_IO_BUFFER_SIZE, DIRECT_IO_ALIGN);
+    writer->direct_used = 0;
+    if (!writer->direct_buffer) {
+#ifdef PLAT_WINDOWS
+        CloseHandle(writer->direct_file);
+#else /* PLAT_LINUX */
+        close(writer->direct_fd);
+#endif /* PLAT_WINDOWS */
+        return false;
+    }
+    return true;
+}
+
+/* Write whole blocks of the staging buffer, then step back over the last size - rewind bytes */
+static bool write_direct(capture_writer_t *writer, size_t size, size_t rewind)
+{
+#ifdef PLAT_WINDOWS
+    DWORD written;
+    LARGE_INTEGER offset;
+
+    if (!WriteFile(writer->direct_file, writer->direct_buffer, (DWORD)size, &written, NULL) ||
+        written != size)
+        return false;
+
+    offset.QuadPart = -(LONGLONG)rewind;
+    return !rewind || SetFilePointerEx(writer->direct_file, offset, NULL, FILE_CURRENT);
+#else /* PLAT_LINUX */
+    const unsigned char *p = writer->direct_buffer;
+    size_t left = size;
+
+    while (left) {
+        ssize_t written = write(writer->direct_fd, p, left);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        p += written;
+        left -= written;
+    }
+    return !rewind || lseek(writer->direct_fd, -(off_t)rewind, SEEK_CUR) >= 0;
+#endif /* PLAT_WINDOWS */
+}
+
+static bool output_write(capture_writer_t *writer, const void *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char *)data;
+
+    if (writer->fp)
+        return !size || fwrite(data, size, 1, writer->fp) == 1;
+
+    while (size) {
+        size_t copy = DIRECT_IO_BUFFER_SIZE - writer->direct_used;
+        if (copy > size)
+            copy = size;
+        memcpy(writer->direct_buffer + writer->direct_used, p, copy);
+        writer->direct_used += copy;
+        p += copy;
+        size -= copy;
+
+        if (writer->direct_used == DIRECT_IO_BUFFER_SIZE) {
+            if (!write_direct(writer, DIRECT_IO_BUFFER_SIZE, 0))
+                return false;
+            writer->direct_used = 0;
+        }
+    }
+    return true;
+}
+
+/*
+ * Hand everything written so far to the OS, so it survives a crash of the process but
+ * not a power loss, see output_sync(). Direct I/O pads the partial last block with
+ * zeros and writes it too, then seeks back so the next flush rewrites that block; a
+ * reader of a crashed recording sees the padding as the end of the chunks.
+ */
+static bool output_flush(capture_writer_t *writer)
+{
+    if (writer->fp)
+        return !fflush(writer->fp);
+
+    size_t whole = writer->direct_used & ~(size_t)(DIRECT_IO_ALIGN - 1);
+    size_t tail = writer->direct_used - whole;
+    size_t padded = tail ? whole + DIRECT_IO_ALIGN : whole;
+
+    memset(writer->direct_buffer + writer->direct_used, 0, padded - writer->direct_used);
+    if (padded && !write_direct(writer, padded, tail ? DIRECT_IO_ALIGN : 0))
+        return false;
+
+    memmove(writer->direct_buffer, writer->direct_buffer + whole, tail);
+    writer->direct_used = tail;
+    return true;
+}
+
+/*
+ * Flush, then have the OS write its cache to the disk so everything written so far
+ * survives a power loss too. Direct I/O skips the OS cache but not the drive's, so it
+ * is synced the same way. Too slow for every chunk, only explicit flushes and close.
+ */
+static bool output_sync(capture_writer_t *writer)
+{
+    if (!output_flush(writer))
+        return false;
+
+#ifdef PLAT_WINDOWS
+    HANDLE file = writer->fp ? (HANDLE)_get_osfhandle(_fileno(writer->fp)) : writer->direct_file;
+    return FlushFileBuffers(file) != 0;
+#else /* PLAT_LINUX */
+    return !fsync(writer->fp ? fileno(writer->fp) : writer->direct_fd);
+#endif /* PLAT_WINDOWS */
+}
+
+/* Sync and close the output, cutting direct I/O padding off at the logical file size */
+static void output_close(capture_writer_t *writer, int64_t file_size)
+{
+    if (writer->fp) {
+        output_sync(writer);
+        fclose(writer->fp);
+        return;
+    }
+
+    bool flushed = output_flush(writer);
+#ifdef PLAT_WINDOWS
+    LARGE_INTEGER offset;
+    offset.QuadPart = file_size;
+    if (flushed && SetFilePointerEx(writer->direct_file, offset, NULL, FILE_BEGIN))
+        SetEndOfFile(writer->direct_file);
+    FlushFileBuffers(writer->direct_file);
+    CloseHandle(writer->direct_file);
+#else /* PLAT_LINUX */
+    /* on failure the padding stays, voxel3d_capture_open() then recovers the chunks */
+    if (flushed && ftruncate(writer->direct_fd, file_size) < 0)
+        flushed = false;
+    fsync(writer->direct_fd);
+    close(writer->direct_fd);
+#endif /* PLAT_WINDOWS */
+    free_aligned(writer->direct_buffer);
+}
+
+static int write_chunk(capture_writer_t *writer, unsigned int stream)
+{
+    StreamChunk &chunk = writer->chunks[stream];
+    ChunkHeader header;
+    size_t table_size = chunk.frames.size() * sizeof(ChunkFrame);
+
+    if (chunk.frames.empty())
+        return true;
+    if (writer->failed)
+        return -2;
+
+    header.magic = CAPTURE_CHUNK_MAGIC;
+    header.stream = stream;
+    header.codec = chunk.codec;
+    header.num_frames = (uint32_t)chunk.frames.size();
+    header.chunk_size = sizeof(header) + table_size + chunk.payload.size();
+    header.payload_crc = crc32_update(0, chunk.frames.data(), table_size);
+    header.payload_crc = crc32_update(header.payload_crc, chunk.payload.data(), chunk.payload.size());
+    header.header_crc = crc32_update(0, &header, offsetof(ChunkHeader, header_crc));
+
+    if (!output_write(writer, &header, sizeof(header)) ||
+        !output_write(writer, chunk.frames.data(), table_size) ||
+        !output_write(writer, chunk.payload.data(), chunk.payload.size()) ||
+        !output_flush(writer)) {
+        writer->failed = true;
+        return -2;
+    }
+
+    int64_t payload_offset = writer->file_size + sizeof(header) + table_size;
+    for (const ChunkFrame &frame : chunk.frames) {
+        IndexEntry entry;
+        entry.offset = payload_offset + frame.offset;
+        entry.host_ts_us = frame.host_ts_us;
+        entry.stream = stream;
+        entry.frame_count = frame.frame_count;
+        entry.size = frame.size;
+        entry.stored_size = frame.stored_size;
+        entry.width = frame.width;
+        entry.height = frame.height;
+        entry.codec = header.codec;
+        entry.reserved = 0;
+        writer->index.push_back(entry);
+    }
+
+    writer->file_size += header.chunk_size;
+    chunk.frames.clear();
+    chunk.payload.clear();
+    return true;
+}
+
+extern "C" capture_writer_t *voxel3d_capture_create(const char *file_path,
+                                                    const CaptureDeviceInfo *dev_info)
+{
+    return voxel3d_capture_create_ex(file_path, dev_info, 0);
+}
+
+extern "C" capture_writer_t *voxel3d_capture_create_ex(const char *file_path,
+                                                       const CaptureDeviceInfo *dev_info,
+                                                       unsigned int flags)
+{
+    FileHeader header;
+
+    if (!file_path || !dev_info)
+        return NULL;
+
+    capture_writer_t *writer = new capture_writer_t;
+    if (flags & CAPTURE_FLAG_DIRECT_IO) {
+        writer->fp = NULL;
+        if (!open_direct(writer, file_path)) {
+            delete writer;
+            return NULL;
+        }
+    }
+    else {
+        writer->fp = fopen(file_path, "wb");
+        if (!writer->fp) {
+            delete writer;
+            return NULL;
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_FILE_VERSION;
+    header.header_size = sizeof(header);
+    header.dev_info = *dev_info;
+    if (!output_write(writer, &header, sizeof(header)) || !output_flush(writer)) {
+        output_close(writer, sizeof(header));
+        delete writer;
+        return NULL;
+    }
+
+    writer->file_size = sizeof(header);
+    writer->failed = false;
+    for (unsigned int ix = 0; ix < CAPTURE_STREAM_COUNT; ix++)
+        writer->chunks[ix].codec = CAPTURE_CODEC_RAW;
+    writer->chunks[CAPTURE_STREAM_TOF].codec = CAPTURE_CODEC_RVL;
+    return writer;
+}
+
+extern "C" int voxel3d_capture_set_codec(capture_writer_t *writer, unsigned int stream,
+                                         unsigned int codec)
+{
+    if (!writer || stream >= CAPTURE_STREAM_COUNT ||
+        (codec != CAPTURE_CODEC_RAW &&
+         (codec != CAPTURE_CODEC_RVL || stream != CAPTURE_STREAM_TOF)))
+        return -1;
+
+    if (writer->chunks[stream].codec != codec && write_chunk(writer, stream) < 0)
+        return -2;
+
+    writer->chunks[stream].codec = codec;
+    return true;
+}
+
+/* Append the RVL coded planes of a frame, returns the stored size */
+static uint32_t append_rvl(capture_writer_t *writer, std::vector<unsigned char> &payload,
+                           const void *data, uint32_t size)
+{
+    const unsigned short *plane = (const unsigned short *)data;
+    size_t start = payload.size();
+
+    writer->encoded.resize(DEPTH_CODEC_MAX_ENCODED_SIZE(TOF_DEPTH_PIXELS));
+    for (uint32_t ix = 0; ix < size / RVL_PLANE_SIZE; ix++, plane += TOF_DEPTH_PIXELS) {
+        uint32_t encoded = (uint32_t)voxel3d_depth_encode(plane, TOF_DEPTH_PIXELS,
+                                                          writer->encoded.data(),
+                                                          (int)writer->encoded.size());
+        const unsigned char *len = (const unsigned char *)&encoded;
+
+        payload.insert(payload.end(), len, len + sizeof(encoded));
+        payload.insert(payload.end(), writer->encoded.data(), writer->encoded.data() + encoded);
+    }
+    return (uint32_t)(payload.size() - start);
+}
+
+static bool decode_rvl(const unsigned char *stored, uint32_t stored_size, void *data, uint32_t size)
+{
+    unsigned short *plane = (unsigned short *)data;
+    uint32_t pos = 0;
+
+    for (uint32_t ix = 0; ix < size / RVL_PLANE_SIZE; ix++, plane += TOF_DEPTH_PIXELS) {
+        uint32_t encoded;
+
+        if (stored_size - pos < sizeof(encoded))
+            return false;
+        memcpy(&encoded, stored + pos, sizeof(encoded));
+        pos += sizeof(encoded);
+        if (encoded > stored_size - pos ||
+            voxel3d_depth_decode(stored + pos, (int)encoded, plane, TOF_DEPTH_PIXELS) < 0)
+            return false;
+        pos += encoded;
+    }
+    return pos == stored_size;
+}
+
+extern "C" int voxel3d_capture_write_frame(capture_writer_t *writer,
+                                           const CaptureFrameInfo *info,
+                                           const void *data)
+{
+    ChunkFrame frame;
+
+    if (!writer || !info || (!data && info->size) || info->stream >= CAPTURE_STREAM_COUNT)
+        return -1;
+
+    /* age out chunks first so streams that went quiet still reach the disk */
+    for (unsigned int ix = 0; ix < CAPTURE_STREAM_COUNT; ix++) {
+        StreamChunk &chunk = writer->chunks[ix];
+        if (!chunk.frames.empty() &&
+            info->host_ts_us >= chunk.frames[0].host_ts_us + CAPTURE_CHUNK_MAX_US &&
+            write_chunk(writer, ix) < 0)
+            return -2;
+    }
+
+    StreamChunk &chunk = writer->chunks[info->stream];
+    if (chunk.codec == CAPTURE_CODEC_RVL && (!info->size || info->size % RVL_PLANE_SIZE))
+        return -1;
+
+    /* the stored size of a coded frame isn't known up front, size the chunk on raw size */
+    if (!chunk.frames.empty() && chunk.payload.size() + info->size > CAPTURE_CHUNK_MAX_BYTES &&
+        write_chunk(writer, info->stream) < 0)
+        return -2;
+
+    frame.host_ts_us = info->host_ts_us;
+    frame.frame_count = info->frame_count;
+    frame.offset = (uint32_t)chunk.payload.size();
+    frame.size = info->size;
+    frame.width = info->width;
+    frame.height = info->height;
+    if (chunk.codec == CAPTURE_CODEC_RVL) {
+        frame.stored_size = append_rvl(writer, chunk.payload, data, info->size);
+    }
+    else {
+        frame.stored_size = info->size;
+        chunk.payload.insert(chunk.payload.end(), (const unsigned char *)data,
+                             (const unsigned char *)data + info->size);
+    }
+    chunk.frames.push_back(frame);
+
+    if (chunk.payload.size() >= CAPTURE_CHUNK_MAX_BYTES && write_chunk(writer, info->stream) < 0)
+        return -2;
+
+    return true;
+}
+
+static int write_chunks(capture_writer_t *writer)
+{
+    for (unsigned int ix = 0; ix < CAPTURE_STREAM_COUNT; ix++) {
+        if (write_chunk(writer, ix) < 0)
+            return -2;
+    }
+    return true;
+}
+
+extern "C" int voxel3d_capture_flush(capture_writer_t *writer)
+{
+    if (!writer)
+        return -1;
+
+    if (write_chunks(writer) < 0)
+        return -2;
+    if (!output_sync(writer)) {
+        writer->failed = true;
+        return -2;
+    }
+    return true;
+}
+
+extern "C" void voxel3d_capture_close(capture_writer_t *writer)
+{
+    IndexFooter footer;
+
+    if (!writer)
+        return;
+
+    /* synced once by output_close(), after the index */
+    if (write_chunks(writer) > 0) {
+        size_t index_size = writer->index.size() * sizeof(IndexEntry);
+
+        memcpy(footer.magic, CAPTURE_INDEX_MAGIC, sizeof(footer.magic));
+        footer.index_offset = writer->file_size;
+        footer.entry_count = writer->index.size();
+        footer.index_crc = crc32_update(0, writer->index.data(), index_size);
+        footer.reserved = 0;
+
+        if (output_write(writer, writer->index.data(), index_size) &&
+            output_write(writer, &footer, sizeof(footer)))
+            writer->file_size += index_size + sizeof(footer);
+    }
+
+    output_close(writer, writer->file_size);
+    delete writer;
+}
+
+static void add_frame(capture_reader_t *reader, const IndexEntry &entry)
+{
+    FrameEntry frame;
+
+    frame.offset = entry.offset;
+    frame.stored_size = entry.stored_size;
+    frame.codec = entry.codec;
+    frame.info.stream = entry.stream;
+    frame.info.frame_count = entry.frame_count;
+    frame.info.host_ts_us = entry.host_ts_us;
+    frame.info.width = entry.width;
+    frame.info.height = entry.height;
+    frame.info.size = entry.size;
+    reader->frames[entry.stream].push_back(frame);
+}
+
+static bool load_index(capture_reader_t *reader, int64_t file_size, int64_t data_start)
+{
+    IndexFooter footer;
+    std::vector<IndexEntry> index;
+
+    if (file_size < data_start + (int64_t)sizeof(footer) ||
+        capture_fseek(reader->fp, file_size - sizeof(footer), SEEK_SET) ||
+        fread(&footer, sizeof(footer), 1, reader->fp) != 1 ||
+        memcmp(footer.magic, CAPTURE_INDEX_MAGIC, sizeof(footer.magic)) ||
+        footer.index_offset + footer.entry_count * sizeof(IndexEntry) + sizeof(footer) !=
+            (uint64_t)file_size)
+        return false;
+
+    index.resize((size_t)footer.entry_count);
+    if (capture_fseek(reader->fp, footer.index_offset, SEEK_SET) ||
+        (!index.empty() && fread(index.data(), index.size() * sizeof(IndexEntry), 1, reader->fp) != 1) ||
+        crc32_update(0, index.data(), index.size() * sizeof(IndexEntry)) != footer.index_crc)
+        return false;
+
+    for (const IndexEntry &entry : index) {
+        if (entry.stream >= CAPTURE_STREAM_COUNT)
+            return false;
+    }
+    for (const IndexEntry &entry : index)
+        add_frame(reader, entry);
+    return true;
+}
+
+/* Rebuild the index of a file whose recording never reached voxel3d_capture_close() */
+static void recover_index(capture_reader_t *reader, int64_t file_size, int64_t data_start)
+{
+    std::vector<unsigned char> body;
+    ChunkHeader header;
+    int64_t offset = data_start;
+
+    for (int ix = 0; ix < CAPTURE_STREAM_COUNT; ix++)
+        reader->frames[ix].clear();
+
+    while (offset + (int64_t)sizeof(header) <= file_size) {
+        if (capture_fseek(reader->fp, offset, SEEK_SET) ||
+            fread(&header, sizeof(header), 1, reader->fp) != 1 ||
+            header.magic != CAPTURE_CHUNK_MAGIC ||
+            header.header_crc != crc32_update(0, &header, offsetof(ChunkHeader, header_crc)) ||
+            header.stream >= CAPTURE_STREAM_COUNT ||
+            header.chunk_size < sizeof(header) + (uint64_t)header.num_frames * sizeof(ChunkFrame) ||
+            offset + (int64_t)header.chunk_size > file_size)
+            break;
+
+        body.resize((size_t)(header.chunk_size - sizeof(header)));
+        if (fread(body.data(), body.size(), 1, reader->fp) != 1 ||
+            crc32_update(0, body.data(), body.size()) != header.payload_crc)
+            break;
+
+        const ChunkFrame *frames = (const ChunkFrame *)body.data();
+        int64_t payload_offset = offset + sizeof(header) + header.num_frames * sizeof(ChunkFrame);
+        for (uint32_t ix = 0; ix < header.num_frames; ix++) {
+            IndexEntry entry;
+            entry.offset = payload_offset + frames[ix].offset;
+            entry.host_ts_us = frames[ix].host_ts_us;
+            entry.stream = header.stream;
+            entry.frame_count = frames[ix].frame_count;
+            entry.size = frames[ix].size;
+            entry.stored_size = frames[ix].stored_size;
+            entry.width = frames[ix].width;
+            entry.height = frames[ix].height;
+            entry.codec = header.codec;
+            add_frame(reader, entry);
+        }
+        offset += header.chunk_size;
+    }
+}
+
+extern "C" capture_reader_t *voxel3d_capture_open(const char *file_path)
+{
+    FileHeader header;
+    int64_t file_size;
+    FILE *fp;
+
+    if (!file_path)
+        return NULL;
+
+    fp = fopen(file_path, "rb");
+    if (!fp)
+        return NULL;
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic)) ||
+        header.version != CAPTURE_FILE_VERSION ||
+        header.header_size != sizeof(header) ||
+        capture_fseek(fp, 0, SEEK_END) ||
+        (file_size = capture_ftell(fp)) < 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    capture_reader_t *reader = new capture_reader_t;
+    reader->fp = fp;
+    reader->file_size = file_size;
+    reader->dev_info = header.dev_info;
+    reader->map = NULL;
+
+    if (!load_index(reader, file_size, sizeof(header)))
+        recover_index(reader, file_size, sizeof(header));
+
+    return reader;
+}
+
+extern "C" int voxel3d_capture_get_device_info(capture_reader_t *reader,
+                                               CaptureDeviceInfo *dev_info)
+{
+    if (!reader || !dev_info)
+        return -1;
+
+    *dev_info = reader->dev_info;
+    return true;
+}
+
+extern "C" int voxel3d_capture_frame_count(capture_reader_t *reader, unsigned int stream)
+{
+    if (!reader || stream >= CAPTURE_STREAM_COUNT)
+        return -1;
+
+    return (int)reader->frames[stream].size();
+}
+
+extern "C" int voxel3d_capture_frame_info(capture_reader_t *reader, unsigned int stream,
+                                          unsigned int index, CaptureFrameInfo *info)
+{
+    if (!reader || stream >= CAPTURE_STREAM_COUNT || !info ||
+        index >= reader->frames[stream].size())
+        return -1;
+
+    *info = reader->frames[stream][index].info;
+    return true;
+}
+
+extern "C" int voxel3d_capture_seek_time(capture_reader_t *reader, unsigned int stream,
+                                         unsigned long long host_ts_us)
+{
+    if (!reader || stream >= CAPTURE_STREAM_COUNT)
+        return -1;
+
+    const std::vector<FrameEntry> &frames = reader->frames[stream];
+    auto it = std::upper_bound(frames.begin(), frames.end(), host_ts_us,
+                               [](unsigned long long ts, const FrameEntry &frame) {
+                                   return ts < frame.info.host_ts_us;
+                               });
+    if (it == frames.begin())
+        return -2;
+    return (int)(it - frames.begin()) - 1;
+}
+
+extern "C" int voxel3d_capture_seek_frame_count(capture_reader_t *reader, unsigned int stream,
+                                                unsigned int frame_count)
+{
+    if (!reader || stream >= CAPTURE_STREAM_COUNT)
+        return -1;
+
+    /* frame counts grow with time unless the device restarted, then fall back to a scan */
+    const std::vector<FrameEntry> &frames = reader->frames[stream];
+    auto it = std::lower_bound(frames.begin(), frames.end(), frame_count,
+                               [](const FrameEntry &frame, unsigned int count) {
+                                   return frame.info.frame_count < count;
+                               });
+    if (it == frames.end() || it->info.frame_count != frame_count) {
+        it = std::find_if(frames.begin(), frames.end(), [frame_count](const FrameEntry &frame) {
+            return frame.info.frame_count == frame_count;
+        });
+        if (it == frames.end())
+            return -2;
+    }
+    return (int)(it - frames.begin());
+}
+
+static bool map_file(capture_reader_t *reader, const char *file_path)
+{
+#ifdef PLAT_WINDOWS
+    reader->map_file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                   NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (reader->map_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    reader->map_handle = CreateFileMappingA(reader->map_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!reader->map_handle) {
+        CloseHandle(reader->map_file);
+        return false;
+    }
+
+    reader->map = (const unsigned char *)MapViewOfFile(reader->map_handle, FILE_MAP_READ, 0, 0,
+                                                       (SIZE_T)reader->file_size);
+    if (!reader->map) {
+        CloseHandle(reader->map_handle);
+        CloseHandle(reader->map_file);
+        return false;
+    }
+#else /* PLAT_LINUX */
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    void *map = mmap(NULL, (size_t)reader->file_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    /* scrubbing must not pull in readahead around every frame, playback asks for it */
+    madvise(map, (size_t)reader->file_size, MADV_RANDOM);
+    reader->map = (const unsigned char *)map;
+#endif /* PLAT_WINDOWS */
+    return true;
+}
+
+static void unmap_file(capture_reader_t *reader)
+{
+    if (!reader->map)
+        return;
+
+#ifdef PLAT_WINDOWS
+    UnmapViewOfFile(reader->map);
+    CloseHandle(reader->map_handle);
+    CloseHandle(reader->map_file);
+#else /* PLAT_LINUX */
+    munmap((void *)reader->map, (size_t)reader->file_size);
+#endif /* PLAT_WINDOWS */
+    reader->map = NULL;
+}
+
+/* Ask the OS to read [begin, end) of the mapped file in the background */
+static void prefetch_range(capture_reader_t *reader, int64_t begin, int64_t end)
+{
+    begin = begin < 0 ? 0 : begin & ~(int64_t)(PREFETCH_PAGE_SIZE - 1);
+    end = end > reader->file_size ? reader->file_size : end;
+    if (begin >= end)
+        return;
+
+#ifdef PLAT_WINDOWS
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = (PVOID)(reader->map + begin);
+    range.NumberOfBytes = (SIZE_T)(end - begin);
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else /* PLAT_LINUX */
+    madvise((void *)(reader->map + begin), (size_t)(end - begin), MADV_WILLNEED);
+#endif /* PLAT_WINDOWS */
+}
+
+/*
+ * Prefetch for an access to a frame of a mapped file. A step of one frame from the last
+ * access keeps a CAPTURE_PREFETCH_BYTES window ahead in the direction of playback,
+ * topped up when half of it is consumed; any other access only brings in the frame.
+ */
+static void prefetch_frame(capture_reader_t *reader, unsigned int stream, unsigned int index)
+{
+    const FrameEntry &entry = reader->frames[stream][index];
+    int64_t frame_end = entry.offset + entry.stored_size;
+    std::lock_guard<std::mutex> lock(reader->prefetch_lock);
+    StreamPrefetch &prefetch = reader->prefetch[stream];
+    int step = (int)index - prefetch.last_index;
+
+    prefetch.last_index = (int)index;
+    if (step == 1) {
+        if (frame_end > prefetch.end - CAPTURE_PREFETCH_BYTES / 2) {
+            int64_t begin = entry.offset > prefetch.end ? entry.offset : prefetch.end;
+            prefetch.begin = entry.offset;
+            prefetch.end = entry.offset + CAPTURE_PREFETCH_BYTES;
+            prefetch_range(reader, begin, prefetch.end);
+        }
+    }
+    else if (step == -1) {
+        if (entry.offset < prefetch.begin + CAPTURE_PREFETCH_BYTES / 2) {
+            int64_t end = frame_end < prefetch.begin ? frame_end : prefetch.begin;
+            prefetch.begin = frame_end - CAPTURE_PREFETCH_BYTES;
+            prefetch.end = frame_end;
+            prefetch_range(reader, prefetch.begin, end);
+        }
+    }
+    else {
+        prefetch.begin = entry.offset;
+        prefetch.end = frame_end;
+        prefetch_range(reader, entry.offset, frame_end);
+    }
+}
+
+static bool decode_payload(uint32_t codec, const unsigned char *stored, uint32_t stored_size,
+                           void *data, uint32_t size)
+{
+    if (codec == CAPTURE_CODEC_RAW) {
+        if (stored_size != size)
+            return false;
+        memcpy(data, stored, size);
+        return true;
+    }
+    if (codec == CAPTURE_CODEC_RVL)
+        return !(size % RVL_PLANE_SIZE) && decode_rvl(stored, stored_size, data, size);
+    return false;
+}
+
+extern "C" capture_reader_t *voxel3d_capture_open_mapped(const char *file_path)
+{
+    capture_reader_t *reader = voxel3d_capture_open(file_path);
+
+    if (!reader)
+        return NULL;
+
+    if (!map_file(reader, file_path)) {
+        voxel3d_capture_release(reader);
+        return NULL;
+    }
+
+    /* the index is CRC checked but offsets still must not leave the mapping */
+    for (int ix = 0; ix < CAPTURE_STREAM_COUNT; ix++) {
+        for (const FrameEntry &entry : reader->frames[ix]) {
+            if (entry.offset < 0 || entry.offset + entry.stored_size > reader->file_size) {
+                voxel3d_capture_release(reader);
+                return NULL;
+            }
+        }
+        reader->prefetch[ix].last_index = -2;
+        reader->prefetch[ix].begin = 0;
+        reader->prefetch[ix].end = 0;
+    }
+    return reader;
+}
+
+extern "C" int voxel3d_capture_map_frame(capture_reader_t *reader, unsigned int stream,
+                                         unsigned int index, CaptureMappedFrame *frame)
+{
+    if (!reader || !reader->map || stream >= CAPTURE_STREAM_COUNT || !frame ||
+        index >= reader->frames[stream].size())
+        return -1;
+
+    const FrameEntry &entry = reader->frames[stream][index];
+    prefetch_frame(reader, stream, index);
+
+    frame->info = entry.info;
+    frame->codec = entry.codec;
+    frame->stored_size = entry.stored_size;
+    frame->data = reader->map + entry.offset;
+    return true;
+}
+
+extern "C" int voxel3d_capture_map_frame_time(capture_reader_t *reader, unsigned int stream,
+                                              unsigned long long host_ts_us,
+                                              CaptureMappedFrame *frame)
+{
+    int index = voxel3d_capture_seek_time(reader, stream, host_ts_us);
+
+    if (index < 0)
+        return index;
+    if (voxel3d_capture_map_frame(reader, stream, (unsigned int)index, frame) < 0)
+        return -1;
+    return index;
+}
+
+extern "C" int voxel3d_capture_decode_frame(const CaptureMappedFrame *frame, void *data,
+                                            unsigned int max_size)
+{
+    if (!frame || !frame->data || !data)
+        return -1;
+    if (frame->info.size > max_size)
+        return -2;
+
+    if (!decode_payload(frame->codec, (const unsigned char *)frame->data, frame->stored_size,
+                        data, frame->info.size))
+        return -3;
+
+    return (int)frame->info.size;
+}
+
+extern "C" int voxel3d_capture_read_frame(capture_reader_t *reader, unsigned int stream,
+                                          unsigned int index, CaptureFrameInfo *info,
+                                          void *data, unsigned int max_size)
+{
+    if (!reader || stream >= CAPTURE_STREAM_COUNT || !data ||
+        index >= reader->frames[stream].size())
+        return -1;
+
+    const FrameEntry &entry = reader->frames[stream][index];
+    if (entry.info.size > max_size)
+        return -2;
+
+    if (reader->map) {
+        prefetch_frame(reader, stream, index);
+        if (!decode_payload(entry.codec, reader->map + entry.offset, entry.stored_size,
+                            data, entry.info.size))
+            return -3;
+    }
+    else if (entry.codec == CAPTURE_CODEC_RAW) {
+        if (entry.stored_size != entry.info.size ||
+            capture_fseek(reader->fp, entry.offset, SEEK_SET) ||
+            fread(data, 1, entry.stored_size, reader->fp) != entry.stored_size)
+            return -3;
+    }
+    else {
+        reader->stored.resize(entry.stored_size);
+        if (capture_fseek(reader->fp, entry.offset, SEEK_SET) ||
+            fread(reader->stored.data(), 1, entry.stored_size, reader->fp) != entry.stored_size ||
+            !decode_payload(entry.codec, reader->stored.data(), entry.stored_size,
+                            data, entry.info.size))
+            return -3;
+    }
+
+    if (info)
+        *info = entry.info;
+
+    return (int)entry.info.size;
+}
+
+extern "C" void voxel3d_capture_release(capture_reader_t *reader)
+{
+    if (!reader)
+        return;
+
+    unmap_file(reader);
+    fclose(reader->fp);
+    delete reader;
+}
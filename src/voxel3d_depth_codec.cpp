@@ -0,0 +1,433 @@
+/**
+ @file      voxel3d_depth_codec.cpp
+ @brief     RVL lossless depth codec
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define DEPTH_CODEC_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "voxel3d_depth_codec.h"
+
+/*
+ * Stream: 32-bit little endian words, each holding 8 nibbles, first nibble in the top
+ * bits. A value is coded as 3-bit groups from the least significant one, bit 3 of the
+ * nibble set when another group follows.
+ */
+#define VLE_TABLE_BITS          (12)
+#define VLE_TABLE_SIZE          (1 << VLE_TABLE_BITS)
+#define DECODE_TABLE_BITS       (12)        /* 3 nibbles */
+
+/* Stream bits left-aligned in buf, zero words past the end are counted in padded */
+struct BitReader {
+    const unsigned char *in;
+    const unsigned char *end;
+    uint64_t buf;
+    int avail;
+    int padded;
+};
+
+/*
+ * Codes of all values below VLE_TABLE_SIZE (up to 4 nibbles, first nibble in the high
+ * bits), so typical depth deltas are emitted with one shift-or instead of a loop
+ */
+struct VleTable {
+    uint16_t code[VLE_TABLE_SIZE];
+    uint8_t bits[VLE_TABLE_SIZE];
+
+    VleTable()
+    {
+        for (uint32_t v = 0; v < VLE_TABLE_SIZE; v++) {
+            uint32_t value = v, c = 0, n = 0;
+            do {
+                uint32_t nibble = value & 0x7;
+                value >>= 3;
+                if (value)
+                    nibble |= 0x8;
+                c = (c << 4) | nibble;
+                n += 4;
+            } while (value);
+            code[v] = (uint16_t)c;
+            bits[v] = (uint8_t)n;
+        }
+    }
+};
+
+static const VleTable vle_table;
+
+/*
+ * Complete values starting the next 3 nibbles, so a smooth surface decodes up to 3 pixels
+ * per lookup: bits 0-26 three 9-bit values (0 past the last one), bits 27-28 the number of
+ * values, bits 29-30 the nibbles they take. No value when the first one is longer.
+ */
+struct DecodeTable {
+    uint32_t entry[1 << DECODE_TABLE_BITS];
+
+    DecodeTable()
+    {
+        for (uint32_t ix = 0; ix < (1 << DECODE_TABLE_BITS); ix++) {
+            uint32_t values = 0, count = 0, nibbles = 0, value = 0, shift = 0;
+            for (uint32_t k = 0; k < DECODE_TABLE_BITS / 4; k++) {
+                uint32_t nibble = (ix >> (DECODE_TABLE_BITS - 4 - 4 * k)) & 0xf;
+                value |= (nibble & 0x7) << shift;
+                shift += 3;
+                if (!(nibble & 0x8)) {
+                    values |= value << (9 * count++);
+                    nibbles = k + 1;
+                    value = shift = 0;
+                }
+            }
+            entry[ix] = values | (count << 27) | (nibbles << 29);
+        }
+    }
+};
+
+static const DecodeTable decode_table;
+
+static inline int lowest_set_bit(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline uint32_t byte_swap(uint32_t word)
+{
+#ifdef _MSC_VER
+    return _byteswap_ulong(word);
+#else
+    return __builtin_bswap32(word);
+#endif
+}
+
+/*
+ * Code of 8 valid pixels when every zig-zag delta fits one nibble (-4 <= delta <= 3),
+ * first pixel in the top nibble
+ */
+static inline bool flat_code(const unsigned short *run, int previous, uint32_t *code)
+{
+#ifdef DEPTH_CODEC_SSE2
+    __m128i v = _mm_loadu_si128((const __m128i *)run);
+    __m128i last = _mm_insert_epi16(_mm_slli_si128(v, 2), previous, 0);
+    __m128i up = _mm_subs_epu16(v, last);
+    __m128i down = _mm_subs_epu16(last, v);
+    __m128i far = _mm_or_si128(_mm_subs_epu16(up, _mm_set1_epi16(3)),
+                               _mm_subs_epu16(down, _mm_set1_epi16(4)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(far, _mm_setzero_si128())) != 0xffff)
+        return false;
+
+    /* 2 * up, or 2 * down - 1 */
+    __m128i negative = _mm_andnot_si128(_mm_cmpeq_epi16(down, _mm_setzero_si128()),
+                                        _mm_set1_epi16(-1));
+    __m128i z = _mm_add_epi16(_mm_slli_epi16(_mm_add_epi16(up, down), 1), negative);
+    __m128i pairs = _mm_and_si128(_mm_or_si128(_mm_slli_epi32(z, 4), _mm_srli_epi32(z, 16)),
+                                  _mm_set1_epi32(0xff));
+    __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(pairs, pairs), pairs);
+    *code = byte_swap((uint32_t)_mm_cvtsi128_si32(bytes));
+    return true;
+#else
+    uint32_t z[8];
+    for (int k = 0; k < 8; k++) {
+        int delta = (int)run[k] - previous;
+        z[k] = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+        previous = run[k];
+    }
+    if ((z[0] | z[1] | z[2] | z[3] | z[4] | z[5] | z[6] | z[7]) >= 8)
+        return false;
+    *code = (z[0] << 28) | (z[1] << 24) | (z[2] << 20) | (z[3] << 16) |
+            (z[4] << 12) | (z[5] << 8) | (z[6] << 4) | z[7];
+    return true;
+#endif
+}
+
+/* Store the 8 pixels of a flat_code() word, returns the last one */
+static inline uint32_t flat_decode(uint32_t code, uint32_t previous, unsigned short *p)
+{
+#ifdef DEPTH_CODEC_SSE2
+    __m128i bytes = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)byte_swap(code)),
+                                      _mm_setzero_si128());
+    __m128i z = _mm_unpacklo_epi16(_mm_srli_epi16(bytes, 4),
+                                   _mm_and_si128(bytes, _mm_set1_epi16(0xf)));
+    __m128i sign = _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(z, _mm_set1_epi16(1)));
+    __m128i sum = _mm_xor_si128(_mm_srli_epi16(z, 1), sign);
+
+    /* prefix sum of the deltas, modulo 2^16 like the pixels */
+    sum = _mm_add_epi16(sum, _mm_slli_si128(sum, 2));
+    sum = _mm_add_epi16(sum, _mm_slli_si128(sum, 4));
+    sum = _mm_add_epi16(sum, _mm_slli_si128(sum, 8));
+    sum = _mm_add_epi16(sum, _mm_set1_epi16((short)previous));
+    _mm_storeu_si128((__m128i *)p, sum);
+    return (uint32_t)_mm_extract_epi16(sum, 7);
+#else
+    for (int k = 0; k < 8; k++) {
+        uint32_t zigzag = (code >> (28 - 4 * k)) & 0x7;
+        previous += (zigzag >> 1) ^ (0u - (zigzag & 1));
+        p[k] = (unsigned short)previous;
+    }
+    return previous;
+#endif
+}
+
+/* Skip pixels while (pixel != 0) == nonzero, 8 pixels per step with SSE2 */
+static inline const unsigned short *scan_run(const unsigned short *p, const unsigned short *end,
+                                             bool nonzero)
+{
+#ifdef DEPTH_CODEC_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const uint32_t invert = nonzero ? 0x0000 : 0xffff;
+
+    while (end - p >= 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)) ^ invert;
+        if (mask)
+            return p + (lowest_set_bit(mask) >> 1);
+        p += 8;
+    }
+#endif
+    while (p != end && (*p != 0) == nonzero)
+        p++;
+    return p;
+}
+
+/*
+ * Append code bits to the accumulator and store the oldest 32 bits once there are that
+ * many. The store is unconditional and the pointer only advances when the word is
+ * complete, which keeps the data dependent branch out of the per-pixel loop; the caller
+ * guarantees 4 bytes of room past the last complete word.
+ */
+#define PUT_BITS(code, n)                                   \
+    do {                                                    \
+        acc = (acc << (n)) | (code);                        \
+        bits += (n);                                        \
+        int full = bits >> 5;                               \
+        bits -= full << 5;                                  \
+        uint32_t word = (uint32_t)(acc >> bits);            \
+        memcpy(o, &word, 4);                                \
+        o += full << 2;                                     \
+    } while (0)
+
+#define PUT_VLE(value)                                      \
+    do {                                                    \
+        uint32_t v = (value);                               \
+        if (v < VLE_TABLE_SIZE) {                           \
+            PUT_BITS(vle_table.code[v], vle_table.bits[v]); \
+        }                                                   \
+        else {                                              \
+            do {                                            \
+                uint32_t nibble = v & 0x7;                  \
+                v >>= 3;                                    \
+                if (v)                                      \
+                    nibble |= 0x8;                          \
+                PUT_BITS(nibble, 4);                        \
+            } while (v);                                    \
+        }                                                   \
+    } while (0)
+
+/* Keep at least 32 bits in the reader, zeros once the stream is exhausted */
+static inline void refill(BitReader &r)
+{
+    if (r.avail < 32) {
+        uint32_t word = 0;
+        if (r.in + 4 <= r.end) {
+            memcpy(&word, r.in, 4);
+            r.in += 4;
+        }
+        else {
+            r.padded += 32;
+        }
+        r.buf |= (uint64_t)word << (32 - r.avail);
+        r.avail += 32;
+    }
+}
+
+static inline uint32_t get_vle(BitReader &r)
+{
+    uint32_t value = 0, nibble;
+    int shift = 0;
+
+    do {
+        refill(r);
+        nibble = (uint32_t)(r.buf >> 60);
+        r.buf <<= 4;
+        r.avail -= 4;
+        value |= (nibble & 0x7) << shift;
+        shift += 3;
+    } while ((nibble & 0x8) && shift < 32);
+
+    return value;
+}
+
+/* Modulo 2^32 like the encoder's deltas, a corrupted stream only gives wrong pixels */
+static inline uint32_t unzigzag(uint32_t zigzag)
+{
+    return (zigzag >> 1) ^ (0u - (zigzag & 1));
+}
+
+extern "C" int voxel3d_depth_encode(const unsigned short *depthmap, int pixels,
+                                    unsigned char *out, int max_size)
+{
+    const unsigned short *p = depthmap, *end = depthmap + pixels;
+    unsigned char *o = out;
+    uint64_t acc = 0;
+    int bits = 0;
+    int previous = 0;
+
+    if (!depthmap || pixels <= 0 || !out)
+        return -1;
+    if (max_size < DEPTH_CODEC_MAX_ENCODED_SIZE(pixels))
+        return -2;
+
+    while (p != end) {
+        const unsigned short *run = p;
+        p = scan_run(p, end, false);
+        PUT_VLE((uint32_t)(p - run));
+
+        run = p;
+        p = scan_run(p, end, true);
+        PUT_VLE((uint32_t)(p - run));
+
+        /*
+         * Groups of pixels share one accumulator update to shorten the serial bit chain:
+         * eight when all deltas fit one nibble (flat surfaces), four when they fit two,
+         * else two
+         */
+        while (p - run >= 4) {
+            uint32_t code;
+            for (; p - run >= 8 && flat_code(run, previous, &code); run += 8) {
+                PUT_BITS(code, 32);
+                previous = run[7];
+            }
+            if (p - run < 4)
+                break;
+
+            int d0 = (int)run[0] - previous;
+            int d1 = (int)run[1] - (int)run[0];
+            int d2 = (int)run[2] - (int)run[1];
+            int d3 = (int)run[3] - (int)run[2];
+            uint32_t z0 = ((uint32_t)d0 << 1) ^ (uint32_t)(d0 >> 31);
+            uint32_t z1 = ((uint32_t)d1 << 1) ^ (uint32_t)(d1 >> 31);
+            uint32_t z2 = ((uint32_t)d2 << 1) ^ (uint32_t)(d2 >> 31);
+            uint32_t z3 = ((uint32_t)d3 << 1) ^ (uint32_t)(d3 >> 31);
+            previous = run[3];
+
+            if ((z0 | z1 | z2 | z3) < 64) {
+                uint32_t n1 = vle_table.bits[z1], n2 = vle_table.bits[z2], n3 = vle_table.bits[z3];
+                uint32_t code = ((((((uint32_t)vle_table.code[z0] << n1) | vle_table.code[z1])
+                                  << n2) | vle_table.code[z2]) << n3) | vle_table.code[z3];
+                PUT_BITS(code, vle_table.bits[z0] + n1 + n2 + n3);
+            }
+            else {
+                PUT_VLE(z0);
+                PUT_VLE(z1);
+                PUT_VLE(z2);
+                PUT_VLE(z3);
+            }
+            run += 4;
+        }
+        for (; p - run >= 2; run += 2) {
+            int d0 = (int)run[0] - previous;
+            int d1 = (int)run[1] - (int)run[0];
+            uint32_t z0 = ((uint32_t)d0 << 1) ^ (uint32_t)(d0 >> 31);
+            uint32_t z1 = ((uint32_t)d1 << 1) ^ (uint32_t)(d1 >> 31);
+            previous = run[1];
+
+            if ((z0 | z1) < VLE_TABLE_SIZE) {
+                uint32_t n1 = vle_table.bits[z1];
+                PUT_BITS(((uint32_t)vle_table.code[z0] << n1) | vle_table.code[z1],
+                         vle_table.bits[z0] + n1);
+            }
+            else {
+                PUT_VLE(z0);
+                PUT_VLE(z1);
+            }
+        }
+        if (run != p) {
+            int delta = (int)*run - previous;
+            PUT_VLE(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+            previous = *run;
+        }
+    }
+
+    if (bits)
+        PUT_BITS(0, 32 - bits);
+
+    return (int)(o - out);
+}
+
+extern "C" int voxel3d_depth_decode(const unsigned char *in, int size,
+                                    unsigned short *depthmap, int pixels)
+{
+    BitReader r = { in, in + (size > 0 ? size : 0), 0, 0, 0 };
+    unsigned short *p = depthmap, *end = depthmap + pixels;
+    uint32_t previous = 0;
+
+    if (!in || !depthmap || pixels <= 0)
+        return -1;
+
+    while (p != end) {
+        uint32_t zeros = get_vle(r);
+        if (r.avail < r.padded || zeros > (uint32_t)(end - p))
+            return -2;
+        memset(p, 0, zeros * sizeof(*p));
+        p += zeros;
+
+        uint32_t nonzeros = get_vle(r);
+        if (r.avail < r.padded || nonzeros > (uint32_t)(end - p))
+            return -2;
+
+        /*
+         * A word without continuation bits is the 8 single-nibble pixels of the encoder's
+         * flat groups. All 3 pixels of a lookup are stored, the ones past its values are
+         * stored again.
+         */
+        unsigned short *run_end = p + nonzeros;
+        while (run_end - p >= 3) {
+            refill(r);
+            if (run_end - p >= 8 && !((r.buf >> 32) & 0x88888888u)) {
+                previous = flat_decode((uint32_t)(r.buf >> 32), previous, p);
+                p += 8;
+                r.buf <<= 32;
+                r.avail -= 32;
+                continue;
+            }
+            uint32_t entry = decode_table.entry[r.buf >> (64 - DECODE_TABLE_BITS)];
+            uint32_t count = (entry >> 27) & 0x3;
+            if (!count) {
+                previous += unzigzag(get_vle(r));
+                *p++ = (unsigned short)previous;
+                continue;
+            }
+            uint32_t v0 = previous + unzigzag(entry & 0x1ff);
+            uint32_t v1 = v0 + unzigzag((entry >> 9) & 0x1ff);
+            uint32_t v2 = v1 + unzigzag((entry >> 18) & 0x1ff);
+            p[0] = (unsigned short)v0;
+            p[1] = (unsigned short)v1;
+            p[2] = (unsigned short)v2;
+            p += count;
+            previous = v2;
+            r.buf <<= (entry >> 29) * 4;
+            r.avail -= (entry >> 29) * 4;
+        }
+        for (; p != run_end; p++) {
+            previous += unzigzag(get_vle(r));
+            *p = (unsigned short)previous;
+        }
+        if (r.avail < r.padded)
+            return -2;
+    }
+
+    /* whole words, as the encoder pads the stream */
+    return (int)((((r.in - in) * 8 + r.padded - r.avail) + 31) / 32 * 4);
+}
@@ -0,0 +1,683 @@
+/**
+ @file      voxel3d_device.cpp
+ @brief     Handle-based access to 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "voxel3d_device.h"
+
+enum DeviceCache
+{
+    CACHE_TOF_INFO = 0x01,
+    CACHE_RGB_INFO = 0x02,
+    CACHE_FLIR_INFO = 0x04,
+    CACHE_HFOV = 0x08,
+    CACHE_VFOV = 0x10,
+    CACHE_FW_VERSION = 0x20,
+    CACHE_FW_BUILD_DATE = 0x40,
+};
+
+/* Settings made through the handle, applied again by voxel3d_device_reinit() */
+enum DeviceSetting
+{
+    SETTING_CONF_THRESHOLD = 0x01,
+    SETTING_AUTO_EXPOSURE = 0x02,
+    SETTING_RECTIFY_TYPE = 0x04,
+};
+
+struct voxel3d_device {
+    /* read by every frame query, kept together at the start */
+    const DeviceBackend *backend;
+    char sn[MAX_PRODUCT_SN_LEN];
+
+    std::mutex lock;                        /* sensor state and caches below */
+    bool tof_on;
+    bool rgb_on;
+    bool flir_on;
+    unsigned int sensors;                   /* DEVICE_OPEN_* bits to bring up on reinit */
+    unsigned int settings;                  /* DeviceSetting */
+    unsigned int conf_threshold;
+    unsigned int auto_exposure;
+    int rectify_type;
+    unsigned int cached;                    /* DeviceCache */
+    CameraInfo tof_info;
+    CameraInfo rgb_info;
+    CameraInfo flir_info;
+    float hfov;
+    float vfov;
+    char fw_version[MAX_FW_VER_LEN];
+    char fw_build_date[MAX_FW_BUILD_DATE_LEN];
+};
+
+/* One sensor brought up by voxel3d_open_all() */
+struct SensorBringUp {
+    voxel3d_device_t *dev;
+    unsigned int sensor;                    /* DEVICE_OPEN_TOF, _RGB or _THERMAL */
+    unsigned int flags;
+    int result;
+    unsigned int cached;                    /* DeviceCache read, merged after the join */
+    unsigned int init_us;
+    unsigned int calibration_us;
+    unsigned int fw_info_us;
+};
+
+static void copy_string(char *dst, const char *src, unsigned int max_len)
+{
+    size_t len = strlen(src);
+
+    if (len > max_len - 1)
+        len = max_len - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+static unsigned int elapsed_us(std::chrono::steady_clock::time_point start)
+{
+    return (unsigned int)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+extern "C" voxel3d_device_t *voxel3d_device_open(char *dev_sn, const DeviceBackend *backend)
+{
+    char sn[MAX_PRODUCT_SN_LEN] = {'\0'};
+
+    if (!backend)
+        backend = voxel3d_device_backend();
+
+    if (dev_sn && dev_sn[0]) {
+        copy_string(sn, dev_sn, MAX_PRODUCT_SN_LEN);
+    }
+    else {
+        CamDevInfo scan_info;
+        if (backend->scan(&scan_info) <= 0 || !scan_info.product_sn[0][0])
+            return NULL;
+        copy_string(sn, scan_info.product_sn[0], MAX_PRODUCT_SN_LEN);
+    }
+
+    voxel3d_device_t *dev = new voxel3d_device_t;
+    dev->backend = backend;
+    memcpy(dev->sn, sn, sizeof(dev->sn));
+    dev->tof_on = false;
+    dev->rgb_on = false;
+    dev->flir_on = false;
+    dev->sensors = 0;
+    dev->settings = 0;
+    dev->rectify_type = RectifyType::NONE;
+    dev->cached = 0;
+    return dev;
+}
+
+/*
+ * Runs before the handle is handed out: each sensor writes only its own cache fields and
+ * the flags are merged once every bring-up has finished, so no lock is taken.
+ */
+static void bring_up(SensorBringUp *bring)
+{
+    voxel3d_device_t *dev = bring->dev;
+    const DeviceBackend *backend = dev->backend;
+    auto start = std::chrono::steady_clock::now();
+
+    switch (bring->sensor) {
+    case DEVICE_OPEN_TOF:
+        bring->result = backend->tof_init(dev->sn);
+        break;
+    case DEVICE_OPEN_RGB:
+        bring->result = backend->rgb_init(dev->sn);
+        break;
+    default:
+        bring->result = backend->lepton3_init(dev->sn);
+        break;
+    }
+    bring->init_us = elapsed_us(start);
+    if (bring->result <= 0)
+        return;
+
+    if (bring->flags & DEVICE_OPEN_CALIBRATION) {
+        start = std::chrono::steady_clock::now();
+        switch (bring->sensor) {
+        case DEVICE_OPEN_TOF:
+            if (backend->tof_read_camera_info(dev->sn, &dev->tof_info) > 0)
+                bring->cached |= CACHE_TOF_INFO;
+            if ((dev->hfov = backend->tof_get_depth_hfov(dev->sn)) > 0)
+                bring->cached |= CACHE_HFOV;
+            if ((dev->vfov = backend->tof_get_depth_vfov(dev->sn)) > 0)
+                bring->cached |= CACHE_VFOV;
+            break;
+        case DEVICE_OPEN_RGB:
+            if (backend->rgb_read_camera_info(dev->sn, &dev->rgb_info) > 0)
+                bring->cached |= CACHE_RGB_INFO;
+            break;
+        default:
+            if (backend->lepton3_read_camera_info(dev->sn, &dev->flir_info) > 0)
+                bring->cached |= CACHE_FLIR_INFO;
+            break;
+        }
+        bring->calibration_us = elapsed_us(start);
+    }
+
+    /* the F/W information becomes readable some time after ToF init, poll for it */
+    if (bring->sensor == DEVICE_OPEN_TOF && (bring->flags & DEVICE_OPEN_FW_INFO)) {
+        start = std::chrono::steady_clock::now();
+        for (;;) {
+            memset(dev->fw_version, 0, sizeof(dev->fw_version));
+            if (backend->read_fw_version(dev->sn, dev->fw_version, MAX_FW_VER_LEN) > 0) {
+                dev->fw_version[MAX_FW_VER_LEN - 1] = '\0';
+                bring->cached |= CACHE_FW_VERSION;
+                break;
+            }
+            if (elapsed_us(start) >= DEVICE_FW_INFO_TIMEOUT_MS * 1000)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(DEVICE_FW_INFO_RETRY_MS));
+        }
+        memset(dev->fw_build_date, 0, sizeof(dev->fw_build_date));
+        if ((bring->cached & CACHE_FW_VERSION) &&
+            backend->read_fw_build_date(dev->sn, dev->fw_build_date, MAX_FW_BUILD_DATE_LEN) > 0) {
+            dev->fw_build_date[MAX_FW_BUILD_DATE_LEN - 1] = '\0';
+            bring->cached |= CACHE_FW_BUILD_DATE;
+        }
+        bring->fw_info_us = elapsed_us(start);
+    }
+}
+
+extern "C" voxel3d_device_t *voxel3d_open_all(char *dev_sn, unsigned int flags,
+                                              const DeviceBackend *backend,
+                                              DeviceOpenReport *report)
+{
+    static const unsigned int sensors[] = {
+        DEVICE_OPEN_TOF, DEVICE_OPEN_RGB, DEVICE_OPEN_THERMAL
+    };
+    SensorBringUp bring[3];
+    std::thread threads[3];
+    unsigned int count = 0, up = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    if (report)
+        memset(report, 0, sizeof(*report));
+
+    voxel3d_device_t *dev = voxel3d_device_open(dev_sn, backend);
+    if (report)
+        report->scan_us = elapsed_us(start);
+    if (!dev)
+        return NULL;
+
+    for (unsigned int ix = 0; ix < 3; ix++) {
+        if (!(flags & sensors[ix]))
+            continue;
+        memset(&bring[count], 0, sizeof(bring[count]));
+        bring[count].dev = dev;
+        bring[count].sensor = sensors[ix];
+        bring[count].flags = flags;
+        count++;
+    }
+
+    /* the first sensor is brought up by the calling thread */
+    for (unsigned int ix = 1; ix < count; ix++) {
+        if (!(flags & DEVICE_OPEN_SEQUENTIAL))
+            threads[ix] = std::thread(bring_up, &bring[ix]);
+    }
+    if (count)
+        bring_up(&bring[0]);
+    for (unsigned int ix = 1; ix < count; ix++) {
+        if (threads[ix].joinable())
+            threads[ix].join();
+        else
+            bring_up(&bring[ix]);
+    }
+
+    for (unsigned int ix = 0; ix < count; ix++) {
+        bool on = bring[ix].result > 0;
+
+        up += on ? 1 : 0;
+        dev->sensors |= on ? bring[ix].sensor : 0;
+        dev->cached |= bring[ix].cached;
+        if (bring[ix].sensor == DEVICE_OPEN_TOF)
+            dev->tof_on = on;
+        else if (bring[ix].sensor == DEVICE_OPEN_RGB)
+            dev->rgb_on = on;
+        else
+            dev->flir_on = on;
+
+        if (report) {
+            if (bring[ix].sensor == DEVICE_OPEN_TOF) {
+                report->tof_result = bring[ix].result;
+                report->tof_init_us = bring[ix].init_us;
+                report->fw_info_us = bring[ix].fw_info_us;
+            }
+            else if (bring[ix].sensor == DEVICE_OPEN_RGB) {
+                report->rgb_result = bring[ix].result;
+                report->rgb_init_us = bring[ix].init_us;
+            }
+            else {
+                report->thermal_result = bring[ix].result;
+                report->thermal_init_us = bring[ix].init_us;
+            }
+            if (bring[ix].calibration_us > report->calibration_us)
+                report->calibration_us = bring[ix].calibration_us;
+        }
+    }
+    if (report)
+        report->total_us = elapsed_us(start);
+
+    if (count && !up) {
+        voxel3d_device_close(dev);
+        return NULL;
+    }
+    return dev;
+}
+
+extern "C" void voxel3d_device_close(voxel3d_device_t *dev)
+{
+    if (!dev)
+        return;
+
+    if (dev->tof_on)
+        dev->backend->tof_release(dev->sn);
+    if (dev->flir_on)
+        dev->backend->lepton3_release(dev->sn);
+    if (dev->rgb_on)
+        dev->backend->rgb_release(dev->sn);
+    dev->backend->release(dev->sn);
+    delete dev;
+}
+
+extern "C" const char *voxel3d_device_sn(voxel3d_device_t *dev)
+{
+    return dev ? dev->sn : NULL;
+}
+
+extern "C" const DeviceBackend *voxel3d_device_get_backend(voxel3d_device_t *dev)
+{
+    return dev ? dev->backend : NULL;
+}
+
+/*
+ * Sensors
+ */
+extern "C" int voxel3d_device_tof_init(voxel3d_device_t *dev)
+{
+    if (!dev)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    int ret = dev->backend->tof_init(dev->sn);
+    if (ret > 0) {
+        dev->tof_on = true;
+        dev->sensors |= DEVICE_OPEN_TOF;
+    }
+    return ret;
+}
+
+extern "C" unsigned int voxel3d_device_tof_queryframe(voxel3d_device_t *dev,
+                                                      unsigned short *depthmap,
+                                                      unsigned short *irmap)
+{
+    return dev ? dev->backend->tof_queryframe(dev->sn, depthmap, irmap) : 0;
+}
+
+extern "C" int voxel3d_device_tof_generatePointCloud(voxel3d_device_t *dev,
+                                                     unsigned short *depthmap,
+                                                     float *xyz)
+{
+    return dev ? dev->backend->tof_generatePointCloud(dev->sn, depthmap, xyz) : -1;
+}
+
+extern "C" void voxel3d_device_tof_release(voxel3d_device_t *dev)
+{
+    if (!dev)
+        return;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    dev->backend->tof_release(dev->sn);
+    dev->tof_on = false;
+    dev->sensors &= ~DEVICE_OPEN_TOF;
+}
+
+extern "C" int voxel3d_device_lepton3_init(voxel3d_device_t *dev)
+{
+    if (!dev)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    int ret = dev->backend->lepton3_init(dev->sn);
+    if (ret > 0) {
+        dev->flir_on = true;
+        dev->sensors |= DEVICE_OPEN_THERMAL;
+    }
+    return ret;
+}
+
+extern "C" unsigned int voxel3d_device_lepton3_queryframe(voxel3d_device_t *dev,
+                                                          float *thermal_map)
+{
+    return dev ? dev->backend->lepton3_queryframe(dev->sn, thermal_map) : 0;
+}
+
+extern "C" void voxel3d_device_lepton3_release(voxel3d_device_t *dev)
+{
+    if (!dev)
+        return;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    dev->backend->lepton3_release(dev->sn);
+    dev->flir_on = false;
+    dev->sensors &= ~DEVICE_OPEN_THERMAL;
+}
+
+extern "C" int voxel3d_device_rgb_init(voxel3d_device_t *dev)
+{
+    if (!dev)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    int ret = dev->backend->rgb_init(dev->sn);
+    if (ret > 0) {
+        dev->rgb_on = true;
+        dev->sensors |= DEVICE_OPEN_RGB;
+    }
+    return ret;
+}
+
+extern "C" unsigned int voxel3d_device_rgb_queryframe(voxel3d_device_t *dev,
+                                                      unsigned char *rgb_map)
+{
+    return dev ? dev->backend->rgb_queryframe(dev->sn, rgb_map) : 0;
+}
+
+extern "C" void voxel3d_device_rgb_release(voxel3d_device_t *dev)
+{
+    if (!dev)
+        return;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    dev->backend->rgb_release(dev->sn);
+    dev->rgb_on = false;
+    dev->sensors &= ~DEVICE_OPEN_RGB;
+}
+
+extern "C" int voxel3d_device_read_imu_data(voxel3d_device_t *dev, IMU_DATA *imu_data)
+{
+    return dev ? dev->backend->read_imu_data(dev->sn, imu_data) : -1;
+}
+
+/*
+ * Cached device information
+ */
+static int read_camera_info(voxel3d_device_t *dev, unsigned int flag, CameraInfo *cache,
+                            int (*read)(char *dev_sn, CameraInfo *cam_info),
+                            CameraInfo *cam_info)
+{
+    if (!cam_info)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    if (!(dev->cached & flag)) {
+        int ret = read(dev->sn, cache);
+        if (ret <= 0)
+            return ret;
+        dev->cached |= flag;
+    }
+    *cam_info = *cache;
+    return true;
+}
+
+extern "C" int voxel3d_device_tof_read_camera_info(voxel3d_device_t *dev, CameraInfo *cam_info)
+{
+    if (!dev)
+        return -1;
+
+    return read_camera_info(dev, CACHE_TOF_INFO, &dev->tof_info,
+                            dev->backend->tof_read_camera_info, cam_info);
+}
+
+extern "C" int voxel3d_device_lepton3_read_camera_info(voxel3d_device_t *dev,
+                                                       CameraInfo *cam_info)
+{
+    if (!dev)
+        return -1;
+
+    return read_camera_info(dev, CACHE_FLIR_INFO, &dev->flir_info,
+                            dev->backend->lepton3_read_camera_info, cam_info);
+}
+
+extern "C" int voxel3d_device_rgb_read_camera_info(voxel3d_device_t *dev, CameraInfo *cam_info)
+{
+    if (!dev)
+        return -1;
+
+    return read_camera_info(dev, CACHE_RGB_INFO, &dev->rgb_info,
+                            dev->backend->rgb_read_camera_info, cam_info);
+}
+
+extern "C" int voxel3d_device_preload_camera_info(voxel3d_device_t *dev, unsigned int sensor,
+                                                  const CameraInfo *cam_info)
+{
+    if (!dev || !cam_info)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    switch (sensor) {
+    case DEVICE_OPEN_TOF:
+        dev->tof_info = *cam_info;
+        dev->cached |= CACHE_TOF_INFO;
+        break;
+    case DEVICE_OPEN_RGB:
+        dev->rgb_info = *cam_info;
+        dev->cached |= CACHE_RGB_INFO;
+        break;
+    case DEVICE_OPEN_THERMAL:
+        dev->flir_info = *cam_info;
+        dev->cached |= CACHE_FLIR_INFO;
+        break;
+    default:
+        return -1;
+    }
+    return true;
+}
+
+extern "C" int voxel3d_device_preload_fov(voxel3d_device_t *dev, float hfov, float vfov)
+{
+    if (!dev || hfov <= 0 || vfov <= 0)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    dev->hfov = hfov;
+    dev->vfov = vfov;
+    dev->cached |= CACHE_HFOV | CACHE_VFOV;
+    return true;
+}
+
+static float read_fov(voxel3d_device_t *dev, unsigned int flag, float *cache,
+                      float (*read)(char *dev_sn))
+{
+    std::lock_guard<std::mutex> guard(dev->lock);
+    if (!(dev->cached & flag)) {
+        float fov = read(dev->sn);
+        if (fov <= 0)
+            return fov;
+        *cache = fov;
+        dev->cached |= flag;
+    }
+    return *cache;
+}
+
+extern "C" float voxel3d_device_tof_get_depth_hfov(voxel3d_device_t *dev)
+{
+    if (!dev)
+        return 0;
+
+    return read_fov(dev, CACHE_HFOV, &dev->hfov, dev->backend->tof_get_depth_hfov);
+}
+
+extern "C" float voxel3d_device_tof_get_depth_vfov(voxel3d_device_t *dev)
+{
+    if (!dev)
+        return 0;
+
+    return read_fov(dev, CACHE_VFOV, &dev->vfov, dev->backend->tof_get_depth_vfov);
+}
+
+static int read_string(voxel3d_device_t *dev, unsigned int flag, char *cache,
+                       unsigned int cache_len,
+                       int (*read)(char *dev_sn, char *str, unsigned int max_len),
+                       char *str, unsigned int max_len)
+{
+    if (!str || !max_len)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    if (!(dev->cached & flag)) {
+        memset(cache, 0, cache_len);
+        int ret = read(dev->sn, cache, cache_len);
+        if (ret <= 0)
+            return ret;
+        cache[cache_len - 1] = '\0';
+        dev->cached |= flag;
+    }
+    copy_string(str, cache, max_len);
+    return true;
+}
+
+extern "C" int voxel3d_device_read_fw_version(voxel3d_device_t *dev, char *fw_ver,
+                                              unsigned int max_len)
+{
+    if (!dev)
+        return -1;
+
+    return read_string(dev, CACHE_FW_VERSION, dev->fw_version, MAX_FW_VER_LEN,
+                       dev->backend->read_fw_version, fw_ver, max_len);
+}
+
+extern "C" int voxel3d_device_read_fw_build_date(voxel3d_device_t *dev, char *fw_build_date,
+                                                 unsigned int max_len)
+{
+    if (!dev)
+        return -1;
+
+    return read_string(dev, CACHE_FW_BUILD_DATE, dev->fw_build_date, MAX_FW_BUILD_DATE_LEN,
+                       dev->backend->read_fw_build_date, fw_build_date, max_len);
+}
+
+/*
+ * Settings
+ */
+extern "C" int voxel3d_device_tof_get_conf_threshold(voxel3d_device_t *dev)
+{
+    return dev ? dev->backend->tof_get_conf_threshold(dev->sn) : -1;
+}
+
+extern "C" int voxel3d_device_tof_set_conf_threshold(voxel3d_device_t *dev,
+                                                     unsigned int conf_threshold)
+{
+    if (!dev)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    int ret = dev->backend->tof_set_conf_threshold(dev->sn, conf_threshold);
+    if (ret > 0) {
+        dev->conf_threshold = conf_threshold;
+        dev->settings |= SETTING_CONF_THRESHOLD;
+    }
+    return ret;
+}
+
+extern "C" int voxel3d_device_tof_set_auto_exposure_mode(voxel3d_device_t *dev,
+                                                         unsigned int enable)
+{
+    if (!dev)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    int ret = dev->backend->tof_set_auto_exposure_mode(dev->sn, enable);
+    if (ret > 0) {
+        dev->auto_exposure = enable;
+        dev->settings |= SETTING_AUTO_EXPOSURE;
+    }
+    return ret;
+}
+
+extern "C" int voxel3d_device_set_rectifyType(voxel3d_device_t *dev, int inputType)
+{
+    if (!dev)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    int ret = dev->backend->set_rectifyType(dev->sn, inputType);
+    dev->cached &= ~(CACHE_RGB_INFO | CACHE_FLIR_INFO);
+    if (ret > 0) {
+        dev->rectify_type = inputType;
+        dev->settings |= SETTING_RECTIFY_TYPE;
+    }
+    return ret;
+}
+
+extern "C" int voxel3d_device_get_rectifyType(voxel3d_device_t *dev)
+{
+    if (!dev)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    return dev->rectify_type;
+}
+
+extern "C" int voxel3d_device_reinit(voxel3d_device_t *dev)
+{
+    int ret = true;
+
+    if (!dev)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    if (dev->tof_on)
+        dev->backend->tof_release(dev->sn);
+    if (dev->flir_on)
+        dev->backend->lepton3_release(dev->sn);
+    if (dev->rgb_on)
+        dev->backend->rgb_release(dev->sn);
+    dev->backend->release(dev->sn);
+
+    dev->tof_on = (dev->sensors & DEVICE_OPEN_TOF) && dev->backend->tof_init(dev->sn) > 0;
+    dev->rgb_on = (dev->sensors & DEVICE_OPEN_RGB) && dev->backend->rgb_init(dev->sn) > 0;
+    dev->flir_on = (dev->sensors & DEVICE_OPEN_THERMAL) &&
+                   dev->backend->lepton3_init(dev->sn) > 0;
+    if (((dev->sensors & DEVICE_OPEN_TOF) && !dev->tof_on) ||
+        ((dev->sensors & DEVICE_OPEN_RGB) && !dev->rgb_on) ||
+        ((dev->sensors & DEVICE_OPEN_THERMAL) && !dev->flir_on))
+        ret = -1;
+
+    /* a device that dropped off the bus comes back with its default settings */
+    if (dev->tof_on && (dev->settings & SETTING_CONF_THRESHOLD) &&
+        dev->backend->tof_set_conf_threshold(dev->sn, dev->conf_threshold) <= 0)
+        ret = -1;
+    if (dev->tof_on && (dev->settings & SETTING_AUTO_EXPOSURE) &&
+        dev->backend->tof_set_auto_exposure_mode(dev->sn, dev->auto_exposure) <= 0)
+        ret = -1;
+    if (ret > 0 && (dev->settings & SETTING_RECTIFY_TYPE) &&
+        dev->backend->set_rectifyType(dev->sn, dev->rectify_type) <= 0)
+        ret = -1;
+    return ret;
+}
+
+extern "C" int voxel3d_device_fw_upgrade(voxel3d_device_t *dev, char *file_path,
+    unsigned char (*fw_upgrade_cb)(int state, unsigned int percent_complete))
+{
+    if (!dev)
+        return -1;
+
+    int ret = dev->backend->dev_fw_upgrade(dev->sn, file_path, fw_upgrade_cb);
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    dev->cached &= ~(CACHE_FW_VERSION | CACHE_FW_BUILD_DATE);
+    return ret;
+}
+
+extern "C" int voxel3d_device_fw_upgrade_state_poll(voxel3d_device_t *dev, int &state,
+                                                    unsigned int &percent_complete)
+{
+    return dev ? dev->backend->dev_fw_upgrade_state_poll(dev->sn, state, percent_complete) : -1;
+}
@@ -0,0 +1,305 @@
+/**
+ @file      voxel3d_fw_upgrade.cpp
+ @brief     Concurrent firmware upgrade of several 5Voxel 5VHiRab devices
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "voxel3d_fw_upgrade.h"
+#include "voxel3d_device.h"
+
+#define FW_BATCH_POLL_INTERVAL_MS       (100)
+
+struct BatchDevice {
+    fw_upgrade_batch_t *batch;
+    unsigned int index;
+    FwUpgradeProgress progress;                 /* under batch->lock */
+};
+
+struct fw_upgrade_batch {
+    const DeviceBackend *backend;
+    std::string file_path;
+    fw_upgrade_progress_cb progress_cb;
+    void *user;
+
+    std::vector<BatchDevice> devices;
+    std::atomic<unsigned int> next;             /* next device a worker takes */
+    std::atomic<bool> cancelled;
+    std::vector<std::thread> workers;
+
+    std::mutex lock;                            /* progress of every device */
+    std::condition_variable finished;
+    unsigned int remaining;
+    std::mutex callback_lock;                   /* one progress_cb call at a time */
+};
+
+/*
+ * voxel3d_dev_fw_upgrade() calls back without any context, so each worker leaves the
+ * device it's flashing here for the callback to find. Nothing guarantees the callback runs
+ * on that thread, so the progress is also polled per device, see poll_progress().
+ */
+static thread_local BatchDevice *current_device;
+
+static void copy_string(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+
+    if (len >= size)
+        len = size - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+static void report(BatchDevice *dev, int status, int state, unsigned int percent_complete)
+{
+    fw_upgrade_batch_t *batch = dev->batch;
+    bool changed;
+
+    if (percent_complete > 100)
+        percent_complete = 100;
+
+    {
+        std::lock_guard<std::mutex> guard(batch->lock);
+        /* the callback and the poll race, a late report of the same state doesn't go back */
+        if (status == FW_BATCH_RUNNING && dev->progress.status == FW_BATCH_RUNNING &&
+            dev->progress.state == state && dev->progress.percent_complete > percent_complete)
+            return;
+        changed = dev->progress.status == FW_BATCH_PENDING || dev->progress.state != state ||
+                  dev->progress.percent_complete != percent_complete;
+        dev->progress.status = status;
+        dev->progress.state = state;
+        dev->progress.percent_complete = percent_complete;
+    }
+
+    /* the upgrade utility and the batch both report the first and last state */
+    if (changed && batch->progress_cb) {
+        std::lock_guard<std::mutex> guard(batch->callback_lock);
+        batch->progress_cb(batch->user, dev->index, dev->progress.dev_sn, state,
+                           percent_complete);
+    }
+}
+
+/* Without a device on this thread, the callback came from elsewhere and is left to the poll */
+static unsigned char upgrade_cb(int state, unsigned int percent_complete)
+{
+    BatchDevice *dev = current_device;
+
+    if (dev)
+        report(dev, FW_BATCH_RUNNING, state, percent_complete);
+    return (1);
+}
+
+/* Runs beside the blocking upgrade of the device until flashing is cleared */
+static void poll_progress(BatchDevice *dev, voxel3d_device_t *handle, std::mutex *lock,
+                          std::condition_variable *stop, bool *flashing)
+{
+    std::unique_lock<std::mutex> guard(*lock);
+    while (!stop->wait_for(guard, std::chrono::milliseconds(FW_BATCH_POLL_INTERVAL_MS),
+                           [flashing] { return !*flashing; })) {
+        int state;
+        unsigned int percent_complete;
+
+        guard.unlock();
+        if (voxel3d_device_fw_upgrade_state_poll(handle, state, percent_complete) > 0)
+            report(dev, FW_BATCH_RUNNING, state, percent_complete);
+        guard.lock();
+    }
+}
+
+static void finish(BatchDevice *dev, int result)
+{
+    fw_upgrade_batch_t *batch = dev->batch;
+    int state;
+
+    {
+        std::lock_guard<std::mutex> guard(batch->lock);
+        dev->progress.result = result;
+        state = result < 0 ? (dev->progress.state < 0 ? dev->progress.state :
+                                                        FW_UPGRADE_STATE_ERROR) :
+                             FW_UPGRADE_STATE_COMPLETE;
+    }
+    report(dev, result < 0 ? FW_BATCH_FAILED : FW_BATCH_DONE, state,
+           result < 0 ? dev->progress.percent_complete : 100);
+
+    std::lock_guard<std::mutex> guard(batch->lock);
+    if (!--batch->remaining)
+        batch->finished.notify_all();
+}
+
+static int upgrade_device(fw_upgrade_batch_t *batch, BatchDevice *dev)
+{
+    char fw_ver[sizeof(dev->progress.fw_version)] = {'\0'};
+    int ret;
+
+    voxel3d_device_t *handle = voxel3d_device_open(dev->progress.dev_sn, batch->backend);
+    if (!handle)
+        return -1;
+
+    /* the upgrade utility talks to the device through its ToF interface */
+    if (voxel3d_device_tof_init(handle) <= 0) {
+        voxel3d_device_close(handle);
+        return -1;
+    }
+    if (voxel3d_device_read_fw_version(handle, fw_ver, sizeof(fw_ver)) > 0) {
+        std::lock_guard<std::mutex> guard(batch->lock);
+        copy_string(dev->progress.fw_version, fw_ver, sizeof(dev->progress.fw_version));
+    }
+
+    std::mutex lock;
+    std::condition_variable stop;
+    bool flashing = true;
+    std::thread poller(poll_progress, dev, handle, &lock, &stop, &flashing);
+
+    current_device = dev;
+    ret = voxel3d_device_fw_upgrade(handle, (char *)batch->file_path.c_str(), upgrade_cb);
+    current_device = NULL;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        flashing = false;
+    }
+    stop.notify_one();
+    poller.join();
+
+    voxel3d_device_close(handle);
+    return ret;
+}
+
+static void worker_thread(fw_upgrade_batch_t *batch)
+{
+    for (;;) {
+        unsigned int ix = batch->next.fetch_add(1, std::memory_order_relaxed);
+        if (ix >= batch->devices.size())
+            return;
+
+        BatchDevice *dev = &batch->devices[ix];
+        if (batch->cancelled.load(std::memory_order_relaxed)) {
+            finish(dev, -1);
+            continue;
+        }
+
+        report(dev, FW_BATCH_RUNNING, FW_UPGRADE_STATE_INITIAL, 0);
+        finish(dev, upgrade_device(batch, dev));
+    }
+}
+
+/*
+ * Public APIs
+ */
+extern "C" fw_upgrade_batch_t *voxel3d_fw_upgrade_batch_start(const FwUpgradeBatchConfig *config)
+{
+    CamDevInfo scan_info;
+    unsigned int num_devices, num_workers;
+
+    if (!config || !config->file_path || !config->file_path[0] ||
+        config->num_devices > MAX_SUPPORTED_CAMERA_MODULE)
+        return NULL;
+
+    fw_upgrade_batch_t *batch = new fw_upgrade_batch_t;
+    batch->backend = config->backend ? config->backend : voxel3d_device_backend();
+    batch->file_path = config->file_path;
+    batch->progress_cb = config->progress_cb;
+    batch->user = config->user;
+
+    num_devices = config->num_devices;
+    if (!num_devices) {
+        if (batch->backend->scan(&scan_info) <= 0) {
+            delete batch;
+            return NULL;
+        }
+        num_devices = (unsigned int)scan_info.num_of_devices;
+    }
+
+    batch->devices.resize(num_devices);
+    for (unsigned int ix = 0; ix < num_devices; ix++) {
+        BatchDevice *dev = &batch->devices[ix];
+        const char *dev_sn = config->num_devices ? config->dev_sn[ix] : scan_info.product_sn[ix];
+
+        memset(&dev->progress, 0, sizeof(dev->progress));
+        copy_string(dev->progress.dev_sn, dev_sn, sizeof(dev->progress.dev_sn));
+        dev->progress.status = FW_BATCH_PENDING;
+        dev->progress.state = FW_UPGRADE_STATE_INITIAL;
+        dev->batch = batch;
+        dev->index = ix;
+    }
+    batch->next.store(0, std::memory_order_relaxed);
+    batch->cancelled.store(false, std::memory_order_relaxed);
+    batch->remaining = num_devices;
+
+    num_workers = config->max_parallel && config->max_parallel < num_devices ?
+                  config->max_parallel : num_devices;
+    for (unsigned int ix = 0; ix < num_workers; ix++)
+        batch->workers.emplace_back(worker_thread, batch);
+    return batch;
+}
+
+extern "C" int voxel3d_fw_upgrade_batch_poll(fw_upgrade_batch_t *batch,
+                                             FwUpgradeBatchState *state)
+{
+    if (!batch)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(batch->lock);
+    if (state) {
+        unsigned int percent = 0;
+
+        memset(state, 0, sizeof(*state));
+        state->num_devices = (unsigned int)batch->devices.size();
+        for (unsigned int ix = 0; ix < state->num_devices; ix++) {
+            const FwUpgradeProgress *progress = &batch->devices[ix].progress;
+
+            state->device[ix] = *progress;
+            switch (progress->status) {
+            case FW_BATCH_PENDING:
+                state->pending++;
+                break;
+            case FW_BATCH_RUNNING:
+                state->running++;
+                break;
+            case FW_BATCH_DONE:
+                state->done++;
+                break;
+            default:
+                state->failed++;
+                break;
+            }
+            percent += progress->status == FW_BATCH_FAILED ? 100 : progress->percent_complete;
+        }
+        state->percent_complete = state->num_devices ? percent / state->num_devices : 100;
+    }
+    return batch->remaining ? true : -1;
+}
+
+extern "C" int voxel3d_fw_upgrade_batch_wait(fw_upgrade_batch_t *batch, unsigned int timeout_ms)
+{
+    if (!batch)
+        return -1;
+
+    std::unique_lock<std::mutex> lock(batch->lock);
+    if (!timeout_ms) {
+        batch->finished.wait(lock, [batch] { return !batch->remaining; });
+        return true;
+    }
+    return batch->finished.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                    [batch] { return !batch->remaining; }) ? true : 0;
+}
+
+extern "C" void voxel3d_fw_upgrade_batch_release(fw_upgrade_batch_t *batch)
+{
+    if (!batch)
+        return;
+
+    batch->cancelled.store(true, std::memory_order_relaxed);
+    for (auto &worker : batch->workers)
+        worker.join();
+    delete batch;
+}
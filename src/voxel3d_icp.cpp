@@ -0,0 +1,702 @@
+/**
+ @file      voxel3d_icp.cpp
+ @brief     Coarse-to-fine projective point-to-plane ICP with an SSE2 normal-equation kernel
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define ICP_SSE2
+#endif
+
+#include "voxel3d_icp.h"
+#include "voxel3d_pointcloud.h"
+
+#define BAND_ROWS               (8)             /* rows of a task at every level */
+#define NUM_SUMS                (29)            /* 21 of J * J', 6 of J * r, r * r and pairs */
+#define DAMPING                 (1e-2)          /* of the pairs, holds the motions a scene
+                                                   doesn't constrain, e.g. along a floor and a
+                                                   wall, rather than fitting them to noise */
+
+/* Lower triangle of J * J' row by row, then J * r, r * r and the pair count */
+enum IcpSum { SUM_JR = 21, SUM_RR = 27, SUM_PAIRS = 28 };
+
+struct IcpLevel {
+    int width, height;
+    float scale;                                /* pixels of the level per depth pixel */
+    std::vector<float> source, source_normals;  /* 3 per pixel, the next model when tracking */
+    std::vector<float> model, normals;          /* 3 per pixel, model camera frame */
+};
+
+struct IcpSums {
+    double v[NUM_SUMS];
+};
+
+struct icp {
+    IcpConfig config;
+    CameraInfo cam;
+    IcpLevel levels[ICP_MAX_LEVELS];
+    std::vector<IcpSums> sums;                  /* per band */
+    bool has_model;
+    double model_pose[12];                      /* model camera to world */
+    double track_pose[12];                      /* last frame of voxel3d_icp_track() */
+
+    /* current job */
+    const float *source[ICP_MAX_LEVELS];
+    int level;
+    float motion[12];                           /* source camera to model camera */
+    const float *world_xyz, *world_normals;     /* voxel3d_icp_set_model() */
+    float inv_rot[9], inv_trans[3];
+};
+
+static const double identity_pose[12] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0 };
+
+/* a * b of 3x4 row-major rigid transforms, out may not alias a or b */
+static void compose(const double *a, const double *b, double *out)
+{
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 4; col++) {
+            out[row * 4 + col] = a[row * 4] * b[col] + a[row * 4 + 1] * b[4 + col] +
+                                 a[row * 4 + 2] * b[8 + col] + (col == 3 ? a[row * 4 + 3] : 0.);
+        }
+    }
+}
+
+static void invert(const double *a, double *out)
+{
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 3; col++)
+            out[row * 4 + col] = a[col * 4 + row];
+        out[row * 4 + 3] = -(a[row] * a[3] + a[4 + row] * a[7] + a[8 + row] * a[11]);
+    }
+}
+
+static void load_pose(const float *pose, double *out)
+{
+    for (int ix = 0; ix < 12; ix++)
+        out[ix] = pose ? pose[ix] : identity_pose[ix];
+}
+
+/*
+ * Pyramids
+ */
+struct DownsampleJob {
+    const IcpLevel *fine;
+    IcpLevel *coarse;
+    const float *fine_xyz, *fine_normals;       /* of fine, normals NULL for points only */
+    float *coarse_xyz, *coarse_normals;         /* of coarse */
+};
+
+/* Task of a band of coarse rows, 2x2 fine pixels near the nearest of them averaged */
+static void downsample_band(void *user, unsigned int task)
+{
+    const DownsampleJob *job = (const DownsampleJob *)user;
+    int width = job->coarse->width, fine_width = job->fine->width;
+    int end = (int)(task + 1) * BAND_ROWS;
+
+    end = end < job->coarse->height ? end : job->coarse->height;
+    for (int v = (int)task * BAND_ROWS; v < end; v++) {
+        for (int u = 0; u < width; u++) {
+            const float *p[4];
+            float near = 0.f, sum[3] = { 0.f, 0.f, 0.f }, normal[3] = { 0.f, 0.f, 0.f };
+            int count = 0;
+
+            for (int k = 0; k < 4; k++) {
+                size_t fine = (size_t)(v * 2 + (k >> 1)) * fine_width + u * 2 + (k & 1);
+                p[k] = job->fine_xyz + fine * 3;
+                if (p[k][2] > 0.f && (near == 0.f || p[k][2] < near))
+                    near = p[k][2];
+            }
+            for (int k = 0; near > 0.f && k < 4; k++) {
+                if (!(p[k][2] > 0.f) || p[k][2] > near * (1.f + ICP_MERGE_DEPTH_RATIO))
+                    continue;
+                for (int axis = 0; axis < 3; axis++)
+                    sum[axis] += p[k][axis];
+                if (job->fine_normals) {
+                    const float *n = job->fine_normals + (p[k] - job->fine_xyz);
+                    for (int axis = 0; axis < 3; axis++)
+                        normal[axis] += n[axis];
+                }
+                count++;
+            }
+
+            size_t ix = (size_t)v * width + u;
+            float *out = job->coarse_xyz + ix * 3;
+            for (int axis = 0; axis < 3; axis++)
+                out[axis] = count ? sum[axis] / count : 0.f;
+            if (job->fine_normals) {
+                float norm = normal[0] * normal[0] + normal[1] * normal[1] +
+                             normal[2] * normal[2];
+                /* normals averaging out to little don't make a plane */
+                norm = norm > 0.25f * count * count ? 1.f / sqrtf(norm) : 0.f;
+                for (int axis = 0; axis < 3; axis++)
+                    job->coarse_normals[ix * 3 + axis] = normal[axis] * norm;
+            }
+        }
+    }
+}
+
+static void downsample(icp_t *icp, int level, const float *fine_xyz, const float *fine_normals,
+                       float *coarse_xyz, float *coarse_normals, parallel_t *pool)
+{
+    DownsampleJob job = { &icp->levels[level - 1], &icp->levels[level], fine_xyz, fine_normals,
+                          coarse_xyz, coarse_normals };
+    int bands = (icp->levels[level].height + BAND_ROWS - 1) / BAND_ROWS;
+
+    voxel3d_parallel_run(pool, (unsigned int)bands, downsample_band, &job);
+}
+
+/* Task of a band of model rows, the world points and normals into the model camera frame */
+static void model_band(void *user, unsigned int task)
+{
+    icp_t *icp = (icp_t *)user;
+    const float *r = icp->inv_rot;
+    float *model = icp->levels[0].model.data(), *normals = icp->levels[0].normals.data();
+
+    for (int ix = (int)task * BAND_ROWS * TOF_DEPTH_WIDTH;
+         ix < (int)(task + 1) * BAND_ROWS * TOF_DEPTH_WIDTH; ix++) {
+        const float *p = icp->world_xyz + (size_t)ix * 3;
+        float *q = model + (size_t)ix * 3;
+
+        if (p[0] == 0.f && p[1] == 0.f && p[2] == 0.f) {
+            q[0] = q[1] = q[2] = 0.f;
+        }
+        else {
+            for (int row = 0; row < 3; row++)
+                q[row] = r[row * 3] * p[0] + r[row * 3 + 1] * p[1] + r[row * 3 + 2] * p[2] +
+                         icp->inv_trans[row];
+        }
+        if (icp->world_normals) {
+            const float *n = icp->world_normals + (size_t)ix * 3;
+            for (int row = 0; row < 3; row++)
+                normals[ix * 3 + row] = r[row * 3] * n[0] + r[row * 3 + 1] * n[1] +
+                                        r[row * 3 + 2] * n[2];
+        }
+    }
+}
+
+/* The model pyramid from level 0 points in the model camera frame, normals estimated */
+static void build_model(icp_t *icp, bool estimate_normals, parallel_t *pool)
+{
+    if (estimate_normals) {
+        voxel3d_pointcloud_normals(icp->levels[0].model.data(), NULL, pool,
+                                   icp->levels[0].normals.data());
+    }
+    for (unsigned int level = 1; level < icp->config.levels; level++) {
+        downsample(icp, (int)level, icp->levels[level - 1].model.data(),
+                   icp->levels[level - 1].normals.data(), icp->levels[level].model.data(),
+                   icp->levels[level].normals.data(), pool);
+    }
+    icp->has_model = true;
+}
+
+/*
+ * Normal equations
+ */
+/* Forward lens model, see voxel3d_calibration_build_rays() */
+static inline void distort(const CameraInfo &ci, float x, float y, float *u, float *v)
+{
+    float r2 = x * x + y * y;
+    float cdist = (1 + ((ci.K3 * r2 + ci.K2) * r2 + ci.K1) * r2) /
+                  (1 + ((ci.K6 * r2 + ci.K5) * r2 + ci.K4) * r2);
+
+    *u = ci.focalLengthFx * (x * cdist + 2 * ci.P1 * x * y + ci.P2 * (r2 + 2 * x * x)) +
+         ci.principalPointCx;
+    *v = ci.focalLengthFy * (y * cdist + ci.P1 * (r2 + 2 * y * y) + 2 * ci.P2 * x * y) +
+         ci.principalPointCy;
+}
+
+/* Model pixel a point of the model camera frame falls on, -1 when none */
+static inline int model_pixel(const icp_t *icp, const IcpLevel *level, const float *q)
+{
+    if (!(q[2] > 0.f))
+        return -1;
+
+    float u, v;
+    distort(icp->cam, q[0] / q[2], q[1] / q[2], &u, &v);
+    u = (u + 0.5f) * level->scale;
+    v = (v + 0.5f) * level->scale;
+    /* written so that NaN fails too */
+    if (!(u >= 0.f && u < level->width && v >= 0.f && v < level->height))
+        return -1;
+    return (int)v * level->width + (int)u;
+}
+
+/* One pair into the sums: J = (q x n, n), r = n . (q - m) */
+static inline void add_pair(double *sums, const float *q, const float *m, const float *n)
+{
+    double j[6] = { q[1] * n[2] - q[2] * n[1], q[2] * n[0] - q[0] * n[2],
+                    q[0] * n[1] - q[1] * n[0], n[0], n[1], n[2] };
+    double r = n[0] * (q[0] - m[0]) + n[1] * (q[1] - m[1]) + n[2] * (q[2] - m[2]);
+    int at = 0;
+
+    for (int row = 0; row < 6; row++) {
+        for (int col = 0; col <= row; col++)
+            sums[at++] += j[row] * j[col];
+        sums[SUM_JR + row] += j[row] * r;
+    }
+    sums[SUM_RR] += r * r;
+    sums[SUM_PAIRS] += 1.;
+}
+
+#ifdef ICP_SSE2
+/* 4 interleaved points to x0..x3, y0..y3, z0..z3 */
+static inline void load_xyz(const float *p, __m128 *x, __m128 *y, __m128 *z)
+{
+    __m128 a = _mm_loadu_ps(p);                 /* x0 y0 z0 x1 */
+    __m128 b = _mm_loadu_ps(p + 4);             /* y1 z1 x2 y2 */
+    __m128 c = _mm_loadu_ps(p + 8);             /* z2 x3 y3 z3 */
+    __m128 b2c1 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+    __m128 a1b0 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+    __m128 b3c2 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+    __m128 a2b1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+
+    *x = _mm_shuffle_ps(a, b2c1, _MM_SHUFFLE(2, 0, 3, 0));
+    *y = _mm_shuffle_ps(a1b0, b3c2, _MM_SHUFFLE(2, 0, 2, 0));
+    *z = _mm_shuffle_ps(a2b1, c, _MM_SHUFFLE(3, 0, 2, 0));
+}
+
+/* model_pixel() of 4 points at a time */
+static inline void model_pixels(const icp_t *icp, const IcpLevel *level, __m128 x, __m128 y,
+                                __m128 z, int *pixels)
+{
+    const CameraInfo &ci = icp->cam;
+    __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f);
+    __m128 valid = _mm_cmpgt_ps(z, _mm_setzero_ps());
+    __m128 inv_z = _mm_div_ps(one, _mm_or_ps(_mm_and_ps(valid, z), _mm_andnot_ps(valid, one)));
+    __m128 xn = _mm_mul_ps(x, inv_z), yn = _mm_mul_ps(y, inv_z);
+    __m128 xy = _mm_mul_ps(xn, yn), xx = _mm_mul_ps(xn, xn), yy = _mm_mul_ps(yn, yn);
+    __m128 r2 = _mm_add_ps(xx, yy);
+    __m128 num = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ci.K3), r2), _mm_set1_ps(ci.K2));
+    __m128 den = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ci.K6), r2), _mm_set1_ps(ci.K5));
+    num = _mm_add_ps(_mm_mul_ps(num, r2), _mm_set1_ps(ci.K1));
+    den = _mm_add_ps(_mm_mul_ps(den, r2), _mm_set1_ps(ci.K4));
+    num = _mm_add_ps(_mm_mul_ps(num, r2), one);
+    den = _mm_add_ps(_mm_mul_ps(den, r2), one);
+    __m128 cdist = _mm_div_ps(num, den);
+    __m128 p1 = _mm_set1_ps(ci.P1), p2 = _mm_set1_ps(ci.P2), scale = _mm_set1_ps(level->scale);
+    __m128 xd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xn, cdist), _mm_mul_ps(two, _mm_mul_ps(p1, xy))),
+                           _mm_mul_ps(p2, _mm_add_ps(r2, _mm_mul_ps(two, xx))));
+    __m128 yd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(yn, cdist), _mm_mul_ps(two, _mm_mul_ps(p2, xy))),
+                           _mm_mul_ps(p1, _mm_add_ps(r2, _mm_mul_ps(two, yy))));
+    __m128 u = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ci.focalLengthFx), xd),
+                          _mm_set1_ps(ci.principalPointCx + 0.5f));
+    __m128 v = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ci.focalLengthFy), yd),
+                          _mm_set1_ps(ci.principalPointCy + 0.5f));
+    u = _mm_mul_ps(u, scale);
+    v = _mm_mul_ps(v, scale);
+    /* ordered compares, NaN fails too */
+    valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, _mm_setzero_ps()),
+                                         _mm_cmplt_ps(u, _mm_set1_ps((float)level->width))));
+    valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, _mm_setzero_ps()),
+                                         _mm_cmplt_ps(v, _mm_set1_ps((float)level->height))));
+
+    /* truncated u and v are exact in floats, and so is the pixel index */
+    __m128 index = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(v)),
+                                         _mm_set1_ps((float)level->width)),
+                              _mm_cvtepi32_ps(_mm_cvttps_epi32(u)));
+    __m128i pixel = _mm_cvttps_epi32(_mm_and_ps(valid, index));
+    pixel = _mm_or_si128(_mm_and_si128(_mm_castps_si128(valid), pixel),
+                         _mm_andnot_si128(_mm_castps_si128(valid), _mm_set1_epi32(-1)));
+    _mm_storeu_si128((__m128i *)pixels, pixel);
+}
+
+static inline double horizontal_sum(__m128 v)
+{
+    float lanes[4];
+
+    _mm_storeu_ps(lanes, v);
+    return (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+#endif
+
+/* Task of a band of source rows of the level, their pairs into the sums of the band */
+static void pair_band(void *user, unsigned int task)
+{
+    icp_t *icp = (icp_t *)user;
+    const IcpLevel *level = &icp->levels[icp->level];
+    const float *source = icp->source[icp->level], *t = icp->motion;
+    const float *model = level->model.data(), *normals = level->normals.data();
+    float max_distance2 = icp->config.max_distance * icp->config.max_distance;
+    double *sums = icp->sums[task].v;
+    int end = (int)(task + 1) * BAND_ROWS;
+
+    memset(sums, 0, sizeof(IcpSums));
+    end = end < level->height ? end : level->height;
+    for (int v = (int)task * BAND_ROWS; v < end; v++) {
+        const float *row = source + (size_t)v * level->width * 3;
+        int u = 0;
+
+#ifdef ICP_SSE2
+        /*
+         * Pairs are found per pixel, their J * J' summed up 4 at a time in floats for a row,
+         * then in doubles: a row stays well within float precision.
+         */
+        __m128 acc[NUM_SUMS];
+        for (int ix = 0; ix < NUM_SUMS; ix++)
+            acc[ix] = _mm_setzero_ps();
+
+        /* level widths are multiples of 4 */
+        for (; u + 4 <= level->width; u += 4) {
+            __m128 px, py, pz;
+            load_xyz(row + u * 3, &px, &py, &pz);
+            __m128 qx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[0]), px),
+                                              _mm_mul_ps(_mm_set1_ps(t[1]), py)),
+                                   _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[2]), pz),
+                                              _mm_set1_ps(t[3])));
+            __m128 qy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[4]), px),
+                                              _mm_mul_ps(_mm_set1_ps(t[5]), py)),
+                                   _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[6]), pz),
+                                              _mm_set1_ps(t[7])));
+            __m128 qz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[8]), px),
+                                              _mm_mul_ps(_mm_set1_ps(t[9]), py)),
+                                   _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[10]), pz),
+                                              _mm_set1_ps(t[11])));
+            if (!_mm_movemask_ps(_mm_cmpgt_ps(pz, _mm_setzero_ps())))
+                continue;
+
+            /* the model points and normals of the lanes, zero where unpaired, gathered in
+               registers: lanes stored one by one and loaded as a vector stall the load */
+            static const float unpaired[3] = { 0.f, 0.f, 0.f };
+            int pixels[4];
+            const float *mp[4], *np[4];
+            model_pixels(icp, level, qx, qy,
+                         _mm_and_ps(_mm_cmpgt_ps(pz, _mm_setzero_ps()), qz), pixels);
+            for (int lane = 0; lane < 4; lane++) {
+                mp[lane] = pixels[lane] >= 0 ? model + (size_t)pixels[lane] * 3 : unpaired;
+                np[lane] = pixels[lane] >= 0 ? normals + (size_t)pixels[lane] * 3 : unpaired;
+            }
+
+            __m128 mx = _mm_set_ps(mp[3][0], mp[2][0], mp[1][0], mp[0][0]);
+            __m128 my = _mm_set_ps(mp[3][1], mp[2][1], mp[1][1], mp[0][1]);
+            __m128 mz = _mm_set_ps(mp[3][2], mp[2][2], mp[1][2], mp[0][2]);
+            __m128 nx = _mm_set_ps(np[3][0], np[2][0], np[1][0], np[0][0]);
+            __m128 ny = _mm_set_ps(np[3][1], np[2][1], np[1][1], np[0][1]);
+            __m128 nz = _mm_set_ps(np[3][2], np[2][2], np[1][2], np[0][2]);
+            __m128 dx = _mm_sub_ps(qx, mx), dy = _mm_sub_ps(qy, my), dz = _mm_sub_ps(qz, mz);
+            __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                                   _mm_mul_ps(dz, dz));
+            __m128 n2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+                                   _mm_mul_ps(nz, nz));
+            __m128 pair = _mm_and_ps(_mm_cmpgt_ps(mz, _mm_setzero_ps()),
+                                     _mm_and_ps(_mm_cmpgt_ps(n2, _mm_setzero_ps()),
+                                                _mm_cmple_ps(d2, _mm_set1_ps(max_distance2))));
+            if (!_mm_movemask_ps(pair))
+                continue;
+
+            __m128 j[6];
+            j[0] = _mm_and_ps(pair, _mm_sub_ps(_mm_mul_ps(qy, nz), _mm_mul_ps(qz, ny)));
+            j[1] = _mm_and_ps(pair, _mm_sub_ps(_mm_mul_ps(qz, nx), _mm_mul_ps(qx, nz)));
+            j[2] = _mm_and_ps(pair, _mm_sub_ps(_mm_mul_ps(qx, ny), _mm_mul_ps(qy, nx)));
+            j[3] = _mm_and_ps(pair, nx);
+            j[4] = _mm_and_ps(pair, ny);
+            j[5] = _mm_and_ps(pair, nz);
+            __m128 r = _mm_and_ps(pair, _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, dx),
+                                                              _mm_mul_ps(ny, dy)),
+                                                   _mm_mul_ps(nz, dz)));
+
+            int at = 0;
+            for (int a = 0; a < 6; a++) {
+                for (int b = 0; b <= a; b++, at++)
+                    acc[at] = _mm_add_ps(acc[at], _mm_mul_ps(j[a], j[b]));
+                acc[SUM_JR + a] = _mm_add_ps(acc[SUM_JR + a], _mm_mul_ps(j[a], r));
+            }
+            acc[SUM_RR] = _mm_add_ps(acc[SUM_RR], _mm_mul_ps(r, r));
+            acc[SUM_PAIRS] = _mm_add_ps(acc[SUM_PAIRS], _mm_and_ps(pair, _mm_set1_ps(1.f)));
+        }
+        for (int ix = 0; ix < NUM_SUMS; ix++)
+            sums[ix] += horizontal_sum(acc[ix]);
+#endif
+        for (; u < level->width; u++) {
+            const float *p = row + u * 3;
+            if (!(p[2] > 0.f))
+                continue;
+
+            float q[3];
+            for (int axis = 0; axis < 3; axis++)
+                q[axis] = t[axis * 4] * p[0] + t[axis * 4 + 1] * p[1] + t[axis * 4 + 2] * p[2] +
+                          t[axis * 4 + 3];
+            int pixel = model_pixel(icp, level, q);
+            if (pixel < 0)
+                continue;
+
+            const float *m = model + (size_t)pixel * 3, *n = normals + (size_t)pixel * 3;
+            float d[3] = { q[0] - m[0], q[1] - m[1], q[2] - m[2] };
+            if (!(m[2] > 0.f) || (n[0] == 0.f && n[1] == 0.f && n[2] == 0.f) ||
+                d[0] * d[0] + d[1] * d[1] + d[2] * d[2] > max_distance2)
+                continue;
+            add_pair(sums, q, m, n);
+        }
+    }
+}
+
+/* Solve (A + damping) x = -b by Cholesky, false when not positive definite */
+static bool solve_motion(const double *sums, double *x)
+{
+    double a[6][6], b[6];
+    int at = 0;
+
+    for (int row = 0; row < 6; row++) {
+        for (int col = 0; col <= row; col++, at++)
+            a[row][col] = a[col][row] = sums[at];
+        a[row][row] += DAMPING * sums[SUM_PAIRS];
+        b[row] = -sums[SUM_JR + row];
+    }
+
+    for (int col = 0; col < 6; col++) {
+        double diag = a[col][col];
+        for (int k = 0; k < col; k++)
+            diag -= a[col][k] * a[col][k];
+        if (!(diag > 0.))
+            return false;
+        a[col][col] = sqrt(diag);
+        for (int row = col + 1; row < 6; row++) {
+            double value = a[row][col];
+            for (int k = 0; k < col; k++)
+                value -= a[row][k] * a[col][k];
+            a[row][col] = value / a[col][col];
+        }
+    }
+    for (int row = 0; row < 6; row++) {
+        double value = b[row];
+        for (int k = 0; k < row; k++)
+            value -= a[row][k] * x[k];
+        x[row] = value / a[row][row];
+    }
+    for (int row = 5; row >= 0; row--) {
+        double value = x[row];
+        for (int k = row + 1; k < 6; k++)
+            value -= a[k][row] * x[k];
+        x[row] = value / a[row][row];
+    }
+    return true;
+}
+
+/* [exp(w) | t] of a small motion (w, t), Rodrigues' formula */
+static void motion_matrix(const double *x, double *out)
+{
+    double angle = sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+    double k[3] = { 0., 0., 0. }, s = sin(angle), c = 1. - cos(angle);
+
+    if (angle > 0.) {
+        for (int axis = 0; axis < 3; axis++)
+            k[axis] = x[axis] / angle;
+    }
+    out[0] = 1. - c * (k[1] * k[1] + k[2] * k[2]);
+    out[1] = c * k[0] * k[1] - s * k[2];
+    out[2] = c * k[0] * k[2] + s * k[1];
+    out[4] = c * k[0] * k[1] + s * k[2];
+    out[5] = 1. - c * (k[0] * k[0] + k[2] * k[2]);
+    out[6] = c * k[1] * k[2] - s * k[0];
+    out[8] = c * k[0] * k[2] - s * k[1];
+    out[9] = c * k[1] * k[2] + s * k[0];
+    out[10] = 1. - c * (k[0] * k[0] + k[1] * k[1]);
+    out[3] = x[3];
+    out[7] = x[4];
+    out[11] = x[5];
+}
+
+/* Align the source pyramid to the model, motion in and out; pairs of the finest level */
+static int align_levels(icp_t *icp, double *motion, parallel_t *pool)
+{
+    int pairs = 0;
+
+    for (int level = (int)icp->config.levels - 1; level >= 0; level--) {
+        const IcpLevel *lv = &icp->levels[level];
+        unsigned int bands = (unsigned int)((lv->height + BAND_ROWS - 1) / BAND_ROWS);
+
+        icp->level = level;
+        for (unsigned int it = 0; it < icp->config.iterations; it++) {
+            double sums[NUM_SUMS], x[6], step[12], moved[12];
+
+            for (int ix = 0; ix < 12; ix++)
+                icp->motion[ix] = (float)motion[ix];
+            voxel3d_parallel_run(pool, bands, pair_band, icp);
+
+            memset(sums, 0, sizeof(sums));
+            for (unsigned int band = 0; band < bands; band++) {
+                for (int ix = 0; ix < NUM_SUMS; ix++)
+                    sums[ix] += icp->sums[band].v[ix];
+            }
+            pairs = (int)sums[SUM_PAIRS];
+            if (pairs < lv->width * lv->height / ICP_MIN_PAIRS_RATIO || !solve_motion(sums, x))
+                return 0;
+
+            motion_matrix(x, step);
+            compose(step, motion, moved);
+            memcpy(motion, moved, sizeof(moved));
+            if (fabs(x[0]) + fabs(x[1]) + fabs(x[2]) + fabs(x[3]) + fabs(x[4]) + fabs(x[5]) <
+                ICP_CONVERGED_MOTION)
+                break;
+        }
+    }
+    return pairs;
+}
+
+/* The coarser levels of a source cloud, with the normals of level 0 when given */
+static void build_source(icp_t *icp, const float *xyz, const float *normals, parallel_t *pool)
+{
+    icp->source[0] = xyz;
+    for (unsigned int level = 1; level < icp->config.levels; level++) {
+        IcpLevel *fine = &icp->levels[level - 1], *lv = &icp->levels[level];
+
+        downsample(icp, (int)level, icp->source[level - 1],
+                   normals ? fine->source_normals.data() : NULL, lv->source.data(),
+                   normals ? lv->source_normals.data() : NULL, pool);
+        icp->source[level] = lv->source.data();
+    }
+}
+
+static void store_pose(const double *pose, float *out)
+{
+    for (int ix = 0; ix < 12; ix++)
+        out[ix] = (float)pose[ix];
+}
+
+/*
+ * Public APIs
+ */
+extern "C" icp_t *voxel3d_icp_create(const CameraInfo *cam_info, const IcpConfig *config)
+{
+    IcpConfig cfg;
+
+    if (!cam_info || cam_info->focalLengthFx <= 0.f || cam_info->focalLengthFy <= 0.f)
+        return NULL;
+    if (config) {
+        cfg = *config;
+    }
+    else {
+        memset(&cfg, 0, sizeof(cfg));
+    }
+    if (!cfg.levels)
+        cfg.levels = ICP_DEFAULT_LEVELS;
+    if (!cfg.iterations)
+        cfg.iterations = ICP_DEFAULT_ITERATIONS;
+    if (cfg.max_distance == 0.f)
+        cfg.max_distance = ICP_DEFAULT_MAX_DISTANCE;
+    if (cfg.levels > ICP_MAX_LEVELS || !(cfg.max_distance > 0.f))
+        return NULL;
+
+    icp_t *icp = new icp_t;
+    icp->config = cfg;
+    icp->cam = *cam_info;
+    for (unsigned int level = 0; level < cfg.levels; level++) {
+        IcpLevel *lv = &icp->levels[level];
+        lv->width = TOF_DEPTH_WIDTH >> level;
+        lv->height = TOF_DEPTH_HEIGHT >> level;
+        lv->scale = 1.f / (float)(1 << level);
+        lv->source.resize((size_t)lv->width * lv->height * 3);
+        lv->source_normals.resize((size_t)lv->width * lv->height * 3);
+        lv->model.resize((size_t)lv->width * lv->height * 3);
+        lv->normals.resize((size_t)lv->width * lv->height * 3);
+    }
+    icp->sums.resize((TOF_DEPTH_HEIGHT + BAND_ROWS - 1) / BAND_ROWS);
+    icp->has_model = false;
+    memcpy(icp->track_pose, identity_pose, sizeof(identity_pose));
+    return icp;
+}
+
+extern "C" int voxel3d_icp_set_model(icp_t *icp, const float *xyz, const float *normals,
+                                     const float *pose, parallel_t *pool)
+{
+    double inverse[12];
+
+    if (!icp || !xyz)
+        return -1;
+
+    load_pose(pose, icp->model_pose);
+    invert(icp->model_pose, inverse);
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 3; col++)
+            icp->inv_rot[row * 3 + col] = (float)inverse[row * 4 + col];
+        icp->inv_trans[row] = (float)inverse[row * 4 + 3];
+    }
+    icp->world_xyz = xyz;
+    icp->world_normals = normals;
+    voxel3d_parallel_run(pool, TOF_DEPTH_HEIGHT / BAND_ROWS, model_band, icp);
+    build_model(icp, !normals, pool);
+    return true;
+}
+
+extern "C" int voxel3d_icp_align(icp_t *icp, const float *xyz, parallel_t *pool, float *pose)
+{
+    double guess[12], inverse[12], motion[12], result[12];
+
+    if (!icp || !xyz || !pose)
+        return -1;
+    if (!icp->has_model)
+        return 0;
+
+    build_source(icp, xyz, NULL, pool);
+    load_pose(pose, guess);
+    invert(icp->model_pose, inverse);
+    compose(inverse, guess, motion);
+
+    int pairs = align_levels(icp, motion, pool);
+    if (pairs > 0) {
+        compose(icp->model_pose, motion, result);
+        store_pose(result, pose);
+    }
+    return pairs;
+}
+
+extern "C" int voxel3d_icp_track(icp_t *icp, const float *xyz, const float *gyro_rotation,
+                                 parallel_t *pool, float *pose)
+{
+    int pairs = 0;
+
+    if (!icp || !xyz || !pose)
+        return -1;
+
+    /* the pyramid of the frame gets its normals once, the source now and the model next */
+    IcpLevel *finest = &icp->levels[0];
+    memcpy(finest->source.data(), xyz, sizeof(float) * TOF_DEPTH_PIXELS * 3);
+    voxel3d_pointcloud_normals(finest->source.data(), NULL, pool, finest->source_normals.data());
+    build_source(icp, finest->source.data(), finest->source_normals.data(), pool);
+
+    if (icp->has_model) {
+        /* the model is the previous frame, at track_pose */
+        double motion[12], result[12];
+        memcpy(motion, identity_pose, sizeof(motion));
+        if (gyro_rotation) {
+            for (int row = 0; row < 3; row++) {
+                for (int col = 0; col < 3; col++)
+                    motion[row * 4 + col] = gyro_rotation[row * 3 + col];
+            }
+        }
+
+        pairs = align_levels(icp, motion, pool);
+        if (pairs > 0) {
+            compose(icp->track_pose, motion, result);
+            memcpy(icp->track_pose, result, sizeof(result));
+        }
+    }
+
+    /* the frame becomes the model, in its own camera frame */
+    for (unsigned int level = 0; level < icp->config.levels; level++) {
+        icp->levels[level].model.swap(icp->levels[level].source);
+        icp->levels[level].normals.swap(icp->levels[level].source_normals);
+    }
+    memcpy(icp->model_pose, icp->track_pose, sizeof(icp->model_pose));
+    icp->has_model = true;
+    store_pose(icp->track_pose, pose);
+    return pairs;
+}
+
+extern "C" void voxel3d_icp_reset(icp_t *icp)
+{
+    if (!icp)
+        return;
+
+    icp->has_model = false;
+    memcpy(icp->track_pose, identity_pose, sizeof(identity_pose));
+}
+
+extern "C" void voxel3d_icp_destroy(icp_t *icp)
+{
+    delete icp;
+}
@@ -0,0 +1,475 @@
+/**
+ @file      voxel3d_occupancy.cpp
+ @brief     2.5D occupancy grid and heightmap straight from the depth plane
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define OCCUPANCY_SSE2
+#endif
+
+#include "voxel3d_calibration.h"
+#include "voxel3d_occupancy.h"
+#include "voxel3d_pointcloud.h"
+
+#define FUSE_ROWS               (8)             /* cell rows of a task */
+#define PI_F                    (3.14159265f)
+#define BIN_SCALE               (OCCUPANCY_BINS / (2.f * PI_F))
+
+/* Points of a chunk of rows of a frame, per cell and per sector */
+struct OccupancyChunk {
+    std::vector<unsigned short> obstacles, points;
+    std::vector<float> tops;
+    float near[OCCUPANCY_BINS];                 /* nearest point of a sector */
+    float ground[OCCUPANCY_BINS];               /* farthest ground, -1 when none */
+    float obstacle[OCCUPANCY_BINS];             /* nearest obstacle */
+};
+
+struct occupancy_grid {
+    OccupancyConfig config;
+    float inv_cell;
+    int size;
+    int origin_col, origin_row;                 /* cells from the grid frame origin */
+    std::vector<float> evidence, heights;       /* size * size, log-odds and meters */
+    std::vector<float> moved_evidence, moved_heights;
+
+    /* sampled pixels: rays per sampled row, x of every column then y, columns padded to 4 */
+    int rows, columns;
+    std::vector<float> rays;
+    std::vector<int> pixels;                    /* column of the depth plane, -1 for padding */
+
+    std::vector<OccupancyChunk> chunks;
+    std::vector<int> seen;                      /* cells seen per fuse task */
+
+    /* current frame */
+    unsigned int num_chunks;
+    const unsigned short *depthmap;
+    float pose[12];
+    float near[OCCUPANCY_BINS], ground[OCCUPANCY_BINS], obstacle[OCCUPANCY_BINS];
+};
+
+/* atan2(y, x) within 1e-5 radians */
+static inline float fast_atan2(float y, float x)
+{
+    float ax = fabsf(x), ay = fabsf(y);
+    float hi = ax > ay ? ax : ay, lo = ax > ay ? ay : ax;
+    float a = hi > 0.f ? lo / hi : 0.f, s = a * a;
+    float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+
+    r = ay > ax ? 0.5f * PI_F - r : r;
+    r = x < 0.f ? PI_F - r : r;
+    return y < 0.f ? -r : r;
+}
+
+static inline int sector(float dx, float dz)
+{
+    int bin = (int)((fast_atan2(dx, dz) + PI_F) * BIN_SCALE);
+
+    return bin < OCCUPANCY_BINS ? bin : OCCUPANCY_BINS - 1;
+}
+
+static void clear_chunk(OccupancyChunk *chunk)
+{
+    std::fill(chunk->obstacles.begin(), chunk->obstacles.end(), 0);
+    std::fill(chunk->points.begin(), chunk->points.end(), 0);
+    std::fill(chunk->tops.begin(), chunk->tops.end(), -FLT_MAX);
+    for (int bin = 0; bin < OCCUPANCY_BINS; bin++) {
+        chunk->near[bin] = FLT_MAX;
+        chunk->ground[bin] = -1.f;
+        chunk->obstacle[bin] = FLT_MAX;
+    }
+}
+
+/* A point of the frame, cell -1 off the grid, range and height in meters */
+static inline void add_point(const OccupancyConfig &cfg, OccupancyChunk *chunk, int cell,
+                             int bin, float range, float height)
+{
+    bool obstacle = height >= cfg.min_height;
+
+    chunk->near[bin] = range < chunk->near[bin] ? range : chunk->near[bin];
+    if (obstacle) {
+        chunk->obstacle[bin] = range < chunk->obstacle[bin] ? range : chunk->obstacle[bin];
+    }
+    else {
+        chunk->ground[bin] = range > chunk->ground[bin] ? range : chunk->ground[bin];
+    }
+    if (cell < 0)
+        return;
+
+    /* counts saturate rather than wrap */
+    if (obstacle && chunk->obstacles[cell] < 0xFFFF)
+        chunk->obstacles[cell]++;
+    if (chunk->points[cell] < 0xFFFF)
+        chunk->points[cell]++;
+    chunk->tops[cell] = height > chunk->tops[cell] ? height : chunk->tops[cell];
+}
+
+#ifdef OCCUPANCY_SSE2
+/* fast_atan2() of 4 at a time */
+static inline __m128 fast_atan2_ps(__m128 y, __m128 x)
+{
+    const __m128 sign = _mm_set1_ps(-0.f);
+    __m128 ax = _mm_andnot_ps(sign, x), ay = _mm_andnot_ps(sign, y);
+    __m128 hi = _mm_max_ps(ax, ay), lo = _mm_min_ps(ax, ay);
+    __m128 nonzero = _mm_cmpgt_ps(hi, _mm_setzero_ps());
+    __m128 divisor = _mm_or_ps(_mm_and_ps(nonzero, hi), _mm_andnot_ps(nonzero, _mm_set1_ps(1.f)));
+    __m128 a = _mm_and_ps(nonzero, _mm_div_ps(lo, divisor));
+    __m128 s = _mm_mul_ps(a, a);
+    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.0464964749f), s), _mm_set1_ps(0.15931422f));
+    r = _mm_sub_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.327622764f));
+    r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), a);
+
+    __m128 swap = _mm_cmpgt_ps(ay, ax), back = _mm_cmplt_ps(x, _mm_setzero_ps());
+    r = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(_mm_set1_ps(0.5f * PI_F), r)),
+                  _mm_andnot_ps(swap, r));
+    r = _mm_or_ps(_mm_and_ps(back, _mm_sub_ps(_mm_set1_ps(PI_F), r)), _mm_andnot_ps(back, r));
+    return _mm_xor_ps(r, _mm_and_ps(sign, y));
+}
+#endif
+
+/* Task of a chunk of sampled rows */
+static void bin_chunk(void *user, unsigned int task)
+{
+    occupancy_grid_t *grid = (occupancy_grid_t *)user;
+    const OccupancyConfig &cfg = grid->config;
+    OccupancyChunk *chunk = &grid->chunks[task];
+    const float *t = grid->pose;
+    int begin = grid->rows * (int)task / (int)grid->num_chunks;
+    int end = grid->rows * (int)(task + 1) / (int)grid->num_chunks;
+    float col0 = (float)grid->origin_col, row0 = (float)grid->origin_row;
+
+    clear_chunk(chunk);
+    for (int row = begin; row < end; row++) {
+        const unsigned short *depth = grid->depthmap + (size_t)row * cfg.stride * TOF_DEPTH_WIDTH;
+        const float *rx = &grid->rays[(size_t)row * grid->columns * 2];
+        const float *ry = rx + grid->columns;
+
+#ifdef OCCUPANCY_SSE2
+        const __m128 zero = _mm_setzero_ps(), size = _mm_set1_ps((float)grid->size);
+
+        for (int col = 0; col < grid->columns; col += 4) {
+            const int *px = &grid->pixels[col];
+            __m128 z = _mm_mul_ps(_mm_set_ps(px[3] < 0 ? 0.f : depth[px[3]],
+                                             px[2] < 0 ? 0.f : depth[px[2]],
+                                             px[1] < 0 ? 0.f : depth[px[1]],
+                                             px[0] < 0 ? 0.f : depth[px[0]]),
+                                  _mm_set1_ps(POINTCLOUD_DEPTH_UNIT_M));
+            __m128 valid = _mm_and_ps(_mm_cmpgt_ps(z, zero),
+                                      _mm_cmple_ps(z, _mm_set1_ps(cfg.max_range)));
+            if (!_mm_movemask_ps(valid))
+                continue;
+
+            __m128 x = _mm_loadu_ps(rx + col), y = _mm_loadu_ps(ry + col);
+            __m128 dx = _mm_mul_ps(z, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[0]), x),
+                                                            _mm_mul_ps(_mm_set1_ps(t[1]), y)),
+                                                 _mm_set1_ps(t[2])));
+            __m128 dy = _mm_mul_ps(z, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[4]), x),
+                                                            _mm_mul_ps(_mm_set1_ps(t[5]), y)),
+                                                 _mm_set1_ps(t[6])));
+            __m128 dz = _mm_mul_ps(z, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t[8]), x),
+                                                            _mm_mul_ps(_mm_set1_ps(t[9]), y)),
+                                                 _mm_set1_ps(t[10])));
+            __m128 height = _mm_sub_ps(_mm_set1_ps(-t[7]), dy);
+            valid = _mm_and_ps(valid, _mm_cmple_ps(height, _mm_set1_ps(cfg.max_height)));
+            int lanes = _mm_movemask_ps(valid);
+            if (!lanes)
+                continue;
+
+            __m128 range = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)));
+            __m128 bin = _mm_mul_ps(_mm_add_ps(fast_atan2_ps(dx, dz), _mm_set1_ps(PI_F)),
+                                    _mm_set1_ps(BIN_SCALE));
+            bin = _mm_min_ps(bin, _mm_set1_ps(OCCUPANCY_BINS - 1.f));
+            __m128 u = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(t[3]), dx),
+                                             _mm_set1_ps(grid->inv_cell)), _mm_set1_ps(col0));
+            __m128 v = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(t[11]), dz),
+                                             _mm_set1_ps(grid->inv_cell)), _mm_set1_ps(row0));
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmplt_ps(u, size)),
+                                       _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmplt_ps(v, size)));
+            /* truncated u and v are exact in floats, and so is the cell index */
+            __m128 cell = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(v)), size),
+                                     _mm_cvtepi32_ps(_mm_cvttps_epi32(u)));
+            cell = _mm_or_ps(_mm_and_ps(inside, cell), _mm_andnot_ps(inside, _mm_set1_ps(-1.f)));
+
+            int cells[4], bins[4];
+            float ranges[4], heights[4];
+            _mm_storeu_si128((__m128i *)cells, _mm_cvttps_epi32(cell));
+            _mm_storeu_si128((__m128i *)bins, _mm_cvttps_epi32(bin));
+            _mm_storeu_ps(ranges, range);
+            _mm_storeu_ps(heights, height);
+            for (int lane = 0; lane < 4; lane++) {
+                if (lanes >> lane & 1)
+                    add_point(cfg, chunk, cells[lane], bins[lane], ranges[lane], heights[lane]);
+            }
+        }
+#else
+        for (int col = 0; col < grid->columns; col++) {
+            int px = grid->pixels[col];
+            float z = px < 0 ? 0.f : depth[px] * POINTCLOUD_DEPTH_UNIT_M;
+            if (!(z > 0.f) || z > cfg.max_range)
+                continue;
+
+            float dx = z * (t[0] * rx[col] + t[1] * ry[col] + t[2]);
+            float dy = z * (t[4] * rx[col] + t[5] * ry[col] + t[6]);
+            float dz = z * (t[8] * rx[col] + t[9] * ry[col] + t[10]);
+            float height = -t[7] - dy;
+            if (height > cfg.max_height)
+                continue;
+
+            float u = (t[3] + dx) * grid->inv_cell - col0;
+            float v = (t[11] + dz) * grid->inv_cell - row0;
+            int cell = u >= 0.f && u < grid->size && v >= 0.f && v < grid->size ?
+                       (int)v * grid->size + (int)u : -1;
+            add_point(cfg, chunk, cell, sector(dx, dz), sqrtf(dx * dx + dz * dz), height);
+        }
+#endif
+    }
+}
+
+/* Task of FUSE_ROWS rows of cells, the points of every chunk and the free space into them */
+static void fuse_rows(void *user, unsigned int task)
+{
+    occupancy_grid_t *grid = (occupancy_grid_t *)user;
+    const OccupancyConfig &cfg = grid->config;
+    float half = 0.5f * cfg.cell;
+    int end = (int)(task + 1) * FUSE_ROWS, seen = 0;
+
+    end = end < grid->size ? end : grid->size;
+    for (int row = (int)task * FUSE_ROWS; row < end; row++) {
+        float dz = (grid->origin_row + row) * cfg.cell + half - grid->pose[11];
+
+        for (int col = 0; col < grid->size; col++) {
+            size_t cell = (size_t)row * grid->size + col;
+            unsigned int obstacles = 0, points = 0;
+            float top = -FLT_MAX;
+
+            for (unsigned int ix = 0; ix < grid->num_chunks; ix++) {
+                const OccupancyChunk *chunk = &grid->chunks[ix];
+                obstacles += chunk->obstacles[cell];
+                points += chunk->points[cell];
+                top = chunk->tops[cell] > top ? chunk->tops[cell] : top;
+            }
+
+            float e = grid->evidence[cell] * cfg.decay;
+            if (obstacles >= cfg.min_points) {
+                e += OCCUPANCY_HIT_EVIDENCE;
+                seen++;
+            }
+            else if (!obstacles && points) {
+                /* the ground itself is seen */
+                e -= OCCUPANCY_FREE_EVIDENCE;
+                seen++;
+            }
+            else if (!obstacles) {
+                float dx = (grid->origin_col + col) * cfg.cell + half - grid->pose[3];
+                float range = sqrtf(dx * dx + dz * dz);
+                int bin = sector(dx, dz);
+
+                /* a ray of the sector passes over the cell and ends beyond it */
+                if (range >= grid->near[bin] - half && range <= grid->ground[bin] &&
+                    range < grid->obstacle[bin] - cfg.cell) {
+                    e -= OCCUPANCY_FREE_EVIDENCE;
+                    grid->heights[cell] = 0.f;
+                    seen++;
+                }
+            }
+            if (points)
+                grid->heights[cell] = top;
+            e = e > OCCUPANCY_MAX_EVIDENCE ? OCCUPANCY_MAX_EVIDENCE : e;
+            grid->evidence[cell] = e < -OCCUPANCY_MAX_EVIDENCE ? -OCCUPANCY_MAX_EVIDENCE : e;
+        }
+    }
+    grid->seen[task] = seen;
+}
+
+/*
+ * Public APIs
+ */
+extern "C" occupancy_grid_t *voxel3d_occupancy_create(const CameraInfo *cam_info,
+                                                      const OccupancyConfig *config)
+{
+    OccupancyConfig cfg;
+
+    if (!cam_info)
+        return NULL;
+    if (config) {
+        cfg = *config;
+    }
+    else {
+        memset(&cfg, 0, sizeof(cfg));
+    }
+    if (cfg.cell == 0.f)
+        cfg.cell = OCCUPANCY_DEFAULT_CELL;
+    if (!cfg.size)
+        cfg.size = OCCUPANCY_DEFAULT_SIZE;
+    if (cfg.min_height == 0.f)
+        cfg.min_height = OCCUPANCY_DEFAULT_MIN_HEIGHT;
+    if (cfg.max_height == 0.f)
+        cfg.max_height = OCCUPANCY_DEFAULT_MAX_HEIGHT;
+    if (cfg.max_range == 0.f)
+        cfg.max_range = OCCUPANCY_DEFAULT_MAX_RANGE;
+    if (cfg.decay == 0.f)
+        cfg.decay = OCCUPANCY_DEFAULT_DECAY;
+    if (!cfg.min_points)
+        cfg.min_points = OCCUPANCY_DEFAULT_MIN_POINTS;
+    if (!cfg.stride)
+        cfg.stride = OCCUPANCY_DEFAULT_STRIDE;
+    if (!(cfg.cell > 0.f) || cfg.size > OCCUPANCY_MAX_SIZE ||
+        !(cfg.max_height > cfg.min_height) || !(cfg.max_range > 0.f) ||
+        !(cfg.decay > 0.f && cfg.decay <= 1.f) || cfg.stride >= TOF_DEPTH_HEIGHT)
+        return NULL;
+
+    std::vector<float> rays(TOF_DEPTH_PIXELS * 2);
+    if (voxel3d_calibration_build_rays(cam_info, rays.data()) < 0)
+        return NULL;
+
+    occupancy_grid_t *grid = new occupancy_grid_t;
+    grid->config = cfg;
+    grid->inv_cell = 1.f / cfg.cell;
+    grid->size = (int)cfg.size;
+    grid->origin_col = grid->origin_row = -grid->size / 2;
+    grid->evidence.assign((size_t)grid->size * grid->size, 0.f);
+    grid->heights.assign((size_t)grid->size * grid->size, 0.f);
+    grid->seen.resize((grid->size + FUSE_ROWS - 1) / FUSE_ROWS);
+
+    /* the rays of the sampled pixels, laid out for 4-wide loads */
+    int samples = (TOF_DEPTH_WIDTH + (int)cfg.stride - 1) / (int)cfg.stride;
+    grid->rows = (TOF_DEPTH_HEIGHT + (int)cfg.stride - 1) / (int)cfg.stride;
+    grid->columns = (samples + 3) & ~3;
+    grid->pixels.assign(grid->columns, -1);
+    grid->rays.assign((size_t)grid->rows * grid->columns * 2, 0.f);
+    for (int col = 0; col < samples; col++)
+        grid->pixels[col] = col * (int)cfg.stride;
+    for (int row = 0; row < grid->rows; row++) {
+        float *out = &grid->rays[(size_t)row * grid->columns * 2];
+        for (int col = 0; col < samples; col++) {
+            size_t pixel = (size_t)row * cfg.stride * TOF_DEPTH_WIDTH + col * cfg.stride;
+            out[col] = rays[pixel * 2];
+            out[grid->columns + col] = rays[pixel * 2 + 1];
+        }
+    }
+    return grid;
+}
+
+extern "C" int voxel3d_occupancy_recenter(occupancy_grid_t *grid, float x, float z)
+{
+    if (!grid || !(fabsf(x) < 1e6f) || !(fabsf(z) < 1e6f))
+        return -1;
+
+    int col0 = (int)floorf(x * grid->inv_cell) - grid->size / 2;
+    int row0 = (int)floorf(z * grid->inv_cell) - grid->size / 2;
+    int shift_col = col0 - grid->origin_col, shift_row = row0 - grid->origin_row;
+    if (!shift_col && !shift_row)
+        return true;
+
+    size_t cells = (size_t)grid->size * grid->size;
+    grid->moved_evidence.assign(cells, 0.f);
+    grid->moved_heights.assign(cells, 0.f);
+    for (int row = 0; row < grid->size; row++) {
+        int from_row = row + shift_row;
+        if (from_row < 0 || from_row >= grid->size)
+            continue;
+        for (int col = 0; col < grid->size; col++) {
+            int from_col = col + shift_col;
+            if (from_col < 0 || from_col >= grid->size)
+                continue;
+            size_t from = (size_t)from_row * grid->size + from_col;
+            grid->moved_evidence[(size_t)row * grid->size + col] = grid->evidence[from];
+            grid->moved_heights[(size_t)row * grid->size + col] = grid->heights[from];
+        }
+    }
+    grid->evidence.swap(grid->moved_evidence);
+    grid->heights.swap(grid->moved_heights);
+    grid->origin_col = col0;
+    grid->origin_row = row0;
+    return true;
+}
+
+extern "C" int voxel3d_occupancy_integrate(occupancy_grid_t *grid, const unsigned short *depthmap,
+                                           const float *pose, parallel_t *pool)
+{
+    if (!grid || !depthmap || !pose)
+        return -1;
+
+    grid->num_chunks = voxel3d_parallel_threads(pool);
+    grid->num_chunks = grid->num_chunks < (unsigned int)grid->rows ? grid->num_chunks :
+                       (unsigned int)grid->rows;
+    if (grid->chunks.size() < grid->num_chunks) {
+        size_t cells = (size_t)grid->size * grid->size;
+        grid->chunks.resize(grid->num_chunks);
+        for (OccupancyChunk &chunk : grid->chunks) {
+            chunk.obstacles.resize(cells);
+            chunk.points.resize(cells);
+            chunk.tops.resize(cells);
+        }
+    }
+    grid->depthmap = depthmap;
+    memcpy(grid->pose, pose, sizeof(grid->pose));
+    voxel3d_parallel_run(pool, grid->num_chunks, bin_chunk, grid);
+
+    for (int bin = 0; bin < OCCUPANCY_BINS; bin++) {
+        grid->near[bin] = grid->obstacle[bin] = FLT_MAX;
+        grid->ground[bin] = -1.f;
+        for (unsigned int ix = 0; ix < grid->num_chunks; ix++) {
+            const OccupancyChunk *chunk = &grid->chunks[ix];
+            grid->near[bin] = chunk->near[bin] < grid->near[bin] ? chunk->near[bin] :
+                              grid->near[bin];
+            grid->ground[bin] = chunk->ground[bin] > grid->ground[bin] ? chunk->ground[bin] :
+                                grid->ground[bin];
+            grid->obstacle[bin] = chunk->obstacle[bin] < grid->obstacle[bin] ?
+                                  chunk->obstacle[bin] : grid->obstacle[bin];
+        }
+    }
+
+    unsigned int tasks = (unsigned int)grid->seen.size();
+    int seen = 0;
+    voxel3d_parallel_run(pool, tasks, fuse_rows, grid);
+    for (unsigned int task = 0; task < tasks; task++)
+        seen += grid->seen[task];
+    return seen;
+}
+
+extern "C" int voxel3d_occupancy_get(occupancy_grid_t *grid, unsigned char *occupancy,
+                                     float *heights, float origin[2])
+{
+    if (!grid)
+        return -1;
+
+    size_t cells = (size_t)grid->size * grid->size;
+    for (size_t cell = 0; cell < cells; cell++) {
+        float e = grid->evidence[cell];
+        bool known = fabsf(e) >= OCCUPANCY_KNOWN_EVIDENCE;
+
+        if (occupancy) {
+            occupancy[cell] = known ? (unsigned char)(100.f / (1.f + expf(-e)) + 0.5f) :
+                              OCCUPANCY_UNKNOWN;
+        }
+        if (heights)
+            heights[cell] = known ? grid->heights[cell] : 0.f;
+    }
+    if (origin) {
+        origin[0] = grid->origin_col * grid->config.cell;
+        origin[1] = grid->origin_row * grid->config.cell;
+    }
+    return grid->size;
+}
+
+extern "C" void voxel3d_occupancy_reset(occupancy_grid_t *grid)
+{
+    if (!grid)
+        return;
+
+    std::fill(grid->evidence.begin(), grid->evidence.end(), 0.f);
+    std::fill(grid->heights.begin(), grid->heights.end(), 0.f);
+}
+
+extern "C" void voxel3d_occupancy_destroy(occupancy_grid_t *grid)
+{
+    delete grid;
+}
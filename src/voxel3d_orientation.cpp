@@ -0,0 +1,226 @@
+/**
+ @file      voxel3d_orientation.cpp
+ @brief     Madgwick / Mahony orientation filters on the IMU samples
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "voxel3d_orientation.h"
+
+#define MIN_ERROR               (1e-6f)
+
+struct orientation_filter {
+    OrientationConfig config;
+    bool seeded;
+    float q[4];
+    float integral[3];                  /* Mahony gyro bias estimate */
+    unsigned int imu_ts;
+};
+
+/* World up in the camera convention, the accelerometer reads it at rest */
+static const float world_up[3] = { 0.f, -1.f, 0.f };
+
+static void normalize_quaternion(float q[4])
+{
+    float norm = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+
+    for (int ix = 0; ix < 4; ix++)
+        q[ix] /= norm;
+}
+
+/* Gravity in the camera frame: the second row of the rotation matrix */
+static void gravity_of(const float q[4], float gravity[3])
+{
+    gravity[0] = 2.f * (q[1] * q[2] + q[0] * q[3]);
+    gravity[1] = 1.f - 2.f * (q[1] * q[1] + q[3] * q[3]);
+    gravity[2] = 2.f * (q[2] * q[3] - q[0] * q[1]);
+}
+
+/* Shortest rotation of a unit up direction in the camera frame onto world up */
+static void shortest_arc(const float up[3], float q[4])
+{
+    float dot = up[0] * world_up[0] + up[1] * world_up[1] + up[2] * world_up[2];
+
+    if (dot < -1.f + MIN_ERROR) {
+        /* upside down, any half turn about a horizontal axis */
+        q[0] = 0.f;
+        q[1] = 1.f;
+        q[2] = 0.f;
+        q[3] = 0.f;
+    }
+    else {
+        q[0] = 1.f + dot;
+        q[1] = up[1] * world_up[2] - up[2] * world_up[1];
+        q[2] = up[2] * world_up[0] - up[0] * world_up[2];
+        q[3] = up[0] * world_up[1] - up[1] * world_up[0];
+        normalize_quaternion(q);
+    }
+}
+
+static void seed(orientation_filter_t *filter, const float up[3])
+{
+    shortest_arc(up, filter->q);
+    memset(filter->integral, 0, sizeof(filter->integral));
+    filter->seeded = true;
+}
+
+/*
+ * Public APIs
+ */
+extern "C" orientation_filter_t *voxel3d_orientation_create(const OrientationConfig *config)
+{
+    if (!config ||
+        (config->filter != ORIENTATION_MADGWICK && config->filter != ORIENTATION_MAHONY) ||
+        config->beta < 0.f || config->kp < 0.f || config->ki < 0.f || config->gyro_scale < 0.f)
+        return NULL;
+
+    orientation_filter_t *filter = new orientation_filter_t;
+    filter->config = *config;
+    if (filter->config.beta == 0.f)
+        filter->config.beta = ORIENTATION_DEFAULT_BETA;
+    if (filter->config.kp == 0.f)
+        filter->config.kp = ORIENTATION_DEFAULT_KP;
+    if (filter->config.gyro_scale == 0.f)
+        filter->config.gyro_scale = 1.f;
+    voxel3d_orientation_reset(filter);
+    return filter;
+}
+
+extern "C" int voxel3d_orientation_update(orientation_filter_t *filter, const IMU_DATA *imu_data)
+{
+    float up[3], gyro[3], error[3], estimate[3];
+
+    if (!filter || !imu_data)
+        return -1;
+
+    float norm = sqrtf(imu_data->imu_accel[0] * imu_data->imu_accel[0] +
+                       imu_data->imu_accel[1] * imu_data->imu_accel[1] +
+                       imu_data->imu_accel[2] * imu_data->imu_accel[2]);
+    if (norm <= 0.f)
+        return -1;
+    for (int axis = 0; axis < 3; axis++)
+        up[axis] = imu_data->imu_accel[axis] / norm;
+
+    int gap = (int)(imu_data->imu_ts - filter->imu_ts);
+    if (!filter->seeded || gap <= 0 || gap > ORIENTATION_MAX_GAP_US) {
+        seed(filter, up);
+        filter->imu_ts = imu_data->imu_ts;
+        return 0;
+    }
+    float dt = gap * 1e-6f;
+    float *q = filter->q;
+
+    /* error between the measured and the estimated up direction */
+    gravity_of(q, estimate);
+    for (int axis = 0; axis < 3; axis++)
+        estimate[axis] = -estimate[axis];
+    error[0] = up[1] * estimate[2] - up[2] * estimate[1];
+    error[1] = up[2] * estimate[0] - up[0] * estimate[2];
+    error[2] = up[0] * estimate[1] - up[1] * estimate[0];
+    float error_norm = sqrtf(error[0] * error[0] + error[1] * error[1] + error[2] * error[2]);
+
+    for (int axis = 0; axis < 3; axis++) {
+        gyro[axis] = imu_data->imu_gyro[axis] * filter->config.gyro_scale;
+
+        if (filter->config.filter == ORIENTATION_MADGWICK) {
+            /* the normalized gradient step of Madgwick, as a rotation rate */
+            if (error_norm > MIN_ERROR)
+                gyro[axis] += 2.f * filter->config.beta * error[axis] / error_norm;
+        }
+        else {
+            filter->integral[axis] += filter->config.ki * error[axis] * dt;
+            gyro[axis] += filter->config.kp * error[axis] + filter->integral[axis];
+        }
+    }
+
+    /* q += q * (0, gyro) * dt / 2 */
+    float hx = gyro[0] * dt * 0.5f, hy = gyro[1] * dt * 0.5f, hz = gyro[2] * dt * 0.5f;
+    float qw = q[0], qx = q[1], qy = q[2], qz = q[3];
+    q[0] += -qx * hx - qy * hy - qz * hz;
+    q[1] += qw * hx + qy * hz - qz * hy;
+    q[2] += qw * hy - qx * hz + qz * hx;
+    q[3] += qw * hz + qx * hy - qy * hx;
+    normalize_quaternion(q);
+
+    filter->imu_ts = imu_data->imu_ts;
+    return true;
+}
+
+extern "C" int voxel3d_orientation_get(orientation_filter_t *filter, Orientation *orientation)
+{
+    if (!filter || !orientation || !filter->seeded)
+        return -1;
+
+    memcpy(orientation->q, filter->q, sizeof(orientation->q));
+    gravity_of(filter->q, orientation->gravity);
+    orientation->imu_ts = filter->imu_ts;
+    return true;
+}
+
+extern "C" void voxel3d_orientation_reset(orientation_filter_t *filter)
+{
+    if (!filter)
+        return;
+
+    filter->seeded = false;
+    filter->q[0] = 1.f;
+    filter->q[1] = filter->q[2] = filter->q[3] = 0.f;
+    memset(filter->integral, 0, sizeof(filter->integral));
+    filter->imu_ts = 0;
+}
+
+extern "C" void voxel3d_orientation_destroy(orientation_filter_t *filter)
+{
+    delete filter;
+}
+
+extern "C" void voxel3d_orientation_interpolate(const Orientation *a, const Orientation *b,
+                                                float t, Orientation *orientation)
+{
+    float dot = 0.f;
+
+    /* normalized lerp on the shorter arc, close enough to slerp between IMU samples */
+    for (int ix = 0; ix < 4; ix++)
+        dot += a->q[ix] * b->q[ix];
+    for (int ix = 0; ix < 4; ix++)
+        orientation->q[ix] = a->q[ix] + t * ((dot < 0.f ? -b->q[ix] : b->q[ix]) - a->q[ix]);
+    normalize_quaternion(orientation->q);
+    gravity_of(orientation->q, orientation->gravity);
+}
+
+extern "C" void voxel3d_orientation_matrix(const float q[4], float r[9])
+{
+    float w = q[0], x = q[1], y = q[2], z = q[3];
+
+    r[0] = 1.f - 2.f * (y * y + z * z);
+    r[1] = 2.f * (x * y - w * z);
+    r[2] = 2.f * (x * z + w * y);
+    r[3] = 2.f * (x * y + w * z);
+    r[4] = 1.f - 2.f * (x * x + z * z);
+    r[5] = 2.f * (y * z - w * x);
+    r[6] = 2.f * (x * z - w * y);
+    r[7] = 2.f * (y * z + w * x);
+    r[8] = 1.f - 2.f * (x * x + y * y);
+}
+
+extern "C" int voxel3d_orientation_level(const float gravity[3], float r[9])
+{
+    float up[3], q[4];
+
+    if (!gravity || !r)
+        return -1;
+
+    float norm = sqrtf(gravity[0] * gravity[0] + gravity[1] * gravity[1] +
+                       gravity[2] * gravity[2]);
+    if (norm <= 0.f)
+        return -1;
+    for (int axis = 0; axis < 3; axis++)
+        up[axis] = -gravity[axis] / norm;
+
+    shortest_arc(up, q);
+    voxel3d_orientation_matrix(q, r);
+    return true;
+}
@@ -0,0 +1,128 @@
+/**
+ @file      voxel3d_parallel.cpp
+ @brief     Worker pool with parked threads and an atomic task counter
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "voxel3d_parallel.h"
+
+struct parallel {
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable start;              /* a new batch or stopping */
+    std::condition_variable done;               /* the last worker left the batch */
+    unsigned long long batch;                   /* under lock */
+    unsigned int active;                        /* workers still in the batch, under lock */
+    bool stopping;
+
+    parallel_task_fn fn;
+    void *user;
+    unsigned int tasks;
+    std::atomic<unsigned int> next;             /* next task to claim */
+};
+
+/* Claim tasks until the batch is exhausted */
+static void run_tasks(parallel_t *pool)
+{
+    unsigned int task;
+
+    while ((task = pool->next.fetch_add(1, std::memory_order_relaxed)) < pool->tasks)
+        pool->fn(pool->user, task);
+}
+
+static void worker_thread(parallel_t *pool)
+{
+    unsigned long long seen = 0;
+
+    std::unique_lock<std::mutex> lock(pool->lock);
+    for (;;) {
+        pool->start.wait(lock, [pool, seen] { return pool->stopping || pool->batch != seen; });
+        if (pool->stopping)
+            break;
+        seen = pool->batch;
+
+        lock.unlock();
+        run_tasks(pool);
+        lock.lock();
+        if (--pool->active == 0)
+            pool->done.notify_one();
+    }
+}
+
+/*
+ * Public APIs
+ */
+extern "C" parallel_t *voxel3d_parallel_create(unsigned int threads)
+{
+    if (!threads)
+        threads = std::thread::hardware_concurrency();
+
+    parallel_t *pool = new parallel_t;
+    pool->batch = 0;
+    pool->active = 0;
+    pool->stopping = false;
+    pool->fn = NULL;
+    pool->user = NULL;
+    pool->tasks = 0;
+    pool->next.store(0, std::memory_order_relaxed);
+    for (unsigned int ix = 1; ix < threads; ix++)
+        pool->workers.emplace_back(worker_thread, pool);
+    return pool;
+}
+
+extern "C" unsigned int voxel3d_parallel_threads(parallel_t *pool)
+{
+    return pool ? (unsigned int)pool->workers.size() + 1 : 1;
+}
+
+extern "C" void voxel3d_parallel_run(parallel_t *pool, unsigned int tasks, parallel_task_fn fn,
+                                     void *user)
+{
+    if (!fn || !tasks)
+        return;
+
+    if (!pool || pool->workers.empty() || tasks == 1) {
+        for (unsigned int task = 0; task < tasks; task++)
+            fn(user, task);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->fn = fn;
+        pool->user = user;
+        pool->tasks = tasks;
+        pool->next.store(0, std::memory_order_relaxed);
+        pool->active = (unsigned int)pool->workers.size();
+        pool->batch++;
+    }
+    pool->start.notify_all();
+
+    run_tasks(pool);
+
+    /* a worker still claiming from this batch would read the next one's tasks */
+    std::unique_lock<std::mutex> lock(pool->lock);
+    pool->done.wait(lock, [pool] { return pool->active == 0; });
+}
+
+extern "C" void voxel3d_parallel_destroy(parallel_t *pool)
+{
+    if (!pool)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->stopping = true;
+    }
+    pool->start.notify_all();
+    for (auto &worker : pool->workers)
+        worker.join();
+    delete pool;
+}
@@ -0,0 +1,541 @@
+/**
+ @file      voxel3d_planes.cpp
+ @brief     Block-wise plane fitting and agglomerative merging on organized point clouds
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "voxel3d_planes.h"
+
+#define MAX_INVALID_DIVISOR     (4)     /* a block may miss up to 1/4 of its points */
+#define MAX_NEWTON_STEPS        (8)
+#define NEWTON_TOLERANCE        (1e-3)  /* relative step of the smallest eigenvalue */
+#define MAX_BATCH_GROWTH        (1.1)   /* mse growth of a cluster within one pop */
+
+/* Sums of a point set, enough to fit its plane */
+enum PlaneSum {
+    SUM_N, SUM_X, SUM_Y, SUM_Z, SUM_XX, SUM_YY, SUM_ZZ, SUM_XY, SUM_XZ, SUM_YZ, SUM_COUNT
+};
+
+struct PlaneNode {
+    double sum[SUM_COUNT];
+    double mse;                                 /* smallest eigenvalue of the covariance */
+    unsigned int blocks;
+    bool alive;
+    int mark;                                   /* last node that listed it, see
+                                                   resolve_neighbours() */
+    std::vector<int> neighbours;
+};
+
+struct HeapEntry {
+    double mse;
+    int node;
+
+    bool operator<(const HeapEntry &other) const
+    {
+        /* std heaps keep the largest on top, the flattest node shall be */
+        return mse > other.mse;
+    }
+};
+
+struct plane_extractor {
+    PlaneConfig config;
+    int cols, rows;                             /* blocks */
+    float lo, hi;                               /* squared range ratio of a depth edge */
+    std::vector<PlaneNode> nodes;               /* blocks first, then the merged clusters */
+    std::vector<int> parent;                    /* node merged into, -1 when none */
+    std::vector<int> plane_of;                  /* output plane of a node, -1 when none */
+    std::vector<HeapEntry> heap;
+    std::vector<HeapEntry> candidates;          /* neighbours of the popped node */
+    std::vector<int> extracted;
+    std::vector<int> block_plane;               /* output plane of each block, -1 when none */
+    const float *xyz;
+    unsigned short *labels;
+};
+
+/* Smallest eigenvalue and its unit eigenvector of the covariance of the sums */
+static double fit_plane(const double *sum, double *normal)
+{
+    double n = sum[SUM_N];
+    double mx = sum[SUM_X] / n, my = sum[SUM_Y] / n, mz = sum[SUM_Z] / n;
+    double a00 = sum[SUM_XX] / n - mx * mx, a11 = sum[SUM_YY] / n - my * my;
+    double a22 = sum[SUM_ZZ] / n - mz * mz, a01 = sum[SUM_XY] / n - mx * my;
+    double a02 = sum[SUM_XZ] / n - mx * mz, a12 = sum[SUM_YZ] / n - my * mz;
+    double lambda = 0.;
+
+    /*
+     * Newton on the characteristic polynomial from 0: it is concave and increasing up to
+     * the smallest root, so the steps stay below it. The points of a plane have one small
+     * eigenvalue far from the other two and the first step lands about on it already,
+     * which is cheaper than the trigonometric closed form run for every merge candidate.
+     */
+    double trace = a00 + a11 + a22;
+    double minors = a00 * a11 - a01 * a01 + a00 * a22 - a02 * a02 + a11 * a22 - a12 * a12;
+    double det = a00 * (a11 * a22 - a12 * a12) - a01 * (a01 * a22 - a12 * a02) +
+                 a02 * (a01 * a12 - a11 * a02);
+    for (int step = 0; step < MAX_NEWTON_STEPS; step++) {
+        double value = ((lambda - trace) * lambda + minors) * lambda - det;
+        double slope = (3. * lambda - 2. * trace) * lambda + minors;
+        if (slope <= 0. || value >= 0.)
+            break;
+
+        double delta = -value / slope;
+        lambda += delta;
+        if (delta <= NEWTON_TOLERANCE * lambda)
+            break;
+    }
+    if (!normal)
+        return lambda;
+
+    /* the eigenvector is normal to the rows of A - lambda I, take the best conditioned
+       cross product of two of them */
+    double rows[3][3] = { { a00 - lambda, a01, a02 }, { a01, a11 - lambda, a12 },
+                          { a02, a12, a22 - lambda } };
+    double best = -1.;
+    for (int ix = 0; ix < 3; ix++) {
+        const double *u = rows[ix], *v = rows[(ix + 1) % 3];
+        double c[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2],
+                        u[0] * v[1] - u[1] * v[0] };
+        double len = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+
+        if (len > best) {
+            best = len;
+            memcpy(normal, c, sizeof(c));
+        }
+    }
+    best = sqrt(best);
+    if (best <= 0.) {
+        /* isotropic, any normal fits as badly */
+        normal[0] = normal[1] = 0.;
+        normal[2] = 1.;
+    }
+    else {
+        for (int axis = 0; axis < 3; axis++)
+            normal[axis] /= best;
+    }
+    return lambda;
+}
+
+/* Squared noise allowed at the range of the centroid of the sums */
+static double max_mse(const plane_extractor_t *ext, const double *sum)
+{
+    double n = sum[SUM_N];
+    double range = sqrt(sum[SUM_X] * sum[SUM_X] + sum[SUM_Y] * sum[SUM_Y] +
+                        sum[SUM_Z] * sum[SUM_Z]) / n;
+    double noise = ext->config.noise_ratio * range + ext->config.noise_floor;
+
+    return noise * noise;
+}
+
+static float range_sq(const float *p)
+{
+    return p[0] * p[0] + p[1] * p[1] + p[2] * p[2];
+}
+
+/* Sums of one block, not alive when it doesn't take part */
+static void fit_block(plane_extractor_t *ext, int bx, int by)
+{
+    int block = (int)ext->config.block, invalid = 0;
+    PlaneNode *node = &ext->nodes[by * ext->cols + bx];
+    const float *origin = NULL;
+    float local[SUM_COUNT] = { 0.f };
+
+    node->alive = false;
+    node->blocks = 1;
+    for (int v = by * block; v < (by + 1) * block; v++) {
+        const float *row = ext->xyz + (size_t)v * TOF_DEPTH_WIDTH * 3;
+        float left = 0.f;
+
+        for (int u = bx * block; u < (bx + 1) * block; u++) {
+            const float *p = row + u * 3;
+            float range = range_sq(p), other = left;
+
+            left = range;
+            if (range <= 0.f) {
+                if (++invalid > block * block / MAX_INVALID_DIVISOR)
+                    return;
+                continue;
+            }
+
+            /* a depth edge to the valid left / upper neighbour in the block */
+            if (other > 0.f && (other < ext->lo * range || other > ext->hi * range))
+                return;
+            if (v > by * block) {
+                other = range_sq(p - TOF_DEPTH_WIDTH * 3);
+                if (other > 0.f && (other < ext->lo * range || other > ext->hi * range))
+                    return;
+            }
+
+            /* float sums stay exact enough about a point of the block itself */
+            if (!origin)
+                origin = p;
+            float x = p[0] - origin[0], y = p[1] - origin[1], z = p[2] - origin[2];
+            local[SUM_N] += 1.f;
+            local[SUM_X] += x;
+            local[SUM_Y] += y;
+            local[SUM_Z] += z;
+            local[SUM_XX] += x * x;
+            local[SUM_YY] += y * y;
+            local[SUM_ZZ] += z * z;
+            local[SUM_XY] += x * y;
+            local[SUM_XZ] += x * z;
+            local[SUM_YZ] += y * z;
+        }
+    }
+
+    /* back to the camera origin, sum (o + x)(o + y) = sum xy + o_x sum y + o_y sum x + n o_x o_y */
+    double *sum = node->sum, n = local[SUM_N];
+    double ox = origin[0], oy = origin[1], oz = origin[2];
+    sum[SUM_N] = n;
+    sum[SUM_X] = local[SUM_X] + n * ox;
+    sum[SUM_Y] = local[SUM_Y] + n * oy;
+    sum[SUM_Z] = local[SUM_Z] + n * oz;
+    sum[SUM_XX] = local[SUM_XX] + 2. * ox * local[SUM_X] + n * ox * ox;
+    sum[SUM_YY] = local[SUM_YY] + 2. * oy * local[SUM_Y] + n * oy * oy;
+    sum[SUM_ZZ] = local[SUM_ZZ] + 2. * oz * local[SUM_Z] + n * oz * oz;
+    sum[SUM_XY] = local[SUM_XY] + ox * local[SUM_Y] + oy * local[SUM_X] + n * ox * oy;
+    sum[SUM_XZ] = local[SUM_XZ] + ox * local[SUM_Z] + oz * local[SUM_X] + n * ox * oz;
+    sum[SUM_YZ] = local[SUM_YZ] + oy * local[SUM_Z] + oz * local[SUM_Y] + n * oy * oz;
+
+    node->mse = fit_plane(sum, NULL);
+    node->alive = node->mse <= max_mse(ext, sum);
+}
+
+static void fit_block_row(void *user, unsigned int task)
+{
+    plane_extractor_t *ext = (plane_extractor_t *)user;
+
+    for (int bx = 0; bx < ext->cols; bx++)
+        fit_block(ext, bx, (int)task);
+}
+
+static int find_root(plane_extractor_t *ext, int node)
+{
+    int root = node;
+
+    while (ext->parent[root] >= 0)
+        root = ext->parent[root];
+    /* path compression, later blocks of the same cluster stop at once */
+    while (ext->parent[node] >= 0) {
+        int next = ext->parent[node];
+        ext->parent[node] = root;
+        node = next;
+    }
+    return root;
+}
+
+static void push_node(plane_extractor_t *ext, int node)
+{
+    HeapEntry entry = { ext->nodes[node].mse, node };
+
+    ext->heap.push_back(entry);
+    std::push_heap(ext->heap.begin(), ext->heap.end());
+}
+
+/*
+ * Neighbour lists keep the nodes merged since, a node stands for the cluster it ended in.
+ * Replace them by their clusters, dropping the node itself, the clusters done with and
+ * the repeated ones.
+ */
+static void resolve_neighbours(plane_extractor_t *ext, int ix)
+{
+    std::vector<int> &list = ext->nodes[ix].neighbours;
+    size_t kept = 0;
+
+    for (size_t jx = 0; jx < list.size(); jx++) {
+        int other = find_root(ext, list[jx]);
+        PlaneNode *neighbour = &ext->nodes[other];
+
+        if (other == ix || !neighbour->alive || neighbour->mark == ix)
+            continue;
+        neighbour->mark = ix;
+        list[kept++] = other;
+    }
+    list.resize(kept);
+}
+
+/*
+ * Agglomerative merging of the fitted blocks, fills ext->extracted. The flattest node
+ * takes its neighbours in the order of the flatness of their union with it, for as long as
+ * the cluster stays within the noise allowed and would still be popped next: about as flat
+ * as it was or flatter than the next node. Taking them in one pop rather than the best one
+ * per pop keeps a growing floor from scanning its whole border for every block it takes.
+ */
+static void cluster(plane_extractor_t *ext)
+{
+    int num_blocks = ext->cols * ext->rows;
+    double sum[SUM_COUNT], grown[SUM_COUNT];
+
+    ext->heap.clear();
+    ext->extracted.clear();
+    for (int ix = 0; ix < num_blocks; ix++) {
+        PlaneNode *node = &ext->nodes[ix];
+        int bx = ix % ext->cols, by = ix / ext->cols;
+
+        node->neighbours.clear();
+        node->mark = -1;
+        if (!node->alive)
+            continue;
+        if (bx > 0 && ext->nodes[ix - 1].alive)
+            node->neighbours.push_back(ix - 1);
+        if (bx < ext->cols - 1 && ext->nodes[ix + 1].alive)
+            node->neighbours.push_back(ix + 1);
+        if (by > 0 && ext->nodes[ix - ext->cols].alive)
+            node->neighbours.push_back(ix - ext->cols);
+        if (by < ext->rows - 1 && ext->nodes[ix + ext->cols].alive)
+            node->neighbours.push_back(ix + ext->cols);
+        push_node(ext, ix);
+    }
+
+    while (!ext->heap.empty()) {
+        std::pop_heap(ext->heap.begin(), ext->heap.end());
+        int ix = ext->heap.back().node;
+        ext->heap.pop_back();
+        if (!ext->nodes[ix].alive)
+            continue;
+
+        resolve_neighbours(ext, ix);
+        ext->candidates.clear();
+        for (int other : ext->nodes[ix].neighbours) {
+            const double *other_sum = ext->nodes[other].sum;
+
+            for (int jx = 0; jx < SUM_COUNT; jx++)
+                sum[jx] = ext->nodes[ix].sum[jx] + other_sum[jx];
+            HeapEntry entry = { fit_plane(sum, NULL), other };
+            ext->candidates.push_back(entry);
+        }
+        /* HeapEntry orders the flattest last */
+        std::sort(ext->candidates.rbegin(), ext->candidates.rend());
+
+        /* grow until the union gets too rough, the ones after are rougher still */
+        memcpy(grown, ext->nodes[ix].sum, sizeof(grown));
+        double grown_mse = ext->nodes[ix].mse;
+        double next_mse = ext->heap.empty() ? HUGE_VAL : ext->heap.front().mse;
+        double bound = grown_mse * MAX_BATCH_GROWTH;
+        bound = bound > next_mse ? bound : next_mse;
+        size_t taken = 0;
+        for (; taken < ext->candidates.size(); taken++) {
+            const double *other_sum = ext->nodes[ext->candidates[taken].node].sum;
+
+            if (taken && grown_mse > bound)
+                break;
+            for (int jx = 0; jx < SUM_COUNT; jx++)
+                sum[jx] = grown[jx] + other_sum[jx];
+            /* the first union is the one fitted above for the order */
+            double mse = taken ? fit_plane(sum, NULL) : ext->candidates[0].mse;
+            if (mse > max_mse(ext, sum))
+                break;
+            memcpy(grown, sum, sizeof(grown));
+            grown_mse = mse;
+        }
+
+        if (!taken) {
+            /* can't grow any more */
+            ext->nodes[ix].alive = false;
+            if (ext->nodes[ix].blocks >= ext->config.min_blocks)
+                ext->extracted.push_back(ix);
+            continue;
+        }
+
+        int merged = (int)ext->nodes.size();
+        ext->nodes.emplace_back();
+        ext->parent.push_back(-1);
+        PlaneNode *node = &ext->nodes[merged];
+        memcpy(node->sum, grown, sizeof(grown));
+        node->mse = grown_mse;
+        node->alive = true;
+        node->mark = -1;
+        node->blocks = 0;
+        /* the list of the popped node is the longest, it moves rather than being copied */
+        node->neighbours.swap(ext->nodes[ix].neighbours);
+        for (size_t jx = 0; jx <= taken; jx++) {
+            int from = jx < taken ? ext->candidates[jx].node : ix;
+            PlaneNode *part = &ext->nodes[from];
+
+            node->blocks += part->blocks;
+            if (from != ix)
+                node->neighbours.insert(node->neighbours.end(), part->neighbours.begin(),
+                                        part->neighbours.end());
+            part->alive = false;
+            ext->parent[from] = merged;
+        }
+        push_node(ext, merged);
+    }
+}
+
+struct LabelJob {
+    plane_extractor_t *ext;
+    const Plane *planes;
+    const int *block_plane;
+};
+
+/* Labels of a row of blocks, with the pixels of left-out blocks joining a neighbour plane */
+static void label_block_row(void *user, unsigned int task)
+{
+    LabelJob *job = (LabelJob *)user;
+    plane_extractor_t *ext = job->ext;
+    int block = (int)ext->config.block, by = (int)task;
+
+    for (int bx = 0; bx < ext->cols; bx++) {
+        int plane = job->block_plane[by * ext->cols + bx];
+        int candidates[4], count = 0;
+
+        if (plane < 0) {
+            int around[4][2] = { { bx - 1, by }, { bx + 1, by }, { bx, by - 1 }, { bx, by + 1 } };
+
+            for (int jx = 0; jx < 4; jx++) {
+                int nx = around[jx][0], ny = around[jx][1];
+                if (nx < 0 || ny < 0 || nx >= ext->cols || ny >= ext->rows)
+                    continue;
+
+                int other = job->block_plane[ny * ext->cols + nx];
+                if (other >= 0 && std::find(candidates, candidates + count, other) ==
+                                  candidates + count)
+                    candidates[count++] = other;
+            }
+        }
+
+        for (int v = by * block; v < (by + 1) * block; v++) {
+            for (int u = bx * block; u < (bx + 1) * block; u++) {
+                int ix = v * TOF_DEPTH_WIDTH + u;
+                const float *p = ext->xyz + (size_t)ix * 3;
+                float range = range_sq(p);
+                unsigned short label = 0;
+
+                if (range > 0.f && plane >= 0) {
+                    label = (unsigned short)(plane + 1);
+                }
+                else if (range > 0.f && count) {
+                    range = sqrtf(range);
+                    float limit = PLANES_REFINE_SIGMA * (ext->config.noise_ratio * range +
+                                                         ext->config.noise_floor);
+
+                    for (int jx = 0; jx < count; jx++) {
+                        const Plane *pl = &job->planes[candidates[jx]];
+                        float dist = fabsf(pl->normal[0] * p[0] + pl->normal[1] * p[1] +
+                                           pl->normal[2] * p[2] + pl->d);
+                        if (dist < limit) {
+                            limit = dist;
+                            label = (unsigned short)(candidates[jx] + 1);
+                        }
+                    }
+                }
+                ext->labels[ix] = label;
+            }
+        }
+    }
+}
+
+/*
+ * Public APIs
+ */
+extern "C" plane_extractor_t *voxel3d_planes_create(const PlaneConfig *config)
+{
+    PlaneConfig cfg;
+
+    if (config) {
+        cfg = *config;
+    }
+    else {
+        memset(&cfg, 0, sizeof(cfg));
+    }
+    if (!cfg.block)
+        cfg.block = PLANES_DEFAULT_BLOCK;
+    if (!cfg.min_blocks)
+        cfg.min_blocks = PLANES_DEFAULT_MIN_BLOCKS;
+    if (cfg.noise_ratio == 0.f)
+        cfg.noise_ratio = PLANES_DEFAULT_NOISE_RATIO;
+    if (cfg.noise_floor == 0.f)
+        cfg.noise_floor = PLANES_DEFAULT_NOISE_FLOOR;
+    if (cfg.max_depth_change == 0.f)
+        cfg.max_depth_change = PLANES_DEFAULT_DEPTH_CHANGE;
+    if (cfg.block < 2 || TOF_DEPTH_WIDTH % cfg.block || TOF_DEPTH_HEIGHT % cfg.block ||
+        cfg.noise_ratio < 0.f || cfg.noise_floor < 0.f || cfg.max_depth_change < 0.f)
+        return NULL;
+
+    plane_extractor_t *ext = new plane_extractor_t;
+    ext->config = cfg;
+    ext->cols = TOF_DEPTH_WIDTH / cfg.block;
+    ext->rows = TOF_DEPTH_HEIGHT / cfg.block;
+    ext->lo = cfg.max_depth_change < 1.f ?
+              (1.f - cfg.max_depth_change) * (1.f - cfg.max_depth_change) : 0.f;
+    ext->hi = (1.f + cfg.max_depth_change) * (1.f + cfg.max_depth_change);
+
+    /* every merge adds one node, at most one less than the blocks */
+    size_t num_blocks = (size_t)ext->cols * ext->rows;
+    ext->nodes.reserve(num_blocks * 2);
+    ext->parent.reserve(num_blocks * 2);
+    ext->plane_of.reserve(num_blocks * 2);
+    ext->heap.reserve(num_blocks * 2);
+    ext->candidates.reserve(num_blocks);
+    ext->extracted.reserve(num_blocks);
+    ext->nodes.resize(num_blocks);
+    ext->block_plane.resize(num_blocks);
+    return ext;
+}
+
+extern "C" int voxel3d_planes_extract(plane_extractor_t *ext, const float *xyz,
+                                      parallel_t *pool, Plane *planes, unsigned int max_planes,
+                                      unsigned short *labels)
+{
+    if (!ext || !xyz || (!planes && max_planes))
+        return -1;
+
+    int num_blocks = ext->cols * ext->rows;
+    ext->xyz = xyz;
+    ext->labels = labels;
+    ext->nodes.resize(num_blocks);
+    ext->parent.assign(num_blocks, -1);
+
+    voxel3d_parallel_run(pool, ext->rows, fit_block_row, ext);
+    cluster(ext);
+
+    /* largest first, the floor of a room comes before its shelves */
+    std::sort(ext->extracted.begin(), ext->extracted.end(), [ext](int a, int b) {
+        return ext->nodes[a].blocks > ext->nodes[b].blocks;
+    });
+    unsigned int found = (unsigned int)ext->extracted.size();
+    found = found < max_planes ? found : max_planes;
+
+    ext->plane_of.assign(ext->nodes.size(), -1);
+    for (unsigned int ix = 0; ix < found; ix++) {
+        int id = ext->extracted[ix];
+        const double *sum = ext->nodes[id].sum;
+        double normal[3], center[3];
+        double mse = fit_plane(sum, normal);
+        Plane *plane = &planes[ix];
+
+        for (int axis = 0; axis < 3; axis++)
+            center[axis] = sum[SUM_X + axis] / sum[SUM_N];
+        double dot = normal[0] * center[0] + normal[1] * center[1] + normal[2] * center[2];
+        double sign = dot > 0. ? -1. : 1.;
+        for (int axis = 0; axis < 3; axis++) {
+            plane->normal[axis] = (float)(normal[axis] * sign);
+            plane->center[axis] = (float)center[axis];
+        }
+        plane->d = (float)(-dot * sign);
+        plane->rms = (float)sqrt(mse);
+        plane->points = (unsigned int)sum[SUM_N];
+        plane->blocks = ext->nodes[id].blocks;
+        ext->plane_of[id] = (int)ix;
+    }
+
+    if (labels) {
+        LabelJob job = { ext, planes, ext->block_plane.data() };
+
+        for (int ix = 0; ix < num_blocks; ix++)
+            ext->block_plane[ix] = ext->plane_of[find_root(ext, ix)];
+        voxel3d_parallel_run(pool, ext->rows, label_block_row, &job);
+    }
+    return (int)found;
+}
+
+extern "C" void voxel3d_planes_destroy(plane_extractor_t *ext)
+{
+    delete ext;
+}
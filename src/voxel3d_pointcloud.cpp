@@ -0,0 +1,308 @@
+/**
+ @file      voxel3d_pointcloud.cpp
+ @brief     Point cloud generation from the ToF ray table and grid normal estimation
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <atomic>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define POINTCLOUD_SSE2
+#endif
+
+#include "voxel3d_pointcloud.h"
+
+#define NORMAL_BAND_ROWS        (16)
+#define NORMAL_PACK_SCALE       (511.f)
+
+static const float identity[9] = { 1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f };
+
+#ifdef POINTCLOUD_SSE2
+/* 4 interleaved points to x0..x3, y0..y3, z0..z3 */
+static inline void load_xyz(const float *p, __m128 *x, __m128 *y, __m128 *z)
+{
+    __m128 a = _mm_loadu_ps(p);                 /* x0 y0 z0 x1 */
+    __m128 b = _mm_loadu_ps(p + 4);             /* y1 z1 x2 y2 */
+    __m128 c = _mm_loadu_ps(p + 8);             /* z2 x3 y3 z3 */
+    __m128 b2c1 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+    __m128 a1b0 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+    __m128 b3c2 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+    __m128 a2b1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+
+    *x = _mm_shuffle_ps(a, b2c1, _MM_SHUFFLE(2, 0, 3, 0));
+    *y = _mm_shuffle_ps(a1b0, b3c2, _MM_SHUFFLE(2, 0, 2, 0));
+    *z = _mm_shuffle_ps(a2b1, c, _MM_SHUFFLE(3, 0, 2, 0));
+}
+
+/* x0..x3, y0..y3, z0..z3 to 4 interleaved points */
+static inline void store_xyz(float *p, __m128 x, __m128 y, __m128 z)
+{
+    __m128 xy_lo = _mm_unpacklo_ps(x, y);
+    __m128 xy_hi = _mm_unpackhi_ps(x, y);
+    __m128 z0x1 = _mm_shuffle_ps(z, xy_lo, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128 y1z1 = _mm_shuffle_ps(xy_lo, z, _MM_SHUFFLE(1, 1, 3, 3));
+    __m128 z2x3 = _mm_shuffle_ps(z, xy_hi, _MM_SHUFFLE(2, 2, 2, 2));
+    __m128 y3z3 = _mm_shuffle_ps(xy_hi, z, _MM_SHUFFLE(3, 3, 3, 3));
+
+    _mm_storeu_ps(p, _mm_shuffle_ps(xy_lo, z0x1, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(p + 4, _mm_shuffle_ps(y1z1, xy_hi, _MM_SHUFFLE(1, 0, 2, 0)));
+    _mm_storeu_ps(p + 8, _mm_shuffle_ps(z2x3, y3z3, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+#endif
+
+/*
+ * Normals
+ */
+struct NormalJob {
+    const float *xyz;
+    void *normals;
+    int format;
+    int step;
+    float lo;                                   /* (1 - max_depth_change) ^ 2 */
+    float hi;                                   /* (1 + max_depth_change) ^ 2 */
+    std::atomic<int> valid;
+};
+
+/* Normal of one pixel, 0 when a neighbour is invalid or across a depth edge */
+static int normal_at(const NormalJob *job, int ix, float *n)
+{
+    const float *c = job->xyz + ix * 3;
+    const float *l = c - job->step * 3, *r = c + job->step * 3;
+    const float *u = c - job->step * TOF_DEPTH_WIDTH * 3, *d = c + job->step * TOF_DEPTH_WIDTH * 3;
+    const float *neighbours[4] = { l, r, u, d };
+    float range = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+
+    n[0] = n[1] = n[2] = 0.f;
+    for (int jx = 0; jx < 4; jx++) {
+        const float *p = neighbours[jx];
+        float other = p[0] * p[0] + p[1] * p[1] + p[2] * p[2];
+
+        if (!(other > job->lo * range && other <= job->hi * range))
+            return 0;
+    }
+
+    float dx[3] = { r[0] - l[0], r[1] - l[1], r[2] - l[2] };
+    float dy[3] = { d[0] - u[0], d[1] - u[1], d[2] - u[2] };
+    float nx = dx[1] * dy[2] - dx[2] * dy[1];
+    float ny = dx[2] * dy[0] - dx[0] * dy[2];
+    float nz = dx[0] * dy[1] - dx[1] * dy[0];
+    float len = sqrtf(nx * nx + ny * ny + nz * nz);
+    if (len <= 0.f)
+        return 0;
+
+    /* towards the camera, which stays at the origin of a rotated cloud too */
+    if (nx * c[0] + ny * c[1] + nz * c[2] > 0.f)
+        len = -len;
+    n[0] = nx / len;
+    n[1] = ny / len;
+    n[2] = nz / len;
+    return 1;
+}
+
+/* Normals of row v into out, TOF_DEPTH_WIDTH * 3 floats, returns the valid ones */
+static int normal_row(const NormalJob *job, int v, float *out)
+{
+    int step = job->step, valid = 0, u = step;
+
+    memset(out, 0, TOF_DEPTH_WIDTH * 3 * sizeof(float));
+    if (v < step || v >= TOF_DEPTH_HEIGHT - step)
+        return 0;
+
+#ifdef POINTCLOUD_SSE2
+    static const int popcount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+    const __m128 lo = _mm_set1_ps(job->lo), hi = _mm_set1_ps(job->hi);
+    const __m128 sign = _mm_set1_ps(-0.f), zero = _mm_setzero_ps();
+
+    for (; u + 4 <= TOF_DEPTH_WIDTH - step; u += 4) {
+        const float *c = job->xyz + (v * TOF_DEPTH_WIDTH + u) * 3;
+        __m128 cx, cy, cz, lx, ly, lz, rx, ry, rz, ux, uy, uz, dx, dy, dz;
+
+        load_xyz(c, &cx, &cy, &cz);
+        load_xyz(c - step * 3, &lx, &ly, &lz);
+        load_xyz(c + step * 3, &rx, &ry, &rz);
+        load_xyz(c - step * TOF_DEPTH_WIDTH * 3, &ux, &uy, &uz);
+        load_xyz(c + step * TOF_DEPTH_WIDTH * 3, &dx, &dy, &dz);
+
+        /* every neighbour valid and within the depth change of the centre */
+        __m128 range = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)),
+                                  _mm_mul_ps(cz, cz));
+        __m128 range_lo = _mm_mul_ps(range, lo), range_hi = _mm_mul_ps(range, hi);
+        __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+#define CHECK_NEIGHBOUR(x, y, z)                                                        \
+        do {                                                                            \
+            __m128 other = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),   \
+                                      _mm_mul_ps(z, z));                                \
+            mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(other, range_lo),           \
+                                               _mm_cmple_ps(other, range_hi)));         \
+        } while (0)
+        CHECK_NEIGHBOUR(lx, ly, lz);
+        CHECK_NEIGHBOUR(rx, ry, rz);
+        CHECK_NEIGHBOUR(ux, uy, uz);
+        CHECK_NEIGHBOUR(dx, dy, dz);
+#undef CHECK_NEIGHBOUR
+
+        __m128 hx = _mm_sub_ps(rx, lx), hy = _mm_sub_ps(ry, ly), hz = _mm_sub_ps(rz, lz);
+        __m128 vx = _mm_sub_ps(dx, ux), vy = _mm_sub_ps(dy, uy), vz = _mm_sub_ps(dz, uz);
+        __m128 nx = _mm_sub_ps(_mm_mul_ps(hy, vz), _mm_mul_ps(hz, vy));
+        __m128 ny = _mm_sub_ps(_mm_mul_ps(hz, vx), _mm_mul_ps(hx, vz));
+        __m128 nz = _mm_sub_ps(_mm_mul_ps(hx, vy), _mm_mul_ps(hy, vx));
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+                                            _mm_mul_ps(nz, nz)));
+        mask = _mm_and_ps(mask, _mm_cmpgt_ps(len, zero));
+
+        /* towards the camera: negate the length where the normal faces away */
+        __m128 facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                   _mm_mul_ps(nz, cz));
+        len = _mm_xor_ps(len, _mm_and_ps(_mm_cmpgt_ps(facing, zero), sign));
+
+        /* invalid lanes divide by a zero length, the mask clears them */
+        __m128 scale = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.f), len), mask);
+        store_xyz(out + u * 3, _mm_mul_ps(nx, scale), _mm_mul_ps(ny, scale),
+                  _mm_mul_ps(nz, scale));
+        valid += popcount[_mm_movemask_ps(mask)];
+    }
+#endif
+    for (; u < TOF_DEPTH_WIDTH - step; u++)
+        valid += normal_at(job, v * TOF_DEPTH_WIDTH + u, out + u * 3);
+    return valid;
+}
+
+static void pack_row(const float *row, unsigned int *packed)
+{
+    int u = 0;
+
+#ifdef POINTCLOUD_SSE2
+    const __m128 scale = _mm_set1_ps(NORMAL_PACK_SCALE);
+    const __m128i bits = _mm_set1_epi32(0x3ff);
+
+    for (; u < TOF_DEPTH_WIDTH; u += 4) {
+        __m128 x, y, z;
+
+        load_xyz(row + u * 3, &x, &y, &z);
+        __m128i px = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(x, scale)), bits);
+        __m128i py = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(y, scale)), bits);
+        __m128i pz = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(z, scale)), bits);
+        _mm_storeu_si128((__m128i *)(packed + u),
+                         _mm_or_si128(px, _mm_or_si128(_mm_slli_epi32(py, 10),
+                                                       _mm_slli_epi32(pz, 20))));
+    }
+#endif
+    for (; u < TOF_DEPTH_WIDTH; u++) {
+        packed[u] = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            float scaled = row[u * 3 + axis] * NORMAL_PACK_SCALE;
+            int value = (int)(scaled < 0.f ? scaled - 0.5f : scaled + 0.5f);
+
+            packed[u] |= ((unsigned int)value & 0x3ff) << (axis * 10);
+        }
+    }
+}
+
+static void normal_band(void *user, unsigned int task)
+{
+    NormalJob *job = (NormalJob *)user;
+    float row[TOF_DEPTH_WIDTH * 3];
+    int valid = 0;
+
+    for (int v = task * NORMAL_BAND_ROWS; v < (int)(task + 1) * NORMAL_BAND_ROWS; v++) {
+        if (job->format == POINTCLOUD_NORMAL_FLOAT) {
+            valid += normal_row(job, v, (float *)job->normals + v * TOF_DEPTH_WIDTH * 3);
+            continue;
+        }
+
+        valid += normal_row(job, v, row);
+        pack_row(row, (unsigned int *)job->normals + v * TOF_DEPTH_WIDTH);
+    }
+    job->valid.fetch_add(valid, std::memory_order_relaxed);
+}
+
+/*
+ * Public APIs
+ */
+extern "C" int voxel3d_pointcloud_generate(const float *rays, const unsigned short *depthmap,
+                                           const float *rotation, float *xyz)
+{
+    const float *r = rotation ? rotation : identity;
+
+    if (!rays || !depthmap || !xyz)
+        return -1;
+
+    /* point = z * (r * (x, y, 1)), the rotated ray scaled by depth */
+#ifdef POINTCLOUD_SSE2
+    const __m128 unit = _mm_set1_ps(POINTCLOUD_DEPTH_UNIT_M);
+    const __m128i zero = _mm_setzero_si128();
+    __m128 m[9];
+
+    for (int jx = 0; jx < 9; jx++)
+        m[jx] = _mm_set1_ps(r[jx]);
+
+    /* TOF_DEPTH_PIXELS is a multiple of 4 */
+    for (int ix = 0; ix < TOF_DEPTH_PIXELS; ix += 4) {
+        __m128i d = _mm_loadl_epi64((const __m128i *)(depthmap + ix));
+        __m128 z = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(d, zero)), unit);
+        __m128 r0 = _mm_loadu_ps(rays + ix * 2);
+        __m128 r1 = _mm_loadu_ps(rays + ix * 2 + 4);
+        __m128 rx = _mm_shuffle_ps(r0, r1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 ry = _mm_shuffle_ps(r0, r1, _MM_SHUFFLE(3, 1, 3, 1));
+
+        __m128 px = _mm_mul_ps(z, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], rx),
+                                                        _mm_mul_ps(m[1], ry)), m[2]));
+        __m128 py = _mm_mul_ps(z, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[3], rx),
+                                                        _mm_mul_ps(m[4], ry)), m[5]));
+        __m128 pz = _mm_mul_ps(z, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[6], rx),
+                                                        _mm_mul_ps(m[7], ry)), m[8]));
+
+        store_xyz(xyz + ix * 3, px, py, pz);
+    }
+#else
+    for (int ix = 0; ix < TOF_DEPTH_PIXELS; ix++) {
+        float z = depthmap[ix] * POINTCLOUD_DEPTH_UNIT_M;
+        float x = rays[ix * 2], y = rays[ix * 2 + 1];
+
+        xyz[ix * 3] = z * (r[0] * x + r[1] * y + r[2]);
+        xyz[ix * 3 + 1] = z * (r[3] * x + r[4] * y + r[5]);
+        xyz[ix * 3 + 2] = z * (r[6] * x + r[7] * y + r[8]);
+    }
+#endif
+    return TOF_DEPTH_PIXELS;
+}
+
+extern "C" int voxel3d_pointcloud_normals(const float *xyz, const NormalConfig *config,
+                                          parallel_t *pool, void *normals)
+{
+    NormalJob job;
+
+    if (!xyz || !normals || (config && (config->step >= TOF_DEPTH_HEIGHT / 2 ||
+                                        config->max_depth_change < 0.f ||
+                                        (config->format != POINTCLOUD_NORMAL_FLOAT &&
+                                         config->format != POINTCLOUD_NORMAL_PACKED))))
+        return -1;
+
+    float change = config && config->max_depth_change > 0.f ? config->max_depth_change :
+                   POINTCLOUD_DEFAULT_DEPTH_CHANGE;
+    job.xyz = xyz;
+    job.normals = normals;
+    job.format = config ? config->format : POINTCLOUD_NORMAL_FLOAT;
+    job.step = config && config->step ? (int)config->step : POINTCLOUD_DEFAULT_NORMAL_STEP;
+    job.lo = change < 1.f ? (1.f - change) * (1.f - change) : 0.f;
+    job.hi = (1.f + change) * (1.f + change);
+    job.valid.store(0, std::memory_order_relaxed);
+
+    /* TOF_DEPTH_HEIGHT is a multiple of NORMAL_BAND_ROWS */
+    voxel3d_parallel_run(pool, TOF_DEPTH_HEIGHT / NORMAL_BAND_ROWS, normal_band, &job);
+    return job.valid.load(std::memory_order_relaxed);
+}
+
+extern "C" void voxel3d_pointcloud_unpack_normal(unsigned int packed, float normal[3])
+{
+    for (int axis = 0; axis < 3; axis++) {
+        int value = (int)((packed >> (axis * 10)) & 0x3ff);
+
+        if (value & 0x200)
+            value -= 0x400;
+        normal[axis] = value / NORMAL_PACK_SCALE;
+    }
+}
@@ -0,0 +1,326 @@
+/**
+ @file      voxel3d_proximity.cpp
+ @brief     Closest obstacle within zones by depth bounds precomputed per pixel
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PROXIMITY_SSE2
+#endif
+
+#include "voxel3d_calibration.h"
+#include "voxel3d_pointcloud.h"
+#include "voxel3d_proximity.h"
+
+#define BLOCK                   (8)             /* pixels of a compare */
+#define BLOCKS_PER_ROW          (TOF_DEPTH_WIDTH / BLOCK)
+#define NUM_BANDS               (TOF_DEPTH_HEIGHT / PROXIMITY_BAND_ROWS)
+#define MAX_DEPTH               (0xFFFF)
+#define PI_F                    (3.14159265f)
+
+struct ProximityBand {
+    float min_distance;                         /* least distance the intervals allow */
+    int first_row;
+};
+
+/* Depth intervals of the pixels of a zone, in blocks of 8 lows then 8 highs */
+struct ProximityTable {
+    std::vector<unsigned short> bounds;
+    int row_first[TOF_DEPTH_HEIGHT], row_last[TOF_DEPTH_HEIGHT];    /* blocks, last excluded */
+    size_t row_offset[TOF_DEPTH_HEIGHT];        /* of the first block in bounds */
+    std::vector<ProximityBand> bands;           /* crossing the zone, nearest first */
+};
+
+struct proximity {
+    unsigned int num_zones;
+    ProximityTable tables[PROXIMITY_MAX_ZONES];
+    std::vector<float> scale;                   /* meters from the camera per depth unit */
+};
+
+/* [s0, s1] of s where f0 + s * f1 >= 0, empty when s0 > s1 */
+static void clip_linear(double f0, double f1, double *s0, double *s1)
+{
+    if (f1 > 0.) {
+        double s = -f0 / f1;
+        *s0 = s > *s0 ? s : *s0;
+    }
+    else if (f1 < 0.) {
+        double s = -f0 / f1;
+        *s1 = s < *s1 ? s : *s1;
+    }
+    else if (f0 < 0.) {
+        *s1 = -1.;
+    }
+}
+
+/* Depth interval of the ray o + s * d inside a zone, in meters of s */
+static void clip_zone(const ProximityZone &zone, const double *o, const double *d,
+                      double *s0, double *s1)
+{
+    *s0 = 0.;
+    *s1 = DBL_MAX;
+    if (zone.type == PROXIMITY_BOX) {
+        for (int axis = 0; axis < 3; axis++) {
+            clip_linear(o[axis] - zone.min[axis], d[axis], s0, s1);
+            clip_linear(zone.max[axis] - o[axis], -d[axis], s0, s1);
+        }
+        return;
+    }
+
+    clip_linear(o[1] - zone.min[1], d[1], s0, s1);
+    clip_linear(zone.max[1] - o[1], -d[1], s0, s1);
+
+    /* within the radius: a * s^2 + b * s + c <= 0 */
+    double a = d[0] * d[0] + d[2] * d[2], b = 2. * (o[0] * d[0] + o[2] * d[2]);
+    double c = o[0] * o[0] + o[2] * o[2] - (double)zone.radius * zone.radius;
+    if (a > 0.) {
+        double disc = b * b - 4. * a * c;
+        if (disc < 0.) {
+            *s1 = -1.;
+            return;
+        }
+        double root = sqrt(disc), near = (-b - root) / (2. * a), far = (-b + root) / (2. * a);
+        *s0 = near > *s0 ? near : *s0;
+        *s1 = far < *s1 ? far : *s1;
+    }
+    else if (c > 0.) {
+        *s1 = -1.;
+        return;
+    }
+
+    /* between the angles: sin(phi - angles[0]) >= 0 and sin(angles[1] - phi) >= 0 */
+    double c0 = cos(zone.angles[0]), n0 = sin(zone.angles[0]);
+    double c1 = cos(zone.angles[1]), n1 = sin(zone.angles[1]);
+    clip_linear(o[0] * c0 - o[2] * n0, d[0] * c0 - d[2] * n0, s0, s1);
+    clip_linear(o[2] * n1 - o[0] * c1, d[2] * n1 - d[0] * c1, s0, s1);
+}
+
+static bool valid_zone(const ProximityZone &zone)
+{
+    if (zone.type == PROXIMITY_BOX) {
+        return zone.min[0] < zone.max[0] && zone.min[1] < zone.max[1] &&
+               zone.min[2] < zone.max[2];
+    }
+    return zone.type == PROXIMITY_SECTOR && zone.min[1] < zone.max[1] && zone.radius > 0.f &&
+           zone.angles[1] >= zone.angles[0] && zone.angles[1] - zone.angles[0] <= PI_F + 1e-6f;
+}
+
+static void build_table(const ProximityZone &zone, const double *pose, const float *rays,
+                        const float *scale, ProximityTable *table)
+{
+    std::vector<unsigned short> lo(TOF_DEPTH_PIXELS), hi(TOF_DEPTH_PIXELS);
+    const double o[3] = { pose[3], pose[7], pose[11] };
+
+    for (int ix = 0; ix < TOF_DEPTH_PIXELS; ix++) {
+        double x = rays[ix * 2], y = rays[ix * 2 + 1], d[3], s0, s1;
+
+        for (int row = 0; row < 3; row++)
+            d[row] = pose[row * 4] * x + pose[row * 4 + 1] * y + pose[row * 4 + 2];
+        clip_zone(zone, o, d, &s0, &s1);
+
+        /* depth units wholly inside, depth 0 is no depth */
+        double first = ceil(s0 / POINTCLOUD_DEPTH_UNIT_M);
+        double last = floor(s1 / POINTCLOUD_DEPTH_UNIT_M);
+        first = first > 1. ? first : 1.;
+        last = last < MAX_DEPTH ? last : MAX_DEPTH;
+        lo[ix] = first <= last ? (unsigned short)first : MAX_DEPTH;
+        hi[ix] = first <= last ? (unsigned short)last : 0;
+    }
+
+    table->bounds.clear();
+    for (int row = 0; row < TOF_DEPTH_HEIGHT; row++) {
+        int first = BLOCKS_PER_ROW, last = 0;
+
+        for (int block = 0; block < BLOCKS_PER_ROW; block++) {
+            for (int px = 0; px < BLOCK; px++) {
+                if (lo[row * TOF_DEPTH_WIDTH + block * BLOCK + px] <=
+                    hi[row * TOF_DEPTH_WIDTH + block * BLOCK + px]) {
+                    first = block < first ? block : first;
+                    last = block + 1;
+                }
+            }
+        }
+        table->row_first[row] = first < last ? first : 0;
+        table->row_last[row] = last;
+        table->row_offset[row] = table->bounds.size() / (BLOCK * 2);
+        for (int block = table->row_first[row]; block < last; block++) {
+            size_t ix = (size_t)row * TOF_DEPTH_WIDTH + block * BLOCK;
+            table->bounds.insert(table->bounds.end(), &lo[ix], &lo[ix] + BLOCK);
+            table->bounds.insert(table->bounds.end(), &hi[ix], &hi[ix] + BLOCK);
+        }
+    }
+
+    table->bands.clear();
+    for (int band = 0; band < NUM_BANDS; band++) {
+        ProximityBand entry = { FLT_MAX, band * PROXIMITY_BAND_ROWS };
+
+        for (int ix = band * PROXIMITY_BAND_ROWS * TOF_DEPTH_WIDTH;
+             ix < (band + 1) * PROXIMITY_BAND_ROWS * TOF_DEPTH_WIDTH; ix++) {
+            float distance = lo[ix] * scale[ix];
+            if (lo[ix] <= hi[ix] && distance < entry.min_distance)
+                entry.min_distance = distance;
+        }
+        if (entry.min_distance < FLT_MAX)
+            table->bands.push_back(entry);
+    }
+    std::sort(table->bands.begin(), table->bands.end(),
+              [](const ProximityBand &a, const ProximityBand &b) {
+                  return a.min_distance < b.min_distance;
+              });
+}
+
+/* Closest point of a band of rows, best and pixel in and out */
+static void query_band(const proximity_t *prox, const ProximityTable *table,
+                       const unsigned short *depthmap, int first_row, float *best, int *pixel)
+{
+#ifdef PROXIMITY_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128 best4 = _mm_set1_ps(*best);
+    __m128i pixel4 = _mm_set1_epi32(*pixel);
+
+    for (int row = first_row; row < first_row + PROXIMITY_BAND_ROWS; row++) {
+        const unsigned short *bounds = table->bounds.data() + table->row_offset[row] * BLOCK * 2;
+
+        for (int block = table->row_first[row]; block < table->row_last[row];
+             block++, bounds += BLOCK * 2) {
+            int ix = row * TOF_DEPTH_WIDTH + block * BLOCK;
+            __m128i d = _mm_loadu_si128((const __m128i *)(depthmap + ix));
+            __m128i lo = _mm_loadu_si128((const __m128i *)bounds);
+            __m128i hi = _mm_loadu_si128((const __m128i *)(bounds + BLOCK));
+
+            /* lo <= d <= hi as saturated unsigned differences of 0 */
+            __m128i inside = _mm_cmpeq_epi16(_mm_or_si128(_mm_subs_epu16(lo, d),
+                                                          _mm_subs_epu16(d, hi)), zero);
+            if (!_mm_movemask_epi8(inside))
+                continue;
+
+            for (int half = 0; half < 2; half++) {
+                __m128i depth = half ? _mm_unpackhi_epi16(d, zero) : _mm_unpacklo_epi16(d, zero);
+                __m128i mask = half ? _mm_unpackhi_epi16(inside, inside) :
+                               _mm_unpacklo_epi16(inside, inside);
+                __m128 distance = _mm_mul_ps(_mm_cvtepi32_ps(depth),
+                                             _mm_loadu_ps(&prox->scale[ix + half * 4]));
+                __m128 closer = _mm_and_ps(_mm_castsi128_ps(mask), _mm_cmplt_ps(distance, best4));
+                __m128i index = _mm_add_epi32(_mm_set1_epi32(ix + half * 4),
+                                              _mm_set_epi32(3, 2, 1, 0));
+
+                best4 = _mm_or_ps(_mm_and_ps(closer, distance), _mm_andnot_ps(closer, best4));
+                pixel4 = _mm_or_si128(_mm_and_si128(_mm_castps_si128(closer), index),
+                                      _mm_andnot_si128(_mm_castps_si128(closer), pixel4));
+            }
+        }
+    }
+
+    float lanes[4];
+    int indices[4];
+    _mm_storeu_ps(lanes, best4);
+    _mm_storeu_si128((__m128i *)indices, pixel4);
+    for (int lane = 0; lane < 4; lane++) {
+        /* the first pixel of equal distances, as the scalar pass */
+        if (lanes[lane] < *best || (lanes[lane] == *best && indices[lane] < *pixel)) {
+            *best = lanes[lane];
+            *pixel = indices[lane];
+        }
+    }
+#else
+    for (int row = first_row; row < first_row + PROXIMITY_BAND_ROWS; row++) {
+        const unsigned short *bounds = table->bounds.data() + table->row_offset[row] * BLOCK * 2;
+
+        for (int block = table->row_first[row]; block < table->row_last[row];
+             block++, bounds += BLOCK * 2) {
+            for (int px = 0; px < BLOCK; px++) {
+                int ix = row * TOF_DEPTH_WIDTH + block * BLOCK + px;
+                unsigned short d = depthmap[ix];
+                if (d < bounds[px] || d > bounds[BLOCK + px])
+                    continue;
+
+                float distance = d * prox->scale[ix];
+                if (distance < *best) {
+                    *best = distance;
+                    *pixel = ix;
+                }
+            }
+        }
+    }
+#endif
+}
+
+/*
+ * Public APIs
+ */
+extern "C" proximity_t *voxel3d_proximity_create(const CameraInfo *cam_info,
+                                                 const ProximityConfig *config)
+{
+    double pose[12];
+    bool identity = true;
+
+    if (!cam_info || !config || config->num_zones > PROXIMITY_MAX_ZONES)
+        return NULL;
+    for (unsigned int zone = 0; zone < config->num_zones; zone++) {
+        if (!valid_zone(config->zones[zone]))
+            return NULL;
+    }
+    for (int ix = 0; ix < 12; ix++) {
+        identity = identity && config->pose[ix] == 0.f;
+        pose[ix] = config->pose[ix];
+    }
+    if (identity) {
+        memset(pose, 0, sizeof(pose));
+        pose[0] = pose[5] = pose[10] = 1.;
+    }
+
+    std::vector<float> rays(TOF_DEPTH_PIXELS * 2);
+    if (voxel3d_calibration_build_rays(cam_info, rays.data()) < 0)
+        return NULL;
+
+    proximity_t *prox = new proximity_t;
+    prox->num_zones = config->num_zones;
+    prox->scale.resize(TOF_DEPTH_PIXELS);
+    for (int ix = 0; ix < TOF_DEPTH_PIXELS; ix++) {
+        float x = rays[ix * 2], y = rays[ix * 2 + 1];
+        prox->scale[ix] = POINTCLOUD_DEPTH_UNIT_M * sqrtf(x * x + y * y + 1.f);
+    }
+    for (unsigned int zone = 0; zone < config->num_zones; zone++) {
+        build_table(config->zones[zone], pose, rays.data(), prox->scale.data(),
+                    &prox->tables[zone]);
+    }
+    return prox;
+}
+
+extern "C" int voxel3d_proximity_query(proximity_t *prox, const unsigned short *depthmap,
+                                       ProximityHit *hits)
+{
+    int occupied = 0;
+
+    if (!prox || !depthmap || (!hits && prox->num_zones))
+        return -1;
+
+    for (unsigned int zone = 0; zone < prox->num_zones; zone++) {
+        const ProximityTable *table = &prox->tables[zone];
+        float best = FLT_MAX;
+        int pixel = -1;
+
+        for (const ProximityBand &band : table->bands) {
+            /* bands come nearest first, none of the rest can be closer */
+            if (band.min_distance >= best)
+                break;
+            query_band(prox, table, depthmap, band.first_row, &best, &pixel);
+        }
+        hits[zone].distance = pixel < 0 ? 0.f : best;
+        hits[zone].pixel = pixel;
+        occupied += pixel >= 0;
+    }
+    return occupied;
+}
+
+extern "C" void voxel3d_proximity_destroy(proximity_t *prox)
+{
+    delete prox;
+}
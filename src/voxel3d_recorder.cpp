@@ -0,0 +1,239 @@
+/**
+ @file      voxel3d_recorder.cpp
+ @brief     Asynchronous recording writer thread
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "voxel3d_recorder.h"
+
+#define RING_ALIGN              (4096)
+#define RECORD_ALIGN            (64)
+#define RECORD_HEADER_SIZE      (64)
+
+/*
+ * Ring layout: records one after another, each a RecordHeader padded to
+ * RECORD_HEADER_SIZE followed by the payload, padded to RECORD_ALIGN. A record that
+ * doesn't fit before the end of the ring is preceded by a skip record filling it.
+ */
+struct RecordHeader {
+    uint32_t size;                  /* ring bytes of header + payload */
+    uint32_t skip;
+    uint32_t ready;                 /* payload copied, under capture_recorder.lock */
+    CaptureFrameInfo info;
+};
+
+struct capture_recorder {
+    capture_writer_t *writer;
+    std::mutex writer_lock;
+
+    std::vector<unsigned char> storage;
+    unsigned char *ring;            /* RING_ALIGN aligned inside storage */
+    uint64_t ring_size;
+
+    /* ring positions grow monotonically, offset in ring is position % ring_size */
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::condition_variable drained;
+    uint64_t head;                  /* reserved by producers */
+    uint64_t tail;                  /* released by the writer thread */
+    bool closing;
+    RecorderStats stats;
+
+    std::thread thread;
+};
+
+static_assert(sizeof(RecordHeader) <= RECORD_HEADER_SIZE, "RecordHeader exceeds its slot");
+
+static inline RecordHeader *record_at(recorder_t *recorder, uint64_t position)
+{
+    return (RecordHeader *)(recorder->ring + position % recorder->ring_size);
+}
+
+static void writer_thread(recorder_t *recorder)
+{
+    std::unique_lock<std::mutex> lock(recorder->lock);
+
+    for (;;) {
+        recorder->wakeup.wait(lock, [recorder] {
+            return (recorder->tail != recorder->head &&
+                    record_at(recorder, recorder->tail)->ready) ||
+                   (recorder->closing && recorder->tail == recorder->head);
+        });
+        if (recorder->tail == recorder->head)
+            break;
+
+        RecordHeader *record = record_at(recorder, recorder->tail);
+        int ret = true;
+
+        lock.unlock();
+        if (!record->skip) {
+            std::lock_guard<std::mutex> guard(recorder->writer_lock);
+            ret = voxel3d_capture_write_frame(recorder->writer, &record->info,
+                                              (unsigned char *)record + RECORD_HEADER_SIZE);
+        }
+        lock.lock();
+
+        if (!record->skip) {
+            if (ret < 0) {
+                recorder->stats.write_failed = 1;
+                recorder->stats.frames_dropped[record->info.stream]++;
+                recorder->stats.bytes_dropped += record->info.size;
+            }
+            else {
+                recorder->stats.frames_written[record->info.stream]++;
+                recorder->stats.bytes_written += record->info.size;
+            }
+        }
+        recorder->tail += record->size;
+        recorder->stats.queued_bytes = (unsigned int)(recorder->head - recorder->tail);
+        if (recorder->tail == recorder->head)
+            recorder->drained.notify_all();
+    }
+}
+
+extern "C" recorder_t *voxel3d_recorder_create(const char *file_path,
+                                               const CaptureDeviceInfo *dev_info,
+                                               unsigned int buffer_size, unsigned int flags)
+{
+    capture_writer_t *writer;
+
+    if (!file_path || !dev_info)
+        return NULL;
+
+    if (!buffer_size)
+        buffer_size = RECORDER_DEFAULT_BUFFER_SIZE;
+    buffer_size = (buffer_size + RING_ALIGN - 1) & ~(RING_ALIGN - 1);
+
+    writer = voxel3d_capture_create_ex(file_path, dev_info, flags);
+    if (!writer)
+        return NULL;
+
+    recorder_t *recorder = new recorder_t;
+    recorder->writer = writer;
+
+    /* touch every page now, a page fault in the acquisition path is a stall too */
+    recorder->storage.assign((size_t)buffer_size + RING_ALIGN, 0);
+    recorder->ring = recorder->storage.data() +
+                     (RING_ALIGN - (uintptr_t)recorder->storage.data() % RING_ALIGN) % RING_ALIGN;
+    recorder->ring_size = buffer_size;
+
+    recorder->head = 0;
+    recorder->tail = 0;
+    recorder->closing = false;
+    memset(&recorder->stats, 0, sizeof(recorder->stats));
+    recorder->stats.buffer_size = buffer_size;
+
+    recorder->thread = std::thread(writer_thread, recorder);
+    return recorder;
+}
+
+extern "C" int voxel3d_recorder_set_codec(recorder_t *recorder, unsigned int stream,
+                                          unsigned int codec)
+{
+    if (!recorder)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(recorder->writer_lock);
+    return voxel3d_capture_set_codec(recorder->writer, stream, codec);
+}
+
+extern "C" int voxel3d_recorder_write_frame(recorder_t *recorder, const CaptureFrameInfo *info,
+                                            const void *data)
+{
+    RecordHeader *record;
+
+    if (!recorder || !info || (!data && info->size) || info->stream >= CAPTURE_STREAM_COUNT)
+        return -1;
+
+    uint64_t size = (RECORD_HEADER_SIZE + (uint64_t)info->size + RECORD_ALIGN - 1) &
+                    ~(uint64_t)(RECORD_ALIGN - 1);
+    {
+        std::lock_guard<std::mutex> guard(recorder->lock);
+        uint64_t offset = recorder->head % recorder->ring_size;
+        uint64_t skip = offset + size > recorder->ring_size ? recorder->ring_size - offset : 0;
+
+        if (recorder->closing || recorder->stats.write_failed ||
+            recorder->head + skip + size - recorder->tail > recorder->ring_size) {
+            recorder->stats.frames_dropped[info->stream]++;
+            recorder->stats.bytes_dropped += info->size;
+            return -2;
+        }
+
+        if (skip) {
+            record = record_at(recorder, recorder->head);
+            record->size = (uint32_t)skip;
+            record->skip = 1;
+            record->ready = 1;
+            recorder->head += skip;
+        }
+
+        record = record_at(recorder, recorder->head);
+        record->size = (uint32_t)size;
+        record->skip = 0;
+        record->ready = 0;
+        record->info = *info;
+        recorder->head += size;
+
+        recorder->stats.queued_bytes = (unsigned int)(recorder->head - recorder->tail);
+        if (recorder->stats.queued_bytes > recorder->stats.max_queued_bytes)
+            recorder->stats.max_queued_bytes = recorder->stats.queued_bytes;
+    }
+
+    /* the slot is reserved, other producers and the writer carry on during the copy */
+    memcpy((unsigned char *)record + RECORD_HEADER_SIZE, data, info->size);
+
+    {
+        std::lock_guard<std::mutex> guard(recorder->lock);
+        record->ready = 1;
+    }
+    recorder->wakeup.notify_one();
+    return true;
+}
+
+extern "C" int voxel3d_recorder_flush(recorder_t *recorder)
+{
+    if (!recorder)
+        return -1;
+
+    {
+        std::unique_lock<std::mutex> lock(recorder->lock);
+        recorder->drained.wait(lock, [recorder] { return recorder->tail == recorder->head; });
+    }
+
+    std::lock_guard<std::mutex> guard(recorder->writer_lock);
+    return voxel3d_capture_flush(recorder->writer) < 0 ? -2 : true;
+}
+
+extern "C" int voxel3d_recorder_get_stats(recorder_t *recorder, RecorderStats *stats)
+{
+    if (!recorder || !stats)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(recorder->lock);
+    *stats = recorder->stats;
+    return true;
+}
+
+extern "C" void voxel3d_recorder_close(recorder_t *recorder)
+{
+    if (!recorder)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(recorder->lock);
+        recorder->closing = true;
+    }
+    recorder->wakeup.notify_one();
+    recorder->thread.join();
+
+    voxel3d_capture_close(recorder->writer);
+    delete recorder;
+}
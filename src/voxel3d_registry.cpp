@@ -0,0 +1,365 @@
+/**
+ @file      voxel3d_registry.cpp
+ @brief     Cached device list kept up to date by hotplug notifications
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#ifdef PLAT_WINDOWS
+#include <windows.h>
+#include <cfgmgr32.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#endif /* PLAT_WINDOWS */
+
+#include "voxel3d_registry.h"
+
+#define UEVENT_BUFFER_SIZE      (4096)
+
+struct registry {
+    const DeviceBackend *backend;
+    registry_event_cb event_cb;
+    void *user;
+    unsigned int poll_interval_ms;
+    bool poll;                                  /* rescan periodically */
+    bool hotplug;
+
+    std::mutex lock;                            /* devices and generation */
+    std::condition_variable changed;
+    CamDevInfo devices;
+    int generation;
+    std::mutex scan_lock;                       /* one rescan and its callbacks at a time */
+
+    std::atomic<bool> stopping;
+    std::thread monitor;
+#ifdef PLAT_WINDOWS
+    HCMNOTIFICATION notification;
+    HANDLE hotplug_event;
+    HANDLE stop_event;
+#else /* PLAT_LINUX */
+    int uevent_fd;
+    int stop_pipe[2];
+#endif /* PLAT_WINDOWS */
+};
+
+static int find_sn(const CamDevInfo *info, const char *dev_sn)
+{
+    for (int ix = 0; ix < info->num_of_devices; ix++) {
+        if (!strncmp(info->product_sn[ix], dev_sn, MAX_PRODUCT_SN_LEN))
+            return ix;
+    }
+    return -1;
+}
+
+/* Scan, swap the new list in and report the differences */
+static int rescan(registry_t *reg, bool report_all)
+{
+    CamDevInfo scanned, previous;
+
+    std::lock_guard<std::mutex> scan_guard(reg->scan_lock);
+    if (reg->backend->scan(&scanned) <= 0)
+        scanned.num_of_devices = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(reg->lock);
+        previous = reg->devices;
+        reg->devices = scanned;
+    }
+
+    bool changed = report_all;
+    for (int ix = 0; ix < previous.num_of_devices; ix++) {
+        if (find_sn(&scanned, previous.product_sn[ix]) >= 0)
+            continue;
+        changed = true;
+        if (reg->event_cb)
+            reg->event_cb(reg->user, REGISTRY_EVENT_REMOVAL, previous.product_sn[ix]);
+    }
+    for (int ix = 0; ix < scanned.num_of_devices; ix++) {
+        if (!report_all && find_sn(&previous, scanned.product_sn[ix]) >= 0)
+            continue;
+        changed = true;
+        if (reg->event_cb)
+            reg->event_cb(reg->user, REGISTRY_EVENT_ARRIVAL, scanned.product_sn[ix]);
+    }
+
+    if (changed) {
+        std::lock_guard<std::mutex> guard(reg->lock);
+        reg->generation++;
+        reg->changed.notify_all();
+    }
+    return scanned.num_of_devices;
+}
+
+/*
+ * Hotplug notifications
+ */
+#ifdef PLAT_WINDOWS
+static DWORD CALLBACK notification_cb(HCMNOTIFICATION notify, PVOID context,
+                                      CM_NOTIFY_ACTION action,
+                                      PCM_NOTIFY_EVENT_DATA event_data, DWORD event_data_size)
+{
+    registry_t *reg = (registry_t *)context;
+
+    if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL ||
+        action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL)
+        SetEvent(reg->hotplug_event);
+    return ERROR_SUCCESS;
+}
+
+/* false when only the stop notification is available */
+static bool hotplug_open(registry_t *reg, bool notify)
+{
+    CM_NOTIFY_FILTER filter;
+
+    reg->notification = NULL;
+    reg->hotplug_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    reg->stop_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!reg->hotplug_event || !reg->stop_event || !notify)
+        return false;
+
+    memset(&filter, 0, sizeof(filter));
+    filter.cbSize = sizeof(filter);
+    filter.Flags = CM_NOTIFY_FILTER_FLAG_ALL_INTERFACE_CLASSES;
+    filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+    return CM_Register_Notification(&filter, reg, notification_cb,
+                                    &reg->notification) == CR_SUCCESS;
+}
+
+static void hotplug_close(registry_t *reg)
+{
+    if (reg->notification)
+        CM_Unregister_Notification(reg->notification);
+    if (reg->hotplug_event)
+        CloseHandle(reg->hotplug_event);
+    if (reg->stop_event)
+        CloseHandle(reg->stop_event);
+}
+
+static void hotplug_stop(registry_t *reg)
+{
+    SetEvent(reg->stop_event);
+}
+
+/* true when a device arrived or left within timeout_ms (-1: no timeout) */
+static bool hotplug_wait(registry_t *reg, long timeout_ms)
+{
+    HANDLE events[2] = { reg->hotplug_event, reg->stop_event };
+
+    return WaitForMultipleObjects(2, events, FALSE, timeout_ms < 0 ? INFINITE :
+                                  (DWORD)timeout_ms) == WAIT_OBJECT_0;
+}
+#else /* PLAT_LINUX */
+static bool hotplug_open(registry_t *reg, bool notify)
+{
+    struct sockaddr_nl addr;
+
+    reg->uevent_fd = -1;
+    if (pipe(reg->stop_pipe) < 0) {
+        reg->stop_pipe[0] = reg->stop_pipe[1] = -1;
+        return false;
+    }
+    if (!notify)
+        return false;
+
+    reg->uevent_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (reg->uevent_fd < 0)
+        return false;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;                         /* kernel uevents */
+    if (bind(reg->uevent_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(reg->uevent_fd);
+        reg->uevent_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+static void hotplug_close(registry_t *reg)
+{
+    if (reg->uevent_fd >= 0)
+        close(reg->uevent_fd);
+    if (reg->stop_pipe[0] >= 0) {
+        close(reg->stop_pipe[0]);
+        close(reg->stop_pipe[1]);
+    }
+}
+
+static void hotplug_stop(registry_t *reg)
+{
+    char stop = 0;
+
+    if (reg->stop_pipe[1] >= 0 && write(reg->stop_pipe[1], &stop, 1) < 0)
+        return;
+}
+
+/*
+ * A uevent is "ACTION@DEVPATH" followed by KEY=VALUE strings. USB devices being added or
+ * removed, and the video nodes the driver creates on them, trigger a rescan.
+ */
+static bool uevent_is_hotplug(const char *buf, size_t len)
+{
+    bool plug = false, usb = false;
+
+    for (size_t pos = strlen(buf) + 1; pos < len; pos += strlen(buf + pos) + 1) {
+        const char *field = buf + pos;
+        if (!strcmp(field, "ACTION=add") || !strcmp(field, "ACTION=remove"))
+            plug = true;
+        else if (!strcmp(field, "DEVTYPE=usb_device") || !strcmp(field, "SUBSYSTEM=video4linux"))
+            usb = true;
+    }
+    return plug && usb;
+}
+
+static bool hotplug_wait(registry_t *reg, long timeout_ms)
+{
+    struct pollfd fds[2];
+    char buf[UEVENT_BUFFER_SIZE];
+
+    /* without uevent socket only fds[0] is polled, fds[1].revents stays 0 */
+    memset(fds, 0, sizeof(fds));
+    fds[0].fd = reg->stop_pipe[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = reg->uevent_fd;
+    fds[1].events = POLLIN;
+    if (poll(fds, reg->uevent_fd >= 0 ? 2 : 1, timeout_ms < 0 ? -1 : (int)timeout_ms) <= 0 ||
+        fds[0].revents || !(fds[1].revents & POLLIN))
+        return false;
+
+    ssize_t len = recv(reg->uevent_fd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+    if (len <= 0)
+        return false;
+    buf[len] = '\0';
+    return uevent_is_hotplug(buf, (size_t)len);
+}
+#endif /* PLAT_WINDOWS */
+
+static void monitor_thread(registry_t *reg)
+{
+    typedef std::chrono::steady_clock clock;
+    clock::time_point next_poll = clock::now() + std::chrono::milliseconds(reg->poll_interval_ms);
+    clock::time_point settled;
+    bool settling = false;
+
+    while (!reg->stopping.load(std::memory_order_relaxed)) {
+        clock::time_point now = clock::now();
+        long timeout_ms = -1;
+
+        /* a plug comes as a burst of notifications, rescan once it has settled */
+        if (settling && now >= settled) {
+            settling = false;
+            rescan(reg, false);
+            next_poll = clock::now() + std::chrono::milliseconds(reg->poll_interval_ms);
+            continue;
+        }
+        if (reg->poll && now >= next_poll) {
+            rescan(reg, false);
+            next_poll = clock::now() + std::chrono::milliseconds(reg->poll_interval_ms);
+            continue;
+        }
+
+        if (settling)
+            timeout_ms = (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                             settled - now).count() + 1;
+        if (reg->poll) {
+            long poll_ms = (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                               next_poll - now).count() + 1;
+            timeout_ms = timeout_ms < 0 || poll_ms < timeout_ms ? poll_ms : timeout_ms;
+        }
+
+        if (hotplug_wait(reg, timeout_ms)) {
+            settling = true;
+            settled = clock::now() + std::chrono::milliseconds(REGISTRY_SETTLE_MS);
+        }
+    }
+}
+
+/*
+ * Public APIs
+ */
+extern "C" registry_t *voxel3d_registry_open(const RegistryConfig *config)
+{
+    registry_t *reg = new registry_t;
+
+    reg->backend = config && config->backend ? config->backend : voxel3d_device_backend();
+    reg->event_cb = config ? config->event_cb : NULL;
+    reg->user = config ? config->user : NULL;
+    reg->poll_interval_ms = config && config->poll_interval_ms ? config->poll_interval_ms :
+                                                                 REGISTRY_DEFAULT_POLL_MS;
+    reg->generation = 1;
+    reg->stopping.store(false, std::memory_order_relaxed);
+
+    /* only real devices raise hotplug notifications */
+    reg->hotplug = hotplug_open(reg, reg->backend == voxel3d_device_backend());
+    reg->poll = !reg->hotplug || (config && (config->flags & REGISTRY_FLAG_POLL));
+
+    rescan(reg, true);
+    reg->monitor = std::thread(monitor_thread, reg);
+    return reg;
+}
+
+extern "C" int voxel3d_registry_get_devices(registry_t *reg, CamDevInfo *cam_dev_info)
+{
+    if (!reg || !cam_dev_info)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(reg->lock);
+    *cam_dev_info = reg->devices;
+    return reg->devices.num_of_devices;
+}
+
+extern "C" int voxel3d_registry_has_device(registry_t *reg, const char *dev_sn)
+{
+    if (!reg || !dev_sn)
+        return -1;
+
+    std::lock_guard<std::mutex> guard(reg->lock);
+    return find_sn(&reg->devices, dev_sn) >= 0 ? true : 0;
+}
+
+extern "C" int voxel3d_registry_wait(registry_t *reg, int generation, unsigned int timeout_ms)
+{
+    if (!reg)
+        return -1;
+
+    std::unique_lock<std::mutex> lock(reg->lock);
+    if (timeout_ms) {
+        reg->changed.wait_for(lock, std::chrono::milliseconds(timeout_ms), [reg, generation] {
+            return reg->generation != generation;
+        });
+    }
+    return reg->generation;
+}
+
+extern "C" int voxel3d_registry_rescan(registry_t *reg)
+{
+    return reg ? rescan(reg, false) : -1;
+}
+
+extern "C" int voxel3d_registry_hotplug(registry_t *reg)
+{
+    return reg && reg->hotplug ? true : 0;
+}
+
+extern "C" void voxel3d_registry_close(registry_t *reg)
+{
+    if (!reg)
+        return;
+
+    reg->stopping.store(true, std::memory_order_relaxed);
+    hotplug_stop(reg);
+    reg->monitor.join();
+    hotplug_close(reg);
+    delete reg;
+}
@@ -0,0 +1,582 @@
+/**
+ @file      voxel3d_replay.cpp
+ @brief     Replay of recorded streams through the voxel3d_* device APIs
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+
+#include "voxel3d_calibration.h"
+#include "voxel3d_capture.h"
+#include "voxel3d_replay.h"
+
+#define TOF_DEPTH_UNIT_M        (0.001f)
+
+struct ReplayDevice {
+    bool in_use;
+    char sn[MAX_PRODUCT_SN_LEN];
+    capture_reader_t *reader;
+    CaptureDeviceInfo dev_info;
+    int rectify_type;                           /* active, sizes the RGB / thermal buffers */
+    int mode;
+    bool loop;
+    double speed;                               /* REPLAY_FIXED_RATE clock scale */
+    unsigned long long start_us;                /* host time playback (re)started */
+    unsigned long long base_ts_us;              /* earliest recorded timestamp */
+    unsigned long long fast_now_us;             /* REPLAY_AS_FAST_AS_POSSIBLE clock */
+    unsigned int frames[CAPTURE_STREAM_COUNT];
+    unsigned int cursor[CAPTURE_STREAM_COUNT];  /* next frame index to hand out */
+    std::vector<float> rays;                    /* normalized (x, y) per ToF pixel */
+    std::vector<unsigned short> tof_frame;      /* depth + ir payload */
+    std::mutex lock;
+};
+
+struct TofBuffers {
+    unsigned short *depthmap;
+    unsigned short *irmap;
+};
+
+static ReplayDevice replay_devices[MAX_SUPPORTED_CAMERA_MODULE];
+static std::mutex replay_table_lock;
+
+static ReplayDevice *find_device(const char *dev_sn)
+{
+    for (int ix = 0; ix < MAX_SUPPORTED_CAMERA_MODULE; ix++) {
+        ReplayDevice *dev = &replay_devices[ix];
+        if (!dev->in_use)
+            continue;
+        if (!dev_sn || !dev_sn[0] || !strncmp(dev->sn, dev_sn, MAX_PRODUCT_SN_LEN))
+            return dev;
+    }
+    return NULL;
+}
+
+/*
+ * Look up the device and take its lock. The table lock is only held for the lookup so
+ * queries on different replay devices don't serialize.
+ */
+static ReplayDevice *lock_device(const char *dev_sn, std::unique_lock<std::mutex> &guard)
+{
+    ReplayDevice *dev;
+
+    {
+        std::lock_guard<std::mutex> table(replay_table_lock);
+        if (!(dev = find_device(dev_sn)))
+            return NULL;
+    }
+
+    guard = std::unique_lock<std::mutex>(dev->lock);
+    if (!dev->in_use) {
+        guard.unlock();
+        return NULL;
+    }
+    return dev;
+}
+
+static void restart_playback(ReplayDevice *dev)
+{
+    memset(dev->cursor, 0, sizeof(dev->cursor));
+    dev->start_us = voxel3d_host_time_us();
+    dev->fast_now_us = 0;
+}
+
+static unsigned long long frame_ts(ReplayDevice *dev, unsigned int stream, unsigned int index)
+{
+    CaptureFrameInfo info;
+    voxel3d_capture_frame_info(dev->reader, stream, index, &info);
+    return info.host_ts_us - dev->base_ts_us;
+}
+
+/* Playback time in recorded microseconds since the first recorded frame */
+static unsigned long long playback_now(ReplayDevice *dev)
+{
+    unsigned long long elapsed = voxel3d_host_time_us() - dev->start_us;
+
+    switch (dev->mode) {
+    case REPLAY_AS_FAST_AS_POSSIBLE:
+        return dev->fast_now_us;
+    case REPLAY_FIXED_RATE:
+        return (unsigned long long)(elapsed * dev->speed);
+    default:
+        return elapsed;
+    }
+}
+
+/* Number of frames of the stream recorded at or before playback time now */
+static unsigned int due_frames(ReplayDevice *dev, unsigned int stream, unsigned long long now)
+{
+    int index = voxel3d_capture_seek_time(dev->reader, stream, dev->base_ts_us + now);
+    return index < 0 ? 0 : (unsigned int)index + 1;
+}
+
+/*
+ * Pick the frame index to hand out for the stream, -1 if nothing is due. Video streams
+ * skip to the newest due frame, IMU samples are handed out one by one.
+ */
+static int next_frame(ReplayDevice *dev, unsigned int stream)
+{
+    bool tof_driven = dev->frames[CAPTURE_STREAM_TOF] > 0;
+
+    if (dev->loop && dev->cursor[CAPTURE_STREAM_TOF] >= dev->frames[CAPTURE_STREAM_TOF]) {
+        bool exhausted = true;
+        if (!tof_driven) {
+            for (int ix = 0; ix < CAPTURE_STREAM_COUNT; ix++)
+                exhausted &= dev->cursor[ix] >= dev->frames[ix];
+        }
+        if (exhausted)
+            restart_playback(dev);
+    }
+
+    if (dev->cursor[stream] >= dev->frames[stream])
+        return -1;
+
+    if (dev->mode == REPLAY_AS_FAST_AS_POSSIBLE &&
+        (stream == CAPTURE_STREAM_TOF || !tof_driven)) {
+        unsigned int index = dev->cursor[stream]++;
+        if (stream == CAPTURE_STREAM_TOF)
+            dev->fast_now_us = frame_ts(dev, stream, index);
+        return (int)index;
+    }
+
+    unsigned int due = due_frames(dev, stream, playback_now(dev));
+    if (due <= dev->cursor[stream])
+        return -1;
+
+    if (stream == CAPTURE_STREAM_IMU)
+        return (int)dev->cursor[stream]++;
+
+    dev->cursor[stream] = due;
+    return (int)(due - 1);
+}
+
+/*
+ * Size of the caller's RGB / thermal buffer under the active rectify type. A recorded frame
+ * of another size was taken under another rectify type and is not handed out.
+ */
+static bool frame_fits(ReplayDevice *dev, unsigned int stream, unsigned int index,
+                       unsigned int *max_size)
+{
+    CaptureFrameInfo info;
+    unsigned int width, height, pixel_size;
+
+    if (stream == CAPTURE_STREAM_RGB) {
+        bool rectified = dev->rectify_type == RectifyType::RGB2TOF;
+        width = rectified ? TOF_DEPTH_WIDTH : RGB_WIDTH;
+        height = rectified ? TOF_DEPTH_HEIGHT : RGB_HEIGHT;
+        pixel_size = 3;
+    }
+    else {
+        bool rectified = dev->rectify_type == RectifyType::FLIR2TOF;
+        width = rectified ? TOF_DEPTH_WIDTH : FLIR_WIDTH;
+        height = rectified ? TOF_DEPTH_HEIGHT : FLIR_HEIGHT;
+        pixel_size = sizeof(float);
+    }
+
+    if (voxel3d_capture_frame_info(dev->reader, stream, index, &info) < 0 ||
+        info.width != width || info.height != height)
+        return false;
+
+    *max_size = width * height * pixel_size;
+    return true;
+}
+
+static unsigned int query_frame(char *dev_sn, unsigned int stream, void *data, unsigned int max_size)
+{
+    CaptureFrameInfo info;
+    ReplayDevice *dev;
+    void *dst = data;
+
+    std::unique_lock<std::mutex> guard;
+    if (!data || !(dev = lock_device(dev_sn, guard)))
+        return 0;
+
+    int index = next_frame(dev, stream);
+    if (index < 0)
+        return 0;
+
+    /* ToF payload is depth + IR back to back, data points to TofBuffers */
+    if (stream == CAPTURE_STREAM_TOF) {
+        dst = dev->tof_frame.data();
+        max_size = TOF_DEPTH_IR_FRAME_SIZE;
+    }
+    else if ((stream == CAPTURE_STREAM_RGB || stream == CAPTURE_STREAM_THERMAL) &&
+             !frame_fits(dev, stream, (unsigned int)index, &max_size)) {
+        return 0;
+    }
+
+    if (voxel3d_capture_read_frame(dev->reader, stream, index, &info, dst, max_size) < 0)
+        return 0;
+
+    if (stream == CAPTURE_STREAM_TOF) {
+        TofBuffers *tof = (TofBuffers *)data;
+        memcpy(tof->depthmap, dev->tof_frame.data(), TOF_DEPTH_ONLY_FRAME_SIZE);
+        if (tof->irmap)
+            memcpy(tof->irmap, dev->tof_frame.data() + TOF_DEPTH_PIXELS, TOF_IR_ONLY_FRAME_SIZE);
+    }
+
+    return info.frame_count ? info.frame_count : (unsigned int)index + 1;
+}
+
+extern "C" int voxel3d_replay_open(char *dev_sn, const char *file_path, int mode, float fixed_fps)
+{
+    ReplayDevice *dev = NULL;
+    capture_reader_t *reader;
+    CaptureDeviceInfo dev_info;
+    char sn[MAX_PRODUCT_SN_LEN];
+
+    std::lock_guard<std::mutex> table(replay_table_lock);
+    for (int ix = 0; ix < MAX_SUPPORTED_CAMERA_MODULE && !dev; ix++) {
+        if (!replay_devices[ix].in_use)
+            dev = &replay_devices[ix];
+    }
+    if (!dev)
+        return -2;
+
+    /* mapped for playback prefetch, plain reads if the file can't be mapped */
+    reader = voxel3d_capture_open_mapped(file_path);
+    if (!reader)
+        reader = voxel3d_capture_open(file_path);
+    if (!reader)
+        return -3;
+
+    /* the S/N stored in the recording is checked like an explicit one */
+    voxel3d_capture_get_device_info(reader, &dev_info);
+    strncpy(sn, (dev_sn && dev_sn[0]) ? dev_sn : dev_info.product_sn, MAX_PRODUCT_SN_LEN - 1);
+    sn[MAX_PRODUCT_SN_LEN - 1] = '\0';
+    if (!sn[0] || find_device(sn)) {
+        voxel3d_capture_release(reader);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    dev->reader = reader;
+    dev->dev_info = dev_info;
+    memcpy(dev->sn, sn, sizeof(dev->sn));
+    dev->rectify_type = RectifyType::NONE;
+    dev->mode = mode & ~REPLAY_LOOP;
+    dev->loop = (mode & REPLAY_LOOP) != 0;
+    dev->speed = 1.0;
+
+    dev->base_ts_us = ~0ULL;
+    for (int ix = 0; ix < CAPTURE_STREAM_COUNT; ix++) {
+        CaptureFrameInfo info;
+        dev->frames[ix] = (unsigned int)voxel3d_capture_frame_count(reader, ix);
+        if (dev->frames[ix] && voxel3d_capture_frame_info(reader, ix, 0, &info) > 0 &&
+            info.host_ts_us < dev->base_ts_us)
+            dev->base_ts_us = info.host_ts_us;
+    }
+
+    if (dev->mode == REPLAY_FIXED_RATE) {
+        unsigned int n = dev->frames[CAPTURE_STREAM_TOF];
+        unsigned long long span = n > 1 ? frame_ts(dev, CAPTURE_STREAM_TOF, n - 1) -
+                                          frame_ts(dev, CAPTURE_STREAM_TOF, 0) : 0;
+        if (fixed_fps <= 0.f || !span) {
+            voxel3d_capture_release(reader);
+            dev->reader = NULL;
+            return -4;
+        }
+        dev->speed = fixed_fps / ((n - 1) * 1e6 / span);
+    }
+
+    dev->rays.resize(TOF_DEPTH_PIXELS * 2);
+    if (voxel3d_calibration_build_rays(&dev->dev_info.tof_cam_info, dev->rays.data()) < 0)
+        dev->rays.clear();
+    dev->tof_frame.resize(TOF_DEPTH_PIXELS * 2);
+
+    restart_playback(dev);
+    dev->in_use = true;
+    return true;
+}
+
+extern "C" void voxel3d_replay_close(char *dev_sn)
+{
+    ReplayDevice *dev;
+
+    std::lock_guard<std::mutex> table(replay_table_lock);
+    if (!(dev = find_device(dev_sn)))
+        return;
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    voxel3d_capture_release(dev->reader);
+    dev->reader = NULL;
+    dev->rays.clear();
+    dev->in_use = false;
+}
+
+extern "C" unsigned int voxel3d_replay_tof_queryframe(char *dev_sn,
+                                                      unsigned short *depthmap,
+                                                      unsigned short *irmap)
+{
+    TofBuffers tof = { depthmap, irmap };
+
+    if (!depthmap)
+        return 0;
+    return query_frame(dev_sn, CAPTURE_STREAM_TOF, &tof, 0);
+}
+
+extern "C" int voxel3d_replay_tof_generatePointCloud(char *dev_sn,
+                                                     unsigned short *depthmap,
+                                                     float *xyz)
+{
+    ReplayDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!depthmap || !xyz || !(dev = lock_device(dev_sn, guard)) || dev->rays.empty())
+        return -1;
+
+    const float *ray = dev->rays.data();
+    for (int ix = 0; ix < TOF_DEPTH_PIXELS; ix++) {
+        float z = depthmap[ix] * TOF_DEPTH_UNIT_M;
+        xyz[ix * 3] = ray[ix * 2] * z;
+        xyz[ix * 3 + 1] = ray[ix * 2 + 1] * z;
+        xyz[ix * 3 + 2] = z;
+    }
+    return TOF_DEPTH_PIXELS;
+}
+
+extern "C" unsigned int voxel3d_replay_lepton3_queryframe(char *dev_sn, float *thermal_map)
+{
+    return query_frame(dev_sn, CAPTURE_STREAM_THERMAL, thermal_map, 0);
+}
+
+extern "C" unsigned int voxel3d_replay_rgb_queryframe(char *dev_sn, unsigned char *rgb_map)
+{
+    return query_frame(dev_sn, CAPTURE_STREAM_RGB, rgb_map, 0);
+}
+
+extern "C" int voxel3d_replay_read_imu_data(char *dev_sn, IMU_DATA *imu_data)
+{
+    return query_frame(dev_sn, CAPTURE_STREAM_IMU, imu_data, sizeof(IMU_DATA)) ? true : 0;
+}
+
+static int replay_read_camera_info(char *dev_sn, unsigned int stream, CameraInfo *cam_info)
+{
+    ReplayDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!cam_info || !(dev = lock_device(dev_sn, guard)))
+        return -1;
+
+    switch (stream) {
+    case CAPTURE_STREAM_RGB:
+        *cam_info = dev->dev_info.rgb_cam_info;
+        break;
+    case CAPTURE_STREAM_THERMAL:
+        *cam_info = dev->dev_info.flir_cam_info;
+        break;
+    default:
+        *cam_info = dev->dev_info.tof_cam_info;
+        break;
+    }
+    return true;
+}
+
+extern "C" int voxel3d_replay_tof_read_camera_info(char *dev_sn, CameraInfo *cam_info)
+{
+    return replay_read_camera_info(dev_sn, CAPTURE_STREAM_TOF, cam_info);
+}
+
+static int replay_lepton3_read_camera_info(char *dev_sn, CameraInfo *cam_info)
+{
+    return replay_read_camera_info(dev_sn, CAPTURE_STREAM_THERMAL, cam_info);
+}
+
+static int replay_rgb_read_camera_info(char *dev_sn, CameraInfo *cam_info)
+{
+    return replay_read_camera_info(dev_sn, CAPTURE_STREAM_RGB, cam_info);
+}
+
+static int replay_stream_init(char *dev_sn, unsigned int stream)
+{
+    ReplayDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!(dev = lock_device(dev_sn, guard)) || !dev->frames[stream])
+        return -1;
+    return true;
+}
+
+static int replay_tof_init(char *dev_sn)
+{
+    return replay_stream_init(dev_sn, CAPTURE_STREAM_TOF);
+}
+
+static int replay_lepton3_init(char *dev_sn)
+{
+    return replay_stream_init(dev_sn, CAPTURE_STREAM_THERMAL);
+}
+
+static int replay_rgb_init(char *dev_sn)
+{
+    return replay_stream_init(dev_sn, CAPTURE_STREAM_RGB);
+}
+
+static void replay_release(char *dev_sn)
+{
+    (void)dev_sn;
+}
+
+static int replay_scan(CamDevInfo *cam_dev_info)
+{
+    int count = 0;
+
+    if (!cam_dev_info)
+        return -1;
+
+    std::lock_guard<std::mutex> table(replay_table_lock);
+    for (int ix = 0; ix < MAX_SUPPORTED_CAMERA_MODULE; ix++) {
+        ReplayDevice *dev = &replay_devices[ix];
+        if (!dev->in_use)
+            continue;
+        strncpy(cam_dev_info->product_sn[count], dev->sn, MAX_PRODUCT_SN_LEN - 1);
+        strncpy(cam_dev_info->dev_name[count], TOF_CAM_DEV_NAME, MAX_DEV_NAME_LEN - 1);
+        cam_dev_info->resolution[count].width = TOF_DEPTH_WIDTH;
+        cam_dev_info->resolution[count].height = TOF_DEPTH_HEIGHT;
+        count++;
+    }
+    cam_dev_info->num_of_devices = count;
+    return count;
+}
+
+static int replay_set_rectifyType(char *dev_sn, int inputType)
+{
+    ReplayDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!(dev = lock_device(dev_sn, guard)))
+        return -1;
+
+    /* frames can't be rectified again, only the recorded type or no rectify is played */
+    if (inputType != RectifyType::NONE && inputType != dev->dev_info.rectify_type)
+        return false;
+    dev->rectify_type = inputType;
+    return true;
+}
+
+static int replay_read_fw_version(char *dev_sn, char *fw_ver, unsigned int max_len)
+{
+    ReplayDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!fw_ver || !max_len || !(dev = lock_device(dev_sn, guard)))
+        return -1;
+
+    strncpy(fw_ver, dev->dev_info.fw_version, max_len - 1);
+    fw_ver[max_len - 1] = '\0';
+    return true;
+}
+
+/* Sensor settings aren't recorded, a replay device can neither report nor change them */
+static int replay_tof_get_conf_threshold(char *dev_sn)
+{
+    (void)dev_sn;
+    return -1;
+}
+
+static int replay_tof_set_setting(char *dev_sn, unsigned int value)
+{
+    (void)dev_sn;
+    (void)value;
+    return -1;
+}
+
+/* Field of view from the recorded ToF intrinsics, in radians like the device reports */
+static float replay_tof_get_fov(char *dev_sn, bool horizontal)
+{
+    CameraInfo cam_info;
+
+    if (voxel3d_replay_tof_read_camera_info(dev_sn, &cam_info) < 0)
+        return 0;
+
+    if (horizontal) {
+        if (cam_info.focalLengthFx <= 0)
+            return 0;
+        return atanf(cam_info.principalPointCx / cam_info.focalLengthFx) +
+               atanf((TOF_DEPTH_WIDTH - cam_info.principalPointCx) / cam_info.focalLengthFx);
+    }
+    if (cam_info.focalLengthFy <= 0)
+        return 0;
+    return atanf(cam_info.principalPointCy / cam_info.focalLengthFy) +
+           atanf((TOF_DEPTH_HEIGHT - cam_info.principalPointCy) / cam_info.focalLengthFy);
+}
+
+static float replay_tof_get_depth_hfov(char *dev_sn)
+{
+    return replay_tof_get_fov(dev_sn, true);
+}
+
+static float replay_tof_get_depth_vfov(char *dev_sn)
+{
+    return replay_tof_get_fov(dev_sn, false);
+}
+
+static int replay_read_fw_build_date(char *dev_sn, char *fw_build_date, unsigned int max_len)
+{
+    (void)dev_sn;
+    (void)fw_build_date;
+    (void)max_len;
+    return -1;
+}
+
+static int replay_dev_fw_upgrade(char *dev_sn, char *file_path,
+                                 unsigned char (*fw_upgrade_cb)(int state, unsigned int percent_complete))
+{
+    (void)dev_sn;
+    (void)file_path;
+    (void)fw_upgrade_cb;
+    return -1;
+}
+
+static int replay_dev_fw_upgrade_state_poll(char *dev_sn, int &state, unsigned int &percent_complete)
+{
+    (void)dev_sn;
+    (void)state;
+    (void)percent_complete;
+    return -1;
+}
+
+static const DeviceBackend replay_backend = {
+    "replay",
+
+    replay_scan,
+
+    replay_tof_init,
+    voxel3d_replay_tof_queryframe,
+    voxel3d_replay_tof_generatePointCloud,
+    replay_release,
+
+    replay_lepton3_init,
+    voxel3d_replay_lepton3_queryframe,
+    replay_release,
+
+    replay_rgb_init,
+    voxel3d_replay_rgb_queryframe,
+    replay_release,
+
+    replay_release,
+
+    voxel3d_replay_read_imu_data,
+    voxel3d_replay_tof_read_camera_info,
+    replay_lepton3_read_camera_info,
+    replay_rgb_read_camera_info,
+    replay_set_rectifyType,
+    replay_read_fw_version,
+
+    replay_tof_get_conf_threshold,
+    replay_tof_set_setting,
+    replay_tof_set_setting,
+    replay_tof_get_depth_hfov,
+    replay_tof_get_depth_vfov,
+    replay_read_fw_build_date,
+    replay_dev_fw_upgrade,
+    replay_dev_fw_upgrade_state_poll,
+};
+
+extern "C" const DeviceBackend *voxel3d_replay_backend(void)
+{
+    return &replay_backend;
+}
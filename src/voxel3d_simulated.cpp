@@ -0,0 +1,782 @@
+/**
+ @file      voxel3d_simulated.cpp
+ @brief     Simulated devices behind the voxel3d_* device APIs
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "voxel3d_simulated.h"
+
+#define SCENE_CAMERA_HEIGHT_MM  (1000.f)
+#define SCENE_WALL_MM           (3000.f)
+#define SCENE_BOX_MM            (1500)
+#define SCENE_BOX_WIDTH         (100)
+#define SCENE_BOX_TOP           (TOF_DEPTH_HEIGHT / 2 - 60)
+#define SCENE_BOX_BOTTOM        (TOF_DEPTH_HEIGHT / 2 + 100)
+#define SCENE_BOX_PERIOD_US     (4000000.0)
+#define SCENE_AMBIENT_C         (22.f)
+#define GRAVITY                 (9.80665f)
+#define TWO_PI                  (6.283185307179586)
+#define SIM_FW_VERSION          "1.0.0"
+#define SIM_FW_BUILD_DATE       "2025/01/01"
+#define SIM_FW_UPGRADE_STEPS    (20)
+
+enum SimulatedStream
+{
+    SIM_TOF = 0,
+    SIM_RGB = 1,
+    SIM_THERMAL = 2,
+    SIM_STREAM_COUNT = 3,
+};
+
+struct SimulatedDevice {
+    bool in_use;
+    unsigned int generation;                    /* bumped when the device is (re)created or
+                                                   drops off the bus */
+    char sn[MAX_PRODUCT_SN_LEN];
+    unsigned long long start_us;                /* host time the device was created */
+    unsigned long long clock_offset_us;         /* device clock at start_us */
+    double clock_rate;                          /* device microseconds per host microsecond */
+    double period_us[SIM_STREAM_COUNT];         /* frame period in device time */
+    double imu_us;
+    float gyro_rate;                            /* peak of the tilt, rad/s */
+    bool imu_newest_only;
+    unsigned int transfer_us;
+    bool on[SIM_STREAM_COUNT];
+    unsigned int frame[SIM_STREAM_COUNT];       /* last frame handed out */
+    unsigned long long imu_index;               /* next IMU sample to hand out */
+    unsigned int conf_threshold;
+    unsigned int auto_exposure;
+    int rectify_type;
+    unsigned int init_ms;
+    unsigned int fw_upgrade_ms;
+    bool fw_upgrading;
+    int fw_state;
+    unsigned int fw_percent;
+    unsigned long long offline_until_us;        /* host time an injected disconnect ends */
+    bool stalled;                               /* ToF frames stopped until the next init */
+    std::mutex lock;
+};
+
+static SimulatedDevice sim_devices[MAX_SUPPORTED_CAMERA_MODULE];
+static std::mutex sim_table_lock;
+
+/* floor + back wall, the same for every device and never changed once built */
+static std::vector<unsigned short> scene_depth;
+static std::vector<unsigned short> scene_ir;
+static std::once_flag scene_once;
+
+static unsigned short ir_of_depth(unsigned int depth_mm)
+{
+    return depth_mm ? (unsigned short)(100 + 900000 / (depth_mm + 1000)) : 0;
+}
+
+static void build_scene(void)
+{
+    const float cy = (TOF_DEPTH_HEIGHT - 1) / 2.f;
+
+    scene_depth.resize(TOF_DEPTH_PIXELS);
+    scene_ir.resize(TOF_DEPTH_PIXELS);
+    for (int v = 0; v < TOF_DEPTH_HEIGHT; v++) {
+        float y = (v - cy) / SIMULATED_FOCAL_LENGTH;
+        float z = SCENE_WALL_MM;
+
+        /* the floor is seen below the horizon, where it comes closer than the wall */
+        if (y > 0.f && SCENE_CAMERA_HEIGHT_MM / y < z)
+            z = SCENE_CAMERA_HEIGHT_MM / y;
+
+        for (int u = 0; u < TOF_DEPTH_WIDTH; u++) {
+            scene_depth[v * TOF_DEPTH_WIDTH + u] = (unsigned short)z;
+            scene_ir[v * TOF_DEPTH_WIDTH + u] = ir_of_depth((unsigned int)z);
+        }
+    }
+}
+
+static SimulatedDevice *find_device(const char *dev_sn)
+{
+    for (int ix = 0; ix < MAX_SUPPORTED_CAMERA_MODULE; ix++) {
+        SimulatedDevice *dev = &sim_devices[ix];
+        if (!dev->in_use)
+            continue;
+        if (!dev_sn || !dev_sn[0] || !strncmp(dev->sn, dev_sn, MAX_PRODUCT_SN_LEN))
+            return dev;
+    }
+    return NULL;
+}
+
+static SimulatedDevice *lock_device(const char *dev_sn, std::unique_lock<std::mutex> &guard)
+{
+    SimulatedDevice *dev;
+
+    {
+        std::lock_guard<std::mutex> table(sim_table_lock);
+        if (!(dev = find_device(dev_sn)))
+            return NULL;
+    }
+
+    guard = std::unique_lock<std::mutex>(dev->lock);
+    if (!dev->in_use) {
+        guard.unlock();
+        return NULL;
+    }
+    return dev;
+}
+
+static bool is_offline(SimulatedDevice *dev)
+{
+    return dev->offline_until_us && voxel3d_host_time_us() < dev->offline_until_us;
+}
+
+/*
+ * Device clock
+ */
+static double device_elapsed_us(SimulatedDevice *dev, unsigned long long host_us)
+{
+    return (double)(host_us - dev->start_us) * dev->clock_rate;
+}
+
+static unsigned long long host_time_of(SimulatedDevice *dev, double device_elapsed)
+{
+    return dev->start_us + (unsigned long long)(device_elapsed / dev->clock_rate);
+}
+
+/* Frames produced by the device up to now, frame n is produced at n periods */
+static unsigned int produced_frames(SimulatedDevice *dev, double period_us)
+{
+    return (unsigned int)(device_elapsed_us(dev, voxel3d_host_time_us()) / period_us);
+}
+
+static void sleep_until_host_us(unsigned long long host_us)
+{
+    unsigned long long now = voxel3d_host_time_us();
+
+    if (host_us > now)
+        std::this_thread::sleep_for(std::chrono::microseconds(host_us - now));
+}
+
+/*
+ * Scene
+ */
+static void render_tof(unsigned int frame, double frame_us, unsigned short *depthmap,
+                       unsigned short *irmap)
+{
+    double phase = fmod(frame * frame_us, SCENE_BOX_PERIOD_US) / SCENE_BOX_PERIOD_US;
+    int center = TOF_DEPTH_WIDTH / 2 + (int)(TOF_DEPTH_WIDTH / 3 * sin(TWO_PI * phase));
+    int left = center - SCENE_BOX_WIDTH / 2;
+    int right = center + SCENE_BOX_WIDTH / 2;
+    unsigned short box_ir = ir_of_depth(SCENE_BOX_MM);
+
+    memcpy(depthmap, scene_depth.data(), TOF_DEPTH_ONLY_FRAME_SIZE);
+    if (irmap)
+        memcpy(irmap, scene_ir.data(), TOF_IR_ONLY_FRAME_SIZE);
+
+    for (int v = SCENE_BOX_TOP; v < SCENE_BOX_BOTTOM; v++) {
+        for (int u = left; u < right; u++) {
+            depthmap[v * TOF_DEPTH_WIDTH + u] = SCENE_BOX_MM;
+            if (irmap)
+                irmap[v * TOF_DEPTH_WIDTH + u] = box_ir;
+        }
+    }
+}
+
+/*
+ * Backend entries
+ */
+static int sim_scan(CamDevInfo *cam_dev_info)
+{
+    int count = 0;
+
+    if (!cam_dev_info)
+        return -1;
+
+    std::lock_guard<std::mutex> table(sim_table_lock);
+    for (int ix = 0; ix < MAX_SUPPORTED_CAMERA_MODULE; ix++) {
+        SimulatedDevice *dev = &sim_devices[ix];
+        {
+            std::lock_guard<std::mutex> guard(dev->lock);
+            if (!dev->in_use || is_offline(dev))
+                continue;
+        }
+        strncpy(cam_dev_info->product_sn[count], dev->sn, MAX_PRODUCT_SN_LEN - 1);
+        strncpy(cam_dev_info->dev_name[count], TOF_CAM_DEV_NAME, MAX_DEV_NAME_LEN - 1);
+        cam_dev_info->resolution[count].width = TOF_DEPTH_WIDTH;
+        cam_dev_info->resolution[count].height = TOF_DEPTH_HEIGHT;
+        count++;
+    }
+    cam_dev_info->num_of_devices = count;
+    return count;
+}
+
+static int sim_stream_init(char *dev_sn, int stream)
+{
+    SimulatedDevice *dev;
+    unsigned int init_ms;
+
+    {
+        std::unique_lock<std::mutex> guard;
+        if (!(dev = lock_device(dev_sn, guard)) || is_offline(dev))
+            return -1;
+        init_ms = dev->init_ms;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(init_ms));
+
+    std::unique_lock<std::mutex> guard;
+    if (!(dev = lock_device(dev_sn, guard)) || is_offline(dev))
+        return -1;
+
+    /* frames produced before init aren't handed out */
+    dev->on[stream] = true;
+    if (stream == SIM_TOF)
+        dev->stalled = false;
+    dev->frame[stream] = produced_frames(dev, dev->period_us[stream]);
+    return true;
+}
+
+static int sim_tof_init(char *dev_sn)
+{
+    return sim_stream_init(dev_sn, SIM_TOF);
+}
+
+static int sim_lepton3_init(char *dev_sn)
+{
+    return sim_stream_init(dev_sn, SIM_THERMAL);
+}
+
+static int sim_rgb_init(char *dev_sn)
+{
+    return sim_stream_init(dev_sn, SIM_RGB);
+}
+
+static void sim_stream_release(char *dev_sn, int stream)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if ((dev = lock_device(dev_sn, guard)))
+        dev->on[stream] = false;
+}
+
+static void sim_tof_release(char *dev_sn)
+{
+    sim_stream_release(dev_sn, SIM_TOF);
+}
+
+static void sim_lepton3_release(char *dev_sn)
+{
+    sim_stream_release(dev_sn, SIM_THERMAL);
+}
+
+static void sim_rgb_release(char *dev_sn)
+{
+    sim_stream_release(dev_sn, SIM_RGB);
+}
+
+static void sim_release(char *dev_sn)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if ((dev = lock_device(dev_sn, guard))) {
+        memset(dev->on, 0, sizeof(dev->on));
+        dev->stalled = false;
+    }
+}
+
+static unsigned int sim_tof_queryframe(char *dev_sn, unsigned short *depthmap,
+                                       unsigned short *irmap)
+{
+    SimulatedDevice *dev;
+    unsigned int frame, generation;
+    unsigned long long ready_us;
+
+    {
+        std::unique_lock<std::mutex> guard;
+        if (!depthmap || !(dev = lock_device(dev_sn, guard)) || !dev->on[SIM_TOF])
+            return 0;
+
+        /* a stalled sensor lets the query time out after a frame period */
+        if (dev->stalled) {
+            ready_us = voxel3d_host_time_us() + (unsigned long long)dev->period_us[SIM_TOF];
+            guard.unlock();
+            sleep_until_host_us(ready_us);
+            return 0;
+        }
+
+        /* the next frame, or the newest one if the query comes late */
+        frame = produced_frames(dev, dev->period_us[SIM_TOF]);
+        if (frame <= dev->frame[SIM_TOF])
+            frame = dev->frame[SIM_TOF] + 1;
+        ready_us = host_time_of(dev, frame * dev->period_us[SIM_TOF]);
+
+        /* the transfer starts once both the frame and the host are there */
+        unsigned long long now = voxel3d_host_time_us();
+        ready_us = (ready_us > now ? ready_us : now) + dev->transfer_us;
+        generation = dev->generation;
+    }
+
+    /* waiting for and transferring the frame doesn't hold the device */
+    sleep_until_host_us(ready_us);
+
+    std::lock_guard<std::mutex> guard(dev->lock);
+    if (!dev->in_use || dev->generation != generation || !dev->on[SIM_TOF])
+        return 0;
+
+    render_tof(frame, dev->period_us[SIM_TOF], depthmap, irmap);
+    dev->frame[SIM_TOF] = frame;
+    return frame;
+}
+
+static int sim_tof_generatePointCloud(char *dev_sn, unsigned short *depthmap, float *xyz)
+{
+    const float cx = (TOF_DEPTH_WIDTH - 1) / 2.f;
+    const float cy = (TOF_DEPTH_HEIGHT - 1) / 2.f;
+
+    if (!depthmap || !xyz)
+        return -1;
+
+    for (int v = 0; v < TOF_DEPTH_HEIGHT; v++) {
+        for (int u = 0; u < TOF_DEPTH_WIDTH; u++) {
+            int ix = v * TOF_DEPTH_WIDTH + u;
+            float z = depthmap[ix] * 0.001f;
+            xyz[ix * 3] = (u - cx) / SIMULATED_FOCAL_LENGTH * z;
+            xyz[ix * 3 + 1] = (v - cy) / SIMULATED_FOCAL_LENGTH * z;
+            xyz[ix * 3 + 2] = z;
+        }
+    }
+    return TOF_DEPTH_PIXELS;
+}
+
+/* Newest frame of a non-blocking stream, 0 if none was produced since the last query */
+static unsigned int sim_poll_frame(SimulatedDevice *dev, int stream)
+{
+    if (!dev->on[stream])
+        return 0;
+
+    unsigned int frame = produced_frames(dev, dev->period_us[stream]);
+    if (frame <= dev->frame[stream])
+        return 0;
+    dev->frame[stream] = frame;
+    return frame;
+}
+
+static unsigned int sim_lepton3_queryframe(char *dev_sn, float *thermal_map)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!thermal_map || !(dev = lock_device(dev_sn, guard)))
+        return 0;
+
+    unsigned int frame = sim_poll_frame(dev, SIM_THERMAL);
+    if (frame) {
+        int pixels = dev->rectify_type == RectifyType::FLIR2TOF ? TOF_DEPTH_PIXELS : FLIR_PIXELS;
+        for (int ix = 0; ix < pixels; ix++)
+            thermal_map[ix] = SCENE_AMBIENT_C;
+    }
+    return frame;
+}
+
+static unsigned int sim_rgb_queryframe(char *dev_sn, unsigned char *rgb_map)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!rgb_map || !(dev = lock_device(dev_sn, guard)))
+        return 0;
+
+    unsigned int frame = sim_poll_frame(dev, SIM_RGB);
+    if (frame) {
+        int pixels = dev->rectify_type == RectifyType::RGB2TOF ? TOF_DEPTH_PIXELS : RGB_PIXELS;
+        memset(rgb_map, 128, (size_t)pixels * 3);
+    }
+    return frame;
+}
+
+static int sim_read_imu_data(char *dev_sn, IMU_DATA *imu_data)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!imu_data || !(dev = lock_device(dev_sn, guard)) || is_offline(dev))
+        return -1;
+
+    /* sample n is produced at n periods like frames, sample 0 at start */
+    unsigned long long produced = produced_frames(dev, dev->imu_us) + 1ULL;
+    unsigned long long backlog = (unsigned long long)(1e6 / dev->imu_us);
+
+    /* the device FIFO holds 1 s of samples, older ones are overwritten; without FIFO a read
+       returns the newest sample, the same one until the next is produced */
+    if (dev->imu_newest_only)
+        dev->imu_index = produced - 1;
+    else if (produced > backlog && dev->imu_index < produced - backlog)
+        dev->imu_index = produced - backlog;
+    if (dev->imu_index >= produced)
+        return 0;
+
+    /* tilt about x: rate r * sin(w t), angle r / w * (1 - cos(w t)), level at sample 0 */
+    double omega = TWO_PI / (SIMULATED_TILT_PERIOD_MS * 1000.0);
+    double phase = omega * dev->imu_index * dev->imu_us;
+    double tilt = dev->gyro_rate / (omega * 1e6) * (1.0 - cos(phase));
+
+    imu_data->imu_ts = (unsigned int)(dev->clock_offset_us + dev->imu_index * dev->imu_us);
+    imu_data->imu_accel[0] = 0.f;
+    imu_data->imu_accel[1] = (float)(-GRAVITY * cos(tilt));
+    imu_data->imu_accel[2] = (float)(GRAVITY * sin(tilt));
+    imu_data->imu_gyro[0] = (float)(dev->gyro_rate * sin(phase));
+    imu_data->imu_gyro[1] = 0.f;
+    imu_data->imu_gyro[2] = 0.f;
+    dev->imu_index++;
+    return true;
+}
+
+static int sim_read_camera_info(char *dev_sn, int unrectified_width, int unrectified_height,
+                                int rectified_type, CameraInfo *cam_info)
+{
+    SimulatedDevice *dev;
+    int width = unrectified_width, height = unrectified_height;
+
+    std::unique_lock<std::mutex> guard;
+    if (!cam_info || !(dev = lock_device(dev_sn, guard)))
+        return -1;
+
+    if (dev->rectify_type == rectified_type) {
+        width = TOF_DEPTH_WIDTH;
+        height = TOF_DEPTH_HEIGHT;
+    }
+
+    /* every sensor sees the ToF field of view */
+    memset(cam_info, 0, sizeof(*cam_info));
+    cam_info->focalLengthFx = SIMULATED_FOCAL_LENGTH * width / TOF_DEPTH_WIDTH;
+    cam_info->focalLengthFy = SIMULATED_FOCAL_LENGTH * width / TOF_DEPTH_WIDTH;
+    cam_info->principalPointCx = (width - 1) / 2.f;
+    cam_info->principalPointCy = (height - 1) / 2.f;
+    return true;
+}
+
+static int sim_tof_read_camera_info(char *dev_sn, CameraInfo *cam_info)
+{
+    return sim_read_camera_info(dev_sn, TOF_DEPTH_WIDTH, TOF_DEPTH_HEIGHT, RectifyType::NONE,
+                                cam_info);
+}
+
+static int sim_lepton3_read_camera_info(char *dev_sn, CameraInfo *cam_info)
+{
+    return sim_read_camera_info(dev_sn, FLIR_WIDTH, FLIR_HEIGHT, RectifyType::FLIR2TOF,
+                                cam_info);
+}
+
+static int sim_rgb_read_camera_info(char *dev_sn, CameraInfo *cam_info)
+{
+    return sim_read_camera_info(dev_sn, RGB_WIDTH, RGB_HEIGHT, RectifyType::RGB2TOF, cam_info);
+}
+
+static int sim_set_rectifyType(char *dev_sn, int inputType)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (inputType < RectifyType::NONE || inputType > RectifyType::FLIR2TOF ||
+        !(dev = lock_device(dev_sn, guard)) || is_offline(dev))
+        return false;
+    dev->rectify_type = inputType;
+    return true;
+}
+
+static int sim_read_string(char *dev_sn, const char *value, char *str, unsigned int max_len)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!str || !max_len || !(dev = lock_device(dev_sn, guard)))
+        return -1;
+
+    strncpy(str, value, max_len - 1);
+    str[max_len - 1] = '\0';
+    return true;
+}
+
+static int sim_read_fw_version(char *dev_sn, char *fw_ver, unsigned int max_len)
+{
+    return sim_read_string(dev_sn, SIM_FW_VERSION, fw_ver, max_len);
+}
+
+static int sim_read_fw_build_date(char *dev_sn, char *fw_build_date, unsigned int max_len)
+{
+    return sim_read_string(dev_sn, SIM_FW_BUILD_DATE, fw_build_date, max_len);
+}
+
+static int sim_tof_get_conf_threshold(char *dev_sn)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!(dev = lock_device(dev_sn, guard)) || !dev->on[SIM_TOF])
+        return -1;
+    return (int)dev->conf_threshold;
+}
+
+static int sim_tof_set_conf_threshold(char *dev_sn, unsigned int conf_threshold)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!(dev = lock_device(dev_sn, guard)) || !dev->on[SIM_TOF])
+        return -1;
+    dev->conf_threshold = conf_threshold;
+    return true;
+}
+
+static int sim_tof_set_auto_exposure_mode(char *dev_sn, unsigned int enable)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!(dev = lock_device(dev_sn, guard)) || !dev->on[SIM_TOF])
+        return -1;
+    dev->auto_exposure = enable;
+    return true;
+}
+
+static float sim_tof_get_depth_hfov(char *dev_sn)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!(dev = lock_device(dev_sn, guard)) || !dev->on[SIM_TOF])
+        return 0;
+    return 2 * atanf(TOF_DEPTH_WIDTH / 2.f / SIMULATED_FOCAL_LENGTH);
+}
+
+static float sim_tof_get_depth_vfov(char *dev_sn)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!(dev = lock_device(dev_sn, guard)) || !dev->on[SIM_TOF])
+        return 0;
+    return 2 * atanf(TOF_DEPTH_HEIGHT / 2.f / SIMULATED_FOCAL_LENGTH);
+}
+
+static int sim_fw_upgrade_step(char *dev_sn, unsigned int generation, int state,
+                               unsigned int percent_complete,
+                               unsigned char (*fw_upgrade_cb)(int state,
+                                                              unsigned int percent_complete))
+{
+    SimulatedDevice *dev;
+
+    {
+        std::unique_lock<std::mutex> guard;
+        if (!(dev = lock_device(dev_sn, guard)) || dev->generation != generation)
+            return -1;
+        dev->fw_state = state;
+        dev->fw_percent = percent_complete;
+        if (state == 2)
+            dev->fw_upgrading = false;
+    }
+
+    if (fw_upgrade_cb)
+        fw_upgrade_cb(state, percent_complete);
+    return true;
+}
+
+static int sim_dev_fw_upgrade(char *dev_sn, char *file_path,
+                              unsigned char (*fw_upgrade_cb)(int state,
+                                                             unsigned int percent_complete))
+{
+    SimulatedDevice *dev;
+    unsigned int generation, step_ms;
+    FILE *fp;
+
+    if (!file_path || !(fp = fopen(file_path, "rb")))
+        return -1;
+    fclose(fp);
+
+    {
+        std::unique_lock<std::mutex> guard;
+        if (!(dev = lock_device(dev_sn, guard)) || dev->fw_upgrading)
+            return -1;
+        dev->fw_upgrading = true;
+        generation = dev->generation;
+        step_ms = dev->fw_upgrade_ms / SIM_FW_UPGRADE_STEPS;
+    }
+
+    if (sim_fw_upgrade_step(dev_sn, generation, 0, 0, fw_upgrade_cb) < 0)
+        return -1;
+    for (unsigned int step = 1; step <= SIM_FW_UPGRADE_STEPS; step++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(step_ms));
+        if (sim_fw_upgrade_step(dev_sn, generation, 1, 100 * step / SIM_FW_UPGRADE_STEPS,
+                                fw_upgrade_cb) < 0)
+            return -1;
+    }
+    return sim_fw_upgrade_step(dev_sn, generation, 2, 100, fw_upgrade_cb);
+}
+
+static int sim_dev_fw_upgrade_state_poll(char *dev_sn, int &state,
+                                         unsigned int &percent_complete)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!(dev = lock_device(dev_sn, guard)))
+        return -1;
+    state = dev->fw_state;
+    percent_complete = dev->fw_percent;
+    return dev->fw_upgrading ? true : -1;
+}
+
+static const DeviceBackend simulated_backend = {
+    "simulated",
+
+    sim_scan,
+
+    sim_tof_init,
+    sim_tof_queryframe,
+    sim_tof_generatePointCloud,
+    sim_tof_release,
+
+    sim_lepton3_init,
+    sim_lepton3_queryframe,
+    sim_lepton3_release,
+
+    sim_rgb_init,
+    sim_rgb_queryframe,
+    sim_rgb_release,
+
+    sim_release,
+
+    sim_read_imu_data,
+    sim_tof_read_camera_info,
+    sim_lepton3_read_camera_info,
+    sim_rgb_read_camera_info,
+    sim_set_rectifyType,
+    sim_read_fw_version,
+
+    sim_tof_get_conf_threshold,
+    sim_tof_set_conf_threshold,
+    sim_tof_set_auto_exposure_mode,
+    sim_tof_get_depth_hfov,
+    sim_tof_get_depth_vfov,
+    sim_read_fw_build_date,
+    sim_dev_fw_upgrade,
+    sim_dev_fw_upgrade_state_poll,
+};
+
+/*
+ * Public APIs
+ */
+extern "C" int voxel3d_simulated_open(const SimulatedConfig *config)
+{
+    SimulatedConfig cfg;
+
+    if (config) {
+        cfg = *config;
+    }
+    else {
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.num_devices = 1;
+    }
+    if (!cfg.num_devices || cfg.num_devices > MAX_SUPPORTED_CAMERA_MODULE ||
+        cfg.tof_fps < 0.f || cfg.clock_drift_ppm < 0.f || cfg.gyro_rate < 0.f)
+        return -1;
+    if (cfg.tof_fps == 0.f)
+        cfg.tof_fps = SIMULATED_DEFAULT_FPS;
+    if (!cfg.imu_rate)
+        cfg.imu_rate = SIMULATED_DEFAULT_IMU_RATE;
+    if (!cfg.fw_upgrade_ms)
+        cfg.fw_upgrade_ms = SIMULATED_DEFAULT_FW_UPGRADE_MS;
+
+    std::call_once(scene_once, build_scene);
+
+    std::lock_guard<std::mutex> table(sim_table_lock);
+    unsigned long long now = voxel3d_host_time_us();
+    for (unsigned int ix = 0; ix < MAX_SUPPORTED_CAMERA_MODULE; ix++) {
+        SimulatedDevice *dev = &sim_devices[ix];
+
+        std::lock_guard<std::mutex> guard(dev->lock);
+        dev->generation++;
+        dev->in_use = ix < cfg.num_devices;
+        if (!dev->in_use)
+            continue;
+
+        /* drifts spread evenly over [-clock_drift_ppm, clock_drift_ppm] */
+        double spread = cfg.num_devices > 1 ? 2.0 * ix / (cfg.num_devices - 1) - 1.0 : 1.0;
+
+        snprintf(dev->sn, sizeof(dev->sn), "SIM%02u", ix);
+        dev->start_us = now;
+        dev->clock_offset_us = 1000000ULL * (ix + 1) + 12345ULL * ix;
+        dev->clock_rate = 1.0 + spread * cfg.clock_drift_ppm * 1e-6;
+        dev->period_us[SIM_TOF] = 1e6 / cfg.tof_fps;
+        dev->period_us[SIM_RGB] = 1e6 / cfg.tof_fps;
+        dev->period_us[SIM_THERMAL] = 1e6 / SIMULATED_THERMAL_FPS;
+        dev->imu_us = 1e6 / cfg.imu_rate;
+        dev->gyro_rate = cfg.gyro_rate;
+        dev->imu_newest_only = cfg.imu_newest_only;
+        dev->transfer_us = cfg.transfer_us;
+        memset(dev->on, 0, sizeof(dev->on));
+        memset(dev->frame, 0, sizeof(dev->frame));
+        dev->imu_index = 0;
+        dev->conf_threshold = 0;
+        dev->auto_exposure = 1;
+        dev->rectify_type = RectifyType::NONE;
+        dev->init_ms = cfg.init_ms;
+        dev->fw_upgrade_ms = cfg.fw_upgrade_ms;
+        dev->fw_upgrading = false;
+        dev->fw_state = 0;
+        dev->fw_percent = 0;
+        dev->offline_until_us = 0;
+        dev->stalled = false;
+    }
+    return (int)cfg.num_devices;
+}
+
+extern "C" void voxel3d_simulated_close(void)
+{
+    std::lock_guard<std::mutex> table(sim_table_lock);
+    for (int ix = 0; ix < MAX_SUPPORTED_CAMERA_MODULE; ix++) {
+        std::lock_guard<std::mutex> guard(sim_devices[ix].lock);
+        sim_devices[ix].generation++;
+        sim_devices[ix].in_use = false;
+    }
+}
+
+extern "C" int voxel3d_simulated_inject_fault(const char *dev_sn, int fault,
+                                              unsigned int duration_ms)
+{
+    SimulatedDevice *dev;
+
+    std::unique_lock<std::mutex> guard;
+    if (!dev_sn || !dev_sn[0] || !(dev = lock_device(dev_sn, guard)))
+        return -1;
+
+    switch (fault) {
+    case SIMULATED_FAULT_DISCONNECT:
+        /* a power cycled device forgets its sensors and settings, queries in flight fail */
+        dev->generation++;
+        memset(dev->on, 0, sizeof(dev->on));
+        dev->stalled = false;
+        dev->conf_threshold = 0;
+        dev->auto_exposure = 1;
+        dev->rectify_type = RectifyType::NONE;
+        dev->fw_upgrading = false;
+        dev->offline_until_us = voxel3d_host_time_us() + duration_ms * 1000ULL;
+        return true;
+    case SIMULATED_FAULT_STALL:
+        dev->stalled = true;
+        return true;
+    default:
+        return -1;
+    }
+}
+
+extern "C" const DeviceBackend *voxel3d_simulated_backend(void)
+{
+    return &simulated_backend;
+}
@@ -0,0 +1,399 @@
+/**
+ @file      voxel3d_sync.cpp
+ @brief     Device clock estimation and cross-device frameset matching
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+
+#include "voxel3d_sync.h"
+
+struct clock_estimator {
+    unsigned int window;
+    unsigned int count;
+    unsigned int next;                  /* ring slot of the next sample */
+    std::vector<double> device;         /* microseconds since device_base */
+    std::vector<double> host;           /* microseconds since host_base */
+    unsigned long long device_base;
+    unsigned long long host_base;
+    unsigned long long last_device;
+    bool dirty;
+    ClockEstimate estimate;
+};
+
+struct PendingFrameset {
+    AcquisitionFrameset *frameset;
+    unsigned long long capture_us;
+    unsigned long long arrival_us;
+};
+
+struct frameset_sync {
+    acquisition_t *acq;
+    unsigned int num_devices;
+    double frame_us;
+    unsigned int tolerance_us;
+    unsigned int min_devices;
+    unsigned int max_wait_us;
+    std::vector<clock_estimator_t *> clocks;
+    std::vector<std::deque<PendingFrameset>> pending;
+    SyncStats stats;
+};
+
+/*
+ * Clock estimator
+ */
+static void clock_restart(clock_estimator_t *clk, unsigned long long device_us,
+                          unsigned long long host_us)
+{
+    clk->count = 0;
+    clk->next = 0;
+    clk->device_base = device_us;
+    clk->host_base = host_us;
+    clk->dirty = true;
+}
+
+static void clock_fit(clock_estimator_t *clk)
+{
+    double n = clk->count;
+    double mean_x = 0, mean_y = 0, sxx = 0, sxy = 0;
+    double lowest, squares = 0;
+
+    for (unsigned int ix = 0; ix < clk->count; ix++) {
+        mean_x += clk->device[ix];
+        mean_y += clk->host[ix];
+    }
+    mean_x /= n;
+    mean_y /= n;
+
+    /* centered sums, the timestamps themselves are far too large to square */
+    for (unsigned int ix = 0; ix < clk->count; ix++) {
+        double dx = clk->device[ix] - mean_x;
+        sxx += dx * dx;
+        sxy += dx * (clk->host[ix] - mean_y);
+    }
+
+    double rate = sxx > 0 ? sxy / sxx : 1.0;
+    double offset = mean_y - rate * mean_x;
+
+    /* lower the line onto the least delayed arrival */
+    lowest = clk->host[0] - (offset + rate * clk->device[0]);
+    for (unsigned int ix = 1; ix < clk->count; ix++) {
+        double residual = clk->host[ix] - (offset + rate * clk->device[ix]);
+        if (residual < lowest)
+            lowest = residual;
+    }
+    offset += lowest;
+
+    for (unsigned int ix = 0; ix < clk->count; ix++) {
+        double residual = clk->host[ix] - (offset + rate * clk->device[ix]);
+        squares += residual * residual;
+    }
+
+    clk->estimate.device_base_us = clk->device_base;
+    clk->estimate.host_base_us = clk->host_base;
+    clk->estimate.rate = rate;
+    clk->estimate.offset_us = offset;
+    clk->estimate.jitter_us = sqrt(squares / n);
+    clk->estimate.samples = clk->count;
+    clk->dirty = false;
+}
+
+static bool clock_ready(clock_estimator_t *clk)
+{
+    if (clk->count < CLOCK_MIN_SAMPLES)
+        return false;
+    if (clk->dirty)
+        clock_fit(clk);
+    return true;
+}
+
+extern "C" clock_estimator_t *voxel3d_clock_create(unsigned int window)
+{
+    if (!window)
+        window = CLOCK_DEFAULT_WINDOW;
+    if (window < CLOCK_MIN_SAMPLES)
+        return NULL;
+
+    clock_estimator_t *clk = new clock_estimator_t;
+    clk->window = window;
+    clk->device.resize(window);
+    clk->host.resize(window);
+    clk->last_device = 0;
+    memset(&clk->estimate, 0, sizeof(clk->estimate));
+    clock_restart(clk, 0, 0);
+    return clk;
+}
+
+extern "C" int voxel3d_clock_add(clock_estimator_t *clk, unsigned long long device_us,
+                                 unsigned long long host_us)
+{
+    int ret = true;
+
+    if (!clk)
+        return -1;
+
+    if (!clk->count || device_us < clk->last_device) {
+        ret = clk->count ? 0 : true;
+        clock_restart(clk, device_us, host_us);
+    }
+
+    clk->device[clk->next] = (double)(device_us - clk->device_base);
+    clk->host[clk->next] = (double)(long long)(host_us - clk->host_base);
+    clk->next = (clk->next + 1) % clk->window;
+    if (clk->count < clk->window)
+        clk->count++;
+    clk->last_device = device_us;
+    clk->dirty = true;
+    return ret;
+}
+
+extern "C" int voxel3d_clock_to_host(clock_estimator_t *clk, unsigned long long device_us,
+                                     unsigned long long *host_us)
+{
+    if (!clk || !host_us || !clock_ready(clk))
+        return -1;
+
+    double device = (double)(long long)(device_us - clk->device_base);
+    double host = clk->estimate.offset_us + clk->estimate.rate * device;
+    *host_us = clk->host_base + (unsigned long long)(long long)llround(host);
+    return true;
+}
+
+extern "C" int voxel3d_clock_to_device(clock_estimator_t *clk, unsigned long long host_us,
+                                       unsigned long long *device_us)
+{
+    if (!clk || !device_us || !clock_ready(clk))
+        return -1;
+
+    double host = (double)(long long)(host_us - clk->host_base);
+    double device = (host - clk->estimate.offset_us) / clk->estimate.rate;
+    *device_us = clk->device_base + (unsigned long long)(long long)llround(device);
+    return true;
+}
+
+extern "C" int voxel3d_clock_get_estimate(clock_estimator_t *clk, ClockEstimate *estimate)
+{
+    if (!clk || !estimate || !clock_ready(clk))
+        return -1;
+
+    *estimate = clk->estimate;
+    return true;
+}
+
+extern "C" void voxel3d_clock_destroy(clock_estimator_t *clk)
+{
+    delete clk;
+}
+
+/*
+ * Frameset matching
+ */
+static void enqueue(sync_t *sync, AcquisitionFrameset *frameset)
+{
+    PendingFrameset pending;
+    clock_estimator_t *clk = sync->clocks[frameset->device];
+
+    pending.frameset = frameset;
+    pending.arrival_us = frameset->host_ts_us[CAPTURE_STREAM_TOF];
+    pending.capture_us = pending.arrival_us;
+
+    /* the ToF frame count ticks at the device's frame rate, that is its clock */
+    if (frameset->streams & ACQUISITION_STREAM(CAPTURE_STREAM_TOF)) {
+        unsigned long long device_us =
+            (unsigned long long)(frameset->frame_count[CAPTURE_STREAM_TOF] * sync->frame_us);
+        voxel3d_clock_add(clk, device_us, pending.arrival_us);
+        voxel3d_clock_to_host(clk, device_us, &pending.capture_us);
+    }
+    sync->pending[frameset->device].push_back(pending);
+}
+
+static void drop_front(sync_t *sync, unsigned int device)
+{
+    voxel3d_acquisition_release(sync->acq, sync->pending[device].front().frameset);
+    sync->pending[device].pop_front();
+    sync->stats.unmatched++;
+}
+
+static void fill_group(sync_t *sync, SyncFrameset *group)
+{
+    unsigned long long earliest = ~0ULL, latest = 0;
+    double sum = 0;
+
+    memset(group, 0, sizeof(*group));
+    group->num_devices = sync->num_devices;
+    for (unsigned int dev = 0; dev < sync->num_devices; dev++) {
+        if (sync->pending[dev].empty())
+            continue;
+
+        PendingFrameset &front = sync->pending[dev].front();
+        group->frameset[dev] = front.frameset;
+        group->capture_ts_us[dev] = front.capture_us;
+        group->matched++;
+        sum += (double)front.capture_us;
+        earliest = front.capture_us < earliest ? front.capture_us : earliest;
+        latest = front.capture_us > latest ? front.capture_us : latest;
+        sync->pending[dev].pop_front();
+    }
+    group->host_ts_us = (unsigned long long)(sum / group->matched);
+    group->spread_us = (unsigned int)(latest - earliest);
+}
+
+/*
+ * Match the fronts of the device queues: the latest front sets the reference, fronts
+ * too early for it can never be matched any more and are dropped. What remains is within
+ * tolerance; it is a match once every device is there, or a partial match once the wait
+ * for the missing ones runs out.
+ */
+static bool try_match(sync_t *sync, SyncFrameset *group, unsigned long long now)
+{
+    unsigned long long reference = 0, oldest_arrival = ~0ULL;
+    unsigned int present = 0;
+
+    for (unsigned int dev = 0; dev < sync->num_devices; dev++) {
+        if (!sync->pending[dev].empty() && sync->pending[dev].front().capture_us > reference)
+            reference = sync->pending[dev].front().capture_us;
+    }
+    if (!reference)
+        return false;
+
+    for (unsigned int dev = 0; dev < sync->num_devices; dev++) {
+        std::deque<PendingFrameset> &queue = sync->pending[dev];
+        while (!queue.empty() && queue.front().capture_us + sync->tolerance_us < reference)
+            drop_front(sync, dev);
+        if (queue.empty())
+            continue;
+        present++;
+        if (queue.front().arrival_us < oldest_arrival)
+            oldest_arrival = queue.front().arrival_us;
+    }
+
+    if (present == sync->num_devices) {
+        fill_group(sync, group);
+        sync->stats.matches++;
+        return true;
+    }
+
+    if (now < oldest_arrival + sync->max_wait_us)
+        return false;
+
+    if (present >= sync->min_devices) {
+        fill_group(sync, group);
+        sync->stats.partial_matches++;
+        return true;
+    }
+
+    /* too few devices in time, free their framesets for newer frames */
+    for (unsigned int dev = 0; dev < sync->num_devices; dev++) {
+        if (!sync->pending[dev].empty())
+            drop_front(sync, dev);
+    }
+    return false;
+}
+
+extern "C" sync_t *voxel3d_sync_create(acquisition_t *acq, const SyncConfig *config)
+{
+    unsigned int num_devices = voxel3d_acquisition_device_count(acq);
+
+    if (!acq || !config || config->fps <= 0.f || !num_devices ||
+        config->min_devices > num_devices)
+        return NULL;
+
+    sync_t *sync = new sync_t;
+    sync->acq = acq;
+    sync->num_devices = num_devices;
+    sync->frame_us = 1e6 / config->fps;
+    sync->tolerance_us = config->tolerance_us ? config->tolerance_us :
+                                                (unsigned int)(sync->frame_us / 2);
+    sync->min_devices = config->min_devices ? config->min_devices : num_devices;
+    sync->max_wait_us = config->max_wait_us ? config->max_wait_us : SYNC_DEFAULT_MAX_WAIT_US;
+    sync->pending.resize(num_devices);
+    memset(&sync->stats, 0, sizeof(sync->stats));
+
+    for (unsigned int dev = 0; dev < num_devices; dev++) {
+        sync->clocks.push_back(voxel3d_clock_create(config->clock_window));
+        if (!sync->clocks.back()) {
+            voxel3d_sync_destroy(sync);
+            return NULL;
+        }
+    }
+    return sync;
+}
+
+extern "C" int voxel3d_sync_next(sync_t *sync, SyncFrameset *group, unsigned int timeout_ms)
+{
+    AcquisitionFrameset *frameset;
+
+    if (!sync || !group)
+        return -1;
+
+    unsigned long long deadline = voxel3d_host_time_us() + timeout_ms * 1000ULL;
+    for (;;) {
+        while ((frameset = voxel3d_acquisition_pop(sync->acq, 0)))
+            enqueue(sync, frameset);
+
+        unsigned long long now = voxel3d_host_time_us();
+        if (try_match(sync, group, now))
+            return true;
+        if (now >= deadline)
+            return 0;
+
+        /* sleep until a frameset arrives, the deadline, or a partial match is due */
+        unsigned long long wake = deadline;
+        for (unsigned int dev = 0; dev < sync->num_devices; dev++) {
+            if (!sync->pending[dev].empty() &&
+                sync->pending[dev].front().arrival_us + sync->max_wait_us < wake)
+                wake = sync->pending[dev].front().arrival_us + sync->max_wait_us;
+        }
+        unsigned int wait_ms = wake > now ? (unsigned int)((wake - now + 999) / 1000) : 1;
+        if ((frameset = voxel3d_acquisition_pop(sync->acq, wait_ms)))
+            enqueue(sync, frameset);
+    }
+}
+
+extern "C" void voxel3d_sync_release(sync_t *sync, SyncFrameset *group)
+{
+    if (!sync || !group)
+        return;
+
+    for (unsigned int dev = 0; dev < group->num_devices; dev++) {
+        if (group->frameset[dev])
+            voxel3d_acquisition_release(sync->acq, group->frameset[dev]);
+        group->frameset[dev] = NULL;
+    }
+    group->matched = 0;
+}
+
+extern "C" int voxel3d_sync_get_stats(sync_t *sync, SyncStats *stats)
+{
+    if (!sync || !stats)
+        return -1;
+
+    *stats = sync->stats;
+    return true;
+}
+
+extern "C" int voxel3d_sync_get_clock(sync_t *sync, unsigned int device, ClockEstimate *estimate)
+{
+    if (!sync || device >= sync->num_devices)
+        return -1;
+
+    return voxel3d_clock_get_estimate(sync->clocks[device], estimate);
+}
+
+extern "C" void voxel3d_sync_destroy(sync_t *sync)
+{
+    if (!sync)
+        return;
+
+    for (unsigned int dev = 0; dev < sync->num_devices; dev++) {
+        for (PendingFrameset &pending : sync->pending[dev])
+            voxel3d_acquisition_release(sync->acq, pending.frameset);
+    }
+    for (clock_estimator_t *clk : sync->clocks)
+        voxel3d_clock_destroy(clk);
+    delete sync;
+}
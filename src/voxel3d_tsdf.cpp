@@ -0,0 +1,1147 @@
+/**
+ @file      voxel3d_tsdf.cpp
+ @brief     TSDF fusion into hashed voxel blocks, raycasting and incremental marching cubes
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TSDF_SSE2
+#endif
+
+#include "voxel3d_calibration.h"
+#include "voxel3d_pointcloud.h"
+#include "voxel3d_tsdf.h"
+
+#define BLOCK_VOXELS            (TSDF_BLOCK_SIZE * TSDF_BLOCK_SIZE * TSDF_BLOCK_SIZE)
+#define BLOCK_SHIFT             (3)             /* log2(TSDF_BLOCK_SIZE) */
+#define BLOCK_MASK              (TSDF_BLOCK_SIZE - 1)
+#define BLOCKS_PER_PAGE         (256)
+#define MIN_SLOTS               (1024)
+#define EMPTY_KEY               (~0ULL)         /* packed keys use 63 bits */
+#define COORD_BITS              (21)
+#define COORD_OFFSET            (1 << (COORD_BITS - 1))
+#define TSDF_SCALE              (32767.f)       /* distance 1 (the truncation) as a short */
+#define NO_BLOCK                (0xFFFFFFFFu)
+#define NO_COORD                (0x7FFFFFFF)    /* no block, voxel coordinates are shifted */
+#define RANGE_TILE              (8)             /* pixels per side of a raycast range tile */
+#define RAY_STEP_RATIO          (0.8f)          /* of the distance read, to step the ray */
+#define RAY_MIN_STEP_VOXELS     (2)             /* the crossing is interpolated anyway */
+#define RAY_MAX_STEPS           (64)            /* samples before a ray grazing a surface
+                                                   gives up */
+#define MAX_CASE_TRIANGLES      (8)             /* the generated cases need up to 5 */
+#define GRID_SIDE               (TSDF_BLOCK_SIZE + 1)
+
+enum RayResult
+{
+    RAY_MISS,
+    RAY_HIT,
+    RAY_GAVE_UP,                                /* RAY_MAX_STEPS along a grazed surface */
+};
+
+struct TsdfVoxel {
+    short tsdf;                                 /* distance / truncation * TSDF_SCALE */
+    unsigned short weight;                      /* 0 until observed */
+};
+
+struct TsdfBlock {
+    TsdfVoxel voxels[BLOCK_VOXELS];             /* x first, voxel i at i * voxel meters */
+};
+
+struct BlockSlot {
+    unsigned long long key;
+    unsigned int block;
+};
+
+/* Last block looked up by a thread, neighbouring samples mostly share it, NULL when the
+   block isn't allocated */
+struct BlockCache {
+    int coord[3];
+    const TsdfBlock *block;
+    bool clear, positive;                       /* see tsdf_volume.clear, .positive */
+};
+
+/* Triangles of the cubes, by the inside (negative) corners as 8 bits */
+struct CubeCases {
+    signed char edges[256][MAX_CASE_TRIANGLES * 3 + 1];    /* -1 terminated */
+    unsigned char corner[12][2];
+};
+
+struct tsdf_volume {
+    TsdfConfig config;
+    CameraInfo cam;
+    float inv_voxel;
+    std::vector<float> rays;                    /* ray table of cam */
+
+    std::vector<BlockSlot> slots;               /* open addressing, at most half full */
+    std::vector<std::vector<TsdfBlock> > pages; /* BLOCKS_PER_PAGE blocks, never moved */
+    std::vector<int> coords;                    /* 3 per block */
+    std::vector<unsigned int> stamp;            /* last frame touching a block */
+    std::vector<unsigned char> updated;         /* blocks whose cells the frame changed, bit c
+                                                   for the block at -(c & 1, c >> 1 & 1,
+                                                   c >> 2 & 1), see integrate_block() */
+    std::vector<unsigned char> dirty;           /* changed since the last mesh update */
+    std::vector<unsigned char> clear;           /* every voxel observed a truncation or more
+                                                   in front of the surface, the raycast
+                                                   jumps over the block */
+    std::vector<unsigned char> positive;        /* every voxel observed in front of the
+                                                   surface, no crossing inside the block */
+    std::vector<std::vector<float> > meshes;    /* 9 floats per triangle, per block */
+    unsigned int num_blocks;
+    unsigned int frame;
+
+    std::vector<unsigned int> touched;          /* blocks of the frame, or to mesh */
+    std::vector<unsigned int> pixel_tile;       /* raycast range tile of each pixel */
+    std::vector<float> tile_near, tile_far;     /* camera depth range of the blocks of a tile */
+    int tiles_x, tiles_y;
+    float tile_x0, tile_y0, tile_scale_x, tile_scale_y;
+
+    /* current job */
+    const unsigned short *depthmap;
+    float rot[9], trans[3];                     /* camera to world */
+    float inv_rot[9], inv_trans[3];             /* world to camera */
+    float *xyz, *normals;
+    int hits[TOF_DEPTH_HEIGHT], gave_up[TOF_DEPTH_HEIGHT];
+    std::vector<unsigned char> gave_up_pixels;  /* 1 where the ray of the last raycast gave up */
+};
+
+/*
+ * The cases are generated instead of typed in: on each face the segments cut the runs of
+ * inside corners off, so the two cubes of a face agree on it and the mesh has no holes, then
+ * the segments of a cube chain into polygons split into fans.
+ */
+static const CubeCases &cube_cases()
+{
+    static const struct Table : CubeCases {
+        Table()
+        {
+            /* corner c at (c & 1, c >> 1 & 1, c >> 2 & 1), 4 edges along each axis */
+            for (int axis = 0; axis < 3; axis++) {
+                int k = 0;
+                for (int c = 0; c < 8; c++) {
+                    if (c & (1 << axis))
+                        continue;
+                    corner[axis * 4 + k][0] = (unsigned char)c;
+                    corner[axis * 4 + k][1] = (unsigned char)(c | (1 << axis));
+                    k++;
+                }
+            }
+
+            for (int cs = 0; cs < 256; cs++) {
+                int next[12], count = 0;
+
+                for (int e = 0; e < 12; e++)
+                    next[e] = -1;
+                for (int face = 0; face < 6; face++)
+                    link_face(cs, face >> 1, face & 1, next);
+
+                /* chain the segments into polygons */
+                bool used[12] = { false };
+                for (int e = 0; e < 12; e++) {
+                    if (next[e] < 0 || used[e])
+                        continue;
+
+                    int polygon[12], size = 0;
+                    for (int at = e; !used[at]; at = next[at]) {
+                        used[at] = true;
+                        polygon[size++] = at;
+                    }
+
+                    /* a fan whose diagonals leave the faces, else the neighbour cube may
+                       put a triangle on the same diagonal */
+                    int start = 0;
+                    for (int s = 0; s < size; s++) {
+                        bool inside = true;
+                        for (int ix = 2; ix + 1 < size; ix++)
+                            inside = inside && !on_face(polygon[s], polygon[(s + ix) % size]);
+                        if (inside) {
+                            start = s;
+                            break;
+                        }
+                    }
+                    for (int ix = 1; ix + 1 < size; ix++) {
+                        edges[cs][count++] = (signed char)polygon[start];
+                        edges[cs][count++] = (signed char)polygon[(start + ix + 1) % size];
+                        edges[cs][count++] = (signed char)polygon[(start + ix) % size];
+                    }
+                }
+                edges[cs][count] = -1;
+            }
+        }
+
+        int edge_of(int a, int b) const
+        {
+            for (int e = 0; e < 12; e++) {
+                if ((corner[e][0] == a && corner[e][1] == b) ||
+                    (corner[e][0] == b && corner[e][1] == a))
+                    return e;
+            }
+            return -1;
+        }
+
+        bool on_face(int e, int f) const
+        {
+            for (int axis = 0; axis < 3; axis++) {
+                if (e >> 2 != axis && f >> 2 != axis &&
+                    (corner[e][0] >> axis & 1) == (corner[f][0] >> axis & 1))
+                    return true;
+            }
+            return false;
+        }
+
+        /* Segments of a face, from the edge leaving a run of inside corners (counter-clockwise
+           seen from outside the cube) to the edge entering it */
+        void link_face(int cs, int axis, int side, int *next) const
+        {
+            int b = (axis + 1) % 3, c = (axis + 2) % 3, ring[4];
+            static const int pq[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+
+            for (int ix = 0; ix < 4; ix++) {
+                int at = side ? ix : 3 - ix;
+                ring[ix] = side << axis | pq[at][0] << b | pq[at][1] << c;
+            }
+            for (int ix = 0; ix < 4; ix++) {
+                int from = ring[ix], to = ring[(ix + 1) & 3];
+                if (!(cs >> from & 1) || (cs >> to & 1))
+                    continue;
+
+                int back = ix;
+                while (cs >> ring[(back + 3) & 3] & 1)
+                    back = (back + 3) & 3;
+                next[edge_of(from, to)] = edge_of(ring[(back + 3) & 3], ring[back]);
+            }
+        }
+    } table;
+
+    return table;
+}
+
+static inline unsigned long long hash_key(unsigned long long key)
+{
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    return key ^ (key >> 31);
+}
+
+static inline unsigned long long block_key(int x, int y, int z)
+{
+    return (unsigned long long)(x + COORD_OFFSET) << (COORD_BITS * 2) |
+           (unsigned long long)(y + COORD_OFFSET) << COORD_BITS |
+           (unsigned long long)(z + COORD_OFFSET);
+}
+
+static inline bool coord_in_range(int x, int y, int z)
+{
+    return x >= -COORD_OFFSET && x < COORD_OFFSET && y >= -COORD_OFFSET && y < COORD_OFFSET &&
+           z >= -COORD_OFFSET && z < COORD_OFFSET;
+}
+
+static inline TsdfBlock *block_at(tsdf_volume_t *vol, unsigned int block)
+{
+    return &vol->pages[block / BLOCKS_PER_PAGE][block % BLOCKS_PER_PAGE];
+}
+
+static unsigned int find_block(const tsdf_volume_t *vol, int x, int y, int z)
+{
+    if (!coord_in_range(x, y, z))
+        return NO_BLOCK;
+
+    unsigned long long key = block_key(x, y, z);
+    size_t mask = vol->slots.size() - 1;
+    size_t slot = (size_t)hash_key(key) & mask;
+
+    for (;;) {
+        const BlockSlot &probe = vol->slots[slot];
+        if (probe.key == key)
+            return probe.block;
+        if (probe.key == EMPTY_KEY)
+            return NO_BLOCK;
+        slot = (slot + 1) & mask;
+    }
+}
+
+static void place_block(tsdf_volume_t *vol, unsigned long long key, unsigned int block)
+{
+    size_t mask = vol->slots.size() - 1;
+    size_t slot = (size_t)hash_key(key) & mask;
+
+    while (vol->slots[slot].key != EMPTY_KEY)
+        slot = (slot + 1) & mask;
+    vol->slots[slot].key = key;
+    vol->slots[slot].block = block;
+}
+
+/* Block of a coordinate, allocated when new and below max_blocks */
+static unsigned int allocate_block(tsdf_volume_t *vol, int x, int y, int z)
+{
+    if (!coord_in_range(x, y, z))
+        return NO_BLOCK;
+
+    unsigned long long key = block_key(x, y, z);
+    size_t mask = vol->slots.size() - 1;
+    size_t slot = (size_t)hash_key(key) & mask;
+
+    for (;;) {
+        const BlockSlot &probe = vol->slots[slot];
+        if (probe.key == key)
+            return probe.block;
+        if (probe.key == EMPTY_KEY)
+            break;
+        slot = (slot + 1) & mask;
+    }
+    if (vol->num_blocks >= vol->config.max_blocks)
+        return NO_BLOCK;
+
+    unsigned int block = vol->num_blocks++;
+    if (block / BLOCKS_PER_PAGE >= vol->pages.size()) {
+        vol->pages.emplace_back(BLOCKS_PER_PAGE);
+        vol->coords.resize(vol->pages.size() * BLOCKS_PER_PAGE * 3);
+        vol->stamp.resize(vol->pages.size() * BLOCKS_PER_PAGE);
+        vol->updated.resize(vol->pages.size() * BLOCKS_PER_PAGE);
+        vol->dirty.resize(vol->pages.size() * BLOCKS_PER_PAGE);
+        vol->clear.resize(vol->pages.size() * BLOCKS_PER_PAGE);
+        vol->positive.resize(vol->pages.size() * BLOCKS_PER_PAGE);
+        vol->meshes.resize(vol->pages.size() * BLOCKS_PER_PAGE);
+    }
+    memset(block_at(vol, block), 0, sizeof(TsdfBlock));
+    vol->coords[block * 3] = x;
+    vol->coords[block * 3 + 1] = y;
+    vol->coords[block * 3 + 2] = z;
+    vol->stamp[block] = 0;
+    vol->dirty[block] = 0;
+    vol->clear[block] = 0;
+    vol->positive[block] = 0;
+    vol->meshes[block].clear();
+
+    /* the slots grow with the blocks, so that the probes of a frame stay in cache */
+    if (vol->num_blocks * 2 > vol->slots.size()) {
+        vol->slots.assign(vol->slots.size() * 2, BlockSlot{ EMPTY_KEY, 0 });
+        for (unsigned int ix = 0; ix < vol->num_blocks; ix++) {
+            const int *coord = &vol->coords[ix * 3];
+            place_block(vol, block_key(coord[0], coord[1], coord[2]), ix);
+        }
+    }
+    else {
+        vol->slots[slot].key = key;
+        vol->slots[slot].block = block;
+    }
+    return block;
+}
+
+static inline int floor_int(float value)
+{
+    /* floor without the libm call, the cast truncates towards zero */
+    int index = (int)value;
+    return index - (value < (float)index);
+}
+
+static const TsdfVoxel *voxel_at(tsdf_volume_t *vol, BlockCache *cache, int x, int y, int z)
+{
+    /* arithmetic shifts, so negative coordinates round down */
+    int bx = x >> BLOCK_SHIFT, by = y >> BLOCK_SHIFT, bz = z >> BLOCK_SHIFT;
+
+    if (bx != cache->coord[0] || by != cache->coord[1] || bz != cache->coord[2]) {
+        unsigned int block = find_block(vol, bx, by, bz);
+        cache->coord[0] = bx;
+        cache->coord[1] = by;
+        cache->coord[2] = bz;
+        cache->block = block == NO_BLOCK ? NULL : block_at(vol, block);
+        cache->clear = block != NO_BLOCK && vol->clear[block];
+        cache->positive = block != NO_BLOCK && vol->positive[block];
+    }
+    if (!cache->block)
+        return NULL;
+    return &cache->block->voxels[((z & BLOCK_MASK) * TSDF_BLOCK_SIZE + (y & BLOCK_MASK)) *
+                                 TSDF_BLOCK_SIZE + (x & BLOCK_MASK)];
+}
+
+/*
+ * Trilinear distance at a world point, in truncations, and its gradient when asked; false
+ * next to unobserved voxels
+ */
+static bool sample_tsdf(tsdf_volume_t *vol, BlockCache *cache, const float *p, float *tsdf,
+                        float *gradient)
+{
+    float f[3], corner[8];
+    int base[3];
+
+    for (int axis = 0; axis < 3; axis++) {
+        float g = p[axis] * vol->inv_voxel;
+        base[axis] = floor_int(g);
+        f[axis] = g - (float)base[axis];
+    }
+
+    /* the 8 corners mostly lie in one block, found once then */
+    const TsdfVoxel *first = voxel_at(vol, cache, base[0], base[1], base[2]);
+    if (!first)
+        return false;
+
+    /* on the last voxel of an axis the corners past it are in the next block there, each
+       neighbour is looked up once rather than switching the cache back and forth */
+    int edge = ((base[0] & BLOCK_MASK) == BLOCK_MASK) |
+               ((base[1] & BLOCK_MASK) == BLOCK_MASK) << 1 |
+               ((base[2] & BLOCK_MASK) == BLOCK_MASK) << 2;
+    const TsdfBlock *blocks[8] = { cache->block };
+    for (int c = 0; c < 8; c++) {
+        const TsdfVoxel *voxel;
+        int other = c & edge;
+        if (!other) {
+            voxel = first + ((c >> 2 & 1) * TSDF_BLOCK_SIZE + (c >> 1 & 1)) * TSDF_BLOCK_SIZE +
+                    (c & 1);
+        }
+        else {
+            if (!blocks[other]) {
+                unsigned int block = find_block(vol, cache->coord[0] + (other & 1),
+                                                cache->coord[1] + (other >> 1 & 1),
+                                                cache->coord[2] + (other >> 2 & 1));
+                if (block == NO_BLOCK)
+                    return false;
+                blocks[other] = block_at(vol, block);
+            }
+            int x = (base[0] + (c & 1)) & BLOCK_MASK, y = (base[1] + (c >> 1 & 1)) & BLOCK_MASK;
+            int z = (base[2] + (c >> 2 & 1)) & BLOCK_MASK;
+            voxel = &blocks[other]->voxels[(z * TSDF_BLOCK_SIZE + y) * TSDF_BLOCK_SIZE + x];
+        }
+        if (!voxel->weight)
+            return false;
+        corner[c] = (float)voxel->tsdf * (1.f / TSDF_SCALE);
+    }
+
+    /* along x, then y, then z */
+    float x00 = corner[0] + (corner[1] - corner[0]) * f[0];
+    float x10 = corner[2] + (corner[3] - corner[2]) * f[0];
+    float x01 = corner[4] + (corner[5] - corner[4]) * f[0];
+    float x11 = corner[6] + (corner[7] - corner[6]) * f[0];
+    float y0 = x00 + (x10 - x00) * f[1], y1 = x01 + (x11 - x01) * f[1];
+    *tsdf = y0 + (y1 - y0) * f[2];
+
+    if (gradient) {
+        float dx00 = corner[1] - corner[0], dx10 = corner[3] - corner[2];
+        float dx01 = corner[5] - corner[4], dx11 = corner[7] - corner[6];
+        float dx0 = dx00 + (dx10 - dx00) * f[1], dx1 = dx01 + (dx11 - dx01) * f[1];
+        float dy0 = x10 - x00, dy1 = x11 - x01;
+        gradient[0] = dx0 + (dx1 - dx0) * f[2];
+        gradient[1] = dy0 + (dy1 - dy0) * f[2];
+        gradient[2] = y1 - y0;
+    }
+    return true;
+}
+
+static void load_pose(const float *pose, float *rot, float *trans, float *inv_rot,
+                      float *inv_trans)
+{
+    static const float identity[12] = {
+        1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f
+    };
+
+    if (!pose)
+        pose = identity;
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 3; col++) {
+            rot[row * 3 + col] = pose[row * 4 + col];
+            inv_rot[col * 3 + row] = pose[row * 4 + col];
+        }
+        trans[row] = pose[row * 4 + 3];
+    }
+    for (int row = 0; row < 3; row++) {
+        inv_trans[row] = -(inv_rot[row * 3] * trans[0] + inv_rot[row * 3 + 1] * trans[1] +
+                           inv_rot[row * 3 + 2] * trans[2]);
+    }
+}
+
+/* Serial, the blocks within truncation of the sampled depth pixels */
+static void allocate_blocks(tsdf_volume_t *vol)
+{
+    float block_side = vol->config.voxel * TSDF_BLOCK_SIZE;
+    float block_scale = vol->inv_voxel / TSDF_BLOCK_SIZE;
+
+    vol->touched.clear();
+    for (int v = 0; v < TOF_DEPTH_HEIGHT; v += TSDF_ALLOC_STRIDE) {
+        for (int u = 0; u < TOF_DEPTH_WIDTH; u += TSDF_ALLOC_STRIDE) {
+            int ix = v * TOF_DEPTH_WIDTH + u;
+            float depth = vol->depthmap[ix] * POINTCLOUD_DEPTH_UNIT_M;
+            if (depth < vol->config.min_depth || depth > vol->config.max_depth)
+                continue;
+
+            float ray[3] = { vol->rays[ix * 2], vol->rays[ix * 2 + 1], 1.f }, dir[3];
+            for (int row = 0; row < 3; row++) {
+                dir[row] = vol->rot[row * 3] * ray[0] + vol->rot[row * 3 + 1] * ray[1] +
+                           vol->rot[row * 3 + 2] * ray[2];
+            }
+
+            /* half-block steps along [depth - truncation, depth + truncation] */
+            float length = sqrtf(ray[0] * ray[0] + ray[1] * ray[1] + 1.f);
+            float near = depth - vol->config.truncation, far = depth + vol->config.truncation;
+            float step = block_side * 0.5f / length;
+            int last[3] = { 0, 0, 0 };
+            bool first = true;
+
+            for (float z = near; ; z += step) {
+                if (z > far)
+                    z = far;
+
+                int coord[3];
+                for (int axis = 0; axis < 3; axis++)
+                    coord[axis] = floor_int((vol->trans[axis] + dir[axis] * z) * block_scale);
+                if (first || coord[0] != last[0] || coord[1] != last[1] ||
+                    coord[2] != last[2]) {
+                    unsigned int block = allocate_block(vol, coord[0], coord[1], coord[2]);
+                    if (block != NO_BLOCK && vol->stamp[block] != vol->frame) {
+                        vol->stamp[block] = vol->frame;
+                        vol->touched.push_back(block);
+                    }
+                    memcpy(last, coord, sizeof(last));
+                    first = false;
+                }
+                if (z >= far)
+                    break;
+            }
+        }
+    }
+}
+
+/*
+ * Pixels and camera depths of a row of TSDF_BLOCK_SIZE voxels from the camera point p of the
+ * first one, step apart, pixel -1 where the voxel is out of the depth frame; forward lens
+ * model, see voxel3d_calibration_build_rays()
+ */
+static void project_row(const tsdf_volume_t *vol, const float *p, const float *step,
+                        int *pixel, float *cam_z)
+{
+    const CameraInfo &ci = vol->cam;
+
+#ifdef TSDF_SSE2
+    for (int i = 0; i < TSDF_BLOCK_SIZE; i += 4) {
+        __m128 lane = _mm_set_ps((float)(i + 3), (float)(i + 2), (float)(i + 1), (float)i);
+        __m128 z = _mm_add_ps(_mm_set1_ps(p[2]), _mm_mul_ps(_mm_set1_ps(step[2]), lane));
+        __m128 inv_z = _mm_div_ps(_mm_set1_ps(1.f), z);
+        __m128 x = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(p[0]),
+                                         _mm_mul_ps(_mm_set1_ps(step[0]), lane)), inv_z);
+        __m128 y = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(p[1]),
+                                         _mm_mul_ps(_mm_set1_ps(step[1]), lane)), inv_z);
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), xy = _mm_mul_ps(x, y);
+        __m128 r2 = _mm_add_ps(xx, yy);
+        __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f);
+
+        __m128 num = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ci.K3), r2), _mm_set1_ps(ci.K2));
+        num = _mm_add_ps(_mm_mul_ps(num, r2), _mm_set1_ps(ci.K1));
+        num = _mm_add_ps(_mm_mul_ps(num, r2), one);
+        __m128 den = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ci.K6), r2), _mm_set1_ps(ci.K5));
+        den = _mm_add_ps(_mm_mul_ps(den, r2), _mm_set1_ps(ci.K4));
+        den = _mm_add_ps(_mm_mul_ps(den, r2), one);
+        __m128 cdist = _mm_div_ps(num, den);
+
+        __m128 p1 = _mm_set1_ps(ci.P1), p2 = _mm_set1_ps(ci.P2);
+        __m128 xd = _mm_add_ps(_mm_mul_ps(x, cdist),
+                               _mm_add_ps(_mm_mul_ps(_mm_mul_ps(two, p1), xy),
+                                          _mm_mul_ps(p2, _mm_add_ps(r2, _mm_mul_ps(two, xx)))));
+        __m128 yd = _mm_add_ps(_mm_mul_ps(y, cdist),
+                               _mm_add_ps(_mm_mul_ps(p1, _mm_add_ps(r2, _mm_mul_ps(two, yy))),
+                                          _mm_mul_ps(_mm_mul_ps(two, p2), xy)));
+        __m128 u = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ci.focalLengthFx), xd),
+                              _mm_set1_ps(ci.principalPointCx + 0.5f));
+        __m128 v = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ci.focalLengthFy), yd),
+                              _mm_set1_ps(ci.principalPointCy + 0.5f));
+
+        /* ordered compares, NaN fails too */
+        __m128 in = _mm_and_ps(_mm_cmpge_ps(z, _mm_set1_ps(vol->config.min_depth)),
+                               _mm_and_ps(_mm_cmpge_ps(u, _mm_setzero_ps()),
+                                          _mm_cmplt_ps(u, _mm_set1_ps(TOF_DEPTH_WIDTH))));
+        in = _mm_and_ps(in, _mm_and_ps(_mm_cmpge_ps(v, _mm_setzero_ps()),
+                                       _mm_cmplt_ps(v, _mm_set1_ps(TOF_DEPTH_HEIGHT))));
+        int mask = _mm_movemask_ps(in);
+        int cols[4], rows[4];
+        _mm_storeu_si128((__m128i *)cols, _mm_cvttps_epi32(u));
+        _mm_storeu_si128((__m128i *)rows, _mm_cvttps_epi32(v));
+        _mm_storeu_ps(cam_z + i, z);
+        for (int lane_ix = 0; lane_ix < 4; lane_ix++) {
+            pixel[i + lane_ix] = mask >> lane_ix & 1 ?
+                                 rows[lane_ix] * TOF_DEPTH_WIDTH + cols[lane_ix] : -1;
+        }
+    }
+#else
+    for (int i = 0; i < TSDF_BLOCK_SIZE; i++) {
+        float x = p[0] + step[0] * i, y = p[1] + step[1] * i, z = p[2] + step[2] * i;
+
+        cam_z[i] = z;
+        pixel[i] = -1;
+        if (z < vol->config.min_depth)
+            continue;
+
+        float inv_z = 1.f / z;
+        x *= inv_z;
+        y *= inv_z;
+        float r2 = x * x + y * y;
+        float cdist = (1 + ((ci.K3 * r2 + ci.K2) * r2 + ci.K1) * r2) /
+                      (1 + ((ci.K6 * r2 + ci.K5) * r2 + ci.K4) * r2);
+        float u = ci.focalLengthFx * (x * cdist + 2 * ci.P1 * x * y + ci.P2 * (r2 + 2 * x * x)) +
+                  ci.principalPointCx + 0.5f;
+        float v = ci.focalLengthFy * (y * cdist + ci.P1 * (r2 + 2 * y * y) + 2 * ci.P2 * x * y) +
+                  ci.principalPointCy + 0.5f;
+        /* written so that NaN fails too */
+        if (u >= 0.f && u < TOF_DEPTH_WIDTH && v >= 0.f && v < TOF_DEPTH_HEIGHT)
+            pixel[i] = (int)v * TOF_DEPTH_WIDTH + (int)u;
+    }
+#endif
+}
+
+/* Task of a block, its voxels projected into the depth frame */
+static void integrate_block(void *user, unsigned int task)
+{
+    tsdf_volume_t *vol = (tsdf_volume_t *)user;
+    unsigned int block = vol->touched[task];
+    TsdfVoxel *voxel = block_at(vol, block)->voxels;
+    const float *r = vol->inv_rot;
+    float voxel_size = vol->config.voxel, inv_trunc = 1.f / vol->config.truncation;
+    float world[3], base[3], step[3] = { r[0] * voxel_size, r[3] * voxel_size, r[6] * voxel_size };
+    unsigned char updated = 0;
+
+    /* voxels on the low faces are corners of the cells of the neighbours there too, one per
+       subset of the axes they lie on */
+    static const unsigned char subsets[8] = { 0x01, 0x03, 0x05, 0x0F, 0x11, 0x33, 0x55, 0xFF };
+
+    /* camera point of the first voxel, then steps of one voxel along each world axis */
+    for (int axis = 0; axis < 3; axis++)
+        world[axis] = (float)(vol->coords[block * 3 + axis] * TSDF_BLOCK_SIZE) * voxel_size;
+    for (int row = 0; row < 3; row++) {
+        base[row] = r[row * 3] * world[0] + r[row * 3 + 1] * world[1] + r[row * 3 + 2] * world[2] +
+                    vol->inv_trans[row];
+    }
+
+    for (int k = 0; k < TSDF_BLOCK_SIZE; k++) {
+        for (int j = 0; j < TSDF_BLOCK_SIZE; j++, voxel += TSDF_BLOCK_SIZE) {
+            float p[3], z[TSDF_BLOCK_SIZE];
+            int pixel[TSDF_BLOCK_SIZE];
+
+            for (int row = 0; row < 3; row++)
+                p[row] = base[row] + (r[row * 3 + 1] * j + r[row * 3 + 2] * k) * voxel_size;
+            project_row(vol, p, step, pixel, z);
+
+            for (int i = 0; i < TSDF_BLOCK_SIZE; i++) {
+                if (pixel[i] < 0)
+                    continue;
+                float depth = vol->depthmap[pixel[i]] * POINTCLOUD_DEPTH_UNIT_M;
+                if (depth < vol->config.min_depth || depth > vol->config.max_depth)
+                    continue;
+
+                /* nothing is known behind the surface beyond truncation */
+                float sdf = (depth - z[i]) * inv_trunc;
+                if (sdf < -1.f)
+                    continue;
+                if (sdf > 1.f)
+                    sdf = 1.f;
+
+                /* running average, the weight capped so that the volume follows changes */
+                unsigned int weight = voxel[i].weight;
+                float tsdf = ((float)voxel[i].tsdf * weight + sdf * TSDF_SCALE) / (weight + 1);
+                voxel[i].tsdf = (short)(tsdf + (tsdf < 0.f ? -0.5f : 0.5f));
+                voxel[i].weight = (unsigned short)(weight < vol->config.max_weight ? weight + 1 :
+                                                   weight);
+                updated |= subsets[(i == 0) | (j == 0) << 1 | (k == 0) << 2];
+            }
+        }
+    }
+    vol->updated[block] = updated;
+
+    /* saturated everywhere, nothing for a ray to find in the block, or positive everywhere,
+       no crossing before the cells it shares with the next block */
+    bool clear = true, positive = true;
+    voxel = block_at(vol, block)->voxels;
+    for (int ix = 0; ix < BLOCK_VOXELS && positive; ix++) {
+        positive = voxel[ix].weight && voxel[ix].tsdf > 0;
+        clear = clear && voxel[ix].tsdf == (short)TSDF_SCALE;
+    }
+    vol->clear[block] = clear && positive;
+    vol->positive[block] = positive;
+}
+
+/* Serial, the camera depth range of the blocks in front of each range tile */
+static void project_blocks(tsdf_volume_t *vol)
+{
+    float side = vol->config.voxel * TSDF_BLOCK_SIZE;
+    const float *r = vol->inv_rot;
+
+    for (size_t ix = 0; ix < vol->tile_near.size(); ix++) {
+        vol->tile_near[ix] = vol->config.max_depth;
+        vol->tile_far[ix] = 0.f;
+    }
+    for (unsigned int block = 0; block < vol->num_blocks; block++) {
+        float world[3], origin[3], c[8][3];
+        for (int axis = 0; axis < 3; axis++)
+            world[axis] = (float)(vol->coords[block * 3 + axis] * TSDF_BLOCK_SIZE) *
+                          vol->config.voxel;
+        for (int row = 0; row < 3; row++) {
+            origin[row] = r[row * 3] * world[0] + r[row * 3 + 1] * world[1] +
+                          r[row * 3 + 2] * world[2] + vol->inv_trans[row];
+        }
+
+        /* the corners of the block in the camera */
+        float near = vol->config.max_depth, far = 0.f;
+        for (int corner = 0; corner < 8; corner++) {
+            for (int row = 0; row < 3; row++) {
+                c[corner][row] = origin[row] + ((corner & 1) * r[row * 3] +
+                                                (corner >> 1 & 1) * r[row * 3 + 1] +
+                                                (corner >> 2 & 1) * r[row * 3 + 2]) * side;
+            }
+            near = c[corner][2] < near ? c[corner][2] : near;
+            far = c[corner][2] > far ? c[corner][2] : far;
+        }
+        if (far < vol->config.min_depth || near >= vol->config.max_depth)
+            continue;
+
+        float x0 = vol->tile_x0, x1 = vol->tile_x0 + vol->tiles_x / vol->tile_scale_x;
+        float y0 = vol->tile_y0, y1 = vol->tile_y0 + vol->tiles_y / vol->tile_scale_y;
+        if (near >= vol->config.min_depth) {
+            x0 = y0 = 1e9f;
+            x1 = y1 = -1e9f;
+            for (int corner = 0; corner < 8; corner++) {
+                float x = c[corner][0] / c[corner][2], y = c[corner][1] / c[corner][2];
+                x0 = x < x0 ? x : x0;
+                x1 = x > x1 ? x : x1;
+                y0 = y < y0 ? y : y0;
+                y1 = y > y1 ? y : y1;
+            }
+        }
+        else {
+            /* across the near plane, all the tiles */
+            near = vol->config.min_depth;
+        }
+
+        int tx0 = floor_int((x0 - vol->tile_x0) * vol->tile_scale_x);
+        int tx1 = floor_int((x1 - vol->tile_x0) * vol->tile_scale_x);
+        int ty0 = floor_int((y0 - vol->tile_y0) * vol->tile_scale_y);
+        int ty1 = floor_int((y1 - vol->tile_y0) * vol->tile_scale_y);
+        tx0 = tx0 < 0 ? 0 : tx0;
+        ty0 = ty0 < 0 ? 0 : ty0;
+        tx1 = tx1 >= vol->tiles_x ? vol->tiles_x - 1 : tx1;
+        ty1 = ty1 >= vol->tiles_y ? vol->tiles_y - 1 : ty1;
+
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++) {
+                int tile = ty * vol->tiles_x + tx;
+                if (near < vol->tile_near[tile])
+                    vol->tile_near[tile] = near;
+                if (far > vol->tile_far[tile])
+                    vol->tile_far[tile] = far;
+            }
+        }
+    }
+}
+
+/* Depth to go along a ray from the voxel coordinates g to where it leaves the block of the
+   cache, at most limit */
+static inline float block_exit(const tsdf_volume_t *vol, const BlockCache *cache,
+                               const float *g, const float *dir, float limit)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        float rate = dir[axis] * vol->inv_voxel;
+        float side = (float)(cache->coord[axis] + (rate > 0.f)) * TSDF_BLOCK_SIZE;
+        if (rate != 0.f && (side - g[axis]) / rate < limit)
+            limit = (side - g[axis]) / rate;
+    }
+    return limit;
+}
+
+/* First zero crossing along the ray of a pixel, from the positive side */
+static RayResult cast_ray(tsdf_volume_t *vol, BlockCache *cache, int ix, float *hit,
+                          float *normal)
+{
+    unsigned int tile = vol->pixel_tile[ix];
+    float z = vol->tile_near[tile], far = vol->tile_far[tile];
+    if (z >= far)
+        return RAY_MISS;
+    if (far > vol->config.max_depth)
+        far = vol->config.max_depth;
+
+    float ray[3] = { vol->rays[ix * 2], vol->rays[ix * 2 + 1], 1.f }, dir[3];
+    for (int row = 0; row < 3; row++) {
+        dir[row] = vol->rot[row * 3] * ray[0] + vol->rot[row * 3 + 1] * ray[1] +
+                   vol->rot[row * 3 + 2] * ray[2];
+    }
+    float inv_length = 1.f / sqrtf(ray[0] * ray[0] + ray[1] * ray[1] + 1.f);
+    float voxel_step = vol->config.voxel * RAY_MIN_STEP_VOXELS * inv_length;
+    float trunc_step = vol->config.truncation * RAY_STEP_RATIO * inv_length;
+    float last_z = -1.f, last_tsdf = 0.f, tsdf = 0.f, p[3];
+    int steps = 0;
+
+    for (; z <= far; ) {
+        if (++steps > RAY_MAX_STEPS)
+            return RAY_GAVE_UP;
+
+        for (int axis = 0; axis < 3; axis++)
+            p[axis] = vol->trans[axis] + dir[axis] * z;
+
+        /* nearest voxel while marching */
+        float g[3] = { p[0] * vol->inv_voxel + 0.5f, p[1] * vol->inv_voxel + 0.5f,
+                       p[2] * vol->inv_voxel + 0.5f };
+        const TsdfVoxel *voxel = voxel_at(vol, cache, floor_int(g[0]), floor_int(g[1]),
+                                          floor_int(g[2]));
+        if (!voxel || cache->clear) {
+            /* on to where the ray leaves the block, in front of the surface through a clear
+               one */
+            if (voxel) {
+                last_z = z;
+                last_tsdf = 1.f;
+            }
+            else {
+                last_z = -1.f;
+            }
+            z += block_exit(vol, cache, g, dir, far - z) +
+                 vol->config.voxel * 0.01f * inv_length;
+            continue;
+        }
+        if (!voxel->weight) {
+            last_z = -1.f;
+            z += trunc_step;
+            continue;
+        }
+
+        tsdf = (float)voxel->tsdf * (1.f / TSDF_SCALE);
+        if (tsdf < 0.f) {
+            /* the back of a surface unless the ray came from its front */
+            if (last_z < 0.f)
+                return RAY_MISS;
+            break;
+        }
+        last_z = z;
+        last_tsdf = tsdf;
+
+        float step = tsdf * trunc_step > voxel_step ? tsdf * trunc_step : voxel_step;
+        if (cache->positive) {
+            /* no crossing inside the block, on to its last sample before the next one */
+            float exit = block_exit(vol, cache, g, dir, far - z) - voxel_step;
+            step = exit > step ? exit : step;
+        }
+        z += step;
+    }
+    if (z > far)
+        return RAY_MISS;
+
+    /* the crossing between the last two samples, interpolated, then one Newton step along
+       the trilinear distance there, whose gradient is the normal too */
+    float near_z = last_z, far_z = z, g[3];
+    z = last_z + (z - last_z) * last_tsdf / (last_tsdf - tsdf);
+    for (int axis = 0; axis < 3; axis++)
+        hit[axis] = vol->trans[axis] + dir[axis] * z;
+    if (normal)
+        normal[0] = normal[1] = normal[2] = 0.f;
+    if (!sample_tsdf(vol, cache, hit, &tsdf, g))
+        return RAY_HIT;
+
+    /* the gradient is per voxel and points to the positive side */
+    float slope = (g[0] * dir[0] + g[1] * dir[1] + g[2] * dir[2]) * vol->inv_voxel;
+    if (slope < 0.f) {
+        float newton = z - tsdf / slope;
+        z = newton < near_z ? near_z : newton > far_z ? far_z : newton;
+        for (int axis = 0; axis < 3; axis++)
+            hit[axis] = vol->trans[axis] + dir[axis] * z;
+    }
+    if (normal) {
+        float norm = g[0] * g[0] + g[1] * g[1] + g[2] * g[2];
+        if (norm > 0.f) {
+            norm = 1.f / sqrtf(norm);
+            for (int axis = 0; axis < 3; axis++)
+                normal[axis] = g[axis] * norm;
+        }
+    }
+    return RAY_HIT;
+}
+
+/* Task of a row of the raycast */
+static void raycast_row(void *user, unsigned int task)
+{
+    tsdf_volume_t *vol = (tsdf_volume_t *)user;
+    BlockCache cache = { { NO_COORD, NO_COORD, NO_COORD }, NULL, false, false };
+    int hits = 0, gave_up = 0;
+
+    for (int u = 0; u < TOF_DEPTH_WIDTH; u++) {
+        int ix = task * TOF_DEPTH_WIDTH + u;
+        float *p = vol->xyz + (size_t)ix * 3, *n = vol->normals ? vol->normals + (size_t)ix * 3 :
+                                                                  NULL;
+        RayResult result = cast_ray(vol, &cache, ix, p, n);
+        if (result == RAY_HIT) {
+            hits++;
+        }
+        else {
+            p[0] = p[1] = p[2] = 0.f;
+            if (n)
+                n[0] = n[1] = n[2] = 0.f;
+        }
+        vol->gave_up_pixels[ix] = result == RAY_GAVE_UP;
+        gave_up += result == RAY_GAVE_UP;
+    }
+    vol->hits[task] = hits;
+    vol->gave_up[task] = gave_up;
+}
+
+/* Task of a block to mesh, over the cells whose lowest corner is one of its voxels */
+static void mesh_block(void *user, unsigned int task)
+{
+    tsdf_volume_t *vol = (tsdf_volume_t *)user;
+    const CubeCases &cases = cube_cases();
+    unsigned int block = vol->touched[task];
+    const int *coord = &vol->coords[block * 3];
+    std::vector<float> &mesh = vol->meshes[block];
+    float tsdf[GRID_SIDE * GRID_SIDE * GRID_SIDE];
+    bool known[GRID_SIDE * GRID_SIDE * GRID_SIDE];
+    const TsdfBlock *blocks[8];
+    bool inside = false, outside = false;
+
+    /* the voxels of the block and the first layer of its positive neighbours, each
+       neighbour looked up once, by the axes it is next on as the cases of updated */
+    for (int c = 0; c < 8; c++) {
+        unsigned int other = c ? find_block(vol, coord[0] + (c & 1), coord[1] + (c >> 1 & 1),
+                                            coord[2] + (c >> 2 & 1)) : block;
+        blocks[c] = other == NO_BLOCK ? NULL : block_at(vol, other);
+    }
+    for (int k = 0; k < GRID_SIDE; k++) {
+        for (int j = 0; j < GRID_SIDE; j++) {
+            for (int i = 0; i < GRID_SIDE; i++) {
+                int at = (k * GRID_SIDE + j) * GRID_SIDE + i;
+                const TsdfBlock *from = blocks[i >> BLOCK_SHIFT | (j >> BLOCK_SHIFT) << 1 |
+                                               (k >> BLOCK_SHIFT) << 2];
+                const TsdfVoxel *voxel = from ? &from->voxels[((k & BLOCK_MASK) *
+                                                               TSDF_BLOCK_SIZE + (j & BLOCK_MASK)) *
+                                                              TSDF_BLOCK_SIZE + (i & BLOCK_MASK)] :
+                                                NULL;
+                known[at] = voxel && voxel->weight;
+                tsdf[at] = known[at] ? voxel->tsdf : 0.f;
+                inside = inside || (known[at] && tsdf[at] < 0.f);
+                outside = outside || (known[at] && tsdf[at] >= 0.f);
+            }
+        }
+    }
+
+    /* no cell can have both, e.g. the free space in front of the surface */
+    mesh.clear();
+    if (!inside || !outside)
+        return;
+    for (int k = 0; k < TSDF_BLOCK_SIZE; k++) {
+        for (int j = 0; j < TSDF_BLOCK_SIZE; j++) {
+            for (int i = 0; i < TSDF_BLOCK_SIZE; i++) {
+                int at[8], inside = 0;
+                bool complete = true;
+
+                for (int c = 0; c < 8; c++) {
+                    at[c] = ((k + (c >> 2 & 1)) * GRID_SIDE + j + (c >> 1 & 1)) * GRID_SIDE + i +
+                            (c & 1);
+                    complete = complete && known[at[c]];
+                    inside |= (tsdf[at[c]] < 0.f) << c;
+                }
+                if (!complete || !inside || inside == 0xFF)
+                    continue;
+
+                for (const signed char *e = cases.edges[inside]; *e >= 0; e++) {
+                    int c0 = cases.corner[*e][0], c1 = cases.corner[*e][1];
+                    float f0 = tsdf[at[c0]], f1 = tsdf[at[c1]];
+                    float t = f0 / (f0 - f1);
+                    float local[3] = { (float)(i + (c0 & 1)), (float)(j + (c0 >> 1 & 1)),
+                                       (float)(k + (c0 >> 2 & 1)) };
+
+                    local[*e >> 2] += t;                /* 4 edges per axis */
+                    for (int axis = 0; axis < 3; axis++) {
+                        mesh.push_back((float)(coord[axis] * TSDF_BLOCK_SIZE + local[axis]) *
+                                       vol->config.voxel);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Public APIs
+ */
+extern "C" tsdf_volume_t *voxel3d_tsdf_create(const CameraInfo *cam_info,
+                                              const TsdfConfig *config)
+{
+    TsdfConfig cfg;
+
+    if (!cam_info)
+        return NULL;
+    if (config) {
+        cfg = *config;
+    }
+    else {
+        memset(&cfg, 0, sizeof(cfg));
+    }
+    if (cfg.voxel == 0.f)
+        cfg.voxel = TSDF_DEFAULT_VOXEL;
+    if (cfg.truncation == 0.f)
+        cfg.truncation = cfg.voxel * TSDF_DEFAULT_TRUNCATION_VOXELS;
+    if (cfg.min_depth == 0.f)
+        cfg.min_depth = TSDF_DEFAULT_MIN_DEPTH;
+    if (cfg.max_depth == 0.f)
+        cfg.max_depth = TSDF_DEFAULT_MAX_DEPTH;
+    if (!cfg.max_weight)
+        cfg.max_weight = TSDF_DEFAULT_MAX_WEIGHT;
+    if (!cfg.max_blocks)
+        cfg.max_blocks = TSDF_DEFAULT_MAX_BLOCKS;
+    if (!(cfg.voxel > 0.f) || !(cfg.truncation >= cfg.voxel) || !(cfg.min_depth > 0.f) ||
+        !(cfg.max_depth > cfg.min_depth) || cfg.max_weight > 0xFFFF ||
+        cfg.max_blocks > (1u << 30))
+        return NULL;
+
+    tsdf_volume_t *vol = new tsdf_volume_t;
+    vol->rays.resize(TOF_DEPTH_PIXELS * 2);
+    if (voxel3d_calibration_build_rays(cam_info, vol->rays.data()) < 0) {
+        delete vol;
+        return NULL;
+    }
+    vol->config = cfg;
+    vol->cam = *cam_info;
+    vol->inv_voxel = 1.f / cfg.voxel;
+
+    vol->slots.assign(MIN_SLOTS, BlockSlot{ EMPTY_KEY, 0 });
+    vol->num_blocks = 0;
+    vol->frame = 0;
+
+    /* range tiles over the undistorted rays, so blocks project through the pinhole model */
+    float x0 = vol->rays[0], x1 = x0, y0 = vol->rays[1], y1 = y0;
+    for (int ix = 1; ix < TOF_DEPTH_PIXELS; ix++) {
+        float x = vol->rays[ix * 2], y = vol->rays[ix * 2 + 1];
+        x0 = x < x0 ? x : x0;
+        x1 = x > x1 ? x : x1;
+        y0 = y < y0 ? y : y0;
+        y1 = y > y1 ? y : y1;
+    }
+    vol->tile_x0 = x0;
+    vol->tile_y0 = y0;
+    vol->tile_scale_x = cam_info->focalLengthFx / RANGE_TILE;
+    vol->tile_scale_y = cam_info->focalLengthFy / RANGE_TILE;
+    vol->tiles_x = (int)((x1 - x0) * vol->tile_scale_x) + 1;
+    vol->tiles_y = (int)((y1 - y0) * vol->tile_scale_y) + 1;
+    vol->tile_near.resize((size_t)vol->tiles_x * vol->tiles_y);
+    vol->tile_far.resize((size_t)vol->tiles_x * vol->tiles_y);
+    vol->pixel_tile.resize(TOF_DEPTH_PIXELS);
+    vol->gave_up_pixels.assign(TOF_DEPTH_PIXELS, 0);
+    memset(vol->gave_up, 0, sizeof(vol->gave_up));
+    for (int ix = 0; ix < TOF_DEPTH_PIXELS; ix++) {
+        int tx = (int)((vol->rays[ix * 2] - x0) * vol->tile_scale_x);
+        int ty = (int)((vol->rays[ix * 2 + 1] - y0) * vol->tile_scale_y);
+        vol->pixel_tile[ix] = (unsigned int)(ty * vol->tiles_x + tx);
+    }
+    return vol;
+}
+
+extern "C" int voxel3d_tsdf_integrate(tsdf_volume_t *vol, const unsigned short *depthmap,
+                                      const float *pose, parallel_t *pool)
+{
+    if (!vol || !depthmap)
+        return -1;
+
+    vol->depthmap = depthmap;
+    load_pose(pose, vol->rot, vol->trans, vol->inv_rot, vol->inv_trans);
+    vol->frame++;
+    allocate_blocks(vol);
+    voxel3d_parallel_run(pool, (unsigned int)vol->touched.size(), integrate_block, vol);
+
+    /* the cells of a block reach into its positive neighbours, a change meshes them again */
+    for (unsigned int block : vol->touched) {
+        const int *coord = &vol->coords[block * 3];
+        for (int c = 0; c < 8; c++) {
+            if (!(vol->updated[block] >> c & 1))
+                continue;
+
+            unsigned int other = find_block(vol, coord[0] - (c & 1), coord[1] - (c >> 1 & 1),
+                                            coord[2] - (c >> 2 & 1));
+            if (other != NO_BLOCK)
+                vol->dirty[other] = 1;
+        }
+    }
+    return (int)vol->touched.size();
+}
+
+extern "C" int voxel3d_tsdf_raycast(tsdf_volume_t *vol, const float *pose, parallel_t *pool,
+                                    float *xyz, float *normals)
+{
+    if (!vol || !xyz)
+        return -1;
+
+    load_pose(pose, vol->rot, vol->trans, vol->inv_rot, vol->inv_trans);
+    vol->xyz = xyz;
+    vol->normals = normals;
+    project_blocks(vol);
+    voxel3d_parallel_run(pool, TOF_DEPTH_HEIGHT, raycast_row, vol);
+
+    int hits = 0;
+    for (int v = 0; v < TOF_DEPTH_HEIGHT; v++)
+        hits += vol->hits[v];
+    return hits;
+}
+
+extern "C" int voxel3d_tsdf_raycast_gave_up(tsdf_volume_t *vol, unsigned char *gave_up)
+{
+    if (!vol)
+        return -1;
+
+    if (gave_up)
+        memcpy(gave_up, vol->gave_up_pixels.data(), TOF_DEPTH_PIXELS);
+    int count = 0;
+    for (int v = 0; v < TOF_DEPTH_HEIGHT; v++)
+        count += vol->gave_up[v];
+    return count;
+}
+
+extern "C" int voxel3d_tsdf_update_mesh(tsdf_volume_t *vol, parallel_t *pool)
+{
+    if (!vol)
+        return -1;
+
+    vol->touched.clear();
+    for (unsigned int block = 0; block < vol->num_blocks; block++) {
+        if (vol->dirty[block]) {
+            vol->dirty[block] = 0;
+            vol->touched.push_back(block);
+        }
+    }
+    voxel3d_parallel_run(pool, (unsigned int)vol->touched.size(), mesh_block, vol);
+    return (int)vol->touched.size();
+}
+
+extern "C" int voxel3d_tsdf_get_mesh(tsdf_volume_t *vol, float *triangles,
+                                     unsigned int max_triangles)
+{
+    if (!vol)
+        return -1;
+
+    size_t count = 0;
+    for (unsigned int block = 0; block < vol->num_blocks; block++) {
+        const std::vector<float> &mesh = vol->meshes[block];
+        size_t size = mesh.size() / 9;
+
+        if (triangles && size && count < max_triangles) {
+            size_t copy = max_triangles - count < size ? max_triangles - count : size;
+            memcpy(triangles + count * 9, mesh.data(), copy * 9 * sizeof(float));
+        }
+        count += size;
+    }
+    return count > 0x7FFFFFFF ? 0x7FFFFFFF : (int)count;
+}
+
+extern "C" int voxel3d_tsdf_num_blocks(tsdf_volume_t *vol)
+{
+    return vol ? (int)vol->num_blocks : -1;
+}
+
+extern "C" void voxel3d_tsdf_reset(tsdf_volume_t *vol)
+{
+    if (!vol)
+        return;
+
+    for (unsigned int block = 0; block < vol->num_blocks; block++)
+        vol->meshes[block].clear();
+    vol->slots.assign(MIN_SLOTS, BlockSlot{ EMPTY_KEY, 0 });
+    vol->num_blocks = 0;
+}
+
+extern "C" void voxel3d_tsdf_destroy(tsdf_volume_t *vol)
+{
+    delete vol;
+}
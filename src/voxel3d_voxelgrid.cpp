@@ -0,0 +1,390 @@
+/**
+ @file      voxel3d_voxelgrid.cpp
+ @brief     Voxel-grid downsampling with per-chunk open-addressing voxel maps
+ @author    Jackie Lee
+ @copyright Copyright (c) 2025 5Voxel Co., Ltd.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "voxel3d_voxelgrid.h"
+
+#define PARTITION_BITS          (4)
+#define NUM_PARTITIONS          (1 << PARTITION_BITS)
+#define ENTRY_BITS              (32 - PARTITION_BITS)
+#define ENTRY_MASK              ((1u << ENTRY_BITS) - 1)
+#define NO_ENTRY                (0xFFFFFFFFu)
+#define MIN_MAP_SLOTS           (256)
+#define EMPTY_KEY               (~0ULL)         /* packed keys use 63 bits */
+#define COORD_BITS              (21)
+
+struct VoxelEntry {
+    unsigned long long key;
+    float sum[3];
+    unsigned int count;
+    unsigned int first;                         /* index of the first point */
+    unsigned int slot;                          /* slot of the key, to clear the map */
+    unsigned int voxel;                         /* entry in the merged map of the partition */
+    unsigned int offset;                        /* merged map: first point of the voxel in the
+                                                   partition; partial map: next point of the
+                                                   chunk in the voxel */
+};
+
+struct VoxelSlot {
+    unsigned long long key;
+    unsigned int entry;
+};
+
+/* Open addressing with linear probing, kept at most half full */
+struct VoxelMap {
+    std::vector<VoxelSlot> slots;
+    std::vector<VoxelEntry> entries;            /* in the order of insertion */
+};
+
+/* Points of one voxel summed up before they go to its entry */
+struct VoxelRun {
+    unsigned long long key;
+    unsigned int part;
+    unsigned int entry;
+    float sum[3];
+    unsigned int count;
+};
+
+struct voxel_grid {
+    VoxelGridConfig config;
+    float scale;                                /* 1 / leaf */
+    std::vector<VoxelMap> partial;              /* NUM_PARTITIONS per chunk */
+    VoxelMap merged[NUM_PARTITIONS];
+    unsigned int base[NUM_PARTITIONS];          /* first voxel of a partition in out */
+    unsigned int points[NUM_PARTITIONS + 1];    /* first point of a partition */
+    std::vector<unsigned int> point_entry;      /* partition and partial entry of each point */
+    std::vector<float> sorted[3];               /* coordinates scattered by voxel */
+
+    const float *xyz;
+    unsigned int num_points;
+    unsigned int chunks;
+    float *out;
+};
+
+/* splitmix64 finalizer, both the partition (high bits) and the slot (low bits) depend on
+   every coordinate */
+static inline unsigned long long hash_key(unsigned long long key)
+{
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    return key ^ (key >> 31);
+}
+
+static void clear_map(VoxelMap *map)
+{
+    if (map->slots.empty())
+        map->slots.assign(MIN_MAP_SLOTS, VoxelSlot{ EMPTY_KEY, 0 });
+    for (const VoxelEntry &entry : map->entries)
+        map->slots[entry.slot].key = EMPTY_KEY;
+    map->entries.clear();
+}
+
+static unsigned int place_key(VoxelMap *map, unsigned long long key, unsigned int entry)
+{
+    size_t mask = map->slots.size() - 1;
+    size_t slot = (size_t)hash_key(key) & mask;
+
+    while (map->slots[slot].key != EMPTY_KEY)
+        slot = (slot + 1) & mask;
+    map->slots[slot].key = key;
+    map->slots[slot].entry = entry;
+    return (unsigned int)slot;
+}
+
+static void grow_map(VoxelMap *map)
+{
+    map->slots.assign(map->slots.size() * 2, VoxelSlot{ EMPTY_KEY, 0 });
+    for (size_t ix = 0; ix < map->entries.size(); ix++)
+        map->entries[ix].slot = place_key(map, map->entries[ix].key, (unsigned int)ix);
+}
+
+/* Entry of a key, a zeroed one with first set to point when it is new */
+static unsigned int find_entry(VoxelMap *map, unsigned long long key, unsigned long long hash,
+                               unsigned int point)
+{
+    size_t mask = map->slots.size() - 1;
+    size_t slot = (size_t)hash & mask;
+
+    for (;;) {
+        const VoxelSlot &probe = map->slots[slot];
+        if (probe.key == key)
+            return probe.entry;
+        if (probe.key == EMPTY_KEY)
+            break;
+        slot = (slot + 1) & mask;
+    }
+
+    unsigned int entry = (unsigned int)map->entries.size();
+    VoxelEntry added;
+    memset(&added, 0, sizeof(added));
+    added.key = key;
+    added.first = point;
+    map->entries.push_back(added);
+    if (map->entries.size() * 2 > map->slots.size()) {
+        grow_map(map);
+    }
+    else {
+        map->slots[slot].key = key;
+        map->slots[slot].entry = entry;
+        map->entries[entry].slot = (unsigned int)slot;
+    }
+    return entry;
+}
+
+static inline int voxel_key(const voxel_grid_t *grid, const float *p, unsigned long long *key)
+{
+    unsigned long long packed = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        float cell = p[axis] * grid->scale;
+        /* written so that NaN fails too */
+        if (!(cell >= -VOXELGRID_MAX_INDEX && cell < VOXELGRID_MAX_INDEX))
+            return 0;
+
+        /* floor without the libm call, the cast truncates towards zero */
+        int index = (int)cell;
+        index -= cell < (float)index;
+        packed = packed << COORD_BITS | (unsigned int)(index + VOXELGRID_MAX_INDEX);
+    }
+    *key = packed;
+    return 1;
+}
+
+static void chunk_range(const voxel_grid_t *grid, unsigned int chunk, unsigned int *begin,
+                        unsigned int *end)
+{
+    *begin = (unsigned int)((unsigned long long)grid->num_points * chunk / grid->chunks);
+    *end = (unsigned int)((unsigned long long)grid->num_points * (chunk + 1) / grid->chunks);
+}
+
+static void flush_run(VoxelMap *maps, const VoxelRun *run)
+{
+    if (!run->count)
+        return;
+
+    VoxelEntry *voxel = &maps[run->part].entries[run->entry];
+    for (int axis = 0; axis < 3; axis++)
+        voxel->sum[axis] += run->sum[axis];
+    voxel->count += run->count;
+}
+
+/* Step 1, the points of a chunk into its partial maps */
+static void bin_chunk(void *user, unsigned int task)
+{
+    voxel_grid_t *grid = (voxel_grid_t *)user;
+    VoxelMap *maps = &grid->partial[(size_t)task * NUM_PARTITIONS];
+    bool median = grid->config.mode == VOXELGRID_MEDIAN;
+    VoxelRun runs[2];
+    unsigned int begin, end;
+
+    for (int ix = 0; ix < NUM_PARTITIONS; ix++)
+        clear_map(&maps[ix]);
+    memset(runs, 0, sizeof(runs));
+    runs[0].key = runs[1].key = EMPTY_KEY;
+
+    /*
+     * Neighbouring pixels of an organized cloud mostly share their voxel, or alternate
+     * between two of them with the noise around a voxel border: the points of the last two
+     * voxels are summed up locally, a voxel costs one lookup per run.
+     */
+    chunk_range(grid, task, &begin, &end);
+    for (unsigned int ix = begin; ix < end; ix++) {
+        const float *p = grid->xyz + (size_t)ix * 3;
+        unsigned long long key;
+
+        if ((p[0] == 0.f && p[1] == 0.f && p[2] == 0.f) || !voxel_key(grid, p, &key)) {
+            if (median)
+                grid->point_entry[ix] = NO_ENTRY;
+            continue;
+        }
+
+        VoxelRun *run = &runs[0];
+        if (key != runs[0].key) {
+            run = &runs[1];
+            if (key != runs[1].key) {
+                flush_run(maps, &runs[1]);
+                runs[1] = runs[0];
+                run = &runs[0];
+
+                unsigned long long hash = hash_key(key);
+                run->key = key;
+                run->part = (unsigned int)(hash >> (64 - PARTITION_BITS));
+                run->entry = find_entry(&maps[run->part], key, hash, ix);
+                run->sum[0] = run->sum[1] = run->sum[2] = 0.f;
+                run->count = 0;
+            }
+        }
+
+        run->sum[0] += p[0];
+        run->sum[1] += p[1];
+        run->sum[2] += p[2];
+        run->count++;
+        if (median)
+            grid->point_entry[ix] = run->part << ENTRY_BITS | run->entry;
+    }
+    flush_run(maps, &runs[0]);
+    flush_run(maps, &runs[1]);
+}
+
+/* Step 2, the partial maps of a partition into its merged map, in chunk order */
+static void merge_partition(void *user, unsigned int task)
+{
+    voxel_grid_t *grid = (voxel_grid_t *)user;
+    VoxelMap *merged = &grid->merged[task];
+
+    clear_map(merged);
+    for (unsigned int chunk = 0; chunk < grid->chunks; chunk++) {
+        VoxelMap *map = &grid->partial[(size_t)chunk * NUM_PARTITIONS + task];
+
+        for (VoxelEntry &entry : map->entries) {
+            unsigned int ix = find_entry(merged, entry.key, hash_key(entry.key), entry.first);
+            VoxelEntry *voxel = &merged->entries[ix];
+
+            entry.voxel = ix;
+            entry.offset = voxel->count;
+            for (int axis = 0; axis < 3; axis++)
+                voxel->sum[axis] += entry.sum[axis];
+            voxel->count += entry.count;
+        }
+    }
+
+    unsigned int offset = 0;
+    for (VoxelEntry &voxel : merged->entries) {
+        voxel.offset = offset;
+        offset += voxel.count;
+    }
+    grid->points[task + 1] = offset;
+}
+
+/* Step 3, the voxels of a partition to out */
+static void write_partition(void *user, unsigned int task)
+{
+    voxel_grid_t *grid = (voxel_grid_t *)user;
+    const VoxelMap *merged = &grid->merged[task];
+    float *out = grid->out + (size_t)grid->base[task] * 3;
+
+    for (const VoxelEntry &voxel : merged->entries) {
+        if (grid->config.mode == VOXELGRID_FIRST) {
+            memcpy(out, grid->xyz + (size_t)voxel.first * 3, sizeof(float) * 3);
+        }
+        else if (grid->config.mode == VOXELGRID_MEDIAN) {
+            size_t begin = grid->points[task] + voxel.offset, middle = begin + voxel.count / 2;
+
+            for (int axis = 0; axis < 3; axis++) {
+                float *values = grid->sorted[axis].data();
+                std::nth_element(values + begin, values + middle, values + begin + voxel.count);
+                out[axis] = values[middle];
+            }
+        }
+        else {
+            float scale = 1.f / (float)voxel.count;
+            for (int axis = 0; axis < 3; axis++)
+                out[axis] = voxel.sum[axis] * scale;
+        }
+        out += 3;
+    }
+}
+
+/* Median mode, the coordinates of the points of a chunk to their places by voxel */
+static void scatter_chunk(void *user, unsigned int task)
+{
+    voxel_grid_t *grid = (voxel_grid_t *)user;
+    VoxelMap *maps = &grid->partial[(size_t)task * NUM_PARTITIONS];
+    unsigned int begin, end;
+
+    chunk_range(grid, task, &begin, &end);
+    for (unsigned int ix = begin; ix < end; ix++) {
+        unsigned int point_entry = grid->point_entry[ix];
+        if (point_entry == NO_ENTRY)
+            continue;
+
+        unsigned int part = point_entry >> ENTRY_BITS;
+        VoxelEntry *entry = &maps[part].entries[point_entry & ENTRY_MASK];
+        const VoxelEntry *voxel = &grid->merged[part].entries[entry->voxel];
+        size_t place = (size_t)grid->points[part] + voxel->offset + entry->offset++;
+
+        for (int axis = 0; axis < 3; axis++)
+            grid->sorted[axis][place] = grid->xyz[(size_t)ix * 3 + axis];
+    }
+}
+
+/*
+ * Public APIs
+ */
+extern "C" voxel_grid_t *voxel3d_voxelgrid_create(const VoxelGridConfig *config)
+{
+    VoxelGridConfig cfg;
+
+    if (config) {
+        cfg = *config;
+    }
+    else {
+        memset(&cfg, 0, sizeof(cfg));
+    }
+    if (cfg.leaf == 0.f)
+        cfg.leaf = VOXELGRID_DEFAULT_LEAF;
+    if (!(cfg.leaf > 0.f) || cfg.mode < VOXELGRID_CENTROID || cfg.mode > VOXELGRID_MEDIAN)
+        return NULL;
+
+    voxel_grid_t *grid = new voxel_grid_t;
+    grid->config = cfg;
+    grid->scale = 1.f / cfg.leaf;
+    grid->xyz = NULL;
+    grid->num_points = 0;
+    grid->chunks = 0;
+    grid->out = NULL;
+    return grid;
+}
+
+extern "C" int voxel3d_voxelgrid_filter(voxel_grid_t *grid, const float *xyz,
+                                        unsigned int num_points, parallel_t *pool, float *out)
+{
+    if (!grid || (num_points && (!xyz || !out)) || num_points > ENTRY_MASK)
+        return -1;
+
+    grid->xyz = xyz;
+    grid->num_points = num_points;
+    grid->out = out;
+    grid->chunks = voxel3d_parallel_threads(pool);
+    if (grid->partial.size() < (size_t)grid->chunks * NUM_PARTITIONS)
+        grid->partial.resize((size_t)grid->chunks * NUM_PARTITIONS);
+    if (grid->config.mode == VOXELGRID_MEDIAN && grid->point_entry.size() < num_points)
+        grid->point_entry.resize(num_points);
+
+    voxel3d_parallel_run(pool, grid->chunks, bin_chunk, grid);
+    voxel3d_parallel_run(pool, NUM_PARTITIONS, merge_partition, grid);
+
+    /* merge_partition() left the point count of each partition */
+    unsigned int voxels = 0;
+    grid->points[0] = 0;
+    for (int part = 0; part < NUM_PARTITIONS; part++) {
+        grid->base[part] = voxels;
+        voxels += (unsigned int)grid->merged[part].entries.size();
+        grid->points[part + 1] += grid->points[part];
+    }
+
+    if (grid->config.mode == VOXELGRID_MEDIAN) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (grid->sorted[axis].size() < grid->points[NUM_PARTITIONS])
+                grid->sorted[axis].resize(grid->points[NUM_PARTITIONS]);
+        }
+        voxel3d_parallel_run(pool, grid->chunks, scatter_chunk, grid);
+    }
+    voxel3d_parallel_run(pool, NUM_PARTITIONS, write_partition, grid);
+    return (int)voxels;
+}
+
+extern "C" void voxel3d_voxelgrid_destroy(voxel_grid_t *grid)
+{
+    delete grid;
+}